@@ -0,0 +1,268 @@
+#include "abr.h"
+#include "fetch_scheduler.h"
+#include "session.h"
+#include "spdlog/spdlog.h"
+#include "trace.h"
+#include <algorithm>
+#include <atomic>
+#include <cstdlib>
+#include <cxxopts.hpp>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <thread>
+
+// The files at paths, with directories replaced by the files in them (and
+// their subdirectories) that is_wanted accepts, in a fixed order.
+template <typename IsWanted>
+static std::vector<std::string>
+find_files(const std::vector<std::string> &paths, IsWanted is_wanted) {
+  std::vector<std::string> files;
+  for (const std::string &path : paths) {
+    if (!std::filesystem::is_directory(path)) {
+      files.push_back(path);
+      continue;
+    }
+    std::vector<std::string> found;
+    for (const auto &entry :
+         std::filesystem::recursive_directory_iterator{path}) {
+      if (entry.is_regular_file() && is_wanted(entry.path())) {
+        found.push_back(entry.path().string());
+      }
+    }
+    std::sort(found.begin(), found.end());
+    files.insert(files.end(), found.begin(), found.end());
+  }
+  return files;
+}
+
+// Load the vid.mpd manifest at path. Returns false, with a warning, if it
+// cannot be read or has no video bitrates or no length.
+static bool load_video(const std::string &path, Video &video) {
+  std::ifstream file{path};
+  if (!file) {
+    spdlog::warn("Manifest {} cannot be read", path);
+    return false;
+  }
+  std::stringstream mpd;
+  mpd << file.rdbuf();
+  std::string xml{mpd.str()};
+  video = {std::filesystem::path{path}.parent_path().filename().string(),
+           {},
+           DEFAULT_SEGMENT_DURATION_S,
+           0};
+  if (!parse_video_mpd(xml.data(), xml.length(), video.bitrates,
+                       video.segment_duration, video.duration) ||
+      video.bitrates.empty() || video.duration <= 0) {
+    spdlog::warn("Manifest {} has no video bitrates or no length", path);
+    return false;
+  }
+  return true;
+}
+
+int main(int argc, char *argv[]) {
+  cxxopts::Options cxxopts_options{
+      "abrSimulator",
+      "Replays bandwidth traces against the proxy's bitrate selection and "
+      "reports the QoE it gives"};
+  cxxopts_options.add_options()(
+      "t,traces",
+      "Comma-separated list of bandwidth traces, or directories of them.",
+      cxxopts::value<std::vector<std::string>>())(
+      "m,mpds",
+      "Comma-separated list of vid.mpd manifests, or directories to find "
+      "them in.",
+      cxxopts::value<std::vector<std::string>>())(
+      "f,filter",
+      "Comma-separated list of throughput filters to simulate: ewma, "
+      "harmonic or percentile.",
+      cxxopts::value<std::vector<std::string>>()->default_value("ewma"))(
+      "a,alpha",
+      "Comma-separated list of EWMA coefficients in the range [0, 1] to "
+      "simulate.",
+      cxxopts::value<std::vector<double>>()->default_value("0.5"))(
+      "s,safety-factor",
+      "Comma-separated list of factors (at least 1) by which the throughput "
+      "estimate must exceed a bitrate for it to be picked.",
+      cxxopts::value<std::vector<double>>()->default_value("1.5"))(
+      "u,trace-unit",
+      "The unit of the throughputs in the traces: mbps or kbps.",
+      cxxopts::value<std::string>()->default_value("mbps"))(
+      "r,rtt",
+      "The round-trip time in ms added to every segment fetch.",
+      cxxopts::value<double>()->default_value("80"))(
+      "b,max-buffer",
+      "How many seconds of video the player buffers at most.",
+      cxxopts::value<double>()->default_value("30"))(
+      "j,jobs",
+      "How many sessions to simulate at a time (0 for one per core).",
+      cxxopts::value<int>()->default_value("0"))(
+      "o,output",
+      "Write the QoE of every session to this CSV file.",
+      cxxopts::value<std::string>()->default_value(""));
+
+  std::vector<std::string> trace_paths, mpd_paths, filter_names;
+  std::vector<double> alphas, safety_factors;
+  std::string trace_unit, output_path;
+  double rtt_ms, max_buffer_s;
+  int no_of_jobs;
+  try {
+    const auto cxxopts_argv{cxxopts_options.parse(argc, argv)};
+    trace_paths = cxxopts_argv["traces"].as<std::vector<std::string>>();
+    mpd_paths = cxxopts_argv["mpds"].as<std::vector<std::string>>();
+    filter_names = cxxopts_argv["filter"].as<std::vector<std::string>>();
+    alphas = cxxopts_argv["alpha"].as<std::vector<double>>();
+    safety_factors = cxxopts_argv["safety-factor"].as<std::vector<double>>();
+    trace_unit = cxxopts_argv["trace-unit"].as<std::string>();
+    rtt_ms = cxxopts_argv["rtt"].as<double>();
+    max_buffer_s = cxxopts_argv["max-buffer"].as<double>();
+    no_of_jobs = cxxopts_argv["jobs"].as<int>();
+    output_path = cxxopts_argv["output"].as<std::string>();
+  } catch (const cxxopts::exceptions::exception &e) {
+    std::cout << e.what() << '\n';
+    return EXIT_FAILURE;
+  }
+  std::vector<ThroughputFilter> filters(filter_names.size());
+  for (size_t i{0}; i < filter_names.size(); ++i) {
+    if (!parse_throughput_filter(filter_names[i], filters[i])) {
+      std::cout << "Error: filter must be ewma, harmonic or percentile\n";
+      return EXIT_FAILURE;
+    }
+  }
+  if (std::any_of(alphas.begin(), alphas.end(),
+                  [](double alpha) { return 0 > alpha || alpha > 1; })) {
+    std::cout << "Error: alpha must be in the range of [0, 1]\n";
+    return EXIT_FAILURE;
+  } else if (std::any_of(safety_factors.begin(), safety_factors.end(),
+                         [](double factor) { return factor < 1; })) {
+    std::cout << "Error: safety-factor must be at least 1\n";
+    return EXIT_FAILURE;
+  } else if (trace_unit != "mbps" && trace_unit != "kbps") {
+    std::cout << "Error: trace-unit must be mbps or kbps\n";
+    return EXIT_FAILURE;
+  } else if (rtt_ms < 0) {
+    std::cout << "Error: rtt must not be negative\n";
+    return EXIT_FAILURE;
+  } else if (max_buffer_s <= 0) {
+    std::cout << "Error: max-buffer must be positive\n";
+    return EXIT_FAILURE;
+  } else if (no_of_jobs < 0) {
+    std::cout << "Error: jobs must not be negative\n";
+    return EXIT_FAILURE;
+  }
+
+  std::vector<Trace> traces;
+  for (const std::string &path :
+       find_files(trace_paths, [](const auto &) { return true; })) {
+    Trace trace;
+    if (load_trace(path, trace_unit == "mbps" ? 1000 : 1, trace)) {
+      traces.push_back(std::move(trace));
+    }
+  }
+  std::vector<Video> videos;
+  for (const std::string &path :
+       find_files(mpd_paths, [](const std::filesystem::path &file) {
+         return file.filename() == "vid.mpd";
+       })) {
+    Video video;
+    if (load_video(path, video)) {
+      videos.push_back(std::move(video));
+    }
+  }
+  if (traces.empty()) {
+    std::cout << "Error: no usable traces\n";
+    return EXIT_FAILURE;
+  } else if (videos.empty()) {
+    std::cout << "Error: no usable manifests\n";
+    return EXIT_FAILURE;
+  }
+
+  // Session i plays video i % #videos over trace i / #videos % #traces with
+  // settings i / (#videos * #traces). Every session writes only its own
+  // result, so the results do not depend on how many run at a time.
+  std::vector<SessionSettings> settings;
+  std::vector<std::string> filter_name_of_setting;
+  for (size_t i{0}; i < filters.size(); ++i) {
+    for (double alpha : alphas) {
+      for (double safety_factor : safety_factors) {
+        settings.push_back({filters[i], alpha, safety_factor, rtt_ms / 1000,
+                            max_buffer_s});
+        filter_name_of_setting.push_back(filter_names[i]);
+      }
+    }
+  }
+  size_t no_of_sessions{settings.size() * traces.size() * videos.size()};
+  std::vector<Qoe> qoe_of_session(no_of_sessions);
+  std::atomic<size_t> next_session{0};
+  auto simulate = [&]() {
+    for (size_t i; (i = next_session.fetch_add(1)) < no_of_sessions;) {
+      qoe_of_session[i] =
+          play(videos[i % videos.size()],
+               traces[i / videos.size() % traces.size()],
+               settings[i / (videos.size() * traces.size())]);
+    }
+  };
+  unsigned no_of_threads{
+      no_of_jobs > 0 ? static_cast<unsigned>(no_of_jobs)
+                     : std::max(1u, std::thread::hardware_concurrency())};
+  std::vector<std::thread> threads;
+  for (unsigned i{0}; i < no_of_threads; ++i) {
+    threads.emplace_back(simulate);
+  }
+  for (std::thread &thread : threads) {
+    thread.join();
+  }
+
+  if (!output_path.empty()) {
+    std::ofstream output{output_path};
+    output << "filter,alpha,safety_factor,video,trace,average_bitrate_kbps,"
+              "no_of_switches,rebuffer_s,startup_s\n";
+    for (size_t i{0}; i < no_of_sessions; ++i) {
+      size_t setting_index{i / (videos.size() * traces.size())};
+      const SessionSettings &setting{settings[setting_index]};
+      const Qoe &qoe{qoe_of_session[i]};
+      output << filter_name_of_setting[setting_index] << ',' << setting.alpha
+             << ',' << setting.safety_factor << ','
+             << videos[i % videos.size()].name << ','
+             << traces[i / videos.size() % traces.size()].name << ','
+             << qoe.average_bitrate << ',' << qoe.no_of_switches << ','
+             << qoe.rebuffer_s << ',' << qoe.startup_s << '\n';
+    }
+    if (!output) {
+      std::cout << "Error: cannot write output\n";
+      return EXIT_FAILURE;
+    }
+  }
+
+  // The mean QoE of the sessions of every setting.
+  std::cout << std::setw(12) << "filter" << std::setw(6) << "alpha"
+            << std::setw(15) << "safety_factor" << std::setw(10) << "sessions"
+            << std::setw(22) << "average_bitrate_kbps" << std::setw(10)
+            << "switches" << std::setw(12) << "rebuffer_s" << std::setw(11)
+            << "startup_s"
+            << '\n'
+            << std::fixed;
+  size_t no_of_sessions_per_setting{traces.size() * videos.size()};
+  for (size_t i{0}; i < settings.size(); ++i) {
+    Qoe sum{};
+    for (size_t j{i * no_of_sessions_per_setting};
+         j < (i + 1) * no_of_sessions_per_setting; ++j) {
+      sum.average_bitrate += qoe_of_session[j].average_bitrate;
+      sum.no_of_switches += qoe_of_session[j].no_of_switches;
+      sum.rebuffer_s += qoe_of_session[j].rebuffer_s;
+      sum.startup_s += qoe_of_session[j].startup_s;
+    }
+    double n{static_cast<double>(no_of_sessions_per_setting)};
+    std::cout << std::setw(12) << filter_name_of_setting[i]
+              << std::setprecision(2) << std::setw(6) << settings[i].alpha
+              << std::setw(15) << settings[i].safety_factor << std::setw(10)
+              << no_of_sessions_per_setting << std::setprecision(1)
+              << std::setw(22) << sum.average_bitrate / n << std::setw(10)
+              << sum.no_of_switches / n << std::setprecision(3)
+              << std::setw(12) << sum.rebuffer_s / n << std::setw(11)
+              << sum.startup_s / n << '\n';
+  }
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,40 @@
+#include "session.h"
+
+#include <algorithm>
+#include <cmath>
+
+Qoe play(const Video &video, const Trace &trace,
+         const SessionSettings &settings) {
+  TraceCursor cursor{trace};
+  Qoe qoe{};
+  size_t no_of_segments{static_cast<size_t>(
+      std::max(1.0, std::ceil(video.duration / video.segment_duration)))};
+  unsigned long throughput{};
+  ThroughputWindow window;
+  double buffer_s{}, sum_of_bitrates{};
+  int prev_bitrate{};
+  for (size_t segment{0}; segment < no_of_segments; ++segment) {
+    int bitrate{
+        select_bitrate(video.bitrates, throughput, settings.safety_factor)};
+    double kbits{bitrate * video.segment_duration},
+        download_s{settings.rtt_s + cursor.transfer(kbits)};
+    throughput = update_throughput(settings.filter, throughput, window,
+                                   kbits / download_s, settings.alpha);
+
+    if (segment == 0) {
+      qoe.startup_s = download_s;
+    } else {
+      qoe.rebuffer_s += std::max(0.0, download_s - buffer_s);
+      qoe.no_of_switches += bitrate != prev_bitrate;
+    }
+    buffer_s = std::max(0.0, buffer_s - download_s) + video.segment_duration;
+    if (buffer_s > settings.max_buffer_s) {
+      cursor.wait(buffer_s - settings.max_buffer_s);
+      buffer_s = settings.max_buffer_s;
+    }
+    sum_of_bitrates += bitrate;
+    prev_bitrate = bitrate;
+  }
+  qoe.average_bitrate = sum_of_bitrates / no_of_segments;
+  return qoe;
+}
@@ -0,0 +1,40 @@
+#ifndef SESSION_H
+#define SESSION_H
+
+#include "abr.h"
+#include "trace.h"
+#include <string>
+#include <vector>
+
+// Playing a video over a bandwidth trace, with bitrates picked by the
+// proxy's own throughput estimate and bitrate selection.
+//
+// The player fetches one segment at a time, as dash.js does through the
+// proxy: each fetch takes a round trip plus the time the trace needs to
+// carry the segment, and its throughput (size over that time, as in the
+// on-fragment-received beacon) feeds the estimate the next bitrate is picked
+// from. Playback starts once the first segment is in; the buffer then
+// drains in real time, and the player stalls whenever it runs dry and holds
+// off fetching whenever it is full.
+
+struct Video {
+  std::string name;
+  std::vector<int> bitrates;
+  double segment_duration, duration;
+};
+
+struct SessionSettings {
+  ThroughputFilter filter;
+  double alpha, safety_factor, rtt_s, max_buffer_s;
+};
+
+struct Qoe {
+  double average_bitrate; // Kbps.
+  int no_of_switches;
+  double rebuffer_s, startup_s;
+};
+
+Qoe play(const Video &video, const Trace &trace,
+         const SessionSettings &settings);
+
+#endif // !SESSION_H
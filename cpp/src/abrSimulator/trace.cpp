@@ -0,0 +1,86 @@
+#include "trace.h"
+
+#include "spdlog/spdlog.h"
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+
+bool load_trace(const std::string &path, double kbps_per_unit, Trace &trace) {
+  std::ifstream file{path};
+  if (!file) {
+    spdlog::warn("Trace {} cannot be read", path);
+    return false;
+  }
+  trace.name = std::filesystem::path{path}.filename().string();
+  std::string line;
+  while (std::getline(file, line)) {
+    const char *field{line.c_str()};
+    char *end;
+    double time{strtod(field, &end)};
+    if (end == field) {
+      continue;
+    }
+    field = end;
+    while (*field == ',' || *field == ' ' || *field == '\t') {
+      ++field;
+    }
+    double throughput{strtod(field, &end)};
+    if (end == field) {
+      continue;
+    }
+    trace.times.push_back(time);
+    trace.kbps.push_back(throughput * kbps_per_unit);
+  }
+
+  bool has_bandwidth{false};
+  for (size_t i{0}; i + 1 < trace.times.size(); ++i) {
+    if (trace.times[i + 1] <= trace.times[i] || trace.kbps[i] < 0) {
+      spdlog::warn("Trace {} is out of time order or negative at line {}",
+                   path, i + 2);
+      return false;
+    }
+    has_bandwidth |= trace.kbps[i] > 0;
+  }
+  if (!has_bandwidth) {
+    spdlog::warn("Trace {} has no bandwidth", path);
+    return false;
+  }
+  return true;
+}
+
+TraceCursor::TraceCursor(const Trace &trace) : trace_{trace} {}
+
+double TraceCursor::transfer(double kbits) {
+  double seconds{};
+  while (kbits > 0) {
+    double left{trace_.times[i_ + 1] - trace_.times[i_] - offset_},
+        kbps{trace_.kbps[i_]};
+    if (kbps > 0 && kbits <= kbps * left) {
+      offset_ += kbits / kbps;
+      return seconds + kbits / kbps;
+    }
+    kbits -= kbps * left;
+    seconds += left;
+    next();
+  }
+  return seconds;
+}
+
+void TraceCursor::wait(double seconds) {
+  while (seconds > 0) {
+    double left{trace_.times[i_ + 1] - trace_.times[i_] - offset_};
+    if (seconds <= left) {
+      offset_ += seconds;
+      return;
+    }
+    seconds -= left;
+    next();
+  }
+}
+
+void TraceCursor::next() {
+  offset_ = 0;
+  if (++i_ + 1 == trace_.times.size()) {
+    i_ = 0;
+  }
+}
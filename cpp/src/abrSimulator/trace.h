@@ -0,0 +1,43 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <string>
+#include <vector>
+
+// A bandwidth trace: the throughput of a network path over time, as in the
+// FCC, 3G/HSDPA and Norway traces used to evaluate ABR algorithms. Each line
+// of a trace file holds a timestamp in seconds and the throughput from then
+// on, separated by whitespace or a comma; lines that do not (headers,
+// comments) are skipped.
+
+struct Trace {
+  std::string name;
+  std::vector<double> times, kbps;
+};
+
+// Load the trace at path, whose throughputs are in units of kbps_per_unit
+// Kbps. Returns false, with a warning, if it cannot be read or does not
+// describe a usable link (at least two points in time order, some bandwidth).
+bool load_trace(const std::string &path, double kbps_per_unit, Trace &trace);
+
+// Replays a trace from its start, wrapping around at its end.
+class TraceCursor {
+public:
+  explicit TraceCursor(const Trace &trace);
+
+  // Transfer kbits over the link. Returns the seconds it took.
+  double transfer(double kbits);
+
+  // Let seconds pass without using the link.
+  void wait(double seconds);
+
+private:
+  // Move to the next point of the trace.
+  void next();
+
+  const Trace &trace_;
+  size_t i_{};
+  double offset_{}; // Seconds into the interval from point i_ to i_ + 1.
+};
+
+#endif // !TRACE_H
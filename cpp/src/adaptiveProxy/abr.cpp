@@ -0,0 +1,145 @@
+#include "abr.h"
+
+#include "pugixml.hpp"
+#include <algorithm>
+#include <cstdlib>
+#include <string>
+
+bool parse_throughput_filter(const std::string &name,
+                             ThroughputFilter &filter) {
+  if (name == "ewma") {
+    filter = ThroughputFilter::EWMA;
+  } else if (name == "harmonic") {
+    filter = ThroughputFilter::HARMONIC_MEAN;
+  } else if (name == "percentile") {
+    filter = ThroughputFilter::PERCENTILE;
+  } else {
+    return false;
+  }
+  return true;
+}
+
+void ThroughputWindow::add(double kbps) {
+  samples_[no_of_samples_++ % THROUGHPUT_WINDOW] = kbps;
+}
+
+double ThroughputWindow::harmonic_mean() const {
+  size_t size{std::min(no_of_samples_, samples_.size())};
+  double sum_of_inverses{};
+  for (size_t i{0}; i < size; ++i) {
+    if (samples_[i] <= 0) {
+      return 0;
+    }
+    sum_of_inverses += 1 / samples_[i];
+  }
+  return size == 0 ? 0 : size / sum_of_inverses;
+}
+
+double ThroughputWindow::percentile(double p) const {
+  size_t size{std::min(no_of_samples_, samples_.size())};
+  if (size == 0) {
+    return 0;
+  }
+  std::array<double, THROUGHPUT_WINDOW> sorted{samples_};
+  std::sort(sorted.begin(), sorted.begin() + size);
+  return sorted[static_cast<size_t>(p * (size - 1) + 0.5)];
+}
+
+unsigned long update_throughput(unsigned long throughput, double kbps,
+                                double alpha) {
+  return alpha * kbps + (1.0 - alpha) * throughput;
+}
+
+unsigned long update_throughput(ThroughputFilter filter,
+                                unsigned long throughput,
+                                ThroughputWindow &window, double kbps,
+                                double alpha) {
+  window.add(kbps);
+  switch (filter) {
+  case ThroughputFilter::HARMONIC_MEAN:
+    return window.harmonic_mean();
+  case ThroughputFilter::PERCENTILE:
+    return window.percentile(THROUGHPUT_PERCENTILE);
+  default:
+    return update_throughput(throughput, kbps, alpha);
+  }
+}
+
+int select_bitrate(const std::vector<int> &bitrates, unsigned long throughput,
+                   double safety_factor) {
+  for (size_t i{bitrates.size()}; i-- > 0;) {
+    if ((throughput / safety_factor) >= bitrates[i]) {
+      return bitrates[i];
+    }
+  }
+  return bitrates.empty() ? 0 : bitrates[0];
+}
+
+// The seconds of an ISO 8601 duration such as PT3M13.167S (days and time
+// only, as in mediaPresentationDuration), or 0 if it is not one.
+static double parse_duration(const char *iso) {
+  if (*iso++ != 'P') {
+    return 0;
+  }
+  double seconds{};
+  bool is_time{false};
+  while (*iso != '\0') {
+    if (*iso == 'T') {
+      is_time = true;
+      ++iso;
+      continue;
+    }
+    char *unit;
+    double value{strtod(iso, &unit)};
+    if (unit == iso) {
+      return 0;
+    } else if (*unit == 'D' && !is_time) {
+      seconds += value * 86400;
+    } else if (*unit == 'H' && is_time) {
+      seconds += value * 3600;
+    } else if (*unit == 'M' && is_time) {
+      seconds += value * 60;
+    } else if (*unit == 'S' && is_time) {
+      seconds += value;
+    } else {
+      return 0;
+    }
+    iso = unit + 1;
+  }
+  return seconds;
+}
+
+bool parse_video_mpd(char *xml, size_t size, std::vector<int> &bitrates,
+                     double &segment_duration, double &duration) {
+  pugi::xml_document document;
+  if (!document.load_buffer_inplace(xml, size)) {
+    return false;
+  }
+  pugi::xml_node mpd{document.child("MPD")};
+  if (double seconds{
+          parse_duration(mpd.attribute("mediaPresentationDuration").value())};
+      seconds > 0) {
+    duration = seconds;
+  }
+  for (pugi::xml_node adaptation_set :
+       mpd.child("Period").children("AdaptationSet")) {
+    pugi::xml_attribute mime_type{adaptation_set.attribute("mimeType")};
+    if (mime_type && std::string{mime_type.value()} == "video/mp4") {
+      pugi::xml_node segment_template{
+          adaptation_set.child("SegmentTemplate")};
+      double segment{segment_template.attribute("duration").as_double()},
+          timescale{segment_template.attribute("timescale").as_double(1)};
+      if (segment > 0 && timescale > 0) {
+        segment_duration = segment / timescale;
+      }
+      for (pugi::xml_node representation :
+           adaptation_set.children("Representation")) {
+        pugi::xml_attribute bandwidth{representation.attribute("bandwidth")};
+        if (bandwidth) {
+          bitrates.push_back(bandwidth.as_int());
+        }
+      }
+    }
+  }
+  return true;
+}
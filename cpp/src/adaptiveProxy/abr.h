@@ -0,0 +1,76 @@
+#ifndef ABR_H
+#define ABR_H
+
+#include <array>
+#include <cstddef>
+#include <string>
+#include <vector>
+
+// Throughput estimation and bitrate selection, shared by the proxy and
+// abrSimulator so that what is tuned offline is what runs.
+
+// A bitrate is only picked if the throughput estimate exceeds it by this
+// factor, to leave room for the estimate being too high.
+#define BITRATE_SAFETY_FACTOR 1.5
+
+// How many of the latest samples of a session the windowed estimates are
+// taken over.
+#define THROUGHPUT_WINDOW 8
+
+// The percentile of the window the percentile estimate takes.
+#define THROUGHPUT_PERCENTILE 0.2
+
+// How an estimate is made of throughput samples: EWMA weighs every sample by
+// alpha; HARMONIC_MEAN and PERCENTILE (a low one) look at the samples in the
+// window only, and one outlier, e.g. a segment that a cache on the way served
+// at many times the real throughput, moves them far less.
+enum class ThroughputFilter { EWMA, HARMONIC_MEAN, PERCENTILE };
+
+// The filter named ewma, harmonic or percentile. Returns false for any other
+// name.
+bool parse_throughput_filter(const std::string &name, ThroughputFilter &filter);
+
+// The latest THROUGHPUT_WINDOW throughput samples (Kbps) of a session, in a
+// ring.
+class ThroughputWindow {
+public:
+  void add(double kbps);
+
+  bool empty() const { return no_of_samples_ == 0; }
+
+  // 0 if empty.
+  double harmonic_mean() const;
+
+  // The p-th percentile (p in [0, 1]) of the samples, 0 if empty.
+  double percentile(double p) const;
+
+private:
+  std::array<double, THROUGHPUT_WINDOW> samples_{};
+  size_t no_of_samples_{}; // All that were added, not only those kept.
+};
+
+// The EWMA throughput estimate (Kbps) after a sample of kbps, with alpha the
+// weight of the sample. Estimates start at 0.
+unsigned long update_throughput(unsigned long throughput, double kbps,
+                                double alpha);
+
+// The throughput estimate (Kbps) after a sample of kbps with filter: the EWMA
+// above, or the estimate of window once kbps is added to it (which happens
+// for EWMA as well, so that the window can be switched to).
+unsigned long update_throughput(ThroughputFilter filter,
+                                unsigned long throughput,
+                                ThroughputWindow &window, double kbps,
+                                double alpha);
+
+// The highest of bitrates (Kbps, ascending) that throughput covers by
+// safety_factor, or the lowest if it covers none (0 if there are none).
+int select_bitrate(const std::vector<int> &bitrates, unsigned long throughput,
+                   double safety_factor);
+
+// Parse the vid.mpd manifest in xml (size bytes, parsed in place) into the
+// bitrates of its video and its segment duration and length in seconds (left
+// unchanged if it does not state them). Returns false if it is not XML.
+bool parse_video_mpd(char *xml, size_t size, std::vector<int> &bitrates,
+                     double &segment_duration, double &duration);
+
+#endif // !ABR_H
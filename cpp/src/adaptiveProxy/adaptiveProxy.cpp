@@ -1,11 +1,10 @@
-#include "Random.h"
-#include "http.h"
-#include "loadBalancer_protocol.h"
+#include "abr.h"
 #include "network_utils.h"
-#include "spdlog/spdlog.h"
+#include "poller.h"
+#include "proxy.h"
 #include <cstdlib>
 #include <cxxopts.hpp>
-#include <sys/epoll.h>
+#include <iostream>
 
 int main(int argc, char *argv[]) {
   increase_fd_limit();
@@ -32,12 +31,96 @@ int main(int argc, char *argv[]) {
       "a,alpha",
       "A float in the range [0, 1]. Used as the coefficient in EWMA "
       "throughput estimate.",
-      cxxopts::value<double>());
+      cxxopts::value<double>())(
+      "r,report-load",
+      "Report the sessions and egress of every videoserver in use to the "
+      "load balancer (for its load mode). Requires --balance.",
+      cxxopts::value<bool>()->default_value("false"))(
+      "c,content-affinity",
+      "Ask the load balancer again whenever a client moves to another video, "
+      "with the path of the video as content key (for its chash mode). "
+      "Requires --balance.",
+      cxxopts::value<bool>()->default_value("false"))(
+      "u,upstreams",
+      "Comma-separated list of host:port of videoservers to fail over to "
+      "when the videoserver of a client fails.",
+      cxxopts::value<std::string>()->default_value(""))(
+      "m,max-inflight",
+      "Hold segment fetches back once this many are outstanding across all "
+      "clients, and send them earliest playback deadline first (0 for no "
+      "limit).",
+      cxxopts::value<int>()->default_value("0"))(
+      "e,estimator",
+      "Where throughput samples come from: beacon (the clients' "
+      "on-fragment-received beacons), tcp_info (the proxy's own measurement "
+      "of segment deliveries) or both.",
+      cxxopts::value<std::string>()->default_value("beacon"))(
+      "throughput-filter",
+      "How the throughput estimate is made of the samples: ewma (weighed by "
+      "alpha), harmonic (the harmonic mean of the latest 8) or percentile "
+      "(the 20th percentile of the latest 8).",
+      cxxopts::value<std::string>()->default_value("ewma"))(
+      "prior-prefix",
+      "Start a new client from the throughput of the clients before it in "
+      "its subnet of this prefix length, e.g. 24 (0 to start it at the "
+      "lowest bitrate).",
+      cxxopts::value<int>()->default_value("0"))(
+      "t,manifest-ttl",
+      "Serve the manifest of a video from memory for this many seconds after "
+      "fetching it, then revalidate it with the videoserver (0 to fetch it "
+      "for every client).",
+      cxxopts::value<int>()->default_value("30"))(
+      "segment-cache",
+      "Keep up to this many MB of whole segments in memory to answer Range "
+      "requests for segments from (0 to pass them on as requests for the "
+      "whole segment).",
+      cxxopts::value<int>()->default_value("0"))(
+      "s,upstream-selection",
+      "How the videoserver of a request is picked without --balance: sticky "
+      "(the one the client was connected to at first, until it fails) or "
+      "latency (per request, by the latency and error rate of every "
+      "videoserver).",
+      cxxopts::value<std::string>()->default_value("sticky"))(
+      "range-parts",
+      "Split a segment fetch into up to this many byte ranges, fetched in "
+      "parallel on connections of their own (1 to fetch segments whole).",
+      cxxopts::value<int>()->default_value("1"))(
+      "state-file",
+      "Keep the throughput estimates of the clients and the bitrates of the "
+      "videos in this file, and start from what it holds, so that they "
+      "survive restarts (none if empty).",
+      cxxopts::value<std::string>()->default_value(""))(
+      "max-sessions",
+      "Stop accepting connections while this many clients are connected (0 "
+      "for no limit).",
+      cxxopts::value<int>()->default_value("0"))(
+      "egress-limit",
+      "The egress to clients in Mbps the proxy should stay below: nearing "
+      "it caps the bitrate of every client (0 for no limit).",
+      cxxopts::value<int>()->default_value("0"))(
+      "trace-file",
+      "Write where the slow requests spent their time to this file, as Chrome "
+      "trace events (none if empty).",
+      cxxopts::value<std::string>()->default_value(""))(
+      "trace-threshold",
+      "The time in ms from which a request is slow enough for --trace-file.",
+      cxxopts::value<int>()->default_value("500"))(
+      "pacing",
+      "Pace the segments sent to every client at a rate matched to its "
+      "bitrate and playback buffer, rather than as fast as TCP allows.",
+      cxxopts::value<bool>()->default_value("false"))(
+      "i,io-backend",
+      "The I/O backend of the event loop: epoll, or io_uring (experimental, "
+      "Linux 6.0 or later; it takes more CPU than epoll on large segments).",
+      cxxopts::value<std::string>()->default_value("epoll"));
 
-  int adaptiveProxy_listen_port, videoserver_port;
-  std::string videoserver_hostname;
+  int adaptiveProxy_listen_port, videoserver_port, max_inflight,
+      manifest_ttl, segment_cache_size, range_parts, prior_prefix,
+      max_sessions, egress_limit, trace_threshold;
+  std::string videoserver_hostname, upstreams, io_backend, estimator,
+      upstream_selection, state_file, throughput_filter_name, trace_file;
   double alpha;
-  bool is_balance;
+  bool is_balance, is_report_load, is_content_affinity, is_pacing;
   try {
     const auto cxxopts_argv{cxxopts_options.parse(argc, argv)};
     adaptiveProxy_listen_port = cxxopts_argv["listen-port"].as<int>();
@@ -45,6 +128,25 @@ int main(int argc, char *argv[]) {
     videoserver_port = cxxopts_argv["port"].as<int>();
     alpha = cxxopts_argv["alpha"].as<double>();
     is_balance = cxxopts_argv["balance"].as<bool>();
+    is_report_load = cxxopts_argv["report-load"].as<bool>();
+    is_content_affinity = cxxopts_argv["content-affinity"].as<bool>();
+    is_pacing = cxxopts_argv["pacing"].as<bool>();
+    upstreams = cxxopts_argv["upstreams"].as<std::string>();
+    max_inflight = cxxopts_argv["max-inflight"].as<int>();
+    manifest_ttl = cxxopts_argv["manifest-ttl"].as<int>();
+    segment_cache_size = cxxopts_argv["segment-cache"].as<int>();
+    range_parts = cxxopts_argv["range-parts"].as<int>();
+    state_file = cxxopts_argv["state-file"].as<std::string>();
+    io_backend = cxxopts_argv["io-backend"].as<std::string>();
+    estimator = cxxopts_argv["estimator"].as<std::string>();
+    throughput_filter_name =
+        cxxopts_argv["throughput-filter"].as<std::string>();
+    prior_prefix = cxxopts_argv["prior-prefix"].as<int>();
+    max_sessions = cxxopts_argv["max-sessions"].as<int>();
+    egress_limit = cxxopts_argv["egress-limit"].as<int>();
+    trace_file = cxxopts_argv["trace-file"].as<std::string>();
+    trace_threshold = cxxopts_argv["trace-threshold"].as<int>();
+    upstream_selection = cxxopts_argv["upstream-selection"].as<std::string>();
   } catch (const cxxopts::exceptions::parsing &e) {
     std::cout << e.what() << '\n';
     return EXIT_FAILURE;
@@ -58,306 +160,120 @@ int main(int argc, char *argv[]) {
   } else if (0 > alpha || alpha > 1) {
     std::cout << "Error: alpha must be in the range of [0, 1]\n";
     return EXIT_FAILURE;
+  } else if (is_report_load && !is_balance) {
+    std::cout << "Error: report-load requires balance\n";
+    return EXIT_FAILURE;
+  } else if (is_content_affinity && !is_balance) {
+    std::cout << "Error: content-affinity requires balance\n";
+    return EXIT_FAILURE;
+  } else if (max_inflight < 0) {
+    std::cout << "Error: max-inflight must not be negative\n";
+    return EXIT_FAILURE;
+  } else if (manifest_ttl < 0) {
+    std::cout << "Error: manifest-ttl must not be negative\n";
+    return EXIT_FAILURE;
+  } else if (segment_cache_size < 0) {
+    std::cout << "Error: segment-cache must not be negative\n";
+    return EXIT_FAILURE;
+  } else if (range_parts < 1) {
+    std::cout << "Error: range-parts must be at least 1\n";
+    return EXIT_FAILURE;
+  } else if (0 > prior_prefix || prior_prefix > 32) {
+    std::cout << "Error: prior-prefix must be in the range of [0, 32]\n";
+    return EXIT_FAILURE;
+  } else if (max_sessions < 0) {
+    std::cout << "Error: max-sessions must not be negative\n";
+    return EXIT_FAILURE;
+  } else if (egress_limit < 0) {
+    std::cout << "Error: egress-limit must not be negative\n";
+    return EXIT_FAILURE;
+  } else if (trace_threshold < 0) {
+    std::cout << "Error: trace-threshold must not be negative\n";
+    return EXIT_FAILURE;
   }
-
-  std::unordered_map<int, int> videoserver_socket_for_client{},
-      client_socket_for_videoserver;
-  int loadBalancer_socket;
-
-  int adaptiveProxy_socket{get_inbound_socket(adaptiveProxy_listen_port)};
-  spdlog::info("adaptiveProxy started");
-
-  int epoll_fd{epoll_create1(EPOLL_CLOEXEC)};
-  if (epoll_fd == -1) {
-    spdlog::warn("epoll_create()");
+  ThroughputFilter throughput_filter;
+  if (!parse_throughput_filter(throughput_filter_name, throughput_filter)) {
+    std::cout << "Error: throughput-filter must be ewma, harmonic or "
+                 "percentile\n";
     return EXIT_FAILURE;
   }
-  epoll_event event, events[MAX_NO_OF_PORTS];
-  event.events = EPOLLIN;
-  event.data.fd = adaptiveProxy_socket;
-  if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, adaptiveProxy_socket, &event) == -1) {
-    spdlog::warn("epoll_ctl_add()");
+  if (estimator != "beacon" && estimator != "tcp_info" &&
+      estimator != "both") {
+    std::cout << "Error: estimator must be beacon, tcp_info or both\n";
+    return EXIT_FAILURE;
+  }
+  if (upstream_selection != "sticky" && upstream_selection != "latency") {
+    std::cout << "Error: upstream-selection must be sticky or latency\n";
+    return EXIT_FAILURE;
+  } else if (upstream_selection == "latency" && is_balance) {
+    std::cout << "Error: upstream-selection latency excludes balance\n";
+    return EXIT_FAILURE;
+  }
+  std::unique_ptr<Poller> poller{make_poller(io_backend)};
+  if (poller == nullptr) {
+    std::cout << "Error: io-backend must be epoll or io_uring\n";
+    return EXIT_FAILURE;
+  } else if (!poller->start()) {
+    std::cout << "Error: " << io_backend << " is not available\n";
     return EXIT_FAILURE;
   }
 
-  std::unordered_map<std::string, unsigned long> throughput_of_client{};
-  std::unordered_map<std::string, std::vector<int>> bitrate_of_video{};
-
-  char ip_str[16];
-  in_addr ip_addr;
-  char buffer[MAX_VIDEO_SIZE];
-  while (true) {
-    int no_of_events{epoll_wait(epoll_fd, events, MAX_NO_OF_PORTS, -1)};
-    if (no_of_events == -1) {
-      spdlog::warn("epoll_wait()");
+  ProxyOptions options{};
+  // Without --balance, hostname:port is the preferred videoserver, tried
+  // before the --upstreams.
+  if (!is_balance) {
+    in_addr_t videoserver_addr;
+    if (!resolve_hostname(videoserver_hostname.c_str(), videoserver_addr)) {
+      std::cout << "Error: cannot resolve hostname\n";
       return EXIT_FAILURE;
     }
-    for (int i{0}; i < no_of_events; ++i) {
-      if (events[i].data.fd == adaptiveProxy_socket) {
-        sockaddr_in client_addr;
-        socklen_t client_addr_len{sizeof(client_addr)};
-        int client_socket{accept(adaptiveProxy_socket, (sockaddr *)&client_addr,
-                                 &client_addr_len)};
-        if (client_socket == -1) {
-          spdlog::warn("accept()");
-          return EXIT_FAILURE;
-        }
-
-        ip_addr.s_addr = client_addr.sin_addr.s_addr;
-        if (inet_ntop(AF_INET, &ip_addr, ip_str, sizeof(ip_str)) == NULL) {
-          spdlog::warn("inet_ntop()");
-          return EXIT_FAILURE;
-        }
-        spdlog::info("New client socket connected with {}:{} on sockfd {}",
-                     ip_str, ntohs(client_addr.sin_port), client_socket);
-
-        event.data.fd = client_socket;
-        if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, client_socket, &event) == -1) {
-          spdlog::warn("epoll_ctl_add()");
-          return EXIT_FAILURE;
-        }
-
-        if (is_balance) {
-          loadBalancer_socket = get_outbound_socket(
-              videoserver_hostname.c_str(), videoserver_port);
-          LoadBalancerRequest loadBalancer_request;
-          loadBalancer_request.client_addr = client_addr.sin_addr.s_addr;
-          loadBalancer_request.request_id = htons(Random::get(0, UINT16_MAX));
-          size_t no_of_bytes_sent{};
-          while (no_of_bytes_sent < sizeof(loadBalancer_request)) {
-            long curr{send(loadBalancer_socket,
-                           &loadBalancer_request + no_of_bytes_sent,
-                           sizeof(loadBalancer_request) - no_of_bytes_sent, 0)};
-            if (curr == -1) {
-              spdlog::warn("loadBalancer_request send()");
-              return EXIT_FAILURE;
-            }
-            no_of_bytes_sent += curr;
-          }
-
-          LoadBalancerResponse loadBalancer_response;
-          size_t no_of_bytes_read{};
-          while (no_of_bytes_read < sizeof(loadBalancer_response)) {
-            long curr{recv(
-                loadBalancer_socket, &loadBalancer_response + no_of_bytes_read,
-                sizeof(loadBalancer_response) - no_of_bytes_read, 0)};
-            if (curr == -1) {
-              spdlog::warn("loadBalancer_request recv()");
-              return EXIT_FAILURE;
-            }
-            no_of_bytes_read += curr;
-          }
-          if (loadBalancer_response.request_id !=
-              loadBalancer_request.request_id) {
-            spdlog::warn("loadBalancer request_id");
-            return EXIT_FAILURE;
-          }
-          ip_addr.s_addr = loadBalancer_response.videoserver_addr;
-          if (inet_ntop(AF_INET, &ip_addr, ip_str, sizeof(ip_str)) == NULL) {
-            spdlog::warn("inet_ntop()");
-            return EXIT_FAILURE;
-          }
-          videoserver_socket_for_client[client_socket] = get_outbound_socket(
-              ip_str, ntohs(loadBalancer_response.videoserver_port));
-          if (close(loadBalancer_socket) == -1) {
-            spdlog::warn("close()");
-            return EXIT_FAILURE;
-          }
-        } else {
-          videoserver_socket_for_client[client_socket] = get_outbound_socket(
-              videoserver_hostname.c_str(), videoserver_port);
-        }
-        client_socket_for_videoserver
-            [videoserver_socket_for_client[client_socket]] = client_socket;
-        event.data.fd = videoserver_socket_for_client[client_socket];
-        if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD,
-                      videoserver_socket_for_client[client_socket],
-                      &event) == -1) {
-          spdlog::warn("epoll_ctl_add()");
-          return EXIT_FAILURE;
-        }
-      } else if (videoserver_socket_for_client.contains(events[i].data.fd)) {
-        int client_socket{events[i].data.fd};
-        size_t msg_len;
-        try {
-          msg_len = recv_one_http(client_socket, buffer);
-        } catch (const std::runtime_error &e) {
-          spdlog::info("Client socket sockfd {} disconnected", client_socket);
-          if (epoll_ctl(epoll_fd, EPOLL_CTL_DEL,
-                        videoserver_socket_for_client[client_socket],
-                        NULL) == -1) {
-            spdlog::warn("epoll_ctl_del()");
-            return EXIT_FAILURE;
-          }
-          if (epoll_ctl(epoll_fd, EPOLL_CTL_DEL, client_socket, NULL) == -1) {
-            spdlog::warn("epoll_ctl_del()");
-            return EXIT_FAILURE;
-          }
-          if (close(videoserver_socket_for_client[client_socket]) == -1) {
-            spdlog::warn("close()");
-            return EXIT_FAILURE;
-          }
-          if (close(client_socket) == -1) {
-            spdlog::warn("close()");
-            return EXIT_FAILURE;
-          }
-          client_socket_for_videoserver.erase(
-              videoserver_socket_for_client[client_socket]);
-          videoserver_socket_for_client.erase(client_socket);
-          continue;
-        }
-
-        if (is_post_on_fragment_received(buffer)) {
-          std::string uuid;
-          unsigned long fragment_size, start, end;
-          parse_post_on_fragment_received(buffer, uuid, fragment_size, start,
-                                          end);
-
-          if (!throughput_of_client.contains(uuid)) {
-            throughput_of_client[uuid] = 0;
-          }
-          throughput_of_client[uuid] =
-              alpha *
-                  ((fragment_size / 1000.0 * 8.0) / ((end - start) / 1000.0)) +
-              (1.0 - alpha) * throughput_of_client[uuid];
-
-          spdlog::info(
-              "Client {} finished receiving a segment of size {} bytes in {} "
-              "ms. Throughput: {} Kbps. Avg Throughput: {} Kbps",
-              uuid, fragment_size, end - start,
-              (unsigned long)((fragment_size / 1000.0 * 8.0) /
-                              ((end - start) / 1000.0)),
-              throughput_of_client[uuid]);
-          try {
-            send_one_http(client_socket, OK, sizeof(OK) - 1);
-          } catch (const std::runtime_error &e) {
-            spdlog::info("Client socket sockfd {} disconnected", client_socket);
-            if (epoll_ctl(epoll_fd, EPOLL_CTL_DEL,
-                          videoserver_socket_for_client[client_socket],
-                          NULL) == -1) {
-              spdlog::warn("epoll_ctl_del()");
-              return EXIT_FAILURE;
-            }
-            if (epoll_ctl(epoll_fd, EPOLL_CTL_DEL, client_socket, NULL) == -1) {
-              spdlog::warn("epoll_ctl_del()");
-              return EXIT_FAILURE;
-            }
-            if (close(videoserver_socket_for_client[client_socket]) == -1) {
-              spdlog::warn("close()");
-              return EXIT_FAILURE;
-            }
-            if (close(client_socket) == -1) {
-              spdlog::warn("close()");
-              return EXIT_FAILURE;
-            }
-            client_socket_for_videoserver.erase(
-                videoserver_socket_for_client[client_socket]);
-            videoserver_socket_for_client.erase(client_socket);
-          }
-        } else if (is_get_vid_mpd(buffer)) {
-          sockaddr_in socket_addr;
-          socklen_t socket_addr_len{sizeof(socket_addr)};
-          if (getpeername(videoserver_socket_for_client[client_socket],
-                          (sockaddr *)&socket_addr, &socket_addr_len) == -1) {
-            spdlog::warn("getpeername()");
-            return EXIT_FAILURE;
-          }
-          ip_addr.s_addr = socket_addr.sin_addr.s_addr;
-          if (inet_ntop(AF_INET, &ip_addr, ip_str, sizeof(ip_str)) == NULL) {
-            spdlog::warn("inet_ntop()");
-            return EXIT_FAILURE;
-          }
-
-          std::string path_to_video, no_list_mpd, uuid;
-          parse_get_vid_mpd(buffer, path_to_video, uuid);
-
-          if (!bitrate_of_video.contains(path_to_video)) {
-            get_bitrate_of_video(videoserver_socket_for_client[client_socket],
-                                 buffer, bitrate_of_video, path_to_video);
-          }
-          no_list_mpd =
-              "GET " + path_to_video +
-              "/vid-no-list.mpd HTTP/1.1\r\ncontent-length: 0\r\n\r\n";
-          send_one_http(videoserver_socket_for_client[client_socket],
-                        no_list_mpd.c_str(), no_list_mpd.length());
-
-          spdlog::info("Manifest requested by {} forwarded to {}:{} for {}",
-                       uuid, ip_str, ntohs(socket_addr.sin_port),
-                       path_to_video + "/vid-no-list.mpd");
-        } else if (is_get_vid_m4s(buffer)) {
-          std::string path_to_video, m4s, uuid, segment_no;
-          parse_get_vid_m4s(buffer, path_to_video, uuid, segment_no);
-
-          int bitrate{bitrate_of_video[path_to_video][0]};
-          unsigned long curr_throughput{throughput_of_client[uuid]};
-          for (size_t i{bitrate_of_video[path_to_video].size()}; i-- > 0;) {
-            if ((curr_throughput / 1.5) >= bitrate_of_video[path_to_video][i]) {
-              bitrate = bitrate_of_video[path_to_video][i];
-              break;
-            }
-          }
-
-          m4s = "GET " + path_to_video + "/video/vid-" +
-                std::to_string(bitrate) + "-seg-" + segment_no +
-                ".m4s HTTP/1.1\r\ncontent-length: 0\r\n\r\n";
-          send_one_http(videoserver_socket_for_client[client_socket],
-                        m4s.c_str(), m4s.length());
-
-          sockaddr_in socket_addr;
-          socklen_t socket_addr_len{sizeof(socket_addr)};
-          if (getpeername(videoserver_socket_for_client[client_socket],
-                          (sockaddr *)&socket_addr, &socket_addr_len) == -1) {
-            spdlog::warn("getpeername()");
-            return EXIT_FAILURE;
-          }
-          ip_addr.s_addr = socket_addr.sin_addr.s_addr;
-          if (inet_ntop(AF_INET, &ip_addr, ip_str, sizeof(ip_str)) == NULL) {
-            spdlog::warn("inet_ntop()");
-            return EXIT_FAILURE;
-          }
-          spdlog::info("Segment requested by {} forwarded to {}:{} as {} at "
-                       "bitrate {} Kbps",
-                       uuid, ip_str, ntohs(socket_addr.sin_port),
-                       path_to_video + "/video/vid-" + std::to_string(bitrate) +
-                           "-seg-" + segment_no + ".m4s",
-                       bitrate);
-        } else {
-          send_one_http(videoserver_socket_for_client[client_socket], buffer,
-                        msg_len);
-        }
-      } else {
-        int videoserver_socket{events[i].data.fd};
-        size_t msg_len{recv_one_http(videoserver_socket, buffer)};
-        try {
-          send_one_http(client_socket_for_videoserver[videoserver_socket],
-                        buffer, msg_len);
-        } catch (const std::runtime_error &e) {
-          spdlog::info("Client socket sockfd {} disconnected",
-                       client_socket_for_videoserver[videoserver_socket]);
-          if (epoll_ctl(epoll_fd, EPOLL_CTL_DEL, videoserver_socket, NULL) ==
-              -1) {
-            spdlog::warn("epoll_ctl_del()");
-            return EXIT_FAILURE;
-          }
-          if (epoll_ctl(epoll_fd, EPOLL_CTL_DEL,
-                        videoserver_socket_for_client[videoserver_socket],
-                        NULL) == -1) {
-            spdlog::warn("epoll_ctl_del()");
-            return EXIT_FAILURE;
-          }
-          if (close(client_socket_for_videoserver[videoserver_socket]) == -1) {
-            spdlog::warn("close()");
-            return EXIT_FAILURE;
-          }
-          if (close(videoserver_socket) == -1) {
-            spdlog::warn("close()");
-            return EXIT_FAILURE;
-          }
-          client_socket_for_videoserver.erase(
-              client_socket_for_videoserver[videoserver_socket]);
-          videoserver_socket_for_client.erase(videoserver_socket);
-        }
-      }
+    options.upstreams.push_back(
+        {videoserver_addr, htons(static_cast<uint16_t>(videoserver_port))});
+  }
+  for (size_t start{0}; start < upstreams.length();) {
+    size_t end{std::min(upstreams.find(',', start), upstreams.length())};
+    std::string upstream{upstreams.substr(start, end - start)};
+    size_t colon{upstream.rfind(':')};
+    in_addr_t upstream_addr;
+    int upstream_port{colon == std::string::npos
+                          ? 0
+                          : std::atoi(upstream.c_str() + colon + 1)};
+    if (1024 > upstream_port || upstream_port > 65535 ||
+        !resolve_hostname(upstream.substr(0, colon).c_str(), upstream_addr)) {
+      std::cout << "Error: upstreams must be a comma-separated list of "
+                   "host:port\n";
+      return EXIT_FAILURE;
     }
+    options.upstreams.push_back(
+        {upstream_addr, htons(static_cast<uint16_t>(upstream_port))});
+    start = end + 1;
   }
+
+  options.listen_port = adaptiveProxy_listen_port;
+  options.hostname = videoserver_hostname;
+  options.port = videoserver_port;
+  options.alpha = alpha;
+  options.throughput_filter = throughput_filter;
+  options.is_balance = is_balance;
+  options.is_report_load = is_report_load;
+  options.is_content_affinity = is_content_affinity;
+  options.is_pacing = is_pacing;
+  options.is_latency_selection = upstream_selection == "latency";
+  options.is_beacon_estimator = estimator != "tcp_info";
+  options.is_tcp_info_estimator = estimator != "beacon";
+  options.max_inflight = static_cast<size_t>(max_inflight);
+  options.segment_cache_size =
+      static_cast<size_t>(segment_cache_size) * 1000 * 1000;
+  options.max_sessions = static_cast<size_t>(max_sessions);
+  options.range_parts = static_cast<size_t>(range_parts);
+  options.manifest_ttl_s = manifest_ttl;
+  options.prior_prefix = prior_prefix;
+  options.egress_limit_kbps = static_cast<unsigned long>(egress_limit) * 1000;
+  options.trace_threshold_ms = static_cast<unsigned long>(trace_threshold);
+  options.state_file = state_file;
+  options.trace_file = trace_file;
+  options.io_backend = io_backend;
+
+  Proxy proxy{std::move(options), std::move(poller)};
+  return proxy.run();
 }
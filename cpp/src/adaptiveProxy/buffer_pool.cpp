@@ -0,0 +1,162 @@
+#include "buffer_pool.h"
+
+#include "spdlog/spdlog.h"
+#include <cstdint>
+#include <cstring>
+#include <sys/mman.h>
+#include <unistd.h>
+#include <utility>
+
+BufferRef::BufferRef(const BufferRef &other) : slab_{other.slab_} {
+  if (slab_ != nullptr) {
+    ++slab_->no_of_refs;
+  }
+}
+
+BufferRef::BufferRef(BufferRef &&other) noexcept : slab_{other.slab_} {
+  other.slab_ = nullptr;
+}
+
+BufferRef &BufferRef::operator=(BufferRef other) noexcept {
+  std::swap(slab_, other.slab_);
+  return *this;
+}
+
+BufferRef::~BufferRef() {
+  if (slab_ != nullptr && --slab_->no_of_refs == 0) {
+    slab_->pool->release(slab_);
+  }
+}
+
+char *BufferRef::data() const { return slab_->data; }
+
+size_t BufferRef::capacity() const { return slab_->capacity; }
+
+size_t BufferRef::size() const { return slab_->size; }
+
+void BufferRef::set_size(size_t size) { slab_->size = size; }
+
+BufferPool::BufferPool() {
+  for (size_t size{BUFFER_POOL_MIN_SIZE}; size <= BUFFER_POOL_CHUNK_SIZE;
+       size *= 2) {
+    class_sizes_.push_back(size);
+  }
+  free_slabs_of_class_.resize(class_sizes_.size());
+}
+
+BufferRef BufferPool::acquire(size_t capacity) {
+  auto new_slab = [this]() {
+    if (unused_slabs_.empty()) {
+      return &slabs_.emplace_back();
+    }
+    Slab *slab{unused_slabs_.back()};
+    unused_slabs_.pop_back();
+    return slab;
+  };
+
+  size_t size_class{0};
+  while (size_class < class_sizes_.size() &&
+         class_sizes_[size_class] < capacity) {
+    ++size_class;
+  }
+  if (size_class == class_sizes_.size()) {
+    size_t page_size{static_cast<size_t>(sysconf(_SC_PAGESIZE))};
+    if (capacity > SIZE_MAX - page_size) {
+      return {};
+    }
+    size_t size{(capacity + page_size - 1) / page_size * page_size};
+    char *data{map(size, false)};
+    if (data == nullptr) {
+      return {};
+    }
+    Slab *slab{new_slab()};
+    *slab = {this, data, size, 0, BufferRef::OWN_MAPPING, 1};
+    return BufferRef{slab};
+  }
+
+  std::vector<Slab *> &free_slabs{free_slabs_of_class_[size_class]};
+  if (free_slabs.empty()) {
+    size_t size{class_sizes_[size_class]};
+    char *chunk{map(BUFFER_POOL_CHUNK_SIZE, true)};
+    if (chunk == nullptr) {
+      return {};
+    }
+    for (size_t offset{0}; offset < BUFFER_POOL_CHUNK_SIZE; offset += size) {
+      Slab *slab{new_slab()};
+      *slab = {this, chunk + offset, size, 0, size_class, 0};
+      free_slabs.push_back(slab);
+    }
+  }
+  Slab *slab{free_slabs.back()};
+  free_slabs.pop_back();
+  slab->size = 0;
+  slab->no_of_refs = 1;
+  return BufferRef{slab};
+}
+
+BufferRef BufferPool::copy_of(std::string_view data) {
+  BufferRef buffer{acquire(data.size())};
+  if (!buffer) {
+    return buffer;
+  }
+  memcpy(buffer.data(), data.data(), data.size());
+  buffer.set_size(data.size());
+  return buffer;
+}
+
+void BufferPool::release(Slab *slab) {
+  // Smaller buffers share their chunk, so they are always kept.
+  if (slab->size_class == BufferRef::OWN_MAPPING ||
+      (slab->capacity == BUFFER_POOL_CHUNK_SIZE &&
+       free_slabs_of_class_[slab->size_class].size() >=
+           BUFFER_POOL_MAX_IDLE_CHUNKS)) {
+    unmap(slab->data, slab->capacity);
+    unused_slabs_.push_back(slab);
+    return;
+  }
+  free_slabs_of_class_[slab->size_class].push_back(slab);
+}
+
+char *BufferPool::map(size_t size, bool is_chunk) {
+  if (is_chunk && is_hugetlb_available_) {
+    // Chunks are 2 MiB, whatever the default huge page size is.
+    void *data{mmap(nullptr, size, PROT_READ | PROT_WRITE,
+                    MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB |
+                        (21 << MAP_HUGE_SHIFT),
+                    -1, 0)};
+    if (data != MAP_FAILED) {
+      return static_cast<char *>(data);
+    }
+    // No huge pages reserved (vm.nr_hugepages); don't ask again.
+    is_hugetlb_available_ = false;
+  }
+
+  // Map a chunk's worth more than needed, so that the kernel can back an
+  // aligned chunk with a transparent huge page, and unmap the excess.
+  size_t excess{is_chunk ? static_cast<size_t>(BUFFER_POOL_CHUNK_SIZE) : 0};
+  void *mapping{mmap(nullptr, size + excess, PROT_READ | PROT_WRITE,
+                     MAP_PRIVATE | MAP_ANONYMOUS, -1, 0)};
+  if (mapping == MAP_FAILED) {
+    spdlog::warn("BufferPool::map(): mmap() of {} bytes", size + excess);
+    return nullptr;
+  }
+  char *data{static_cast<char *>(mapping)};
+  if (is_chunk) {
+    uintptr_t start{reinterpret_cast<uintptr_t>(data)},
+        aligned{(start + BUFFER_POOL_CHUNK_SIZE - 1) &
+                ~static_cast<uintptr_t>(BUFFER_POOL_CHUNK_SIZE - 1)};
+    size_t head{aligned - start};
+    unmap(data, head);
+    unmap(data + head + size, excess - head);
+    data += head;
+    madvise(data, size, MADV_HUGEPAGE);
+  }
+  return data;
+}
+
+void BufferPool::unmap(char *data, size_t size) {
+  if (size > 0 && munmap(data, size) == -1) {
+    spdlog::warn("BufferPool::unmap(): munmap()");
+    quick_exit(EXIT_FAILURE);
+  }
+}
@@ -0,0 +1,97 @@
+#ifndef BUFFER_POOL_H
+#define BUFFER_POOL_H
+
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <string_view>
+#include <vector>
+
+// Buffers for the messages the proxy relays, borrowed from a pool and
+// returned to it once the last reference to them is dropped. A response can
+// thus stay in memory while it is sent to a slow client, and be shared by
+// several clients (cached manifests) without being copied.
+//
+// Buffers come in size classes of powers of two from BUFFER_POOL_MIN_SIZE up
+// to BUFFER_POOL_CHUNK_SIZE, so that a buffer (which a cached message holds
+// on to) is never twice as large as its message needs. They are carved out
+// of chunks of BUFFER_POOL_CHUNK_SIZE bytes, backed by huge pages when the
+// kernel has some to spare and otherwise aligned to them for transparent huge
+// pages. Buffers larger than a chunk get a mapping of their own.
+//
+// Not thread-safe: the proxy runs on one thread.
+
+#define BUFFER_POOL_MIN_SIZE (4 * 1024)
+#define BUFFER_POOL_CHUNK_SIZE (2 * 1024 * 1024)
+
+// Chunk-sized buffers kept for reuse once returned; the rest are unmapped.
+#define BUFFER_POOL_MAX_IDLE_CHUNKS 32
+
+class BufferPool;
+
+class BufferRef {
+public:
+  BufferRef() = default;
+  BufferRef(const BufferRef &other);
+  BufferRef(BufferRef &&other) noexcept;
+  BufferRef &operator=(BufferRef other) noexcept;
+  ~BufferRef();
+
+  explicit operator bool() const { return slab_ != nullptr; }
+
+  char *data() const;
+  size_t capacity() const;
+
+  // How many bytes of data() are in use.
+  size_t size() const;
+  void set_size(size_t size);
+
+  std::string_view view() const { return {data(), size()}; }
+
+private:
+  friend class BufferPool;
+  struct Slab {
+    BufferPool *pool;
+    char *data;
+    size_t capacity, size;
+    size_t size_class; // OWN_MAPPING for a mapping of its own.
+    int no_of_refs;
+  };
+
+  static constexpr size_t OWN_MAPPING{SIZE_MAX};
+
+  explicit BufferRef(Slab *slab) : slab_{slab} {}
+
+  Slab *slab_{};
+};
+
+class BufferPool {
+public:
+  BufferPool();
+  BufferPool(const BufferPool &) = delete;
+  BufferPool &operator=(const BufferPool &) = delete;
+
+  // A buffer of at least capacity bytes, with size() 0, or an empty one if
+  // no memory can be mapped for it.
+  BufferRef acquire(size_t capacity);
+
+  // A buffer holding a copy of data, or an empty one as for acquire().
+  BufferRef copy_of(std::string_view data);
+
+private:
+  friend class BufferRef;
+  using Slab = BufferRef::Slab;
+
+  void release(Slab *slab);
+  // nullptr if the mapping fails.
+  char *map(size_t size, bool is_chunk);
+  void unmap(char *data, size_t size);
+
+  std::vector<size_t> class_sizes_;
+  std::vector<std::vector<Slab *>> free_slabs_of_class_;
+  std::deque<Slab> slabs_; // Stable addresses; only ever grows.
+  std::vector<Slab *> unused_slabs_; // Whose mappings were unmapped.
+  bool is_hugetlb_available_{true};
+};
+
+#endif // !BUFFER_POOL_H
@@ -0,0 +1,111 @@
+#include "chunked.h"
+
+#include <algorithm>
+
+// The value of the hex digit c, or -1 if it is none.
+static int hex_value(char c) {
+  if (c >= '0' && c <= '9') {
+    return c - '0';
+  } else if (c >= 'a' && c <= 'f') {
+    return c - 'a' + 10;
+  } else if (c >= 'A' && c <= 'F') {
+    return c - 'A' + 10;
+  }
+  return -1;
+}
+
+size_t ChunkedDecoder::feed(std::string_view data, std::string *decoded) {
+  size_t i{0};
+  while (i < data.length() && state_ != DONE && state_ != MALFORMED) {
+    char c{data[i]};
+    switch (state_) {
+    case SIZE:
+      if (int digit{hex_value(c)}; digit >= 0) {
+        remaining_ = remaining_ * 16 + digit;
+        has_size_digit_ = true;
+        if (remaining_ > MAX_CHUNK_SIZE) {
+          state_ = MALFORMED;
+          continue;
+        }
+      } else if (!has_size_digit_) {
+        state_ = MALFORMED;
+        continue;
+      } else if (c == ';' || c == ' ' || c == '\t') {
+        state_ = EXTENSION;
+      } else if (c == '\r') {
+        state_ = SIZE_LF;
+      } else {
+        state_ = MALFORMED;
+        continue;
+      }
+      break;
+    case EXTENSION:
+      if (c == '\r') {
+        state_ = SIZE_LF;
+      }
+      break;
+    case SIZE_LF:
+      if (c != '\n') {
+        state_ = MALFORMED;
+        continue;
+      }
+      state_ = remaining_ == 0 ? TRAILER_START : DATA;
+      break;
+    case DATA: {
+      size_t length{static_cast<size_t>(
+          std::min<uint64_t>(remaining_, data.length() - i))};
+      if (decoded != nullptr) {
+        decoded->append(data.substr(i, length));
+      }
+      remaining_ -= length;
+      i += length;
+      if (remaining_ == 0) {
+        state_ = DATA_CR;
+      }
+      continue;
+    }
+    case DATA_CR:
+      if (c != '\r') {
+        state_ = MALFORMED;
+        continue;
+      }
+      state_ = DATA_LF;
+      break;
+    case DATA_LF:
+      if (c != '\n') {
+        state_ = MALFORMED;
+        continue;
+      }
+      state_ = SIZE;
+      has_size_digit_ = false;
+      break;
+    case TRAILER_START:
+      state_ = c == '\r' ? FINAL_LF : TRAILER;
+      break;
+    case TRAILER:
+      if (c == '\r') {
+        state_ = TRAILER_LF;
+      }
+      break;
+    case TRAILER_LF:
+      if (c != '\n') {
+        state_ = MALFORMED;
+        continue;
+      }
+      state_ = TRAILER_START;
+      break;
+    case FINAL_LF:
+      if (c != '\n') {
+        state_ = MALFORMED;
+        continue;
+      }
+      state_ = DONE;
+      break;
+    case DONE:
+    case MALFORMED:
+      break;
+    }
+    ++i;
+  }
+  return i;
+}
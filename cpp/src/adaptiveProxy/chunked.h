@@ -0,0 +1,48 @@
+#ifndef CHUNKED_H
+#define CHUNKED_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+// Incremental parsing of Transfer-Encoding: chunked bodies, fed however the
+// bytes happen to arrive, so that a body can be relayed chunk by chunk (as
+// low-latency CMAF segments are produced) and the proxy still knows where it
+// ends.
+
+// Chunks claiming to be larger than this are taken for garbage.
+#define MAX_CHUNK_SIZE (1ULL << 40)
+
+class ChunkedDecoder {
+public:
+  // Scan data, the next bytes of the body. Returns how many of them belong
+  // to it: all, unless the body ends (or turns out malformed) within data.
+  // The chunk data among them is appended to decoded, if given.
+  size_t feed(std::string_view data, std::string *decoded = nullptr);
+
+  bool is_done() const { return state_ == DONE; }
+  bool is_malformed() const { return state_ == MALFORMED; }
+
+private:
+  enum State {
+    SIZE,           // The hex digits of a chunk size.
+    EXTENSION,      // A chunk extension, up to the CR.
+    SIZE_LF,        // The LF after a chunk size line.
+    DATA,           // remaining_ bytes of chunk data.
+    DATA_CR,        // The CRLF after chunk data.
+    DATA_LF,        //
+    TRAILER_START,  // The start of a trailer field, or of the final CRLF.
+    TRAILER,        // A trailer field, up to the CR.
+    TRAILER_LF,     // The LF after a trailer field.
+    FINAL_LF,       // The LF ending the body.
+    DONE,
+    MALFORMED
+  };
+
+  State state_{SIZE};
+  bool has_size_digit_{};
+  uint64_t remaining_{};
+};
+
+#endif // !CHUNKED_H
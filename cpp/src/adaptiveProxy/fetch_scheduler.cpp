@@ -0,0 +1,122 @@
+#include "fetch_scheduler.h"
+
+#include <algorithm>
+#include <unordered_set>
+
+FetchScheduler::FetchScheduler(size_t max_inflight)
+    : max_inflight_{max_inflight} {}
+
+void FetchScheduler::on_fragment_received(const std::string &uuid,
+                                          unsigned long end_ms,
+                                          Clock::time_point now) {
+  auto [it, is_new]{buffer_of_client_.try_emplace(
+      uuid, Buffer{0.0, end_ms, now, DEFAULT_SEGMENT_DURATION_S})};
+  Buffer &buffer{it->second};
+  if (!is_new && end_ms > buffer.last_end_ms) {
+    buffer.level_s = std::max(
+        0.0, buffer.level_s - (end_ms - buffer.last_end_ms) / 1000.0);
+  }
+  buffer.level_s += buffer.segment_duration_s;
+  buffer.last_end_ms = std::max(buffer.last_end_ms, end_ms);
+  buffer.updated_at = now;
+}
+
+FetchScheduler::Clock::time_point
+FetchScheduler::deadline_of(const std::string &uuid) const {
+  auto it{buffer_of_client_.find(uuid)};
+  if (it == buffer_of_client_.end()) {
+    // Nothing buffered yet: the player is waiting for this segment.
+    return Clock::now();
+  }
+  return it->second.updated_at +
+         std::chrono::duration_cast<Clock::duration>(
+             std::chrono::duration<double>{it->second.level_s});
+}
+
+bool FetchScheduler::submit(int client_socket, const std::string &uuid,
+                            double segment_duration_s, uint64_t response_slot,
+                            std::string request) {
+  auto it{buffer_of_client_.find(uuid)};
+  if (it != buffer_of_client_.end()) {
+    it->second.segment_duration_s = segment_duration_s;
+  } else {
+    buffer_of_client_[uuid] = {0.0, 0, Clock::now(), segment_duration_s};
+  }
+
+  if (max_inflight_ == 0 ||
+      (queue_.empty() && no_of_inflight_ < max_inflight_)) {
+    ++no_of_inflight_;
+    ++inflight_of_socket_[client_socket];
+    return true;
+  }
+  queue_.push_back(
+      {deadline_of(uuid), client_socket, response_slot, std::move(request)});
+  return false;
+}
+
+void FetchScheduler::complete(int client_socket) {
+  auto it{inflight_of_socket_.find(client_socket)};
+  if (it == inflight_of_socket_.end()) {
+    return;
+  }
+  --no_of_inflight_;
+  if (--it->second == 0) {
+    inflight_of_socket_.erase(it);
+  }
+}
+
+void FetchScheduler::remove(int client_socket) {
+  auto it{inflight_of_socket_.find(client_socket)};
+  if (it != inflight_of_socket_.end()) {
+    no_of_inflight_ -= it->second;
+    inflight_of_socket_.erase(it);
+  }
+  std::erase_if(queue_, [client_socket](const Fetch &fetch) {
+    return fetch.client_socket == client_socket;
+  });
+}
+
+std::optional<FetchScheduler::Fetch> FetchScheduler::next() {
+  if (queue_.empty() || no_of_inflight_ >= max_inflight_) {
+    return std::nullopt;
+  }
+
+  // Earliest deadline among the clients under their fair share, or among all
+  // clients if every waiting one is at it (so no slot is left idle). Ties go
+  // to the fetch that arrived first.
+  size_t share{fair_share()};
+  auto is_under_share{[this, share](const Fetch &fetch) {
+    auto it{inflight_of_socket_.find(fetch.client_socket)};
+    return it == inflight_of_socket_.end() || it->second < share;
+  }};
+  auto chosen{queue_.end()};
+  for (bool is_fair : {true, false}) {
+    for (auto it{queue_.begin()}; it != queue_.end(); ++it) {
+      if ((!is_fair || is_under_share(*it)) &&
+          (chosen == queue_.end() || it->deadline < chosen->deadline)) {
+        chosen = it;
+      }
+    }
+    if (chosen != queue_.end()) {
+      break;
+    }
+  }
+
+  Fetch fetch{std::move(*chosen)};
+  queue_.erase(chosen);
+  ++no_of_inflight_;
+  ++inflight_of_socket_[fetch.client_socket];
+  return fetch;
+}
+
+size_t FetchScheduler::fair_share() const {
+  std::unordered_set<int> clients{};
+  for (const auto &[client_socket, inflight] : inflight_of_socket_) {
+    clients.insert(client_socket);
+  }
+  for (const Fetch &fetch : queue_) {
+    clients.insert(fetch.client_socket);
+  }
+  return std::max<size_t>(
+      1, (max_inflight_ + clients.size() - 1) / clients.size());
+}
@@ -0,0 +1,82 @@
+#ifndef FETCH_SCHEDULER_H
+#define FETCH_SCHEDULER_H
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+// Earliest-deadline-first scheduling of segment fetches across clients.
+
+// The playback buffer of every client is estimated from its
+// on-fragment-received beacons: each one adds a segment's worth of video,
+// and the buffer drains in real time between the ends of two downloads. A
+// client's next segment is due when its buffer runs dry, so that is the
+// deadline of its fetch. While fewer than max_inflight segment fetches are
+// outstanding, fetches go out as soon as they arrive; beyond that they queue
+// and the one with the earliest deadline goes next, skipping clients that
+// already use their fair share of the in-flight fetches while others wait.
+
+// Assumed when a manifest does not state its segment duration.
+#define DEFAULT_SEGMENT_DURATION_S 2.0
+
+class FetchScheduler {
+public:
+  using Clock = std::chrono::steady_clock;
+
+  struct Fetch {
+    Clock::time_point deadline;
+    int client_socket;
+    uint64_t response_slot; // Where the client gets the segment.
+    std::string request;
+  };
+
+  // max_inflight == 0 means fetches are never held back.
+  explicit FetchScheduler(size_t max_inflight);
+
+  // The client uuid finished downloading a segment at end_ms (client clock).
+  void on_fragment_received(const std::string &uuid, unsigned long end_ms,
+                            Clock::time_point now);
+
+  // When the playback buffer of uuid is expected to run dry.
+  Clock::time_point deadline_of(const std::string &uuid) const;
+
+  // Ask to fetch a segment of segment_duration_s seconds for uuid on
+  // client_socket, into response_slot. Returns true if request may go out
+  // now; otherwise it is queued and returned by next() later.
+  bool submit(int client_socket, const std::string &uuid,
+              double segment_duration_s, uint64_t response_slot,
+              std::string request);
+
+  // A segment arrived for client_socket, freeing one of its in-flight
+  // fetches.
+  void complete(int client_socket);
+
+  // The session of client_socket is gone: forget its fetches.
+  void remove(int client_socket);
+
+  // The next queued fetch that may go out now, if any.
+  std::optional<Fetch> next();
+
+  size_t no_of_queued() const { return queue_.size(); }
+
+private:
+  struct Buffer {
+    double level_s;
+    unsigned long last_end_ms;
+    Clock::time_point updated_at;
+    double segment_duration_s; // Of the segment being fetched.
+  };
+  size_t fair_share() const;
+
+  size_t max_inflight_, no_of_inflight_{};
+  std::unordered_map<std::string, Buffer> buffer_of_client_;
+  std::unordered_map<int, size_t> inflight_of_socket_;
+  std::vector<Fetch> queue_; // In arrival order.
+};
+
+#endif // !FETCH_SCHEDULER_H
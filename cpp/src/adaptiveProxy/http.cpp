@@ -1,75 +1,280 @@
 #include "http.h"
 
-bool is_header_end(char *buffer, size_t no_of_bytes_read) {
-  char *start{buffer + no_of_bytes_read - 4};
-  return start[0] == '\r' && start[1] == '\n' && start[2] == '\r' &&
-         start[3] == '\n';
+#include "abr.h"
+#include <algorithm>
+#include <cctype>
+#include <cerrno>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <string_view>
+#include <strings.h>
+
+// Whether a recv() with MSG_DONTWAIT that returned curr found nothing there.
+static bool is_nothing_there(long curr) {
+  return curr < 0 && (errno == EAGAIN || errno == EWOULDBLOCK);
 }
 
-int get_content_length(const char *header) {
+// The Content-Length of header, 0 if it has none, or SIZE_MAX if it is too
+// large to parse.
+static size_t get_content_length(const char *header) {
   try {
     boost::regex content_length_regex{"content-length:\\s*(\\d+)\\r\\n",
                                       boost::regex_constants::icase};
     boost::cmatch capture_groups;
     if (boost::regex_search(header, capture_groups, content_length_regex)) {
-      return std::stoi(capture_groups[1].str());
+      return std::stoull(capture_groups[1].str());
     } else {
       return 0;
     }
-  } catch (const std::exception &e) {
-    std::cout << e.what() << '\n';
-    quick_exit(EXIT_FAILURE);
+  } catch (const std::exception &) {
+    return SIZE_MAX;
   }
 }
 
-size_t recv_one_http(int socket, char *buffer) {
-  size_t no_of_bytes_of_header_read{};
+bool is_chunked(const char *msg) {
+  std::string transfer_encoding{parse_header_field(msg, "transfer-encoding")};
+  std::transform(transfer_encoding.begin(), transfer_encoding.end(),
+                 transfer_encoding.begin(),
+                 [](unsigned char c) { return std::tolower(c); });
+  return transfer_encoding.find("chunked") != std::string::npos;
+}
 
-  while (no_of_bytes_of_header_read < 4 ||
-         !is_header_end(buffer, no_of_bytes_of_header_read)) {
-    long curr{recv(socket, buffer + no_of_bytes_of_header_read, 1, 0)};
-    if (curr == 0) {
-      spdlog::warn("recv_one_http(): header, socket {} disconnected", socket);
+// A buffer from pool of at least capacity bytes. Throws std::runtime_error
+// if there is no memory for it.
+static BufferRef acquire(BufferPool &pool, size_t capacity,
+                         const char *caller, int socket) {
+  BufferRef buffer{pool.acquire(capacity)};
+  if (!buffer) {
+    spdlog::warn("{}: socket {}, no memory for {} bytes", caller, socket,
+                 capacity);
+    throw std::runtime_error("");
+  }
+  return buffer;
+}
+
+// A NUL-terminated copy of data in a buffer from pool. Throws
+// std::runtime_error if there is no memory for it.
+static BufferRef copy_of(std::string_view data, BufferPool &pool,
+                         int socket) {
+  BufferRef copy{
+      acquire(pool, data.length() + 1, "HttpReader::read()", socket)};
+  memcpy(copy.data(), data.data(), data.length());
+  copy.data()[data.length()] = '\0';
+  copy.set_size(data.length());
+  return copy;
+}
+
+// Feed decoder the next bytes of a chunked body that have arrived on socket,
+// up to capacity of them, consuming only those that belong to the body and
+// copying them into buffer. Returns how many there were, 0 if none had
+// arrived.
+static size_t recv_chunked(Poller &poller, int socket, ChunkedDecoder &decoder,
+                           char *buffer, size_t capacity, std::string *decoded,
+                           const char *caller) {
+  long curr{poller.recv(socket, buffer, capacity, MSG_PEEK)};
+  if (is_nothing_there(curr)) {
+    return 0;
+  } else if (curr == 0) {
+    spdlog::warn("{}: body, socket {} disconnected", caller, socket);
+    throw std::runtime_error("");
+  } else if (curr < 0) {
+    spdlog::warn("{}: body, socket {} failed", caller, socket);
+    throw std::runtime_error("");
+  }
+  size_t no_of_bytes_to_consume{
+      decoder.feed({buffer, static_cast<size_t>(curr)}, decoded)};
+  if (decoder.is_malformed()) {
+    spdlog::warn("{}: body, socket {} malformed chunk", caller, socket);
+    throw std::runtime_error("");
+  }
+  if (poller.recv(socket, buffer, no_of_bytes_to_consume, 0) !=
+      static_cast<long>(no_of_bytes_to_consume)) {
+    spdlog::warn("{}: body, socket {} failed", caller, socket);
+    throw std::runtime_error("");
+  }
+  return no_of_bytes_to_consume;
+}
+
+// The header, with Content-Length: content_length in place of the framing
+// it had.
+static std::string reframed_header(std::string_view header,
+                                   size_t content_length) {
+  std::string reframed;
+  size_t line_start{0};
+  while (line_start + 2 < header.length()) {
+    size_t line_end{header.find("\r\n", line_start)};
+    std::string_view line{header.substr(line_start, line_end - line_start)};
+    if (line_start == 0 ||
+        (strncasecmp(line.data(), "transfer-encoding:", 18) != 0 &&
+         strncasecmp(line.data(), "content-length:", 15) != 0)) {
+      reframed.append(line).append("\r\n");
+    }
+    line_start = line_end + 2;
+  }
+  return reframed + "Content-Length: " + std::to_string(content_length) +
+         "\r\n\r\n";
+}
+
+BufferRef HttpReader::read(Poller &poller, int socket, BufferPool &pool,
+                           bool is_chunked_relayed) {
+  if (phase_ != BODY) {
+    if (!read_header(poller, socket, pool)) {
+      return {};
+    }
+    is_chunked_ = is_chunked(header_.data());
+    if (is_chunked_ && is_chunked_relayed) {
+      phase_ = IDLE;
+      return copy_of(header_.view(), pool, socket);
+    }
+    if (!is_chunked_) {
+      // Capped before it sizes anything, so that the size of the message
+      // cannot overflow.
+      content_length_ = get_content_length(header_.data());
+      if (content_length_ > MAX_HTTP_BODY_SIZE) {
+        spdlog::warn("HttpReader::read(): body, socket {} too long", socket);
+        throw std::runtime_error("");
+      }
+      message_ = acquire(pool, header_.size() + content_length_ + 1,
+                         "HttpReader::read()", socket);
+      memcpy(message_.data(), header_.data(), header_.size());
+      message_.set_size(header_.size());
+    }
+    phase_ = BODY;
+  }
+  if (!read_body(poller, socket)) {
+    return {};
+  }
+  BufferRef message{is_chunked_
+                        ? copy_of(reframed_header(header_.view(),
+                                                  body_.length()) +
+                                      body_,
+                                  pool, socket)
+                        : std::move(message_)};
+  phase_ = IDLE;
+  header_ = {};
+  message_ = {};
+  decoder_ = {};
+  body_ = {};
+  return message;
+}
+
+// The end of the header may straddle what was consumed before, and it is
+// only consumed up to there, so that the body stays queued.
+bool HttpReader::read_header(Poller &poller, int socket, BufferPool &pool) {
+  if (phase_ == IDLE) {
+    header_ = acquire(pool, MAX_HTTP_HEADER_SIZE, "HttpReader::read()",
+                      socket);
+  }
+  char *buffer{header_.data()};
+  while (true) {
+    size_t no_of_bytes_of_header_read{header_.size()};
+    long curr{poller.recv(
+        socket, buffer + no_of_bytes_of_header_read,
+        std::min<size_t>(HTTP_HEADER_PEEK_SIZE, MAX_HTTP_HEADER_SIZE - 1 -
+                                                    no_of_bytes_of_header_read),
+        MSG_PEEK)};
+    if (is_nothing_there(curr)) {
+      return false;
+    } else if (curr == 0) {
+      spdlog::warn("HttpReader::read(): header, socket {} disconnected",
+                   socket);
       throw std::runtime_error("");
     } else if (curr < 0) {
-      spdlog::warn("recv_one_http(): header");
-      quick_exit(EXIT_FAILURE);
+      spdlog::warn("HttpReader::read(): header, socket {} failed", socket);
+      throw std::runtime_error("");
+    }
+    if (phase_ == IDLE) {
+      phase_ = HEADER;
+      started_at_ = Clock::now();
+    }
+
+    size_t from{std::max<size_t>(no_of_bytes_of_header_read, 3) - 3},
+        to{no_of_bytes_of_header_read + curr};
+    std::string_view peeked{buffer + from, to - from};
+    size_t header_end{peeked.find("\r\n\r\n")};
+    size_t no_of_bytes_to_consume{
+        header_end == std::string_view::npos
+            ? static_cast<size_t>(curr)
+            : from + header_end + 4 - no_of_bytes_of_header_read};
+    if (poller.recv(socket, buffer + no_of_bytes_of_header_read,
+                    no_of_bytes_to_consume, 0) !=
+        static_cast<long>(no_of_bytes_to_consume)) {
+      spdlog::warn("HttpReader::read(): header, socket {} failed", socket);
+      throw std::runtime_error("");
+    }
+    no_of_bytes_of_header_read += no_of_bytes_to_consume;
+    buffer[no_of_bytes_of_header_read] = '\0';
+    header_.set_size(no_of_bytes_of_header_read);
+    if (header_end != std::string_view::npos) {
+      return true;
+    }
+    if (no_of_bytes_of_header_read == MAX_HTTP_HEADER_SIZE - 1) {
+      spdlog::warn("HttpReader::read(): header, socket {} too long", socket);
+      throw std::runtime_error("");
     }
-    ++no_of_bytes_of_header_read;
   }
-  buffer[no_of_bytes_of_header_read] = '\0';
-
-  int content_length{get_content_length(buffer)};
-  size_t no_of_bytes_of_body_read{};
-  while (no_of_bytes_of_body_read < content_length) {
-    long curr{recv(
-        socket, buffer + no_of_bytes_of_header_read + no_of_bytes_of_body_read,
-        content_length - no_of_bytes_of_body_read, 0)};
-    if (curr == 0) {
-      spdlog::warn("recv_one_http(): body, socket {} disconnected", socket);
+}
+
+bool HttpReader::read_body(Poller &poller, int socket) {
+  if (is_chunked_) {
+    char chunks[HTTP_HEADER_PEEK_SIZE];
+    while (!decoder_.is_done()) {
+      if (recv_chunked(poller, socket, decoder_, chunks, sizeof(chunks),
+                       &body_, "HttpReader::read()") == 0) {
+        return false;
+      }
+      if (body_.length() > MAX_HTTP_BODY_SIZE) {
+        spdlog::warn("HttpReader::read(): body, socket {} too long", socket);
+        throw std::runtime_error("");
+      }
+    }
+    return true;
+  }
+
+  char *buffer{message_.data()};
+  size_t no_of_bytes_read{message_.size()},
+      message_length{header_.size() + content_length_};
+  while (no_of_bytes_read < message_length) {
+    long curr{poller.recv(socket, buffer + no_of_bytes_read,
+                          message_length - no_of_bytes_read, 0)};
+    if (is_nothing_there(curr)) {
+      return false;
+    } else if (curr == 0) {
+      spdlog::warn("HttpReader::read(): body, socket {} disconnected", socket);
       throw std::runtime_error("");
     } else if (curr < 0) {
-      spdlog::warn("recv_one_http(): body");
-      quick_exit(EXIT_FAILURE);
+      spdlog::warn("HttpReader::read(): body, socket {} failed", socket);
+      throw std::runtime_error("");
     }
-    no_of_bytes_of_body_read += curr;
+    no_of_bytes_read += curr;
+    message_.set_size(no_of_bytes_read);
   }
-  buffer[no_of_bytes_of_header_read + no_of_bytes_of_body_read] = '\0';
+  buffer[no_of_bytes_read] = '\0';
+  return true;
+}
 
-  return no_of_bytes_of_header_read + no_of_bytes_of_body_read;
+BufferRef recv_chunks(Poller &poller, int socket, ChunkedDecoder &decoder,
+                      BufferPool &pool) {
+  BufferRef chunks{
+      acquire(pool, CHUNK_RELAY_READ_SIZE, "recv_chunks()", socket)};
+  chunks.set_size(recv_chunked(poller, socket, decoder, chunks.data(),
+                               CHUNK_RELAY_READ_SIZE, nullptr,
+                               "recv_chunks()"));
+  return chunks;
 }
 
 void send_one_http(int socket, const char *msg, size_t msg_len) {
   size_t no_of_bytes_sent{};
   while (no_of_bytes_sent < msg_len) {
-    long curr{
-        send(socket, msg + no_of_bytes_sent, msg_len - no_of_bytes_sent, 0)};
+    long curr{send(socket, msg + no_of_bytes_sent, msg_len - no_of_bytes_sent,
+                   MSG_NOSIGNAL)};
     if (curr == 0) {
       spdlog::warn("send_one_http(): socket {} disconnected", socket);
       throw std::runtime_error("");
     } else if (curr < 0) {
-      spdlog::warn("send_one_http()");
-      quick_exit(EXIT_FAILURE);
+      spdlog::warn("send_one_http(): socket {} failed", socket);
+      throw std::runtime_error("");
     }
     no_of_bytes_sent += curr;
   }
@@ -152,70 +357,36 @@ void parse_get_vid_mpd(const char *msg, std::string &path_to_video,
   }
 }
 
-void get_bitrate_of_video(
-    int socket, char *buffer,
+std::string vid_mpd_request(const std::string &path_to_video) {
+  return "GET " + path_to_video +
+         "/vid.mpd HTTP/1.1\r\ncontent-length: 0\r\n\r\n";
+}
+
+bool parse_bitrate_of_video(
+    const BufferRef &response,
     std::unordered_map<std::string, std::vector<int>> &bitrate_of_video,
+    std::unordered_map<std::string, double> &segment_duration_of_video,
     const std::string &path_to_video) {
-  const std::string mpd{"GET " + path_to_video +
-                        "/vid.mpd HTTP/1.1\r\ncontent-length: 0\r\n\r\n"};
-  size_t no_of_bytes_sent{};
-  while (no_of_bytes_sent < mpd.length()) {
-    long curr{send(socket, mpd.c_str() + no_of_bytes_sent,
-                   mpd.length() - no_of_bytes_sent, 0)};
-    if (curr == -1) {
-      spdlog::warn("get_bitrate_of_video(): send()");
-      quick_exit(EXIT_FAILURE);
-    }
-    no_of_bytes_sent += curr;
+  const char *header_end{strstr(response.data(), "\r\n\r\n")};
+  if (parse_status_code(response.data()) != 200 || header_end == nullptr) {
+    return false;
   }
+  char *body{response.data() + (header_end + 4 - response.data())};
+  size_t no_of_bytes_of_body_read{response.size() -
+                                  (body - response.data())};
 
-  size_t no_of_bytes_of_header_read{};
-  while (no_of_bytes_of_header_read < 4 ||
-         !is_header_end(buffer, no_of_bytes_of_header_read)) {
-    long curr{recv(socket, buffer + no_of_bytes_of_header_read, 1, 0)};
-    if (curr == -1) {
-      spdlog::warn("get_bitrate_of_video(): recv() header");
-      quick_exit(EXIT_FAILURE);
-    }
-    ++no_of_bytes_of_header_read;
+  std::vector<int> bitrates{};
+  double segment_duration{}, duration{};
+  if (!parse_video_mpd(body, no_of_bytes_of_body_read + 1, bitrates,
+                       segment_duration, duration) ||
+      bitrates.empty()) {
+    return false;
   }
-  buffer[no_of_bytes_of_header_read] = '\0';
-
-  int content_length{get_content_length(buffer)};
-  size_t no_of_bytes_of_body_read{};
-  while (no_of_bytes_of_body_read < content_length) {
-    long curr{recv(socket,
-                   buffer + no_of_bytes_of_body_read, // overwrites header
-                   content_length - no_of_bytes_of_body_read, 0)};
-    if (curr == -1) {
-      spdlog::warn("get_bitrate_of_video(): recv() body");
-      quick_exit(EXIT_FAILURE);
-    }
-    no_of_bytes_of_body_read += curr;
-  }
-  buffer[no_of_bytes_of_body_read] = '\0';
-
-  bitrate_of_video[path_to_video] = {};
-  pugi::xml_document xml;
-  pugi::xml_parse_result parsed_xml{
-      xml.load_buffer_inplace(buffer, no_of_bytes_of_body_read + 1)};
-  if (!parsed_xml) {
-    spdlog::warn("!parsed_xml");
-    quick_exit(EXIT_FAILURE);
-  }
-  for (pugi::xml_node adaptation_set :
-       xml.child("MPD").child("Period").children("AdaptationSet")) {
-    pugi::xml_attribute mime_type{adaptation_set.attribute("mimeType")};
-    if (mime_type && std::string{mime_type.value()} == "video/mp4") {
-      for (pugi::xml_node representation :
-           adaptation_set.children("Representation")) {
-        pugi::xml_attribute bandwidth{representation.attribute("bandwidth")};
-        if (bandwidth) {
-          bitrate_of_video[path_to_video].push_back(bandwidth.as_int());
-        }
-      }
-    }
+  bitrate_of_video[path_to_video] = std::move(bitrates);
+  if (segment_duration > 0) {
+    segment_duration_of_video[path_to_video] = segment_duration;
   }
+  return true;
 }
 
 bool is_get_vid_m4s(const char *msg) {
@@ -255,3 +426,67 @@ void parse_get_vid_m4s(const char *msg, std::string &path_to_video,
     quick_exit(EXIT_FAILURE);
   }
 }
+
+bool parse_path_to_video(const char *msg, std::string &path_to_video) {
+  try {
+    boost::cmatch capture_groups;
+    boost::regex path_to_video_regex{
+        "GET\\s*(.*)/(?:vid\\.mpd|video/vid-\\d+-seg-\\d+.m4s)",
+        boost::regex_constants::icase};
+    if (!boost::regex_search(msg, capture_groups, path_to_video_regex)) {
+      return false;
+    }
+    path_to_video = capture_groups[1].str();
+    return true;
+  } catch (const std::exception &e) {
+    std::cout << e.what() << '\n';
+    quick_exit(EXIT_FAILURE);
+  }
+}
+
+std::string parse_request_target(const char *msg) {
+  try {
+    boost::cmatch capture_groups;
+    boost::regex request_target_regex{"^[A-Z]+\\s+(\\S+)\\s+HTTP/"};
+    if (!boost::regex_search(msg, capture_groups, request_target_regex)) {
+      return "";
+    }
+    return capture_groups[1].str();
+  } catch (const std::exception &e) {
+    std::cout << e.what() << '\n';
+    quick_exit(EXIT_FAILURE);
+  }
+}
+
+int parse_status_code(const char *msg) {
+  try {
+    boost::cmatch capture_groups;
+    boost::regex status_code_regex{"^HTTP/\\d\\.\\d\\s+(\\d{3})"};
+    if (!boost::regex_search(msg, capture_groups, status_code_regex)) {
+      return 0;
+    }
+    return std::stoi(capture_groups[1].str());
+  } catch (const std::exception &e) {
+    std::cout << e.what() << '\n';
+    quick_exit(EXIT_FAILURE);
+  }
+}
+
+std::string parse_header_field(const char *msg, const std::string &name) {
+  try {
+    const char *header_end{strstr(msg, "\r\n\r\n")};
+    boost::cmatch capture_groups;
+    boost::regex field_regex{"\r\n" + name + ":\\s*([^\\r\\n]*)\r\n",
+                             boost::regex_constants::icase};
+    if (!boost::regex_search(msg,
+                             header_end == nullptr ? msg + strlen(msg)
+                                                   : header_end + 2,
+                             capture_groups, field_regex)) {
+      return "";
+    }
+    return capture_groups[1].str();
+  } catch (const std::exception &e) {
+    std::cout << e.what() << '\n';
+    quick_exit(EXIT_FAILURE);
+  }
+}
@@ -1,20 +1,117 @@
 #ifndef HTTP_H
 #define HTTP_H
 
+#include "buffer_pool.h"
+#include "chunked.h"
+#include "poller.h"
 #include "pugixml.hpp"
 #include "spdlog/spdlog.h"
 #include <boost/regex.hpp>
+#include <chrono>
 #include <cstddef>
 #include <cstdlib>
 #include <iostream>
+#include <string>
 #include <sys/socket.h>
+#include <unordered_map>
+#include <vector>
 
-#define MAX_VIDEO_SIZE (2 * 1000 * 1000)
+// How much of a message is peeked at per recv() while looking for the end of
+// its header.
+#define HTTP_HEADER_PEEK_SIZE 8192
+
+// Longer headers are taken for a broken connection.
+#define MAX_HTTP_HEADER_SIZE (16 * 1024)
+
+// As are longer bodies of messages read whole (requests, and responses the
+// proxy needs all of): the buffer of one is sized by its Content-Length, or
+// grows with its chunks, so a peer could otherwise have the proxy map as much
+// memory as it likes.
+#define MAX_HTTP_BODY_SIZE (64 * 1024 * 1024)
+
+// How much of a chunked response is relayed per recv_chunks().
+#define CHUNK_RELAY_READ_SIZE (64 * 1024)
+
+// Messages are read as they come in (see HttpReader), so that a peer that
+// sends one slowly holds up only its own connection. Still, it is given up
+// on if the header of a message is not all in this long after its first
+// byte, or its body this long after its header: deadlines on the timer wheel
+// of the poller.
+#define HTTP_HEADER_READ_TIMEOUT_MS 2000
+#define HTTP_BODY_READ_TIMEOUT_MS 10000
+
+// A client is disconnected if it sends no request this long after
+// connecting, or neither sends one nor takes any of its responses this long
+// later on.
+#define CLIENT_HEADER_TIMEOUT_MS 10000
+#define CLIENT_IDLE_TIMEOUT_MS 60000
 
 #define OK "HTTP/1.1 200 OK\r\ncontent-length: 0\r\n\r\n"
+#define SERVICE_UNAVAILABLE                                                    \
+  "HTTP/1.1 503 Service Unavailable\r\nconnection: close\r\n"                 \
+  "content-length: 0\r\n\r\n"
+
+// A message read from a socket as it comes in, across as many read()s as it
+// takes, none of which waits for more of it. Rather than one recv() per
+// byte, what has arrived (as the poller has it, see Poller::recv()) is
+// peeked at and consumed up to the end of the header, then of the body, so
+// that nothing past the end of the message (such as the next request a
+// client pipelined) is taken. Messages come in buffers from pool,
+// NUL-terminated. A chunked body read whole is decoded, and the message given
+// a Content-Length in place of its Transfer-Encoding.
+class HttpReader {
+public:
+  using Clock = std::chrono::steady_clock;
+
+  // What of the message has come in: none of it, part of its header, or all
+  // of its header and part of its body.
+  enum Phase { IDLE, HEADER, BODY };
+
+  // What has arrived of the message on socket. Returns the message once all
+  // of it is in, the reader then being IDLE for the next one, else an empty
+  // buffer. With is_chunked_relayed, a message whose body is chunked is
+  // returned as soon as its header is in, left as it is given, for the
+  // caller to relay the body with recv_chunks(). Throws std::runtime_error
+  // if the peer disconnects, the connection fails, the header or the body is
+  // too long, a chunk is malformed or there is no memory for the message.
+  BufferRef read(Poller &poller, int socket, BufferPool &pool,
+                 bool is_chunked_relayed = false);
+
+  Phase phase() const { return phase_; }
 
-size_t recv_one_http(int socket, char *buffer);
+  // When the first byte of the message being read, or else of the last one
+  // read, came in.
+  Clock::time_point started_at() const { return started_at_; }
 
+private:
+  // Whether all of the header, or the body, is in now.
+  bool read_header(Poller &poller, int socket, BufferPool &pool);
+  bool read_body(Poller &poller, int socket);
+
+  Phase phase_{IDLE};
+  Clock::time_point started_at_{};
+  // The header as it comes in, then the message with a Content-Length as its
+  // body does, or the chunked body decoded so far.
+  BufferRef header_{}, message_{};
+  size_t content_length_{};
+  bool is_chunked_{};
+  ChunkedDecoder decoder_{};
+  std::string body_{};
+};
+
+// Whether the body of msg is Transfer-Encoding: chunked.
+bool is_chunked(const char *msg);
+
+// What has arrived of a chunked body on socket, up to CHUNK_RELAY_READ_SIZE
+// bytes of it, framing and all, without waiting for more; nothing past its
+// end is consumed. decoder tracks the body across calls and is done once all
+// of it is in. Throws std::runtime_error if the peer disconnects, the
+// connection fails, a chunk is malformed or there is no memory for it.
+BufferRef recv_chunks(Poller &poller, int socket, ChunkedDecoder &decoder,
+                      BufferPool &pool);
+
+// Send all of msg, waiting for room if need be (requests, which are small).
+// Throws std::runtime_error if the connection fails.
 void send_one_http(int socket, const char *msg, size_t msg_len);
 
 bool is_post_on_fragment_received(const char *msg);
@@ -28,14 +125,37 @@ bool is_get_vid_mpd(const char *msg);
 void parse_get_vid_mpd(const char *msg, std::string &path_to_video,
                        std::string &uuid);
 
-void get_bitrate_of_video(
-    int socket, char *buffer,
+// The request for the full manifest of path_to_video.
+std::string vid_mpd_request(const std::string &path_to_video);
+
+// Record the video bitrates of path_to_video and, if stated, its segment
+// duration in seconds from response, its full manifest. Returns false, and
+// records nothing, unless response is a 200 with a manifest that lists
+// bitrates.
+bool parse_bitrate_of_video(
+    const BufferRef &response,
     std::unordered_map<std::string, std::vector<int>> &bitrate_of_video,
+    std::unordered_map<std::string, double> &segment_duration_of_video,
     const std::string &path_to_video);
 
 bool is_get_vid_m4s(const char *msg);
 
+// Extract the path of the video a vid.mpd or segment request is for. Returns
+// false for any other message.
+bool parse_path_to_video(const char *msg, std::string &path_to_video);
+
 void parse_get_vid_m4s(const char *msg, std::string &path_to_video,
                        std::string &uuid, std::string &segment_no);
 
+// The target of the HTTP request msg (e.g. /videos/x/vid.mpd), or "" if it
+// is not one.
+std::string parse_request_target(const char *msg);
+
+// The status code of the HTTP response msg, or 0 if it is not one.
+int parse_status_code(const char *msg);
+
+// The value of the header field name (matched case-insensitively) in the
+// header of msg, or "" if it has none.
+std::string parse_header_field(const char *msg, const std::string &name);
+
 #endif // !HTTP_H
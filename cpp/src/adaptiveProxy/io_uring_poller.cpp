@@ -0,0 +1,557 @@
+#include "io_uring_poller.h"
+
+#include "spdlog/spdlog.h"
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <poll.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+// The kind of a request (3 bits), the index of an accept (5 bits), the
+// generation of its watch or stream (24 bits) and its fd.
+#define GENERATION_MASK 0xffffff
+
+static uint64_t user_data_of(uint64_t kind, uint32_t generation, int fd,
+                             unsigned index = 0) {
+  return kind << 61 | static_cast<uint64_t>(index) << 56 |
+         static_cast<uint64_t>(generation & GENERATION_MASK) << 32 |
+         static_cast<uint32_t>(fd);
+}
+
+bool IoUringPoller::start() {
+  // Only this thread submits, so the kernel may skip the locking and the
+  // interrupts otherwise needed to post completions from other CPUs.
+  // A kernel older than 6.0, without multishot recvs, fails here.
+  io_uring_params params{};
+  params.flags = IORING_SETUP_SINGLE_ISSUER | IORING_SETUP_COOP_TASKRUN;
+  ring_fd_ = syscall(__NR_io_uring_setup, IO_URING_ENTRIES, &params);
+  if (ring_fd_ == -1) {
+    return false;
+  }
+
+  size_t sq_ring_size{params.sq_off.array +
+                      params.sq_entries * sizeof(unsigned)},
+      cq_ring_size{params.cq_off.cqes +
+                   params.cq_entries * sizeof(io_uring_cqe)};
+  bool is_single_mmap{(params.features & IORING_FEAT_SINGLE_MMAP) != 0};
+  if (is_single_mmap) {
+    sq_ring_size = cq_ring_size = std::max(sq_ring_size, cq_ring_size);
+  }
+  void *sq_ring{mmap(nullptr, sq_ring_size, PROT_READ | PROT_WRITE,
+                     MAP_SHARED | MAP_POPULATE, ring_fd_, IORING_OFF_SQ_RING)};
+  void *cq_ring{is_single_mmap
+                    ? sq_ring
+                    : mmap(nullptr, cq_ring_size, PROT_READ | PROT_WRITE,
+                           MAP_SHARED | MAP_POPULATE, ring_fd_,
+                           IORING_OFF_CQ_RING)};
+  void *sqes{mmap(nullptr, params.sq_entries * sizeof(io_uring_sqe),
+                  PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring_fd_,
+                  IORING_OFF_SQES)};
+  if (sq_ring == MAP_FAILED || cq_ring == MAP_FAILED || sqes == MAP_FAILED) {
+    close(ring_fd_);
+    return false;
+  }
+
+  char *sq{static_cast<char *>(sq_ring)}, *cq{static_cast<char *>(cq_ring)};
+  sq_head_ = reinterpret_cast<unsigned *>(sq + params.sq_off.head);
+  sq_tail_ = reinterpret_cast<unsigned *>(sq + params.sq_off.tail);
+  sq_mask_ = *reinterpret_cast<unsigned *>(sq + params.sq_off.ring_mask);
+  sq_entries_ = params.sq_entries;
+  sqe_tail_ = *sq_tail_;
+  // Slot i of the submission queue always holds SQE i.
+  unsigned *sq_array{reinterpret_cast<unsigned *>(sq + params.sq_off.array)};
+  for (unsigned i{0}; i < sq_entries_; ++i) {
+    sq_array[i] = i;
+  }
+  sqes_ = static_cast<io_uring_sqe *>(sqes);
+  cq_head_ = reinterpret_cast<unsigned *>(cq + params.cq_off.head);
+  cq_tail_ = reinterpret_cast<unsigned *>(cq + params.cq_off.tail);
+  cq_mask_ = *reinterpret_cast<unsigned *>(cq + params.cq_off.ring_mask);
+  cqes_ = reinterpret_cast<io_uring_cqe *>(cq + params.cq_off.cqes);
+  if (!provide_recv_buffers()) {
+    close(ring_fd_);
+    return false;
+  }
+  return true;
+}
+
+bool IoUringPoller::provide_recv_buffers() {
+  size_t ring_size{IO_URING_RECV_BUFFERS * sizeof(io_uring_buf)},
+      buffers_size{static_cast<size_t>(IO_URING_RECV_BUFFERS) *
+                   IO_URING_RECV_BUFFER_SIZE};
+  void *ring{mmap(nullptr, ring_size, PROT_READ | PROT_WRITE,
+                  MAP_PRIVATE | MAP_ANONYMOUS | MAP_POPULATE, -1, 0)};
+  void *buffers{mmap(nullptr, buffers_size, PROT_READ | PROT_WRITE,
+                     MAP_PRIVATE | MAP_ANONYMOUS, -1, 0)};
+  io_uring_buf_reg reg{};
+  reg.ring_addr = reinterpret_cast<uint64_t>(ring);
+  reg.ring_entries = IO_URING_RECV_BUFFERS;
+  reg.bgid = 0;
+  if (ring == MAP_FAILED || buffers == MAP_FAILED ||
+      syscall(__NR_io_uring_register, ring_fd_, IORING_REGISTER_PBUF_RING,
+              &reg, 1) == -1) {
+    if (ring != MAP_FAILED) {
+      munmap(ring, ring_size);
+    }
+    if (buffers != MAP_FAILED) {
+      munmap(buffers, buffers_size);
+    }
+    return false;
+  }
+  recv_buffer_ring_ = static_cast<io_uring_buf *>(ring);
+  recv_buffers_ = static_cast<char *>(buffers);
+  for (unsigned id{0}; id < IO_URING_RECV_BUFFERS; ++id) {
+    provide(id);
+  }
+  return true;
+}
+
+void IoUringPoller::provide(uint16_t id) {
+  // Field by field: the tail of the ring overlays the first entry.
+  io_uring_buf &buf{
+      recv_buffer_ring_[recv_buffer_ring_tail_ & (IO_URING_RECV_BUFFERS - 1)]};
+  buf.addr = reinterpret_cast<uint64_t>(
+      recv_buffers_ + static_cast<size_t>(id) * IO_URING_RECV_BUFFER_SIZE);
+  buf.len = IO_URING_RECV_BUFFER_SIZE;
+  buf.bid = id;
+  __atomic_store_n(
+      &reinterpret_cast<io_uring_buf_ring *>(recv_buffer_ring_)->tail,
+      ++recv_buffer_ring_tail_, __ATOMIC_RELEASE);
+  ++no_of_provided_;
+}
+
+void IoUringPoller::add(int fd, bool is_writable) {
+  uint32_t poll_mask{static_cast<uint32_t>(is_writable ? POLLOUT : POLLIN)};
+  Watch &watch{watch_of_fd_[fd] = {next_generation_++, poll_mask, false,
+                                   false}};
+  arm(fd, watch);
+}
+
+void IoUringPoller::add_socket(int fd) {
+  Stream &stream{stream_of_fd_[fd] = {next_generation_++, false, {}, OPEN,
+                                      nullptr, false, 0}};
+  arm_recv(fd, stream);
+}
+
+void IoUringPoller::watch_writable(int fd, bool is_watched) {
+  if (stream_of_fd_.contains(fd)) {
+    // Reported writable once its send completes.
+    return;
+  }
+  Watch &watch{watch_of_fd_.at(fd)};
+  watch.poll_mask = is_watched ? POLLIN | POLLOUT : POLLIN;
+  if (watch.is_armed) {
+    // Replace the poll in flight; otherwise the re-arm picks up the mask.
+    cancel(fd, watch);
+    watch.generation = next_generation_++;
+    arm(fd, watch);
+  }
+}
+
+void IoUringPoller::remove(int fd) {
+  clear_deadline(fd);
+  auto stream_it{stream_of_fd_.find(fd)};
+  if (stream_it != stream_of_fd_.end()) {
+    Stream &stream{stream_it->second};
+    bool is_in_flight{stream.is_recv_armed || stream.is_sending};
+    if (stream.is_recv_armed) {
+      cancel(user_data_of(RECV, stream.generation, fd), fd);
+    }
+    if (stream.is_sending) {
+      // What it sends stays alive until it is done with.
+      uint64_t user_data{user_data_of(SEND, stream.generation, fd)};
+      cancel(user_data, fd);
+      retired_sends_[user_data] = std::move(stream.send);
+    }
+    for (const Received &received : stream.received) {
+      provide(received.id);
+    }
+    readable_.erase(fd);
+    sent_.erase(fd);
+    stream_of_fd_.erase(stream_it);
+    // Cancelled now rather than on the next wait(): the socket may be sent a
+    // request and added again before then (an idle videoserver connection
+    // taken for a client), and the recv would take the response with it.
+    if (is_in_flight && enter(0) == -1) {
+      spdlog::warn("io_uring_enter()");
+      quick_exit(EXIT_FAILURE);
+    }
+    return;
+  }
+  auto it{watch_of_fd_.find(fd)};
+  if (it == watch_of_fd_.end()) {
+    return;
+  }
+  if (it->second.is_armed || it->second.is_listener) {
+    // The request holds its own reference to the file, so it would outlive
+    // closing fd.
+    cancel(fd, it->second);
+  }
+  watch_of_fd_.erase(it);
+}
+
+void IoUringPoller::add_listener(int fd) {
+  Watch &watch{watch_of_fd_[fd] = {next_generation_++, 0, true, false}};
+  arm(fd, watch);
+}
+
+long IoUringPoller::recv(int fd, void *buffer, size_t length, int flags) {
+  auto it{stream_of_fd_.find(fd)};
+  if (it == stream_of_fd_.end()) {
+    return recv_now(fd, buffer, length, flags);
+  }
+  Stream &stream{it->second};
+  char *to{static_cast<char *>(buffer)};
+  size_t no_of_bytes{0};
+  auto received_it{stream.received.begin()};
+  while (received_it != stream.received.end() && no_of_bytes < length) {
+    Received &received{*received_it};
+    size_t curr{std::min<size_t>(length - no_of_bytes,
+                                 received.length - received.offset)};
+    memcpy(to + no_of_bytes,
+           recv_buffers_ +
+               static_cast<size_t>(received.id) * IO_URING_RECV_BUFFER_SIZE +
+               received.offset,
+           curr);
+    no_of_bytes += curr;
+    if ((flags & MSG_PEEK) != 0 ||
+        (received.offset += curr) < received.length) {
+      ++received_it;
+    } else {
+      provide(received.id);
+      received_it = stream.received.erase(received_it);
+    }
+  }
+  if (no_of_bytes > 0) {
+    return no_of_bytes;
+  } else if (stream.end == OPEN) {
+    errno = EAGAIN;
+    return -1;
+  } else if (stream.end < 0) {
+    errno = -stream.end;
+    return -1;
+  }
+  return 0;
+}
+
+long IoUringPoller::send(int fd, const iovec *iovs, const BufferRef *buffers,
+                         int no_of_iovs) {
+  auto it{stream_of_fd_.find(fd)};
+  if (it == stream_of_fd_.end()) {
+    return send_now(fd, iovs, no_of_iovs);
+  }
+  Stream &stream{it->second};
+  if (!stream.is_sending) {
+    if (stream.send == nullptr) {
+      stream.send = std::make_unique<Send>();
+    }
+    Send &send{*stream.send};
+    send.iovs.assign(iovs, iovs + no_of_iovs);
+    send.buffers.assign(buffers, buffers + no_of_iovs);
+    send.msg = {};
+    send.msg.msg_iov = send.iovs.data();
+    send.msg.msg_iovlen = send.iovs.size();
+    // Without MSG_WAITALL, it completes with what the socket took once it
+    // took some, rather than holding on for a slow client.
+    io_uring_sqe *sqe{get_sqe()};
+    sqe->opcode = IORING_OP_SENDMSG;
+    sqe->fd = fd;
+    sqe->addr = reinterpret_cast<uint64_t>(&send.msg);
+    sqe->len = 1;
+    sqe->msg_flags = MSG_NOSIGNAL;
+    sqe->user_data = user_data_of(SEND, stream.generation, fd);
+    stream.is_sending = true;
+  }
+  errno = EINPROGRESS;
+  return -1;
+}
+
+long IoUringPoller::take_sent(int fd) {
+  auto it{stream_of_fd_.find(fd)};
+  if (it == stream_of_fd_.end() || it->second.is_sending) {
+    return 0;
+  }
+  long sent{std::exchange(it->second.sent, 0)};
+  if (sent < 0) {
+    errno = -sent;
+    return -1;
+  }
+  return sent;
+}
+
+int IoUringPoller::wait_for(PollEvent *events, int max_no_of_events,
+                            int timeout_ms) {
+  for (auto [fd, generation] : to_rearm_) {
+    auto it{watch_of_fd_.find(fd)};
+    if (it != watch_of_fd_.end() && it->second.generation == generation &&
+        !it->second.is_armed) {
+      arm(fd, it->second);
+    }
+  }
+  to_rearm_.clear();
+  // No more recvs than there are buffers for, or the rest would run out
+  // again right away.
+  for (unsigned no_of_armed{0};
+       !to_arm_recv_.empty() && no_of_armed < no_of_provided_;
+       to_arm_recv_.pop_front()) {
+    auto [fd, generation]{to_arm_recv_.front()};
+    auto it{stream_of_fd_.find(fd)};
+    if (it != stream_of_fd_.end() && it->second.generation == generation &&
+        !it->second.is_recv_armed && it->second.end == OPEN) {
+      arm_recv(fd, it->second);
+      ++no_of_armed;
+    }
+  }
+  // Like level-triggered epoll, a socket with something left to read is
+  // reported again, without waiting.
+  std::erase_if(readable_, [this](int fd) {
+    const Stream &stream{stream_of_fd_.at(fd)};
+    return stream.received.empty() && stream.end == OPEN;
+  });
+  if (!readable_.empty()) {
+    timeout_ms = 0;
+  }
+
+  // A wait that submits requests does not report that it timed out, so the
+  // time left is counted here.
+  std::chrono::steady_clock::time_point deadline{
+      std::chrono::steady_clock::now() +
+      std::chrono::milliseconds{std::max(timeout_ms, 0)}};
+  int no_of_events{0};
+  while (true) {
+    int remaining_ms{-1};
+    if (timeout_ms >= 0) {
+      remaining_ms = std::max(
+          0, static_cast<int>(std::chrono::ceil<std::chrono::milliseconds>(
+                                  deadline - std::chrono::steady_clock::now())
+                                  .count()));
+    }
+    if (enter(remaining_ms == 0 ? 0 : 1, remaining_ms) == -1 &&
+        errno != ETIME) {
+      if (errno == EINTR) {
+        continue;
+      }
+      spdlog::warn("io_uring_enter()");
+      return -1;
+    }
+    // Completions for sockets are reported after the others, one event per
+    // socket.
+    unsigned head{*cq_head_}, tail{__atomic_load_n(cq_tail_, __ATOMIC_ACQUIRE)};
+    for (; head != tail && no_of_events + readable_.size() + sent_.size() <
+                               static_cast<size_t>(max_no_of_events);
+         ++head) {
+      complete(cqes_[head & cq_mask_], events, no_of_events);
+    }
+    __atomic_store_n(cq_head_, head, __ATOMIC_RELEASE);
+    for (int fd : readable_) {
+      events[no_of_events++] = {fd, -1, {}, true, sent_.erase(fd) > 0, false};
+    }
+    for (int fd : sent_) {
+      events[no_of_events++] = {fd, -1, {}, false, true, false};
+    }
+    sent_.clear();
+    if (no_of_events > 0 || remaining_ms == 0) {
+      return no_of_events;
+    }
+  }
+}
+
+void IoUringPoller::arm(int fd, Watch &watch) {
+  watch.is_armed = true;
+  if (!watch.is_listener) {
+    io_uring_sqe *sqe{get_sqe()};
+    sqe->opcode = IORING_OP_POLL_ADD;
+    sqe->fd = fd;
+    sqe->poll32_events = watch.poll_mask;
+    sqe->user_data = user_data_of(POLL, watch.generation, fd);
+    return;
+  }
+  std::array<Accept, IO_URING_ACCEPTS> &accepts{accepts_of_fd_[fd]};
+  for (unsigned i{0}; i < accepts.size(); ++i) {
+    Accept &accept{accepts[i]};
+    if (accept.is_in_flight) {
+      // Possibly one of a previous watch, being cancelled.
+      watch.is_armed = watch.is_armed && accept.generation == watch.generation;
+      continue;
+    }
+    accept = {{}, sizeof(accept.addr), watch.generation, true};
+    io_uring_sqe *sqe{get_sqe()};
+    sqe->opcode = IORING_OP_ACCEPT;
+    sqe->fd = fd;
+    sqe->addr = reinterpret_cast<uint64_t>(&accept.addr);
+    sqe->addr2 = reinterpret_cast<uint64_t>(&accept.addr_len);
+    sqe->user_data = user_data_of(ACCEPT, watch.generation, fd, i);
+  }
+}
+
+void IoUringPoller::arm_recv(int fd, Stream &stream) {
+  if (no_of_provided_ == 0) {
+    to_arm_recv_.push_back({fd, stream.generation});
+    return;
+  }
+  stream.is_recv_armed = true;
+  io_uring_sqe *sqe{get_sqe()};
+  sqe->opcode = IORING_OP_RECV;
+  sqe->fd = fd;
+  sqe->ioprio = IORING_RECV_MULTISHOT;
+  sqe->flags = IOSQE_BUFFER_SELECT;
+  sqe->buf_group = 0;
+  sqe->user_data = user_data_of(RECV, stream.generation, fd);
+}
+
+void IoUringPoller::cancel(int fd, const Watch &watch) {
+  if (!watch.is_listener) {
+    cancel(user_data_of(POLL, watch.generation, fd), fd);
+    return;
+  }
+  std::array<Accept, IO_URING_ACCEPTS> &accepts{accepts_of_fd_.at(fd)};
+  for (unsigned i{0}; i < accepts.size(); ++i) {
+    if (accepts[i].is_in_flight && accepts[i].generation == watch.generation) {
+      cancel(user_data_of(ACCEPT, watch.generation, fd, i), fd);
+    }
+  }
+}
+
+void IoUringPoller::cancel(uint64_t user_data, int fd) {
+  io_uring_sqe *sqe{get_sqe()};
+  sqe->opcode = IORING_OP_ASYNC_CANCEL;
+  sqe->fd = -1;
+  sqe->addr = user_data;
+  sqe->user_data = user_data_of(CANCEL, 0, fd);
+}
+
+io_uring_sqe *IoUringPoller::get_sqe() {
+  if (sqe_tail_ - __atomic_load_n(sq_head_, __ATOMIC_ACQUIRE) == sq_entries_ &&
+      enter(0) == -1) {
+    spdlog::warn("io_uring_enter()");
+    quick_exit(EXIT_FAILURE);
+  }
+  io_uring_sqe *sqe{&sqes_[sqe_tail_++ & sq_mask_]};
+  memset(sqe, 0, sizeof(*sqe));
+  return sqe;
+}
+
+int IoUringPoller::enter(unsigned min_complete, int timeout_ms) {
+  __atomic_store_n(sq_tail_, sqe_tail_, __ATOMIC_RELEASE);
+  unsigned to_submit{sqe_tail_ - __atomic_load_n(sq_head_, __ATOMIC_ACQUIRE)};
+  if (min_complete == 0 || timeout_ms < 0) {
+    return syscall(__NR_io_uring_enter, ring_fd_, to_submit, min_complete,
+                   min_complete > 0 ? IORING_ENTER_GETEVENTS : 0, nullptr, 0);
+  }
+  __kernel_timespec timeout{timeout_ms / 1000,
+                            (timeout_ms % 1000) * 1000000LL};
+  io_uring_getevents_arg arg{};
+  arg.ts = reinterpret_cast<uint64_t>(&timeout);
+  return syscall(__NR_io_uring_enter, ring_fd_, to_submit, min_complete,
+                 IORING_ENTER_GETEVENTS | IORING_ENTER_EXT_ARG, &arg,
+                 sizeof(arg));
+}
+
+void IoUringPoller::complete(const io_uring_cqe &cqe, PollEvent *events,
+                             int &no_of_events) {
+  uint64_t kind{cqe.user_data >> 61};
+  unsigned index{static_cast<unsigned>(cqe.user_data >> 56) & 0x1f};
+  uint32_t generation{static_cast<uint32_t>(cqe.user_data >> 32) &
+                      GENERATION_MASK};
+  int fd{static_cast<int>(static_cast<uint32_t>(cqe.user_data))};
+  if (kind == RECV) {
+    complete_recv(cqe, fd, generation);
+    return;
+  } else if (kind == SEND) {
+    complete_send(cqe, fd, generation);
+    return;
+  }
+  auto it{watch_of_fd_.find(fd)};
+  bool is_stale{kind == CANCEL || it == watch_of_fd_.end() ||
+                (it->second.generation & GENERATION_MASK) != generation};
+  if (kind == ACCEPT) {
+    Accept &accept{accepts_of_fd_.at(fd)[index]};
+    accept.is_in_flight = false;
+    if (it != watch_of_fd_.end() && it->second.is_listener) {
+      // The accept is free for the listen socket as it is now.
+      it->second.is_armed = false;
+      to_rearm_.push_back({fd, it->second.generation});
+    }
+    if (is_stale) {
+      // A connection accepted for a listener removed meanwhile is closed;
+      // its client connects again.
+      if (cqe.res >= 0) {
+        close(cqe.res);
+      }
+      return;
+    }
+    events[no_of_events++] = {
+        fd, cqe.res < 0 ? -1 : cqe.res, accept.addr, true, false, false};
+    return;
+  } else if (is_stale) {
+    // Left over from a removed fd.
+    return;
+  }
+  Watch &watch{it->second};
+  watch.is_armed = false;
+  to_rearm_.push_back({fd, watch.generation});
+  // A failed poll is reported as readable, so that reading finds out why.
+  uint32_t ready{cqe.res < 0 ? POLLERR : static_cast<uint32_t>(cqe.res)};
+  events[no_of_events++] = {fd,
+                            -1,
+                            {},
+                            (ready & (POLLIN | POLLERR | POLLHUP)) != 0,
+                            (ready & POLLOUT) != 0,
+                            false};
+}
+
+void IoUringPoller::complete_recv(const io_uring_cqe &cqe, int fd,
+                                  uint32_t generation) {
+  bool has_buffer{(cqe.flags & IORING_CQE_F_BUFFER) != 0};
+  uint16_t id{static_cast<uint16_t>(cqe.flags >> IORING_CQE_BUFFER_SHIFT)};
+  if (has_buffer) {
+    --no_of_provided_;
+  }
+  auto it{stream_of_fd_.find(fd)};
+  if (it == stream_of_fd_.end() ||
+      (it->second.generation & GENERATION_MASK) != generation) {
+    // Left over from a removed socket.
+    if (has_buffer) {
+      provide(id);
+    }
+    return;
+  }
+  Stream &stream{it->second};
+  if ((cqe.flags & IORING_CQE_F_MORE) == 0) {
+    stream.is_recv_armed = false;
+  }
+  if (cqe.res > 0) {
+    stream.received.push_back({id, 0, static_cast<uint32_t>(cqe.res)});
+    readable_.insert(fd);
+  } else {
+    if (has_buffer) {
+      provide(id);
+    }
+    // Out of buffers, the recv is armed again once some are read.
+    if (cqe.res != -ENOBUFS) {
+      stream.end = cqe.res;
+      readable_.insert(fd);
+    }
+  }
+  if (!stream.is_recv_armed && stream.end == OPEN) {
+    to_arm_recv_.push_back({fd, stream.generation});
+  }
+}
+
+void IoUringPoller::complete_send(const io_uring_cqe &cqe, int fd,
+                                  uint32_t generation) {
+  auto it{stream_of_fd_.find(fd)};
+  if (it == stream_of_fd_.end() ||
+      (it->second.generation & GENERATION_MASK) != generation) {
+    retired_sends_.erase(cqe.user_data);
+    return;
+  }
+  Stream &stream{it->second};
+  stream.is_sending = false;
+  stream.sent = cqe.res;
+  stream.send->buffers.clear();
+  sent_.insert(fd);
+}
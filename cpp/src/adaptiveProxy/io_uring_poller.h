@@ -0,0 +1,153 @@
+#ifndef IO_URING_POLLER_H
+#define IO_URING_POLLER_H
+
+#include "poller.h"
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <linux/io_uring.h>
+#include <memory>
+#include <sys/socket.h>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+// A Poller on io_uring, talking to the kernel through the raw syscalls.
+//
+// Every watched fd has one poll request in flight. Once it completes, the fd
+// is reported and its poll is re-armed on the next wait(), after the caller
+// has read from it, so readiness is level-triggered like epoll. The re-arms
+// and removals queued since the last wait() go to the kernel in the same
+// io_uring_enter() that waits, so unlike epoll_ctl() they cost no syscall
+// of their own. Listen sockets keep IO_URING_ACCEPTS accepts in flight, which
+// hand over new connections without an accept() call. Each accept has an
+// address of its own for its peer: a multishot accept would write the
+// address of every connection to the same one, before it is read.
+//
+// Connected sockets are not polled but read and written by the kernel.
+// Each has a multishot recv in flight, which fills buffers the kernel picks
+// from a ring of IO_URING_RECV_BUFFERS provided to it, so that idle
+// connections hold none. What came in waits in them for recv() to copy it
+// out, and each buffer goes back to the ring once it is all read. Sends go
+// in the ring too, as one sendmsg() of the buffers queued, and the
+// poller holds references to them until it completes. Needs Linux 6.0.
+//
+// Experimental: the copy out of the ring's buffers makes it take more CPU
+// than epoll on large messages, fewer syscalls notwithstanding.
+
+#define IO_URING_ENTRIES 4096
+#define IO_URING_ACCEPTS 16
+// A power of 2.
+#define IO_URING_RECV_BUFFERS 256
+#define IO_URING_RECV_BUFFER_SIZE (64 * 1024)
+
+class IoUringPoller : public Poller {
+public:
+  bool start() override;
+  void add(int fd, bool is_writable = false) override;
+  void add_socket(int fd) override;
+  void watch_writable(int fd, bool is_watched) override;
+  void remove(int fd) override;
+  void add_listener(int fd) override;
+  long recv(int fd, void *buffer, size_t length, int flags) override;
+  long send(int fd, const iovec *iovs, const BufferRef *buffers,
+            int no_of_iovs) override;
+  long take_sent(int fd) override;
+
+protected:
+  int wait_for(PollEvent *events, int max_no_of_events,
+               int timeout_ms) override;
+
+private:
+  struct Watch {
+    uint32_t generation; // Tells completions for a reused fd apart.
+    uint32_t poll_mask;
+    // For a listen socket, whether all of its accepts are in flight.
+    bool is_listener, is_armed;
+  };
+  // An accept of a listen socket and the address it fills in. It stays in
+  // flight after the listen socket is removed until it is cancelled, so it
+  // outlives the Watch.
+  struct Accept {
+    sockaddr_in addr;
+    socklen_t addr_len;
+    uint32_t generation;
+    bool is_in_flight;
+  };
+  // Part of a buffer of the ring that came in on a socket and is not read
+  // yet.
+  struct Received {
+    uint16_t id;
+    uint32_t offset, length;
+  };
+  // A sendmsg() and what it sends. It stays in flight after its socket is
+  // removed until it is cancelled, so it outlives the Stream.
+  struct Send {
+    msghdr msg;
+    std::vector<iovec> iovs;
+    std::vector<BufferRef> buffers;
+  };
+  // A connected socket.
+  struct Stream {
+    uint32_t generation;
+    bool is_recv_armed;
+    std::deque<Received> received;
+    // OPEN, then 0 once the peer closed the connection or -errno once it
+    // failed; recv() reports it after all that came in before.
+    int end;
+    std::unique_ptr<Send> send;
+    bool is_sending;
+    // What the last send completed with, until take_sent().
+    long sent;
+  };
+  static constexpr int OPEN{1};
+  enum Kind : uint64_t { POLL, ACCEPT, CANCEL, RECV, SEND };
+
+  bool provide_recv_buffers();
+  // Put back buffer id of the ring for the kernel to fill.
+  void provide(uint16_t id);
+  void arm(int fd, Watch &watch);
+  void arm_recv(int fd, Stream &stream);
+  void cancel(int fd, const Watch &watch);
+  void cancel(uint64_t user_data, int fd);
+  io_uring_sqe *get_sqe();
+  // Submit the queued requests and wait for at least min_complete
+  // completions, at most timeout_ms (-1 for no limit).
+  int enter(unsigned min_complete, int timeout_ms = -1);
+  void complete(const io_uring_cqe &cqe, PollEvent *events,
+                int &no_of_events);
+  void complete_recv(const io_uring_cqe &cqe, int fd, uint32_t generation);
+  void complete_send(const io_uring_cqe &cqe, int fd, uint32_t generation);
+
+  int ring_fd_{-1};
+  unsigned *sq_head_, *sq_tail_, sq_mask_, sq_entries_, sqe_tail_{};
+  io_uring_sqe *sqes_;
+  unsigned *cq_head_, *cq_tail_, cq_mask_;
+  io_uring_cqe *cqes_;
+  uint32_t next_generation_{};
+  std::unordered_map<int, Watch> watch_of_fd_;
+  std::unordered_map<int, std::array<Accept, IO_URING_ACCEPTS>>
+      accepts_of_fd_;
+  // (fd, generation) reported by the last wait().
+  std::vector<std::pair<int, uint32_t>> to_rearm_;
+
+  // The ring of buffers provided for recvs, its tail, and the buffers.
+  io_uring_buf *recv_buffer_ring_{};
+  uint16_t recv_buffer_ring_tail_{};
+  char *recv_buffers_{};
+  // How many buffers the kernel has to fill, as far as completions tell.
+  unsigned no_of_provided_{};
+  std::unordered_map<int, Stream> stream_of_fd_;
+  // (fd, generation) whose recv ended while they are open, such as when
+  // the ring ran out of buffers; armed again in turn on the next wait()s.
+  std::deque<std::pair<int, uint32_t>> to_arm_recv_;
+  // Sockets with something for recv() or take_sent(), reported on the next
+  // wait().
+  std::unordered_set<int> readable_, sent_;
+  // The sends of removed sockets, by user_data, until they complete.
+  std::unordered_map<uint64_t, std::unique_ptr<Send>> retired_sends_;
+};
+
+#endif // !IO_URING_POLLER_H
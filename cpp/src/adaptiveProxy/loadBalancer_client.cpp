@@ -0,0 +1,71 @@
+#include "loadBalancer_client.h"
+
+#include "Random.h"
+#include "network_utils.h"
+#include "spdlog/spdlog.h"
+#include <stdexcept>
+#include <sys/socket.h>
+#include <unistd.h>
+
+LoadBalancerResponse query_load_balancer(const char *hostname, int port,
+                                         in_addr_t client_addr,
+                                         const std::string &content_key) {
+  in_addr_t loadBalancer_addr;
+  int loadBalancer_socket{-1};
+  if (resolve_hostname(hostname, loadBalancer_addr)) {
+    loadBalancer_socket = try_get_outbound_socket(
+        loadBalancer_addr, htons(static_cast<uint16_t>(port)),
+        LOADBALANCER_CONNECT_TIMEOUT_MS);
+  }
+  if (loadBalancer_socket == -1) {
+    spdlog::warn("Load balancer {}:{} is unreachable", hostname, port);
+    throw LoadBalancerUnreachable("load balancer unreachable");
+  }
+
+  LoadBalancerRequest loadBalancer_request;
+  loadBalancer_request.client_addr = client_addr;
+  loadBalancer_request.request_id = htons(Random::get(0, UINT16_MAX));
+  loadBalancer_request.content_key_len = htons(static_cast<uint16_t>(
+      std::min<size_t>(content_key.length(), MAX_CONTENT_KEY_LEN)));
+  std::string msg{(const char *)&loadBalancer_request,
+                  sizeof(loadBalancer_request)};
+  msg.append(content_key, 0, ntohs(loadBalancer_request.content_key_len));
+  size_t no_of_bytes_sent{};
+  while (no_of_bytes_sent < msg.length()) {
+    long curr{send(loadBalancer_socket, msg.c_str() + no_of_bytes_sent,
+                   msg.length() - no_of_bytes_sent, MSG_NOSIGNAL)};
+    if (curr == -1) {
+      spdlog::warn("loadBalancer_request send()");
+      close(loadBalancer_socket);
+      throw LoadBalancerUnreachable("load balancer disconnected");
+    }
+    no_of_bytes_sent += curr;
+  }
+
+  LoadBalancerResponse loadBalancer_response;
+  size_t no_of_bytes_read{};
+  while (no_of_bytes_read < sizeof(loadBalancer_response)) {
+    long curr{recv(loadBalancer_socket,
+                   (char *)&loadBalancer_response + no_of_bytes_read,
+                   sizeof(loadBalancer_response) - no_of_bytes_read, 0)};
+    if (curr == -1) {
+      spdlog::warn("loadBalancer_request recv()");
+      close(loadBalancer_socket);
+      throw LoadBalancerUnreachable("load balancer disconnected");
+    } else if (curr == 0) {
+      // The load balancer hangs up on clients it cannot serve.
+      close(loadBalancer_socket);
+      throw std::runtime_error("load balancer has no videoserver for client");
+    }
+    no_of_bytes_read += curr;
+  }
+  if (close(loadBalancer_socket) == -1) {
+    spdlog::warn("close()");
+    quick_exit(EXIT_FAILURE);
+  }
+  if (loadBalancer_response.request_id != loadBalancer_request.request_id) {
+    spdlog::warn("loadBalancer request_id");
+    quick_exit(EXIT_FAILURE);
+  }
+  return loadBalancer_response;
+}
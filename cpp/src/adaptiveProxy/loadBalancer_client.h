@@ -0,0 +1,26 @@
+#ifndef LOADBALANCER_CLIENT_H
+#define LOADBALANCER_CLIENT_H
+
+#include "loadBalancer_protocol.h"
+#include <stdexcept>
+#include <string>
+
+#define LOADBALANCER_CONNECT_TIMEOUT_MS 500
+
+// Thrown when the load balancer cannot be reached or fails mid-query, as
+// opposed to refusing the client.
+class LoadBalancerUnreachable : public std::runtime_error {
+public:
+  using std::runtime_error::runtime_error;
+};
+
+// Ask the load balancer at hostname:port which videoserver should serve the
+// client at client_addr (network byte order), optionally for a particular
+// content key such as the path of the video being watched. Throws
+// std::runtime_error if the load balancer cannot serve the client, and
+// LoadBalancerUnreachable if it cannot be reached.
+LoadBalancerResponse query_load_balancer(const char *hostname, int port,
+                                         in_addr_t client_addr,
+                                         const std::string &content_key);
+
+#endif // !LOADBALANCER_CLIENT_H
@@ -0,0 +1,85 @@
+#include "load_reporter.h"
+
+#include "network_utils.h"
+#include "spdlog/spdlog.h"
+#include <sys/timerfd.h>
+#include <unistd.h>
+
+void LoadReporter::start(const char *hostname, int port) {
+  socket_ = get_outbound_udp_socket(hostname, port);
+  if ((timer_fd_ = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC)) == -1) {
+    spdlog::warn("timerfd_create()");
+    quick_exit(EXIT_FAILURE);
+  }
+  itimerspec interval{};
+  interval.it_interval.tv_sec = LOAD_REPORT_INTERVAL_MS / 1000;
+  interval.it_interval.tv_nsec = (LOAD_REPORT_INTERVAL_MS % 1000) * 1000000L;
+  interval.it_value = interval.it_interval;
+  if (timerfd_settime(timer_fd_, 0, &interval, nullptr) == -1) {
+    spdlog::warn("timerfd_settime()");
+    quick_exit(EXIT_FAILURE);
+  }
+}
+
+void LoadReporter::add_session(int videoserver_socket,
+                               in_addr_t videoserver_addr,
+                               uint16_t videoserver_port) {
+  if (timer_fd_ == -1) {
+    return;
+  }
+  uint64_t videoserver{(static_cast<uint64_t>(videoserver_addr) << 16) |
+                       videoserver_port};
+  videoserver_of_socket_[videoserver_socket] = videoserver;
+  Load &load{load_of_videoserver_[videoserver]};
+  load.videoserver_addr = videoserver_addr;
+  load.videoserver_port = videoserver_port;
+  ++load.active_sessions;
+}
+
+void LoadReporter::remove_session(int videoserver_socket) {
+  auto it{videoserver_of_socket_.find(videoserver_socket)};
+  if (it == videoserver_of_socket_.end()) {
+    return;
+  }
+  --load_of_videoserver_[it->second].active_sessions;
+  videoserver_of_socket_.erase(it);
+}
+
+void LoadReporter::add_egress(int videoserver_socket, size_t no_of_bytes) {
+  auto it{videoserver_of_socket_.find(videoserver_socket)};
+  if (it == videoserver_of_socket_.end()) {
+    return;
+  }
+  load_of_videoserver_[it->second].no_of_bytes += no_of_bytes;
+}
+
+void LoadReporter::send_reports() {
+  uint64_t no_of_expirations;
+  if (read(timer_fd_, &no_of_expirations, sizeof(no_of_expirations)) == -1) {
+    spdlog::warn("LoadReporter::send_reports(): read()");
+    return;
+  }
+
+  for (auto it{load_of_videoserver_.begin()};
+       it != load_of_videoserver_.end();) {
+    Load &load{it->second};
+    LoadReport report;
+    report.videoserver_addr = load.videoserver_addr;
+    report.videoserver_port = load.videoserver_port;
+    report.report_interval_ms = htons(LOAD_REPORT_INTERVAL_MS);
+    report.active_sessions = htonl(load.active_sessions);
+    report.egress_kbps = htonl(static_cast<uint32_t>(
+        load.no_of_bytes * 8 / no_of_expirations / LOAD_REPORT_INTERVAL_MS));
+    if (send(socket_, &report, sizeof(report), MSG_DONTWAIT) == -1) {
+      spdlog::warn("LoadReporter::send_reports(): send()");
+    }
+    load.no_of_bytes = 0;
+
+    // A videoserver is reported idle once before being forgotten.
+    if (load.active_sessions == 0) {
+      it = load_of_videoserver_.erase(it);
+    } else {
+      ++it;
+    }
+  }
+}
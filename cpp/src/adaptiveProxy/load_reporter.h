@@ -0,0 +1,44 @@
+#ifndef LOAD_REPORTER_H
+#define LOAD_REPORTER_H
+
+#include "loadBalancer_protocol.h"
+#include <cstddef>
+#include <cstdint>
+#include <unordered_map>
+
+#define LOAD_REPORT_INTERVAL_MS 1000
+
+// A stand-in for videoservers reporting their own load to a load balancer in
+// load mode: the proxy counts the sessions and egress it relays for every
+// videoserver and sends them as LoadReports every LOAD_REPORT_INTERVAL_MS.
+// Until start() is called every method is a no-op.
+class LoadReporter {
+public:
+  // Start reporting to the load balancer at hostname:port.
+  void start(const char *hostname, int port);
+
+  // The timerfd to watch for EPOLLIN; -1 if not started.
+  int timer_fd() const { return timer_fd_; }
+
+  void add_session(int videoserver_socket, in_addr_t videoserver_addr,
+                   uint16_t videoserver_port);
+  void remove_session(int videoserver_socket);
+  void add_egress(int videoserver_socket, size_t no_of_bytes);
+
+  // Send one report per videoserver; call when timer_fd() is readable.
+  void send_reports();
+
+private:
+  struct Load {
+    in_addr_t videoserver_addr;
+    uint16_t videoserver_port;
+    uint32_t active_sessions;
+    uint64_t no_of_bytes;
+  };
+
+  int socket_{-1}, timer_fd_{-1};
+  std::unordered_map<int, uint64_t> videoserver_of_socket_;
+  std::unordered_map<uint64_t, Load> load_of_videoserver_;
+};
+
+#endif // !LOAD_REPORTER_H
@@ -0,0 +1,53 @@
+#include "manifest_cache.h"
+
+#include "http.h"
+#include "spdlog/spdlog.h"
+
+ManifestCache::ManifestCache(Clock::duration ttl) : ttl_{ttl} {}
+
+BufferRef ManifestCache::find_fresh(const std::string &path_to_video,
+                                    Clock::time_point now) const {
+  auto it{entry_of_video_.find(path_to_video)};
+  if (it == entry_of_video_.end() || now >= it->second.expires_at) {
+    return {};
+  }
+  return it->second.response;
+}
+
+std::string ManifestCache::request_for(const std::string &path_to_video) const {
+  std::string request{"GET " + path_to_video + "/vid-no-list.mpd HTTP/1.1\r\n"};
+  auto it{entry_of_video_.find(path_to_video)};
+  if (it != entry_of_video_.end()) {
+    if (!it->second.etag.empty()) {
+      request += "If-None-Match: " + it->second.etag + "\r\n";
+    }
+    if (!it->second.last_modified.empty()) {
+      request += "If-Modified-Since: " + it->second.last_modified + "\r\n";
+    }
+  }
+  return request + "content-length: 0\r\n\r\n";
+}
+
+BufferRef ManifestCache::on_response(const std::string &path_to_video,
+                                     BufferRef response,
+                                     Clock::time_point now) {
+  // response is NUL-terminated, as an HttpReader leaves it.
+  int status_code{parse_status_code(response.data())};
+  auto it{entry_of_video_.find(path_to_video)};
+  if (status_code == 304 && it != entry_of_video_.end()) {
+    it->second.expires_at = now + ttl_;
+    spdlog::info(
+        "Manifest of {} unchanged, cached for another {} s", path_to_video,
+        std::chrono::duration_cast<std::chrono::seconds>(ttl_).count());
+    return it->second.response;
+  } else if (status_code != 200) {
+    return response;
+  }
+
+  Entry &entry{entry_of_video_[path_to_video]};
+  entry.etag = parse_header_field(response.data(), "etag");
+  entry.last_modified = parse_header_field(response.data(), "last-modified");
+  entry.expires_at = now + ttl_;
+  entry.response = response;
+  return response;
+}
@@ -0,0 +1,56 @@
+#ifndef MANIFEST_CACHE_H
+#define MANIFEST_CACHE_H
+
+#include "buffer_pool.h"
+#include <chrono>
+#include <string>
+#include <unordered_map>
+
+// The vid-no-list.mpd response of every video, kept in memory in the buffer
+// it arrived in and sent to clients from there, since it is the same for
+// everyone watching the video and fetching it is on the critical path of
+// every session start.
+//
+// A response is served from memory for ttl after it was fetched or last
+// revalidated. After that, the next request for it goes to the videoserver
+// with If-None-Match/If-Modified-Since from the cached ETag/Last-Modified, so
+// an unchanged manifest comes back as a bodiless 304. The videoservers'
+// Cache-Control (they send no-store to keep browsers from caching) is
+// ignored: the proxy is the cache they are meant to be behind.
+
+class ManifestCache {
+public:
+  using Clock = std::chrono::steady_clock;
+
+  // ttl == 0 disables the cache.
+  explicit ManifestCache(Clock::duration ttl);
+
+  bool is_enabled() const { return ttl_ > Clock::duration::zero(); }
+
+  // The cached response for the manifest of path_to_video if it is fresh,
+  // an empty BufferRef otherwise.
+  BufferRef find_fresh(const std::string &path_to_video,
+                       Clock::time_point now) const;
+
+  // The request for the manifest of path_to_video: conditional if a stale
+  // response is cached.
+  std::string request_for(const std::string &path_to_video) const;
+
+  // The videoserver answered request_for(path_to_video) with response.
+  // Returns what to send the client: the cached response if it was still
+  // valid, otherwise response itself (cached if it is a 200).
+  BufferRef on_response(const std::string &path_to_video, BufferRef response,
+                        Clock::time_point now);
+
+private:
+  struct Entry {
+    BufferRef response;
+    std::string etag, last_modified;
+    Clock::time_point expires_at;
+  };
+
+  Clock::duration ttl_;
+  std::unordered_map<std::string, Entry> entry_of_video_;
+};
+
+#endif // !MANIFEST_CACHE_H
@@ -0,0 +1,87 @@
+#include "overload_control.h"
+
+#include "abr.h"
+#include "spdlog/spdlog.h"
+#include <algorithm>
+#include <sys/timerfd.h>
+#include <unistd.h>
+
+OverloadControl::OverloadControl(size_t max_sessions,
+                                 unsigned long egress_limit_kbps)
+    : max_sessions_{max_sessions}, egress_limit_kbps_{egress_limit_kbps} {}
+
+void OverloadControl::start() {
+  if (egress_limit_kbps_ == 0) {
+    return;
+  }
+  if ((timer_fd_ = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC)) == -1) {
+    spdlog::warn("timerfd_create()");
+    quick_exit(EXIT_FAILURE);
+  }
+  itimerspec interval{};
+  interval.it_interval.tv_sec = OVERLOAD_CONTROL_INTERVAL_MS / 1000;
+  interval.it_interval.tv_nsec =
+      (OVERLOAD_CONTROL_INTERVAL_MS % 1000) * 1000000L;
+  interval.it_value = interval.it_interval;
+  if (timerfd_settime(timer_fd_, 0, &interval, nullptr) == -1) {
+    spdlog::warn("timerfd_settime()");
+    quick_exit(EXIT_FAILURE);
+  }
+}
+
+unsigned long OverloadControl::capped(unsigned long throughput) const {
+  if (bitrate_cap_ == 0) {
+    return throughput;
+  }
+  // select_bitrate() picks at most throughput / BITRATE_SAFETY_FACTOR.
+  return std::min(throughput, static_cast<unsigned long>(
+                                  bitrate_cap_ * BITRATE_SAFETY_FACTOR));
+}
+
+void OverloadControl::record_segment(int bitrate, int top_bitrate) {
+  max_bitrate_in_interval_ = std::max(max_bitrate_in_interval_, bitrate);
+  top_bitrate_ = std::max(top_bitrate_, top_bitrate);
+}
+
+void OverloadControl::update(uint64_t no_of_bytes_sent) {
+  uint64_t no_of_expirations;
+  if (read(timer_fd_, &no_of_expirations, sizeof(no_of_expirations)) == -1) {
+    spdlog::warn("OverloadControl::update(): read()");
+    return;
+  }
+
+  double kbps{(no_of_bytes_sent - last_no_of_bytes_sent_) * 8.0 /
+              (no_of_expirations * OVERLOAD_CONTROL_INTERVAL_MS)};
+  last_no_of_bytes_sent_ = no_of_bytes_sent;
+  egress_kbps_ =
+      EGRESS_EWMA_WEIGHT * kbps + (1.0 - EGRESS_EWMA_WEIGHT) * egress_kbps_;
+  int max_bitrate{max_bitrate_in_interval_};
+  max_bitrate_in_interval_ = 0;
+  ms_since_decrease_ += no_of_expirations * OVERLOAD_CONTROL_INTERVAL_MS;
+
+  double high{EGRESS_HIGH_WATERMARK * egress_limit_kbps_},
+      low{EGRESS_LOW_WATERMARK * egress_limit_kbps_};
+  if (egress_kbps_ > high) {
+    double cap{bitrate_cap_ == 0 ? max_bitrate : bitrate_cap_};
+    if (cap == 0 ||
+        (bitrate_cap_ != 0 && ms_since_decrease_ < BITRATE_CAP_HOLD_MS)) {
+      // No segments were requested to lower the bitrate of, or not yet
+      // enough at the current cap to tell whether it suffices.
+      return;
+    }
+    ms_since_decrease_ = 0;
+    bitrate_cap_ = std::max(1.0, cap * std::max(MAX_BITRATE_CAP_DECREASE,
+                                                high / egress_kbps_));
+    spdlog::info("Egress at {} Kbps of {} Kbps: bitrates capped at {} Kbps",
+                 static_cast<unsigned long>(egress_kbps_), egress_limit_kbps_,
+                 static_cast<unsigned long>(bitrate_cap_));
+  } else if (egress_kbps_ < low && bitrate_cap_ != 0) {
+    bitrate_cap_ *= BITRATE_CAP_INCREASE;
+    if (bitrate_cap_ >= top_bitrate_) {
+      bitrate_cap_ = 0;
+      spdlog::info("Egress at {} Kbps of {} Kbps: bitrates no longer capped",
+                   static_cast<unsigned long>(egress_kbps_),
+                   egress_limit_kbps_);
+    }
+  }
+}
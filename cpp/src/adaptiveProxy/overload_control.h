@@ -0,0 +1,70 @@
+#ifndef OVERLOAD_CONTROL_H
+#define OVERLOAD_CONTROL_H
+
+#include <cstddef>
+#include <cstdint>
+
+// Keeps the proxy within its own capacity, so that an overloaded edge sheds
+// quality gradually rather than stalling every client at once.
+//
+// Admission control: at max_sessions clients, the proxy stops accepting
+// connections and leaves new ones in the listen backlog until a session ends.
+//
+// Egress control: every OVERLOAD_CONTROL_INTERVAL_MS, the egress to clients
+// is measured and smoothed. Above EGRESS_HIGH_WATERMARK of the egress limit,
+// a cap on the bitrate of every session is set to the highest bitrate picked
+// in the interval and lowered in proportion to the excess, at most halved at a
+// time. It is lowered again at the earliest BITRATE_CAP_HOLD_MS later, once
+// sessions have fetched segments at it. Below EGRESS_LOW_WATERMARK, it is
+// raised by BITRATE_CAP_INCREASE per interval until it no longer caps any
+// video.
+// Sessions whose own estimate is below the cap are unaffected.
+
+#define OVERLOAD_CONTROL_INTERVAL_MS 500
+#define EGRESS_EWMA_WEIGHT 0.5
+#define EGRESS_HIGH_WATERMARK 0.9
+#define EGRESS_LOW_WATERMARK 0.75
+#define MAX_BITRATE_CAP_DECREASE 0.5
+#define BITRATE_CAP_HOLD_MS 2000
+#define BITRATE_CAP_INCREASE 1.1
+
+class OverloadControl {
+public:
+  // 0 for either means no limit.
+  OverloadControl(size_t max_sessions, unsigned long egress_limit_kbps);
+
+  // Start measuring egress, if there is an egress limit.
+  void start();
+
+  // The timerfd to watch for readability; -1 if not started.
+  int timer_fd() const { return timer_fd_; }
+
+  // Whether another client may be admitted next to no_of_sessions.
+  bool is_admitting(size_t no_of_sessions) const {
+    return max_sessions_ == 0 || no_of_sessions < max_sessions_;
+  }
+
+  // The throughput estimate to pick a bitrate from instead of throughput, so
+  // that the pick does not exceed the bitrate cap.
+  unsigned long capped(unsigned long throughput) const;
+
+  // A segment was requested at bitrate from a video topping out at
+  // top_bitrate.
+  void record_segment(int bitrate, int top_bitrate);
+
+  // Update the cap from no_of_bytes_sent (to clients, since the start); call
+  // when timer_fd() is readable.
+  void update(uint64_t no_of_bytes_sent);
+
+private:
+  size_t max_sessions_;
+  unsigned long egress_limit_kbps_;
+  int timer_fd_{-1};
+  uint64_t last_no_of_bytes_sent_{};
+  double egress_kbps_{};
+  double bitrate_cap_{}; // 0 if not capped.
+  int max_bitrate_in_interval_{}, top_bitrate_{};
+  uint64_t ms_since_decrease_{};
+};
+
+#endif // !OVERLOAD_CONTROL_H
@@ -0,0 +1,113 @@
+#include "poller.h"
+
+#include "io_uring_poller.h"
+#include "spdlog/spdlog.h"
+#include <algorithm>
+#include <cerrno>
+#include <sys/socket.h>
+
+void Poller::set_deadline(int fd, uint64_t timeout_ms) {
+  deadlines_.arm(fd, timeout_ms, TimerWheel::Clock::now());
+}
+
+void Poller::clear_deadline(int fd) { deadlines_.cancel(fd); }
+
+int Poller::wait(PollEvent *events, int max_no_of_events) {
+  TimerWheel::Clock::time_point now{TimerWheel::Clock::now()};
+  deadlines_.expire(now, timed_out_);
+  if (timed_out_.empty()) {
+    return wait_for(events, max_no_of_events, deadlines_.next_timeout_ms(now));
+  }
+  int no_of_events{
+      std::min(static_cast<int>(timed_out_.size()), max_no_of_events)};
+  for (int i{0}; i < no_of_events; ++i) {
+    events[i] = {timed_out_[i], -1, {}, false, false, true};
+  }
+  timed_out_.erase(timed_out_.begin(), timed_out_.begin() + no_of_events);
+  return no_of_events;
+}
+
+bool EpollPoller::start() {
+  return (epoll_fd_ = epoll_create1(EPOLL_CLOEXEC)) != -1;
+}
+
+void EpollPoller::add(int fd, bool is_writable) {
+  epoll_event event;
+  event.events = is_writable ? EPOLLOUT : EPOLLIN;
+  event.data.fd = fd;
+  if (epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, fd, &event) == -1) {
+    spdlog::warn("epoll_ctl_add()");
+    quick_exit(EXIT_FAILURE);
+  }
+}
+
+void EpollPoller::watch_writable(int fd, bool is_watched) {
+  epoll_event event;
+  event.events = is_watched ? EPOLLIN | EPOLLOUT : EPOLLIN;
+  event.data.fd = fd;
+  if (epoll_ctl(epoll_fd_, EPOLL_CTL_MOD, fd, &event) == -1) {
+    spdlog::warn("epoll_ctl_mod()");
+    quick_exit(EXIT_FAILURE);
+  }
+}
+
+void EpollPoller::remove(int fd) {
+  clear_deadline(fd);
+  if (epoll_ctl(epoll_fd_, EPOLL_CTL_DEL, fd, NULL) == -1) {
+    spdlog::warn("epoll_ctl_del()");
+    quick_exit(EXIT_FAILURE);
+  }
+  listeners_.erase(fd);
+}
+
+long Poller::recv_now(int fd, void *buffer, size_t length, int flags) {
+  long curr;
+  do {
+    curr = ::recv(fd, buffer, length, flags | MSG_DONTWAIT);
+  } while (curr < 0 && errno == EINTR);
+  return curr;
+}
+
+long Poller::send_now(int fd, const iovec *iovs, int no_of_iovs) {
+  msghdr msg{};
+  msg.msg_iov = const_cast<iovec *>(iovs);
+  msg.msg_iovlen = no_of_iovs;
+  long curr;
+  do {
+    curr = sendmsg(fd, &msg, MSG_DONTWAIT | MSG_NOSIGNAL);
+  } while (curr < 0 && errno == EINTR);
+  return curr;
+}
+
+void EpollPoller::add_listener(int fd) {
+  add(fd);
+  listeners_.insert(fd);
+}
+
+int EpollPoller::wait_for(PollEvent *events, int max_no_of_events,
+                          int timeout_ms) {
+  ready_.resize(max_no_of_events);
+  int no_of_events{
+      epoll_wait(epoll_fd_, ready_.data(), max_no_of_events, timeout_ms)};
+  for (int i{0}; i < no_of_events; ++i) {
+    int fd{ready_[i].data.fd};
+    uint32_t ready{ready_[i].events};
+    events[i] = {fd, -1, {}, (ready & (EPOLLIN | EPOLLERR | EPOLLHUP)) != 0,
+                 (ready & EPOLLOUT) != 0, false};
+    if (listeners_.contains(fd)) {
+      socklen_t addr_len{sizeof(events[i].accepted_addr)};
+      events[i].accepted =
+          accept(fd, (sockaddr *)&events[i].accepted_addr, &addr_len);
+    }
+  }
+  return no_of_events;
+}
+
+std::unique_ptr<Poller> make_poller(const std::string &name) {
+  if (name == "epoll") {
+    return std::make_unique<EpollPoller>();
+  } else if (name == "io_uring") {
+    return std::make_unique<IoUringPoller>();
+  }
+  return nullptr;
+}
@@ -0,0 +1,141 @@
+#ifndef POLLER_H
+#define POLLER_H
+
+#include "buffer_pool.h"
+#include "timer_wheel.h"
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <netinet/in.h>
+#include <string>
+#include <sys/epoll.h>
+#include <sys/uio.h>
+#include <unordered_set>
+#include <vector>
+
+// The event loop of the proxy, behind one interface so that the I/O backend
+// can be picked at startup: epoll(7), or io_uring(7) (see io_uring_poller.h).
+// Watched fds are reported while they are readable (or writable), like
+// level-triggered epoll, and listen sockets are reported once per connection
+// accepted on them. A watched fd may have a deadline, and is reported as
+// timed out once it passes.
+//
+// Connections are read and written through the poller too, with recv() and
+// send(), so that a backend can do that I/O itself rather than leave it to a
+// syscall per call once the fd is ready.
+
+struct PollEvent {
+  int fd;
+  // If fd is a listen socket, the socket accepted from it, or -1 if accept
+  // failed, and the address of its peer. Otherwise -1.
+  int accepted;
+  sockaddr_in accepted_addr;
+  // Errors and hangups count as readable, as reading is what reports them.
+  bool is_readable, is_writable;
+  // The deadline of fd passed. Timeouts are reported on their own, ahead of
+  // any I/O, so that no fd in them was closed and reused in the meantime.
+  bool is_timed_out;
+};
+
+class Poller {
+public:
+  virtual ~Poller() = default;
+
+  // Returns false if the backend is not available.
+  virtual bool start() = 0;
+
+  // Report fd whenever it is readable, or writable if is_writable.
+  virtual void add(int fd, bool is_writable = false) = 0;
+
+  // Report the connected socket fd whenever recv() has something for it:
+  // some of what came in on it, or that it was closed or failed.
+  virtual void add_socket(int fd) = 0;
+
+  // Also report fd (added to be readable) while it is writable, until called
+  // again with is_watched false.
+  virtual void watch_writable(int fd, bool is_watched) = 0;
+
+  // Stop reporting fd, and drop its deadline. Call before closing it.
+  virtual void remove(int fd) = 0;
+
+  // Accept connections on the listen socket fd and report each of them.
+  virtual void add_listener(int fd) = 0;
+
+  // What has come in on the socket fd, like recv() with MSG_DONTWAIT (and
+  // MSG_PEEK if flags has it): up to length bytes of it, 0 if the peer
+  // closed the connection, or -1 with errno EAGAIN if nothing is there, or
+  // with the error of the connection.
+  virtual long recv(int fd, void *buffer, size_t length, int flags) = 0;
+
+  // Send to the socket fd as much of the no_of_iovs buffers of iovs as it
+  // takes without waiting, buffers[i] keeping iovs[i] alive (unless it is
+  // static). Returns how many bytes went, or -1 with errno EAGAIN if none
+  // could, or with the error of the connection. A backend that sends
+  // through its ring takes references to the buffers and returns -1 with
+  // errno EINPROGRESS instead: fd is reported writable once the send
+  // completes, and take_sent() then tells how it went. Only one send may be
+  // in flight per fd.
+  virtual long send(int fd, const iovec *iovs, const BufferRef *buffers,
+                    int no_of_iovs) = 0;
+
+  // After fd was reported writable: how many bytes the send in flight sent,
+  // or -1 with the errno it failed with; 0 if no send was in flight.
+  virtual long take_sent(int /*fd*/) { return 0; }
+
+  // Report fd as timed out once timeout_ms pass, unless the deadline is set
+  // again, cleared or fd removed first.
+  void set_deadline(int fd, uint64_t timeout_ms);
+  void clear_deadline(int fd);
+
+  // Block until something happens or a deadline passes and fill in at most
+  // max_no_of_events events. Returns how many, or -1 on failure.
+  int wait(PollEvent *events, int max_no_of_events);
+
+protected:
+  // Block until something happens, at most timeout_ms (-1 for no limit), and
+  // fill in at most max_no_of_events events. Returns how many (0 if the
+  // timeout passed), or -1 on failure.
+  virtual int wait_for(PollEvent *events, int max_no_of_events,
+                       int timeout_ms) = 0;
+
+  // recv() and sendmsg() on fd without waiting, resumed if interrupted (by a
+  // signal or io_uring task work).
+  static long recv_now(int fd, void *buffer, size_t length, int flags);
+  static long send_now(int fd, const iovec *iovs, int no_of_iovs);
+
+private:
+  TimerWheel deadlines_;
+  std::vector<int> timed_out_;
+};
+
+class EpollPoller : public Poller {
+public:
+  bool start() override;
+  void add(int fd, bool is_writable = false) override;
+  void add_socket(int fd) override { add(fd); }
+  void watch_writable(int fd, bool is_watched) override;
+  void remove(int fd) override;
+  void add_listener(int fd) override;
+  long recv(int fd, void *buffer, size_t length, int flags) override {
+    return recv_now(fd, buffer, length, flags);
+  }
+  long send(int fd, const iovec *iovs, const BufferRef *,
+            int no_of_iovs) override {
+    return send_now(fd, iovs, no_of_iovs);
+  }
+
+protected:
+  int wait_for(PollEvent *events, int max_no_of_events,
+               int timeout_ms) override;
+
+private:
+  int epoll_fd_{-1};
+  std::unordered_set<int> listeners_;
+  std::vector<epoll_event> ready_;
+};
+
+// The poller of the backend named name ("epoll" or "io_uring"), not started
+// yet; nullptr if there is no such backend.
+std::unique_ptr<Poller> make_poller(const std::string &name);
+
+#endif // !POLLER_H
@@ -0,0 +1,1534 @@
+#include "proxy.h"
+
+#include "loadBalancer_client.h"
+#include "loadBalancer_protocol.h"
+#include "network_utils.h"
+#include "spdlog/spdlog.h"
+#include "tcp_pacing.h"
+#include <algorithm>
+#include <csignal>
+#include <cstdlib>
+#include <iostream>
+#include <sys/signalfd.h>
+
+Proxy::Proxy(ProxyOptions options, std::unique_ptr<Poller> poller)
+    : options_{std::move(options)}, poller_{std::move(poller)},
+      write_queues_{*poller_}, response_queues_{write_queues_},
+      overload_control_{options_.max_sessions, options_.egress_limit_kbps},
+      fetch_scheduler_{options_.max_inflight},
+      manifest_cache_{std::chrono::seconds{options_.manifest_ttl_s}},
+      segment_cache_{options_.segment_cache_size},
+      throughput_priors_{options_.prior_prefix} {
+  for (Upstream upstream : options_.upstreams) {
+    upstream_health_.add(upstream);
+  }
+}
+
+bool Proxy::start() {
+  listen_socket_ = get_inbound_socket(options_.listen_port);
+  spdlog::info("adaptiveProxy started");
+  poller_->add_listener(listen_socket_);
+
+  if (options_.is_report_load) {
+    load_reporter_.start(options_.hostname.c_str(), options_.port);
+    poller_->add(load_reporter_.timer_fd());
+  }
+
+  upstream_health_.start(*poller_);
+  poller_->add(upstream_health_.timer_fd());
+
+  overload_control_.start();
+  if (overload_control_.timer_fd() != -1) {
+    poller_->add(overload_control_.timer_fd());
+  }
+
+  if (!options_.trace_file.empty() &&
+      !request_tracer_.open(options_.trace_file,
+                            options_.trace_threshold_ms)) {
+    std::cout << "Error: cannot open trace-file\n";
+    return false;
+  }
+
+  // With --state-file, clients and videos start from what the previous proxy
+  // saved, and SIGTERM/SIGINT save once more before exiting, so that a
+  // restart loses nothing.
+  if (!options_.state_file.empty()) {
+    if (!session_state_.open(options_.state_file)) {
+      std::cout << "Error: cannot open state-file\n";
+      return false;
+    }
+    if (session_state_.load(throughput_of_client_, sampled_at_of_client_,
+                            bitrate_of_video_, segment_duration_of_video_)) {
+      spdlog::info("Loaded {} throughput estimates and {} videos from {}",
+                   throughput_of_client_.size(), bitrate_of_video_.size(),
+                   options_.state_file);
+    }
+    poller_->add(session_state_.timer_fd());
+
+    sigset_t mask;
+    sigemptyset(&mask);
+    sigaddset(&mask, SIGTERM);
+    sigaddset(&mask, SIGINT);
+    if (sigprocmask(SIG_BLOCK, &mask, NULL) != 0 ||
+        (signal_fd_ = signalfd(-1, &mask, SFD_CLOEXEC)) == -1) {
+      spdlog::warn("signalfd()");
+      return false;
+    }
+    poller_->add(signal_fd_);
+  }
+  return true;
+}
+
+int Proxy::run() {
+  if (!start()) {
+    return EXIT_FAILURE;
+  }
+  static PollEvent events[MAX_NO_OF_PORTS];
+  while (true) {
+    int no_of_events{poller_->wait(events, MAX_NO_OF_PORTS)};
+    if (no_of_events == -1) {
+      spdlog::warn("{} wait", options_.io_backend);
+      return EXIT_FAILURE;
+    }
+    for (int i{0}; i < no_of_events; ++i) {
+      int fd{events[i].fd};
+      if (events[i].is_timed_out) {
+        on_timeout(fd);
+      } else if (fd == listen_socket_) {
+        on_accept(events[i]);
+      } else if (session_of_client_.contains(fd)) {
+        on_client(events[i]);
+      } else if (fd == load_reporter_.timer_fd()) {
+        load_reporter_.send_reports();
+      } else if (fd == upstream_health_.timer_fd()) {
+        upstream_health_.send_checks();
+        if (options_.state_file.empty()) {
+          forget_stale_clients();
+        }
+      } else if (fd == overload_control_.timer_fd()) {
+        overload_control_.update(write_queues_.no_of_bytes_sent());
+      } else if (fd == session_state_.timer_fd()) {
+        session_state_.on_timer();
+        save_session_state();
+      } else if (fd == signal_fd_) {
+        save_session_state();
+        spdlog::info("adaptiveProxy stopped, session state saved to {}",
+                     options_.state_file);
+        return EXIT_SUCCESS;
+      } else if (upstream_health_.is_check(fd)) {
+        upstream_health_.finish_check(fd);
+      } else if (upstream_of_idle_videoserver_.contains(fd)) {
+        // Nothing is expected on an idle connection but its videoserver
+        // closing it.
+        drop_idle_videoserver(fd);
+      } else if (client_socket_for_videoserver_.contains(fd)) {
+        on_videoserver(fd);
+      } else if (range_part_of_videoserver_.contains(fd)) {
+        on_range_part(fd);
+      } else if (exchange_of_videoserver_.contains(fd)) {
+        on_exchange(fd);
+      } else if (bitrate_lookup_of_videoserver_.contains(fd)) {
+        on_bitrate_lookup(fd);
+      }
+    }
+    if (request_tracer_.is_enabled()) {
+      request_tracer_.complete_delivered([&](int client_socket, uint64_t slot) {
+        return response_queues_.is_written(client_socket, slot) &&
+               write_queues_.no_of_queued_bytes(client_socket) == 0;
+      });
+    }
+  }
+}
+
+void Proxy::on_timeout(int socket) {
+  auto session_it{session_of_client_.find(socket)};
+  bool is_client{session_it != session_of_client_.end()};
+  if (is_client &&
+      session_it->second.request_reader.phase() == HttpReader::IDLE &&
+      response_queues_.no_of_open(socket) > 0 &&
+      write_queues_.no_of_queued_bytes(socket) == 0) {
+    // Waiting for a videoserver, which has a deadline of its own.
+    poller_->set_deadline(socket, CLIENT_IDLE_TIMEOUT_MS);
+    return;
+  }
+  // Reading a socket that is shut down fails, which cleans it up (and fails
+  // its request over) like any other socket that failed.
+  spdlog::info("{} socket sockfd {} timed out",
+               is_client ? "Client" : "Videoserver", socket);
+  shutdown(socket, SHUT_RDWR);
+}
+
+void Proxy::on_accept(const PollEvent &event) {
+  RequestTracer::Clock::time_point accepted_at{RequestTracer::Clock::now()};
+  int client_socket{event.accepted};
+  if (client_socket == -1) {
+    spdlog::warn("accept()");
+    quick_exit(EXIT_FAILURE);
+  }
+  const sockaddr_in &client_addr{event.accepted_addr};
+  char ip_str[16];
+  if (inet_ntop(AF_INET, &client_addr.sin_addr, ip_str, sizeof(ip_str)) ==
+      NULL) {
+    spdlog::warn("inet_ntop()");
+    quick_exit(EXIT_FAILURE);
+  }
+  spdlog::info("New client socket connected with {}:{} on sockfd {}", ip_str,
+               ntohs(client_addr.sin_port), client_socket);
+  if (!overload_control_.is_admitting(session_of_client_.size())) {
+    // Accepted before accepting was paused; io_uring accepts ahead.
+    spdlog::info("Turning away client socket sockfd {}: {} sessions",
+                 client_socket, session_of_client_.size());
+    send(client_socket, SERVICE_UNAVAILABLE, sizeof(SERVICE_UNAVAILABLE) - 1,
+         MSG_DONTWAIT | MSG_NOSIGNAL);
+    if (close(client_socket) == -1) {
+      spdlog::warn("close()");
+      quick_exit(EXIT_FAILURE);
+    }
+    return;
+  }
+
+  request_tracer_.on_accept(client_socket, accepted_at);
+  Upstream upstream;
+  int videoserver_socket;
+  {
+    RequestTracer::Scope scope{request_tracer_, client_socket,
+                               RequestTracer::SETUP};
+    videoserver_socket = connect_to_videoserver(client_addr.sin_addr.s_addr,
+                                                "", nullptr, upstream);
+  }
+  if (videoserver_socket == -1) {
+    spdlog::info("No videoserver for client socket sockfd {}", client_socket);
+    request_tracer_.remove(client_socket);
+    if (close(client_socket) == -1) {
+      spdlog::warn("close()");
+      quick_exit(EXIT_FAILURE);
+    }
+    return;
+  }
+  poller_->add_socket(client_socket);
+  poller_->set_deadline(client_socket, CLIENT_HEADER_TIMEOUT_MS);
+  session_of_client_[client_socket].addr = client_addr.sin_addr.s_addr;
+  set_videoserver(client_socket, videoserver_socket, upstream);
+  if (!overload_control_.is_admitting(session_of_client_.size())) {
+    // Further connections wait in the listen backlog.
+    poller_->remove(listen_socket_);
+    is_accepting_ = false;
+    spdlog::info("{} sessions: not accepting connections",
+                 session_of_client_.size());
+  }
+}
+
+void Proxy::on_client(const PollEvent &event) {
+  int client_socket{event.fd};
+  Session &session{session_of_client_.at(client_socket)};
+  // A request coming in has a deadline of its own.
+  if (session.request_reader.phase() == HttpReader::IDLE) {
+    poller_->set_deadline(client_socket, CLIENT_IDLE_TIMEOUT_MS);
+  }
+  if (event.is_writable && !write_queues_.flush(client_socket)) {
+    spdlog::info("Client socket sockfd {} disconnected", client_socket);
+    close_session(client_socket);
+    return;
+  } else if (!event.is_readable) {
+    return;
+  }
+  BufferRef request;
+  try {
+    request = read_message(client_socket, session.request_reader);
+  } catch (const std::runtime_error &e) {
+    spdlog::info("Client socket sockfd {} disconnected", client_socket);
+    close_session(client_socket);
+    return;
+  }
+  if (!request) {
+    return;
+  }
+  poller_->set_deadline(client_socket, CLIENT_IDLE_TIMEOUT_MS);
+  RequestTracer::Clock::time_point received_at{RequestTracer::Clock::now()};
+  const char *buffer{request.data()};
+  if (response_queues_.no_of_open(client_socket) >= MAX_PIPELINED_REQUESTS) {
+    spdlog::info("Client socket sockfd {} pipelined too many requests",
+                 client_socket);
+    close_session(client_socket);
+    return;
+  }
+  // A request pipelined behind others says nothing of when the client
+  // received its last segment.
+  bool is_pipelined{response_queues_.no_of_open(client_socket) > 0};
+  uint64_t slot{response_queues_.open(client_socket)};
+  request_tracer_.start(client_socket, slot, received_at);
+  RequestTracer::Scope scope{request_tracer_, client_socket, slot};
+
+  measure_delivery(client_socket, is_pipelined);
+  if (options_.is_content_affinity) {
+    follow_content(client_socket, buffer);
+  }
+
+  // With the segment cache on, a Range request for a segment is a seek or a
+  // retry, answered from the whole segment, rather than a request for the
+  // next segment.
+  std::string range{
+      segment_cache_.is_enabled() ? parse_header_field(buffer, "range") : ""};
+  if (is_post_on_fragment_received(buffer)) {
+    on_beacon(client_socket, slot, buffer);
+  } else if (is_get_vid_mpd(buffer)) {
+    on_manifest_request(client_socket, slot, buffer);
+  } else if (!range.empty() && is_get_vid_m4s(buffer)) {
+    on_range_request(client_socket, slot, buffer, range);
+  } else if (is_get_vid_m4s(buffer)) {
+    on_segment_request(client_socket, slot, buffer, is_pipelined);
+  } else if (!dispatch(client_socket, {slot, false},
+                       std::string{buffer, request.size()}, "")) {
+    spdlog::info("No videoserver left for client socket sockfd {}",
+                 client_socket);
+    close_session(client_socket);
+  }
+}
+
+void Proxy::measure_delivery(int client_socket, bool is_pipelined) {
+  Session &session{session_of_client_.at(client_socket)};
+  TcpDelivery after;
+  if (session.segment_delivery && !is_pipelined &&
+      sample_tcp_delivery(client_socket, after)) {
+    const SegmentDelivery &delivery{*session.segment_delivery};
+    double kbps{delivered_kbps(delivery.before, after)};
+    if (kbps > 0) {
+      add_throughput_sample(delivery.uuid, kbps, session.addr);
+      spdlog::info("Client {} was delivered a segment of size {} bytes at {} "
+                   "Kbps (rtt {} ms, cwnd {} x {} bytes). Avg Throughput: {} "
+                   "Kbps",
+                   delivery.uuid, delivery.no_of_bytes, (unsigned long)kbps,
+                   after.rtt_us / 1000.0, after.snd_cwnd, after.snd_mss,
+                   throughput_of(delivery.uuid));
+    }
+  }
+  session.segment_delivery.reset();
+}
+
+void Proxy::follow_content(int client_socket, const char *request) {
+  Session &session{session_of_client_.at(client_socket)};
+  std::string content_key;
+  if (session.slot || !parse_path_to_video(request, content_key) ||
+      content_key == session.content_key) {
+    return;
+  }
+  // The client moved to another video: ask the load balancer again with the
+  // video as content key, and move the client over to the videoserver it
+  // picks if that changed (once its connection is free).
+  session.content_key = content_key;
+  Upstream upstream{session.upstream};
+  try {
+    RequestTracer::Timed timed{request_tracer_, "load balancer lookup"};
+    LoadBalancerResponse loadBalancer_response{
+        query_load_balancer(options_.hostname.c_str(), options_.port,
+                            session.addr, content_key)};
+    upstream = {loadBalancer_response.videoserver_addr,
+                loadBalancer_response.videoserver_port};
+    upstream_health_.add(upstream);
+  } catch (const std::runtime_error &e) {
+    // Keep the videoserver the client already has.
+  }
+  if (upstream.key() == session.upstream.key() ||
+      !upstream_health_.is_healthy(upstream)) {
+    return;
+  }
+  int videoserver_socket{open_connection(upstream)};
+  if (videoserver_socket == -1) {
+    // Keep the videoserver the client already has.
+    report_failure(upstream);
+    return;
+  }
+  set_videoserver(client_socket, videoserver_socket, upstream);
+  spdlog::info("Client socket sockfd {} moved to {} for {}", client_socket,
+               upstream_name(upstream), content_key);
+}
+
+void Proxy::on_beacon(int client_socket, uint64_t slot, const char *request) {
+  std::string uuid;
+  unsigned long fragment_size, start, end;
+  parse_post_on_fragment_received(request, uuid, fragment_size, start, end);
+  request_tracer_.tag(client_socket, slot, "beacon", uuid);
+
+  if (options_.is_beacon_estimator) {
+    add_throughput_sample(
+        uuid, (fragment_size / 1000.0 * 8.0) / ((end - start) / 1000.0),
+        session_of_client_.at(client_socket).addr);
+  }
+  fetch_scheduler_.on_fragment_received(uuid, end,
+                                        FetchScheduler::Clock::now());
+
+  spdlog::info("Client {} finished receiving a segment of size {} bytes in {} "
+               "ms. Throughput: {} Kbps. Avg Throughput: {} Kbps",
+               uuid, fragment_size, end - start,
+               (unsigned long)((fragment_size / 1000.0 * 8.0) /
+                               ((end - start) / 1000.0)),
+               throughput_of(uuid));
+  request_tracer_.on_last_byte(client_socket, slot,
+                               RequestTracer::Clock::now());
+  if (!response_queues_.write(client_socket, slot,
+                              std::string_view{OK, sizeof(OK) - 1}) ||
+      !response_queues_.finish(client_socket, slot)) {
+    spdlog::info("Client socket sockfd {} disconnected", client_socket);
+    close_session(client_socket);
+  }
+}
+
+void Proxy::on_manifest_request(int client_socket, uint64_t slot,
+                                const char *request) {
+  std::string path_to_video, uuid;
+  parse_get_vid_mpd(request, path_to_video, uuid);
+  request_tracer_.tag(client_socket, slot, "manifest", uuid, path_to_video);
+
+  if (bitrate_of_video_.contains(path_to_video)) {
+    serve_manifest(client_socket, slot, path_to_video, uuid);
+    return;
+  }
+  // The client is sent a manifest without the bitrates, so they are looked
+  // up in the full one first.
+  if (!look_up_bitrates({client_socket, slot, path_to_video, uuid,
+                         session_of_client_.at(client_socket).upstream,
+                         RequestTracer::Clock::now()},
+                        false)) {
+    spdlog::info("No videoserver left for client socket sockfd {}",
+                 client_socket);
+    close_session(client_socket);
+  }
+}
+
+// Answer the manifest request of client_socket in slot, for path_to_video,
+// whose bitrates are known: from the cache if it is fresh there, else from
+// a videoserver.
+void Proxy::serve_manifest(int client_socket, uint64_t slot,
+                           const std::string &path_to_video,
+                           const std::string &uuid) {
+  if (BufferRef cached{manifest_cache_.find_fresh(
+          path_to_video, ManifestCache::Clock::now())}) {
+    request_tracer_.on_last_byte(client_socket, slot,
+                                 RequestTracer::Clock::now());
+    if (!response_queues_.write(client_socket, slot, std::move(cached)) ||
+        !response_queues_.finish(client_socket, slot)) {
+      spdlog::info("Client socket sockfd {} disconnected", client_socket);
+      close_session(client_socket);
+      return;
+    }
+    spdlog::info("Manifest requested by {} served from cache for {}", uuid,
+                 path_to_video + "/vid-no-list.mpd");
+    return;
+  }
+  if (!dispatch(client_socket, {slot, false},
+                manifest_cache_.request_for(path_to_video),
+                manifest_cache_.is_enabled() ? path_to_video : "")) {
+    spdlog::info("No videoserver left for client socket sockfd {}",
+                 client_socket);
+    close_session(client_socket);
+    return;
+  }
+
+  spdlog::info("Manifest requested by {} forwarded to {} for {}", uuid,
+               upstream_name(session_of_client_.at(client_socket).upstream),
+               path_to_video + "/vid-no-list.mpd");
+}
+
+void Proxy::on_range_request(int client_socket, uint64_t slot,
+                             const char *request, const std::string &range) {
+  std::string path_to_video, uuid, segment_no;
+  parse_get_vid_m4s(request, path_to_video, uuid, segment_no);
+  request_tracer_.tag(client_socket, slot, "segment range", uuid,
+                      path_to_video);
+  // The bytes of a segment at one bitrate are of no use with those at
+  // another, so the one the client was sent is kept to.
+  std::string path{parse_request_target(request)};
+  auto last_segment_it{last_segment_of_client_.find(uuid)};
+  if (last_segment_it != last_segment_of_client_.end() &&
+      last_segment_it->second.asked == path_to_video + "/" + segment_no) {
+    path = last_segment_it->second.fetched;
+  }
+
+  if (BufferRef whole{segment_cache_.find(path)}) {
+    size_t no_of_bytes;
+    request_tracer_.on_last_byte(client_socket, slot,
+                                 RequestTracer::Clock::now());
+    if (!write_ranges(client_socket, slot, range, std::move(whole),
+                      no_of_bytes) ||
+        !response_queues_.finish(client_socket, slot)) {
+      spdlog::info("Client socket sockfd {} disconnected", client_socket);
+      close_session(client_socket);
+      return;
+    }
+    load_reporter_.add_egress(
+        session_of_client_.at(client_socket).videoserver_socket, no_of_bytes);
+    spdlog::info("Range {} of {} requested by {} served from cache", range,
+                 path, uuid);
+    return;
+  }
+  session_of_client_.at(client_socket).range_fills[slot] = {path, range};
+  if (!dispatch(client_socket, {slot, false},
+                "GET " + path + " HTTP/1.1\r\ncontent-length: 0\r\n\r\n",
+                "")) {
+    spdlog::info("No videoserver left for client socket sockfd {}",
+                 client_socket);
+    close_session(client_socket);
+    return;
+  }
+
+  spdlog::info("Range {} of {} requested by {} missed the cache, fetching "
+               "all of it from {}",
+               range, path, uuid,
+               upstream_name(session_of_client_.at(client_socket).upstream));
+}
+
+void Proxy::on_segment_request(int client_socket, uint64_t slot,
+                               const char *request, bool is_pipelined) {
+  Session &session{session_of_client_.at(client_socket)};
+  std::string path_to_video, m4s, uuid, segment_no;
+  parse_get_vid_m4s(request, path_to_video, uuid, segment_no);
+
+  if (!throughput_of_client_.contains(uuid)) {
+    unsigned long prior{throughput_priors_.prior(session.addr)};
+    if (prior > 0) {
+      throughput_of_client_[uuid] = prior;
+      sampled_at_of_client_[uuid] = std::time(nullptr);
+      spdlog::info("Client {} starts from the throughput of its subnet: {} "
+                   "Kbps",
+                   uuid, prior);
+    }
+  }
+  // Without the bitrates of the video (its manifest was not looked up
+  // through the proxy), the segment is fetched as the client asked for it.
+  auto bitrates_it{bitrate_of_video_.find(path_to_video)};
+  bool is_chosen{bitrates_it != bitrate_of_video_.end() &&
+                 !bitrates_it->second.empty()};
+  int bitrate{};
+  if (is_chosen) {
+    bitrate = select_bitrate(bitrates_it->second,
+                             overload_control_.capped(throughput_of(uuid)),
+                             BITRATE_SAFETY_FACTOR);
+    overload_control_.record_segment(bitrate, bitrates_it->second.back());
+    m4s = "GET " + path_to_video + "/video/vid-" + std::to_string(bitrate) +
+          "-seg-" + segment_no +
+          ".m4s HTTP/1.1\r\ncontent-length: 0\r\n\r\n";
+  } else {
+    spdlog::info("No bitrates of {} known for the segment requested by {}",
+                 path_to_video, uuid);
+    m4s = "GET " + parse_request_target(request) +
+          " HTTP/1.1\r\ncontent-length: 0\r\n\r\n";
+  }
+  request_tracer_.tag(client_socket, slot, "segment", uuid, path_to_video,
+                      bitrate);
+  if (segment_cache_.is_enabled()) {
+    last_segment_of_client_[uuid] = {path_to_video + "/" + segment_no,
+                                      parse_request_target(m4s.c_str()),
+                                      std::time(nullptr)};
+  }
+  auto segment_duration_it{segment_duration_of_video_.find(path_to_video)};
+  double segment_duration{segment_duration_it ==
+                                  segment_duration_of_video_.end()
+                              ? DEFAULT_SEGMENT_DURATION_S
+                              : segment_duration_it->second};
+  if (options_.is_tcp_info_estimator && !is_pipelined) {
+    session.segment_uuid = uuid;
+  }
+  if (options_.is_pacing && is_chosen) {
+    double buffer_s{
+        std::chrono::duration<double>(fetch_scheduler_.deadline_of(uuid) -
+                                      FetchScheduler::Clock::now())
+            .count()};
+    unsigned long pacing_kbps{
+        pacing_rate_kbps(bitrates_it->second, bitrate, segment_duration,
+                         buffer_s)};
+    // Not before the responses pipelined ahead of it have gone.
+    response_queues_.pace(client_socket, slot, pacing_kbps);
+    if (pacing_kbps > 0) {
+      spdlog::info("Client {} paced at {} Kbps with {:.1f} s buffered", uuid,
+                   pacing_kbps, buffer_s);
+    }
+  }
+  // Split by the size the segment should have at its bitrate.
+  size_t expected_size{static_cast<size_t>(bitrate * 125 * segment_duration)},
+      no_of_parts{
+          std::min(options_.range_parts, expected_size / RANGE_MIN_PART_SIZE)};
+  if (no_of_parts > 1) {
+    session.range_split = {(expected_size + no_of_parts - 1) / no_of_parts,
+                           no_of_parts};
+  }
+  if (!fetch_scheduler_.submit(client_socket, uuid, segment_duration, slot,
+                               m4s)) {
+    spdlog::info("Segment requested by {} queued behind {} others, due in {} "
+                 "ms",
+                 uuid, fetch_scheduler_.no_of_queued() - 1,
+                 std::chrono::duration_cast<std::chrono::milliseconds>(
+                     fetch_scheduler_.deadline_of(uuid) -
+                     FetchScheduler::Clock::now())
+                     .count());
+    return;
+  }
+  if (!send_segment_request(client_socket, slot, m4s)) {
+    spdlog::info("No videoserver left for client socket sockfd {}",
+                 client_socket);
+    close_session(client_socket);
+    return;
+  }
+
+  spdlog::info("Segment requested by {} forwarded to {} as {} at bitrate {} "
+               "Kbps",
+               uuid, upstream_name(session.upstream),
+               parse_request_target(m4s.c_str()), bitrate);
+}
+
+void Proxy::on_videoserver(int videoserver_socket) {
+  int client_socket{client_socket_for_videoserver_.at(videoserver_socket)};
+  Session &session{session_of_client_.at(client_socket)};
+  if (session.chunked_response) {
+    relay_chunks(client_socket, videoserver_socket);
+    return;
+  }
+  // The first part of a segment being fetched in parts completes only the
+  // part.
+  bool is_range_part{session.range_fetch && !session.range_fetch->has_part(0)};
+  bool is_filling{session.slot &&
+                  session.range_fills.contains(session.slot->id)};
+  BufferRef response;
+  try {
+    // A chunked response goes on to the client chunk by chunk as it comes
+    // in, unless the proxy needs all of it: range parts are stitched
+    // together, manifests cached, and the segments of Range requests cached
+    // and cut into ranges.
+    response = read_message(
+        videoserver_socket, session.response_reader,
+        !is_range_part && session.manifest.empty() && !is_filling);
+  } catch (const std::runtime_error &e) {
+    // A videoserver closing an idle connection has not failed anyone.
+    bool is_failed{session.pending_request.has_value()};
+    if (is_failed) {
+      report_failure(session.upstream);
+    }
+    if (!fail_over(client_socket, is_failed)) {
+      spdlog::info("No videoserver left for client socket sockfd {}",
+                   client_socket);
+      close_session(client_socket);
+    }
+    return;
+  }
+  if (!response) {
+    return;
+  }
+  // When the first byte of the response came in.
+  UpstreamSelector::Clock::time_point responded_at{
+      session.response_reader.started_at()};
+  if (!session.slot) {
+    spdlog::warn("Videoserver sent client socket sockfd {} a response it did "
+                 "not ask for",
+                 client_socket);
+    return;
+  }
+  size_t msg_len{response.size()};
+  bool is_relayed{is_chunked(response.data())};
+  uint64_t slot{session.slot->id};
+  request_tracer_.on_first_byte(client_socket, slot, responded_at);
+  if (!is_relayed && !is_range_part) {
+    request_tracer_.on_last_byte(client_socket, slot,
+                                 RequestTracer::Clock::now());
+  }
+  if (is_relayed) {
+    // Until the next chunk.
+    poller_->set_deadline(videoserver_socket, UPSTREAM_RESPONSE_TIMEOUT_MS);
+  } else {
+    poller_->clear_deadline(videoserver_socket);
+  }
+  if (segment_cache_.is_enabled() && session.slot->is_segment &&
+      !is_relayed && !is_range_part && session.pending_request) {
+    segment_cache_.insert(
+        parse_request_target(session.pending_request->c_str()), response);
+  }
+  session.pending_request.reset();
+  if (session.request_sent_at) {
+    upstream_selector_.record_latency(session.upstream,
+                                      responded_at - *session.request_sent_at,
+                                      responded_at);
+    session.request_sent_at.reset();
+  }
+  TcpDelivery before;
+  if (session.segment_uuid) {
+    if (sample_tcp_delivery(client_socket, before)) {
+      session.segment_delivery =
+          SegmentDelivery{*session.segment_uuid, msg_len, before};
+    }
+    session.segment_uuid.reset();
+  }
+  if (!session.manifest.empty()) {
+    response = manifest_cache_.on_response(
+        session.manifest, std::move(response), ManifestCache::Clock::now());
+    session.manifest.clear();
+  }
+  // Whatever the client does not take right away is sent from the buffer as
+  // it drains, while the loop serves other sockets.
+  if (is_range_part) {
+    deliver_range_part(client_socket, 0, std::move(response));
+  } else if (write_response(client_socket, slot, std::move(response),
+                            msg_len) &&
+             (is_relayed || finish_exchange(client_socket))) {
+    load_reporter_.add_egress(videoserver_socket, msg_len);
+    if (is_relayed) {
+      session.chunked_response.emplace();
+    }
+  } else {
+    spdlog::info("Client socket sockfd {} disconnected", client_socket);
+    close_session(client_socket);
+  }
+  send_backlog(client_socket);
+  send_queued_fetches();
+}
+
+void Proxy::on_range_part(int videoserver_socket) {
+  RangePart &part{range_part_of_videoserver_.at(videoserver_socket)};
+  BufferRef response;
+  try {
+    response = read_message(videoserver_socket, part.reader);
+  } catch (const std::runtime_error &e) {
+    RangePart failed{std::move(part)};
+    range_part_of_videoserver_.erase(videoserver_socket);
+    poller_->remove(videoserver_socket);
+    if (close(videoserver_socket) == -1) {
+      spdlog::warn("close()");
+      quick_exit(EXIT_FAILURE);
+    }
+    report_failure(failed.upstream);
+    if (!send_range_part(failed.client_socket, failed.index, failed.request,
+                         failed.upstream, true)) {
+      spdlog::info("No videoserver left for client socket sockfd {}",
+                   failed.client_socket);
+      close_session(failed.client_socket);
+    }
+    return;
+  }
+  if (!response) {
+    return;
+  }
+  int client_socket{part.client_socket};
+  size_t index{part.index};
+  park_videoserver(videoserver_socket, part.upstream);
+  range_part_of_videoserver_.erase(videoserver_socket);
+  deliver_range_part(client_socket, index, std::move(response));
+  send_backlog(client_socket);
+  send_queued_fetches();
+}
+
+void Proxy::on_exchange(int videoserver_socket) {
+  Exchange &in_flight{exchange_of_videoserver_.at(videoserver_socket)};
+  BufferRef response;
+  try {
+    response = read_message(videoserver_socket, in_flight.reader);
+  } catch (const std::runtime_error &e) {
+    Exchange exchange{std::move(in_flight)};
+    exchange_of_videoserver_.erase(videoserver_socket);
+    poller_->remove(videoserver_socket);
+    if (close(videoserver_socket) == -1) {
+      spdlog::warn("close()");
+      quick_exit(EXIT_FAILURE);
+    }
+    report_failure(exchange.upstream);
+    int retry_socket{send_on_own_connection(
+        exchange.client_socket, exchange.request, exchange.upstream, true)};
+    if (retry_socket == -1) {
+      spdlog::info("No videoserver left for client socket sockfd {}",
+                   exchange.client_socket);
+      close_session(exchange.client_socket);
+      return;
+    }
+    exchange.sent_at = UpstreamSelector::Clock::now();
+    exchange.reader = {};
+    exchange_of_videoserver_[retry_socket] = std::move(exchange);
+    return;
+  }
+  if (!response) {
+    return;
+  }
+  Exchange exchange{std::move(in_flight)};
+  exchange_of_videoserver_.erase(videoserver_socket);
+  UpstreamSelector::Clock::time_point responded_at{
+      exchange.reader.started_at()};
+  int client_socket{exchange.client_socket};
+  request_tracer_.on_first_byte(client_socket, exchange.slot.id,
+                                responded_at);
+  request_tracer_.on_last_byte(client_socket, exchange.slot.id,
+                               RequestTracer::Clock::now());
+  if (options_.is_latency_selection) {
+    upstream_selector_.record_latency(
+        exchange.upstream, responded_at - exchange.sent_at, responded_at);
+  }
+  park_videoserver(videoserver_socket, exchange.upstream);
+  Session &session{session_of_client_.at(client_socket)};
+  --session.no_of_exchanges;
+  if (!exchange.manifest.empty()) {
+    response = manifest_cache_.on_response(
+        exchange.manifest, std::move(response), ManifestCache::Clock::now());
+  }
+  if (exchange.slot.is_segment) {
+    fetch_scheduler_.complete(client_socket);
+    if (segment_cache_.is_enabled()) {
+      segment_cache_.insert(parse_request_target(exchange.request.c_str()),
+                            response);
+    }
+  }
+  size_t msg_len;
+  if (write_response(client_socket, exchange.slot.id, std::move(response),
+                     msg_len) &&
+      response_queues_.finish(client_socket, exchange.slot.id)) {
+    load_reporter_.add_egress(session.videoserver_socket, msg_len);
+  } else {
+    spdlog::info("Client socket sockfd {} disconnected", client_socket);
+    close_session(client_socket);
+  }
+  send_backlog(client_socket);
+  send_queued_fetches();
+}
+
+// The full manifest looked up on videoserver_socket is in: record the
+// bitrates of its video and go on with the manifest request it was looked up
+// for, or look them up on another videoserver if it lists none.
+void Proxy::on_bitrate_lookup(int videoserver_socket) {
+  BitrateLookup &in_flight{
+      bitrate_lookup_of_videoserver_.at(videoserver_socket)};
+  BufferRef response;
+  try {
+    response = read_message(videoserver_socket, in_flight.reader);
+  } catch (const std::runtime_error &e) {
+    BitrateLookup lookup{std::move(in_flight)};
+    bitrate_lookup_of_videoserver_.erase(videoserver_socket);
+    poller_->remove(videoserver_socket);
+    if (close(videoserver_socket) == -1) {
+      spdlog::warn("close()");
+      quick_exit(EXIT_FAILURE);
+    }
+    report_failure(lookup.upstream);
+    int client_socket{lookup.client_socket};
+    if (!look_up_bitrates(std::move(lookup), true)) {
+      spdlog::info("No videoserver left for client socket sockfd {}",
+                   client_socket);
+      close_session(client_socket);
+    }
+    return;
+  }
+  if (!response) {
+    return;
+  }
+  BitrateLookup lookup{std::move(in_flight)};
+  bitrate_lookup_of_videoserver_.erase(videoserver_socket);
+  park_videoserver(videoserver_socket, lookup.upstream);
+  RequestTracer::Scope scope{request_tracer_, lookup.client_socket,
+                             lookup.slot};
+  request_tracer_.add_span("bitrate lookup", lookup.sent_at,
+                           RequestTracer::Clock::now());
+  int status_code{parse_status_code(response.data())};
+  if (!parse_bitrate_of_video(response, bitrate_of_video_,
+                              segment_duration_of_video_,
+                              lookup.path_to_video) &&
+      (status_code < 400 || status_code >= 500)) {
+    // Any videoserver would answer a 4xx the same (there is no such video),
+    // so the client gets the answer to its own request; otherwise this one
+    // is taken to have failed.
+    spdlog::warn("No bitrates of {} in the manifest from {}",
+                 lookup.path_to_video, upstream_name(lookup.upstream));
+    report_failure(lookup.upstream);
+    int client_socket{lookup.client_socket};
+    if (!look_up_bitrates(std::move(lookup), true)) {
+      spdlog::info("No videoserver left for client socket sockfd {}",
+                   client_socket);
+      close_session(client_socket);
+    }
+    return;
+  }
+  serve_manifest(lookup.client_socket, lookup.slot, lookup.path_to_video,
+                 lookup.uuid);
+}
+
+// What has come in of the message on socket, read by reader: the message
+// once all of it is in, else an empty buffer. Its header, then its body,
+// have until a deadline from when they start to come in; once it is all in,
+// the caller sets the deadline of socket for what comes next.
+BufferRef Proxy::read_message(int socket, HttpReader &reader,
+                              bool is_chunked_relayed) {
+  HttpReader::Phase phase{reader.phase()};
+  BufferRef message{
+      reader.read(*poller_, socket, buffer_pool_, is_chunked_relayed)};
+  if (!message && reader.phase() != phase) {
+    poller_->set_deadline(socket, reader.phase() == HttpReader::HEADER
+                                      ? HTTP_HEADER_READ_TIMEOUT_MS
+                                      : HTTP_BODY_READ_TIMEOUT_MS);
+  }
+  return message;
+}
+
+const std::string &Proxy::upstream_name(Upstream upstream) {
+  auto it{name_of_upstream_.find(upstream.key())};
+  if (it == name_of_upstream_.end()) {
+    it = name_of_upstream_.emplace(upstream.key(), name_of(upstream)).first;
+  }
+  return it->second;
+}
+
+void Proxy::report_failure(Upstream upstream) {
+  upstream_health_.report_failure(upstream);
+  upstream_selector_.record_error(upstream, UpstreamSelector::Clock::now());
+}
+
+// A new connection to upstream, or -1 if it cannot be made in time.
+int Proxy::open_connection(Upstream upstream) {
+  RequestTracer::Timed timed{request_tracer_, "upstream connect"};
+  return try_get_outbound_socket(upstream.addr, upstream.port,
+                                 UPSTREAM_CONNECT_TIMEOUT_MS);
+}
+
+// A connection to upstream from the idle ones, or -1 if there is none.
+int Proxy::take_idle_videoserver(Upstream upstream) {
+  auto it{idle_videoservers_of_upstream_.find(upstream.key())};
+  if (it == idle_videoservers_of_upstream_.end() || it->second.empty()) {
+    return -1;
+  }
+  int videoserver_socket{it->second.back()};
+  it->second.pop_back();
+  upstream_of_idle_videoserver_.erase(videoserver_socket);
+  poller_->remove(videoserver_socket);
+  return videoserver_socket;
+}
+
+// Keep videoserver_socket (connected to upstream and no longer any client's)
+// open for the next client routed there, unless enough are.
+void Proxy::park_videoserver(int videoserver_socket, Upstream upstream) {
+  std::vector<int> &idle{idle_videoservers_of_upstream_[upstream.key()]};
+  if (idle.size() < MAX_IDLE_CONNECTIONS_PER_UPSTREAM) {
+    idle.push_back(videoserver_socket);
+    upstream_of_idle_videoserver_[videoserver_socket] = upstream;
+    poller_->set_deadline(videoserver_socket, UPSTREAM_IDLE_TIMEOUT_MS);
+    return;
+  }
+  poller_->remove(videoserver_socket);
+  if (close(videoserver_socket) == -1) {
+    spdlog::warn("park_videoserver()");
+    quick_exit(EXIT_FAILURE);
+  }
+}
+
+// Close an idle connection, e.g. once its videoserver closed it.
+void Proxy::drop_idle_videoserver(int videoserver_socket) {
+  std::vector<int> &idle{idle_videoservers_of_upstream_
+                             [upstream_of_idle_videoserver_[videoserver_socket]
+                                  .key()]};
+  idle.erase(std::find(idle.begin(), idle.end(), videoserver_socket));
+  upstream_of_idle_videoserver_.erase(videoserver_socket);
+  poller_->remove(videoserver_socket);
+  if (close(videoserver_socket) == -1) {
+    spdlog::warn("drop_idle_videoserver()");
+    quick_exit(EXIT_FAILURE);
+  }
+}
+
+// Connect to a videoserver for the client at client_addr other than avoid (if
+// given): the one the load balancer picks if it is healthy, then the other
+// healthy ones in order (best first with --upstream-selection latency, reusing
+// idle connections). Returns the socket and sets upstream, or -1 if no
+// videoserver takes the connection. When not failing over, a client the load
+// balancer refuses is refused.
+int Proxy::connect_to_videoserver(in_addr_t client_addr,
+                                  const std::string &content_key,
+                                  const Upstream *avoid, Upstream &upstream) {
+  std::vector<Upstream> candidates{};
+  if (options_.is_balance) {
+    RequestTracer::Timed timed{request_tracer_, "load balancer lookup"};
+    try {
+      LoadBalancerResponse loadBalancer_response{
+          query_load_balancer(options_.hostname.c_str(), options_.port,
+                              client_addr, content_key)};
+      Upstream chosen{loadBalancer_response.videoserver_addr,
+                      loadBalancer_response.videoserver_port};
+      upstream_health_.add(chosen);
+      if (upstream_health_.is_healthy(chosen)) {
+        candidates.push_back(chosen);
+      }
+    } catch (const LoadBalancerUnreachable &e) {
+      // Fall back to the videoservers we know.
+    } catch (const std::runtime_error &e) {
+      if (avoid == nullptr) {
+        return -1;
+      }
+    }
+  }
+  for (const Upstream &healthy : upstream_health_.healthy_upstreams()) {
+    if (candidates.empty() || healthy.key() != candidates[0].key()) {
+      candidates.push_back(healthy);
+    }
+  }
+
+  if (options_.is_latency_selection) {
+    candidates =
+        upstream_selector_.rank(candidates, UpstreamSelector::Clock::now());
+  }
+
+  for (const Upstream &candidate : candidates) {
+    if (avoid != nullptr && candidate.key() == avoid->key()) {
+      continue;
+    }
+    int videoserver_socket{take_idle_videoserver(candidate)};
+    if (videoserver_socket == -1) {
+      videoserver_socket = open_connection(candidate);
+    }
+    if (videoserver_socket != -1) {
+      upstream = candidate;
+      return videoserver_socket;
+    }
+    report_failure(candidate);
+  }
+  return -1;
+}
+
+// Make videoserver_socket (connected to upstream) the videoserver socket of
+// client_socket, closing the one it had, if any.
+void Proxy::set_videoserver(int client_socket, int videoserver_socket,
+                            Upstream upstream) {
+  Session &session{session_of_client_.at(client_socket)};
+  if (session.videoserver_socket != -1) {
+    int old_videoserver_socket{session.videoserver_socket};
+    poller_->remove(old_videoserver_socket);
+    if (close(old_videoserver_socket) == -1) {
+      spdlog::warn("set_videoserver()");
+      quick_exit(EXIT_FAILURE);
+    }
+    load_reporter_.remove_session(old_videoserver_socket);
+    client_socket_for_videoserver_.erase(old_videoserver_socket);
+  }
+  session.response_reader = {};
+  session.chunked_response.reset();
+  session.videoserver_socket = videoserver_socket;
+  session.upstream = upstream;
+  client_socket_for_videoserver_[videoserver_socket] = client_socket;
+  load_reporter_.add_session(videoserver_socket, upstream.addr,
+                             upstream.port);
+  poller_->add_socket(videoserver_socket);
+}
+
+// Close the connections in connection_of_videoserver that are client_socket's.
+template <typename Connection>
+void Proxy::close_connections(
+    int client_socket,
+    std::unordered_map<int, Connection> &connection_of_videoserver) {
+  for (auto it{connection_of_videoserver.begin()};
+       it != connection_of_videoserver.end();) {
+    if (it->second.client_socket != client_socket) {
+      ++it;
+      continue;
+    }
+    poller_->remove(it->first);
+    if (close(it->first) == -1) {
+      spdlog::warn("close_connections()");
+      quick_exit(EXIT_FAILURE);
+    }
+    it = connection_of_videoserver.erase(it);
+  }
+}
+
+// Stop sending client_socket a segment in parts, closing the connections of
+// the parts still outstanding.
+void Proxy::end_range_fetch(int client_socket) {
+  session_of_client_.at(client_socket).range_fetch.reset();
+  close_connections(client_socket, range_part_of_videoserver_);
+}
+
+void Proxy::close_session(int client_socket) {
+  auto session_it{session_of_client_.find(client_socket)};
+  if (session_it == session_of_client_.end()) {
+    return;
+  }
+  Session &session{session_it->second};
+  int videoserver_socket{session.videoserver_socket};
+  poller_->remove(client_socket);
+  if (close(client_socket) == -1) {
+    spdlog::warn("close()");
+    quick_exit(EXIT_FAILURE);
+  }
+  // A connection still in the middle of a response cannot be reused.
+  if (options_.is_latency_selection && !session.slot) {
+    park_videoserver(videoserver_socket, session.upstream);
+  } else {
+    poller_->remove(videoserver_socket);
+    if (close(videoserver_socket) == -1) {
+      spdlog::warn("close()");
+      quick_exit(EXIT_FAILURE);
+    }
+  }
+  close_connections(client_socket, exchange_of_videoserver_);
+  close_connections(client_socket, bitrate_lookup_of_videoserver_);
+  end_range_fetch(client_socket);
+  load_reporter_.remove_session(videoserver_socket);
+  write_queues_.remove(client_socket);
+  response_queues_.remove(client_socket);
+  request_tracer_.remove(client_socket);
+  fetch_scheduler_.remove(client_socket);
+  client_socket_for_videoserver_.erase(videoserver_socket);
+  session_of_client_.erase(session_it);
+  if (!is_accepting_ &&
+      overload_control_.is_admitting(session_of_client_.size())) {
+    poller_->add_listener(listen_socket_);
+    is_accepting_ = true;
+    spdlog::info("Accepting connections again");
+  }
+}
+
+// Reconnect client_socket to a videoserver (another one if is_failed) and
+// re-issue its pending request there. Returns false if no videoserver could
+// take over, in which case the session should be closed.
+bool Proxy::fail_over(int client_socket, bool is_failed) {
+  Session &session{session_of_client_.at(client_socket)};
+  for (int attempt{0}; attempt < MAX_FAILOVER_ATTEMPTS; ++attempt) {
+    Upstream failed{session.upstream}, upstream;
+    int videoserver_socket{
+        connect_to_videoserver(session.addr, session.content_key,
+                               is_failed ? &failed : nullptr, upstream)};
+    if (videoserver_socket == -1) {
+      return false;
+    }
+    set_videoserver(client_socket, videoserver_socket, upstream);
+    spdlog::info("Client socket sockfd {} {} to {}", client_socket,
+                 is_failed ? "failed over" : "reconnected",
+                 upstream_name(upstream));
+
+    if (!session.pending_request) {
+      return true;
+    }
+    try {
+      send_one_http(videoserver_socket, session.pending_request->c_str(),
+                    session.pending_request->length());
+      poller_->set_deadline(videoserver_socket, UPSTREAM_RESPONSE_TIMEOUT_MS);
+      if (options_.is_latency_selection) {
+        session.request_sent_at = UpstreamSelector::Clock::now();
+      }
+      return true;
+    } catch (const std::runtime_error &e) {
+      report_failure(upstream);
+      is_failed = true;
+    }
+  }
+  return false;
+}
+
+// With --upstream-selection latency, move client_socket over to the best
+// ranked videoserver, if it is not on it already, before it sends its next
+// request. Its connection to the previous one is parked for reuse. A client
+// still being sent a response on it stays where it is.
+void Proxy::route(int client_socket) {
+  Session &session{session_of_client_.at(client_socket)};
+  if (!options_.is_latency_selection || session.slot) {
+    return;
+  }
+  std::vector<Upstream> ranked{upstream_selector_.rank(
+      upstream_health_.healthy_upstreams(), UpstreamSelector::Clock::now())};
+  Upstream curr_upstream{session.upstream};
+  if (ranked.empty() || ranked[0].key() == curr_upstream.key()) {
+    return;
+  }
+  int videoserver_socket{take_idle_videoserver(ranked[0])};
+  if (videoserver_socket == -1) {
+    videoserver_socket = open_connection(ranked[0]);
+  }
+  if (videoserver_socket == -1) {
+    // Stay on the videoserver the client already has.
+    report_failure(ranked[0]);
+    return;
+  }
+  int old_videoserver_socket{session.videoserver_socket};
+  load_reporter_.remove_session(old_videoserver_socket);
+  client_socket_for_videoserver_.erase(old_videoserver_socket);
+  session.videoserver_socket = -1;
+  park_videoserver(old_videoserver_socket, curr_upstream);
+  set_videoserver(client_socket, videoserver_socket, ranked[0]);
+  spdlog::info("Client socket sockfd {} routed from {} to {}", client_socket,
+               upstream_name(curr_upstream), upstream_name(ranked[0]));
+}
+
+// Send request to the videoserver of client_socket, its response to go to
+// slot, failing over to another one if it fails. Returns false if no
+// videoserver is left.
+bool Proxy::send_to_videoserver(int client_socket, ResponseSlot slot,
+                                const std::string &request) {
+  route(client_socket);
+  Session &session{session_of_client_.at(client_socket)};
+  session.slot = slot;
+  session.pending_request = request;
+  request_tracer_.on_forwarded(client_socket, slot.id,
+                               RequestTracer::Clock::now());
+  try {
+    send_one_http(session.videoserver_socket, request.c_str(),
+                  request.length());
+    poller_->set_deadline(session.videoserver_socket,
+                          UPSTREAM_RESPONSE_TIMEOUT_MS);
+    if (options_.is_latency_selection) {
+      session.request_sent_at = UpstreamSelector::Clock::now();
+    }
+    return true;
+  } catch (const std::runtime_error &e) {
+    report_failure(session.upstream);
+    return fail_over(client_socket, true);
+  }
+}
+
+// Send request of client_socket on a connection of its own: to upstream, or
+// to another videoserver if that fails (or is_failed, when upstream just
+// failed to answer it), setting upstream to the one that takes it. Returns
+// the connection, or -1 if no videoserver takes the request.
+int Proxy::send_on_own_connection(int client_socket,
+                                  const std::string &request,
+                                  Upstream &upstream, bool is_failed) {
+  for (int attempt{0}; attempt < MAX_FAILOVER_ATTEMPTS; ++attempt) {
+    int videoserver_socket;
+    if (is_failed) {
+      Upstream failed{upstream};
+      videoserver_socket = connect_to_videoserver(
+          session_of_client_.at(client_socket).addr, "", &failed, upstream);
+      if (videoserver_socket == -1) {
+        return -1;
+      }
+    } else if ((videoserver_socket = take_idle_videoserver(upstream)) == -1 &&
+               (videoserver_socket = open_connection(upstream)) == -1) {
+      report_failure(upstream);
+      is_failed = true;
+      continue;
+    }
+    try {
+      send_one_http(videoserver_socket, request.c_str(), request.length());
+    } catch (const std::runtime_error &e) {
+      if (close(videoserver_socket) == -1) {
+        spdlog::warn("send_on_own_connection()");
+        quick_exit(EXIT_FAILURE);
+      }
+      report_failure(upstream);
+      is_failed = true;
+      continue;
+    }
+    poller_->add_socket(videoserver_socket);
+    poller_->set_deadline(videoserver_socket, UPSTREAM_RESPONSE_TIMEOUT_MS);
+    return videoserver_socket;
+  }
+  return -1;
+}
+
+// Fetch part index of the segment client_socket is being sent on a
+// connection of its own: to upstream, or to another videoserver if that
+// fails (or is_failed, when upstream just failed to deliver the part).
+// Returns false if no videoserver takes it.
+bool Proxy::send_range_part(int client_socket, size_t index,
+                            const std::string &request, Upstream upstream,
+                            bool is_failed) {
+  int videoserver_socket{
+      send_on_own_connection(client_socket, request, upstream, is_failed)};
+  if (videoserver_socket == -1) {
+    return false;
+  }
+  range_part_of_videoserver_[videoserver_socket] = {client_socket, index,
+                                                    upstream, request};
+  return true;
+}
+
+// Fetch the full manifest for lookup on a connection of its own: to its
+// upstream, or to another videoserver if that fails (or is_failed, when its
+// upstream just failed to send it). Returns false if no videoserver takes it.
+bool Proxy::look_up_bitrates(BitrateLookup lookup, bool is_failed) {
+  int videoserver_socket{send_on_own_connection(
+      lookup.client_socket, vid_mpd_request(lookup.path_to_video),
+      lookup.upstream, is_failed)};
+  if (videoserver_socket == -1) {
+    return false;
+  }
+  lookup.reader = {};
+  bitrate_lookup_of_videoserver_[videoserver_socket] = std::move(lookup);
+  return true;
+}
+
+// Send request of client_socket, its response to go to slot: on the
+// connection of the client if it is free, else on one of its own to the same
+// videoserver. manifest is the video whose manifest it fetches, if the
+// response is to be cached. Returns false if no videoserver is left.
+bool Proxy::dispatch(int client_socket, ResponseSlot slot,
+                     const std::string &request,
+                     const std::string &manifest) {
+  RequestTracer::Scope scope{request_tracer_, client_socket, slot.id};
+  Session &session{session_of_client_.at(client_socket)};
+  if (!session.slot) {
+    if (!manifest.empty()) {
+      session.manifest = manifest;
+    }
+    return send_to_videoserver(client_socket, slot, request);
+  }
+  Upstream upstream{session.upstream};
+  if (session.no_of_exchanges >= MAX_CONCURRENT_PIPELINED_REQUESTS) {
+    session.backlog.push_back(
+        {client_socket, slot, upstream, request, manifest, {}});
+    return true;
+  }
+  int videoserver_socket{
+      send_on_own_connection(client_socket, request, upstream, false)};
+  if (videoserver_socket == -1) {
+    return false;
+  }
+  ++session.no_of_exchanges;
+  request_tracer_.on_forwarded(client_socket, slot.id,
+                               RequestTracer::Clock::now());
+  exchange_of_videoserver_[videoserver_socket] = {
+      client_socket, slot,     upstream,
+      request,       manifest, UpstreamSelector::Clock::now()};
+  if (slot.is_segment) {
+    // Its delivery is not measured.
+    session.segment_uuid.reset();
+  }
+  return true;
+}
+
+// Send the requests in the backlog of client_socket, if it is still
+// connected, as far as it may have them out now.
+void Proxy::send_backlog(int client_socket) {
+  while (true) {
+    auto it{session_of_client_.find(client_socket)};
+    if (it == session_of_client_.end() || it->second.backlog.empty() ||
+        (it->second.slot && it->second.no_of_exchanges >=
+                                MAX_CONCURRENT_PIPELINED_REQUESTS)) {
+      return;
+    }
+    Exchange exchange{std::move(it->second.backlog.front())};
+    it->second.backlog.pop_front();
+    if (!dispatch(client_socket, exchange.slot, exchange.request,
+                  exchange.manifest)) {
+      spdlog::info("No videoserver left for client socket sockfd {}",
+                   client_socket);
+      close_session(client_socket);
+      return;
+    }
+  }
+}
+
+// Send the segment request m4s of client_socket, its response to go to slot,
+// split into byte ranges if its fetch is to be and the connection of the
+// client is free: the first on that connection, the others spread over the
+// videoservers (with --upstream-selection latency, the best ranked ones).
+// Returns false if no videoserver is left.
+bool Proxy::send_segment_request(int client_socket, uint64_t slot,
+                                 const std::string &m4s) {
+  RequestTracer::Scope scope{request_tracer_, client_socket, slot};
+  Session &session{session_of_client_.at(client_socket)};
+  if (!session.range_split || session.slot) {
+    session.range_split.reset();
+    return dispatch(client_socket, {slot, true}, m4s, "");
+  }
+  auto [part_size, no_of_parts]{*session.range_split};
+  session.range_split.reset();
+
+  std::vector<std::string> requests{
+      split_into_ranges(m4s, part_size, no_of_parts)};
+  session.range_fetch.emplace(part_size, no_of_parts);
+  if (!send_to_videoserver(client_socket, {slot, true}, requests[0])) {
+    return false;
+  }
+  std::vector<Upstream> upstreams{session.upstream};
+  if (options_.is_latency_selection) {
+    std::vector<Upstream> ranked{
+        upstream_selector_.rank(upstream_health_.healthy_upstreams(),
+                                UpstreamSelector::Clock::now())};
+    if (!ranked.empty()) {
+      upstreams = ranked;
+    }
+  }
+  for (size_t i{1}; i < no_of_parts; ++i) {
+    if (!send_range_part(client_socket, i, requests[i],
+                         upstreams[i % upstreams.size()], false)) {
+      return false;
+    }
+  }
+  spdlog::info("Segment of client socket sockfd {} split into {} ranges of {} "
+               "bytes",
+               client_socket, no_of_parts, part_size);
+  return true;
+}
+
+// Hand the slots freed by completed fetches to the most urgent queued ones.
+void Proxy::send_queued_fetches() {
+  while (auto fetch{fetch_scheduler_.next()}) {
+    if (!send_segment_request(fetch->client_socket, fetch->response_slot,
+                              fetch->request)) {
+      spdlog::info("No videoserver left for client socket sockfd {}",
+                   fetch->client_socket);
+      close_session(fetch->client_socket);
+      continue;
+    }
+    spdlog::info("Queued segment of client socket sockfd {} forwarded",
+                 fetch->client_socket);
+  }
+}
+
+// Write to slot of client_socket the response to its Range request range
+// from whole, the response with the whole segment, setting no_of_bytes to
+// its size. Returns false if the client failed.
+bool Proxy::write_ranges(int client_socket, uint64_t slot,
+                         const std::string &range, BufferRef whole,
+                         size_t &no_of_bytes) {
+  std::vector<std::pair<std::string_view, BufferRef>> writes;
+  respond_to_range(range, std::move(whole), buffer_pool_, writes);
+  no_of_bytes = 0;
+  for (auto &[data, buffer] : writes) {
+    no_of_bytes += data.length();
+    if (!response_queues_.write(client_socket, slot, data,
+                                std::move(buffer))) {
+      return false;
+    }
+  }
+  return true;
+}
+
+// Write response, all of it in, to slot of client_socket, setting
+// no_of_bytes to what the client is sent: if it is the whole segment fetched
+// for a Range request, it is cached and the client sent the ranges it asked
+// for. Returns false if the client failed.
+bool Proxy::write_response(int client_socket, uint64_t slot,
+                           BufferRef response, size_t &no_of_bytes) {
+  Session &session{session_of_client_.at(client_socket)};
+  auto fill_it{session.range_fills.find(slot)};
+  if (fill_it == session.range_fills.end()) {
+    no_of_bytes = response.size();
+    return response_queues_.write(client_socket, slot, std::move(response));
+  }
+  RangeFill fill{std::move(fill_it->second)};
+  session.range_fills.erase(fill_it);
+  segment_cache_.insert(fill.path, response);
+  return write_ranges(client_socket, slot, fill.range, std::move(response),
+                      no_of_bytes);
+}
+
+// All of the response on the connection of client_socket is in: free its
+// slot, and the fetch it held if any. Returns false if the client failed.
+bool Proxy::finish_exchange(int client_socket) {
+  Session &session{session_of_client_.at(client_socket)};
+  ResponseSlot slot{*session.slot};
+  session.slot.reset();
+  if (slot.is_segment) {
+    fetch_scheduler_.complete(client_socket);
+  }
+  return response_queues_.finish(client_socket, slot.id);
+}
+
+// Part index of the segment client_socket is being sent is in: send the
+// client what is ready now, and end the fetch once it is complete.
+void Proxy::deliver_range_part(int client_socket, size_t index,
+                               BufferRef response) {
+  Session &session{session_of_client_.at(client_socket)};
+  std::vector<std::pair<std::string_view, BufferRef>> writes;
+  RangeFetch::Status status{session.range_fetch->on_part(
+      index, std::move(response), buffer_pool_, writes)};
+  for (auto &[data, buffer] : writes) {
+    if (!response_queues_.write(client_socket, session.slot->id, data,
+                                std::move(buffer))) {
+      spdlog::info("Client socket sockfd {} disconnected", client_socket);
+      close_session(client_socket);
+      return;
+    }
+    load_reporter_.add_egress(session.videoserver_socket, data.length());
+  }
+  if (status == RangeFetch::FAILED) {
+    spdlog::warn("Ranges of the segment of client socket sockfd {} do not add "
+                 "up",
+                 client_socket);
+    close_session(client_socket);
+  } else if (status == RangeFetch::DONE) {
+    if (session.segment_delivery && session.range_fetch->total() > 0) {
+      session.segment_delivery->no_of_bytes = session.range_fetch->total();
+    }
+    end_range_fetch(client_socket);
+    request_tracer_.on_last_byte(client_socket, session.slot->id,
+                                 RequestTracer::Clock::now());
+    if (!finish_exchange(client_socket)) {
+      spdlog::info("Client socket sockfd {} disconnected", client_socket);
+      close_session(client_socket);
+    }
+  }
+}
+
+// Relay to client_socket what has come in of the chunked response on
+// videoserver_socket, completing its fetch once all of it has. The client
+// has part of the response already, so a videoserver failing now cannot be
+// failed over from.
+void Proxy::relay_chunks(int client_socket, int videoserver_socket) {
+  Session &session{session_of_client_.at(client_socket)};
+  ChunkedDecoder &decoder{*session.chunked_response};
+  BufferRef chunks;
+  try {
+    chunks = recv_chunks(*poller_, videoserver_socket, decoder, buffer_pool_);
+  } catch (const std::runtime_error &e) {
+    report_failure(session.upstream);
+    spdlog::info("Client socket sockfd {} lost its videoserver mid-response",
+                 client_socket);
+    close_session(client_socket);
+    return;
+  }
+  size_t no_of_bytes{chunks.size()};
+  if (no_of_bytes > 0 && !response_queues_.write(client_socket,
+                                                 session.slot->id,
+                                                 std::move(chunks))) {
+    spdlog::info("Client socket sockfd {} disconnected", client_socket);
+    close_session(client_socket);
+    return;
+  }
+  load_reporter_.add_egress(videoserver_socket, no_of_bytes);
+  if (session.segment_delivery) {
+    session.segment_delivery->no_of_bytes += no_of_bytes;
+  }
+  if (!decoder.is_done() && no_of_bytes > 0) {
+    poller_->set_deadline(videoserver_socket, UPSTREAM_RESPONSE_TIMEOUT_MS);
+  } else if (decoder.is_done()) {
+    poller_->clear_deadline(videoserver_socket);
+    session.chunked_response.reset();
+    request_tracer_.on_last_byte(client_socket, session.slot->id,
+                                 RequestTracer::Clock::now());
+    if (!finish_exchange(client_socket)) {
+      spdlog::info("Client socket sockfd {} disconnected", client_socket);
+      close_session(client_socket);
+    }
+    send_backlog(client_socket);
+    send_queued_fetches();
+  }
+}
+
+void Proxy::add_throughput_sample(const std::string &uuid, double kbps,
+                                  in_addr_t client_addr) {
+  throughput_of_client_[uuid] = update_throughput(
+      options_.throughput_filter, throughput_of_client_[uuid],
+      window_of_client_[uuid], kbps, options_.alpha);
+  sampled_at_of_client_[uuid] = std::time(nullptr);
+  throughput_priors_.add_sample(client_addr, kbps);
+}
+
+// Without adding an estimate of 0 that would never be forgotten.
+unsigned long Proxy::throughput_of(const std::string &uuid) const {
+  auto throughput_it{throughput_of_client_.find(uuid)};
+  return throughput_it == throughput_of_client_.end() ? 0UL
+                                                      : throughput_it->second;
+}
+
+// Clients not heard from in SESSION_STATE_MAX_AGE_S are forgotten, so that
+// what is kept by uuid does not grow for as long as the proxy runs. This is
+// done once a second, before saving, or with the health checks if there is no
+// state file.
+void Proxy::forget_stale_clients() {
+  std::time_t now{std::time(nullptr)};
+  std::erase_if(sampled_at_of_client_, [&](const auto &entry) {
+    if (now - entry.second <= SESSION_STATE_MAX_AGE_S) {
+      return false;
+    }
+    throughput_of_client_.erase(entry.first);
+    window_of_client_.erase(entry.first);
+    return true;
+  });
+  std::erase_if(last_segment_of_client_, [now](const auto &entry) {
+    return now - entry.second.sent_at > SESSION_STATE_MAX_AGE_S;
+  });
+}
+
+void Proxy::save_session_state() {
+  forget_stale_clients();
+  session_state_.save(throughput_of_client_, sampled_at_of_client_,
+                      bitrate_of_video_, segment_duration_of_video_);
+}
@@ -0,0 +1,304 @@
+#ifndef PROXY_H
+#define PROXY_H
+
+#include "abr.h"
+#include "buffer_pool.h"
+#include "chunked.h"
+#include "fetch_scheduler.h"
+#include "http.h"
+#include "load_reporter.h"
+#include "manifest_cache.h"
+#include "overload_control.h"
+#include "poller.h"
+#include "range_fetch.h"
+#include "request_tracer.h"
+#include "response_queue.h"
+#include "segment_cache.h"
+#include "session_state.h"
+#include "tcp_delivery.h"
+#include "throughput_priors.h"
+#include "upstream_health.h"
+#include "upstream_selector.h"
+#include "write_queue.h"
+#include <cstddef>
+#include <cstdint>
+#include <ctime>
+#include <deque>
+#include <memory>
+#include <optional>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+// The event loop of the proxy: the client connections it accepts, the
+// videoserver connections it relays their requests over, and what it keeps
+// of every client and video to pick bitrates with.
+
+// The command line options of the proxy, checked.
+struct ProxyOptions {
+  int listen_port;
+  // The load balancer with --balance, else the preferred videoserver.
+  std::string hostname;
+  int port;
+  // The videoservers to fail over to.
+  std::vector<Upstream> upstreams;
+  double alpha;
+  ThroughputFilter throughput_filter;
+  bool is_balance, is_report_load, is_content_affinity, is_pacing,
+      is_latency_selection, is_beacon_estimator, is_tcp_info_estimator;
+  size_t max_inflight, segment_cache_size, max_sessions, range_parts;
+  int manifest_ttl_s, prior_prefix;
+  unsigned long egress_limit_kbps, trace_threshold_ms;
+  std::string state_file, trace_file, io_backend;
+};
+
+class Proxy {
+public:
+  // poller is started already.
+  Proxy(ProxyOptions options, std::unique_ptr<Poller> poller);
+  Proxy(const Proxy &) = delete;
+  Proxy &operator=(const Proxy &) = delete;
+
+  // Run until SIGTERM or SIGINT with --state-file, or until the proxy fails.
+  // Returns the exit status.
+  int run();
+
+private:
+  // The slot of a response, and whether it holds one of the fetch
+  // scheduler's fetches.
+  struct ResponseSlot {
+    uint64_t id;
+    bool is_segment;
+  };
+  // A pipelined request of a client, on a connection of its own.
+  struct Exchange {
+    int client_socket;
+    ResponseSlot slot;
+    Upstream upstream;
+    std::string request;
+    std::string manifest; // The video, if the response is to be cached.
+    UpstreamSelector::Clock::time_point sent_at;
+    HttpReader reader{};
+  };
+  // Part index of the segment a client is being sent in parts, on a
+  // connection of its own.
+  struct RangePart {
+    int client_socket;
+    size_t index;
+    Upstream upstream;
+    std::string request;
+    HttpReader reader{};
+  };
+  // The full manifest of a video whose bitrates are not known yet, fetched on
+  // a connection of its own for the manifest request of a client, which goes
+  // on once it is in.
+  struct BitrateLookup {
+    int client_socket;
+    uint64_t slot;
+    std::string path_to_video, uuid;
+    Upstream upstream;
+    RequestTracer::Clock::time_point sent_at;
+    HttpReader reader{};
+  };
+  // For --estimator tcp_info: the client a segment is on its way to, and the
+  // state of its connection when the proxy started sending it. The delivery
+  // is measured once the client sends its next message, as it has received
+  // the whole segment by then.
+  struct SegmentDelivery {
+    std::string uuid;
+    size_t no_of_bytes;
+    TcpDelivery before;
+  };
+  // For the segment cache: a Range request whose whole segment is being
+  // fetched.
+  struct RangeFill {
+    std::string path, range;
+  };
+  // The segment a client was last sent, as it asked for it (the video and
+  // segment number) and as it was fetched (at the bitrate picked), for a
+  // Range request retrying it to get the same bytes.
+  struct LastSegment {
+    std::string asked, fetched;
+    std::time_t sent_at;
+  };
+
+  // A client connection and its own connection to a videoserver.
+  struct Session {
+    in_addr_t addr{};
+    int videoserver_socket{-1};
+    Upstream upstream{};
+    // With --content-affinity, the video it was last routed for.
+    std::string content_key;
+    // The request coming in from it, and the response coming in on its
+    // videoserver connection.
+    HttpReader request_reader{}, response_reader{};
+    // The request on its videoserver connection until all of its response
+    // is in, and until the first of it is, the request (re-issued to another
+    // videoserver if this one fails) and, with --upstream-selection latency,
+    // when it was sent.
+    std::optional<ResponseSlot> slot;
+    std::optional<std::string> pending_request;
+    std::optional<UpstreamSelector::Clock::time_point> request_sent_at;
+    // The response being relayed chunk by chunk as it comes in, if it is.
+    std::optional<ChunkedDecoder> chunked_response;
+    // The video whose manifest it is waiting for, if the cache is on.
+    std::string manifest;
+    // For --estimator tcp_info: the uuid of the segment on its way, then its
+    // delivery.
+    std::optional<std::string> segment_uuid;
+    std::optional<SegmentDelivery> segment_delivery;
+    // For the segment cache, by response slot.
+    std::unordered_map<uint64_t, RangeFill> range_fills;
+    // For --range-parts: the part size and number of parts its next segment
+    // fetch is split into, and the segment it is being sent in parts.
+    std::optional<std::pair<size_t, size_t>> range_split;
+    std::optional<RangeFetch> range_fetch;
+    // The pipelined requests out on connections of their own, and those
+    // waiting while it has as many out as it may.
+    size_t no_of_exchanges{};
+    std::deque<Exchange> backlog;
+  };
+
+  // Start-up; false if the proxy cannot run.
+  bool start();
+
+  // The event handlers.
+  void on_timeout(int socket);
+  void on_accept(const PollEvent &event);
+  void on_client(const PollEvent &event);
+  void on_videoserver(int videoserver_socket);
+  void on_range_part(int videoserver_socket);
+  void on_exchange(int videoserver_socket);
+  void on_bitrate_lookup(int videoserver_socket);
+
+  // The requests of a client, by kind, in slot of client_socket.
+  void on_beacon(int client_socket, uint64_t slot, const char *request);
+  void on_manifest_request(int client_socket, uint64_t slot,
+                           const char *request);
+  void on_range_request(int client_socket, uint64_t slot, const char *request,
+                        const std::string &range);
+  void on_segment_request(int client_socket, uint64_t slot,
+                          const char *request, bool is_pipelined);
+  void serve_manifest(int client_socket, uint64_t slot,
+                      const std::string &path_to_video,
+                      const std::string &uuid);
+
+  // Reading messages.
+  BufferRef read_message(int socket, HttpReader &reader,
+                         bool is_chunked_relayed = false);
+
+  // Before a request of client_socket is handled: for --estimator tcp_info,
+  // measure the delivery of the segment it was sent last, and for
+  // --content-affinity, move it to the videoserver for the video of request.
+  void measure_delivery(int client_socket, bool is_pipelined);
+  void follow_content(int client_socket, const char *request);
+
+  const std::string &upstream_name(Upstream upstream);
+  void report_failure(Upstream upstream);
+
+  // Connections to videoservers.
+  int open_connection(Upstream upstream);
+  int take_idle_videoserver(Upstream upstream);
+  void park_videoserver(int videoserver_socket, Upstream upstream);
+  void drop_idle_videoserver(int videoserver_socket);
+  int connect_to_videoserver(in_addr_t client_addr,
+                             const std::string &content_key,
+                             const Upstream *avoid, Upstream &upstream);
+  void set_videoserver(int client_socket, int videoserver_socket,
+                       Upstream upstream);
+
+  // Sessions.
+  template <typename Connection>
+  void close_connections(
+      int client_socket,
+      std::unordered_map<int, Connection> &connection_of_videoserver);
+  void end_range_fetch(int client_socket);
+  void close_session(int client_socket);
+  bool fail_over(int client_socket, bool is_failed);
+  void route(int client_socket);
+
+  // Sending requests.
+  bool send_to_videoserver(int client_socket, ResponseSlot slot,
+                           const std::string &request);
+  int send_on_own_connection(int client_socket, const std::string &request,
+                             Upstream &upstream, bool is_failed);
+  bool send_range_part(int client_socket, size_t index,
+                       const std::string &request, Upstream upstream,
+                       bool is_failed);
+  bool look_up_bitrates(BitrateLookup lookup, bool is_failed);
+  bool dispatch(int client_socket, ResponseSlot slot,
+                const std::string &request, const std::string &manifest);
+  void send_backlog(int client_socket);
+  bool send_segment_request(int client_socket, uint64_t slot,
+                            const std::string &m4s);
+  void send_queued_fetches();
+
+  // Writing responses.
+  bool write_ranges(int client_socket, uint64_t slot, const std::string &range,
+                    BufferRef whole, size_t &no_of_bytes);
+  bool write_response(int client_socket, uint64_t slot, BufferRef response,
+                      size_t &no_of_bytes);
+  bool finish_exchange(int client_socket);
+  void deliver_range_part(int client_socket, size_t index,
+                          BufferRef response);
+  void relay_chunks(int client_socket, int videoserver_socket);
+
+  // Throughput estimates.
+  void add_throughput_sample(const std::string &uuid, double kbps,
+                             in_addr_t client_addr);
+  unsigned long throughput_of(const std::string &uuid) const;
+  void forget_stale_clients();
+  void save_session_state();
+
+  ProxyOptions options_;
+  // Holds every message the proxy relays; declared first, so that it
+  // outlives all of them (the poller holds those it is sending).
+  BufferPool buffer_pool_{};
+  std::unique_ptr<Poller> poller_;
+  WriteQueues write_queues_;
+  ResponseQueues response_queues_;
+
+  // Without --balance, hostname:port is the preferred videoserver and the
+  // upstreams are tried in order when it fails, or with --upstream-selection
+  // latency, all of them are ranked for every request. With --balance, they
+  // back up the videoservers the load balancer hands out.
+  UpstreamHealth upstream_health_{};
+  UpstreamSelector upstream_selector_{};
+  LoadReporter load_reporter_{};
+  OverloadControl overload_control_;
+  RequestTracer request_tracer_{};
+  FetchScheduler fetch_scheduler_;
+  ManifestCache manifest_cache_;
+  SegmentCache segment_cache_;
+  SessionStateFile session_state_{};
+  ThroughputPriors throughput_priors_;
+
+  int listen_socket_{-1}, signal_fd_{-1};
+  bool is_accepting_{true};
+
+  std::unordered_map<int, Session> session_of_client_{};
+  // The other connections to videoservers: those of sessions, those of the
+  // pipelined requests, range parts and bitrate lookups of clients, and those
+  // no client is using, kept open for the next request routed there.
+  std::unordered_map<int, int> client_socket_for_videoserver_{};
+  std::unordered_map<int, Exchange> exchange_of_videoserver_{};
+  std::unordered_map<int, RangePart> range_part_of_videoserver_{};
+  std::unordered_map<int, BitrateLookup> bitrate_lookup_of_videoserver_{};
+  std::unordered_map<uint64_t, std::vector<int>>
+      idle_videoservers_of_upstream_{};
+  std::unordered_map<int, Upstream> upstream_of_idle_videoserver_{};
+  std::unordered_map<uint64_t, std::string> name_of_upstream_{};
+
+  // By the uuid of a client: its throughput estimate, the samples it is made
+  // of, when it was last sampled and the segment it was last sent.
+  std::unordered_map<std::string, unsigned long> throughput_of_client_{};
+  std::unordered_map<std::string, ThroughputWindow> window_of_client_{};
+  std::unordered_map<std::string, std::time_t> sampled_at_of_client_{};
+  std::unordered_map<std::string, LastSegment> last_segment_of_client_{};
+  // By video.
+  std::unordered_map<std::string, std::vector<int>> bitrate_of_video_{};
+  std::unordered_map<std::string, double> segment_duration_of_video_{};
+};
+
+#endif // !PROXY_H
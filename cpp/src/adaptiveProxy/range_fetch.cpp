@@ -0,0 +1,116 @@
+#include "range_fetch.h"
+
+#include "http.h"
+#include <cstdio>
+#include <cstring>
+#include <strings.h>
+
+std::vector<std::string> split_into_ranges(const std::string &m4s,
+                                           size_t part_size,
+                                           size_t no_of_parts) {
+  size_t request_line_end{m4s.find("\r\n") + 2};
+  std::vector<std::string> requests;
+  for (size_t i{0}; i < no_of_parts; ++i) {
+    std::string range{"Range: bytes=" + std::to_string(i * part_size) + "-"};
+    if (i + 1 < no_of_parts) {
+      range += std::to_string((i + 1) * part_size - 1);
+    }
+    requests.push_back(m4s.substr(0, request_line_end) + range + "\r\n" +
+                       m4s.substr(request_line_end));
+  }
+  return requests;
+}
+
+// The first and last byte and the total size in the Content-Range of the
+// 206 response msg. Returns false if it has none.
+static bool parse_content_range(const char *msg, size_t &first, size_t &last,
+                                size_t &total) {
+  std::string content_range{parse_header_field(msg, "content-range")};
+  return sscanf(content_range.c_str(), "bytes %zu-%zu/%zu", &first, &last,
+                &total) == 3 &&
+         first <= last && last < total;
+}
+
+// The header of a 200 response carrying the whole segment, from that of the
+// 206 response header carrying its first part.
+static std::string whole_header(std::string_view header, size_t total) {
+  std::string whole{"HTTP/1.1 200 OK\r\n"};
+  size_t line_start{header.find("\r\n") + 2};
+  while (line_start < header.length()) {
+    size_t line_end{header.find("\r\n", line_start)};
+    std::string_view line{header.substr(line_start, line_end - line_start)};
+    if (strncasecmp(line.data(), "content-range:", 14) != 0 &&
+        strncasecmp(line.data(), "content-length:", 15) != 0) {
+      whole.append(line).append("\r\n");
+    }
+    line_start = line_end + 2;
+  }
+  return whole + "Content-Length: " + std::to_string(total) + "\r\n\r\n";
+}
+
+RangeFetch::RangeFetch(size_t part_size, size_t no_of_parts)
+    : part_size_{part_size}, parts_(no_of_parts) {}
+
+RangeFetch::Status RangeFetch::on_part(
+    size_t index, BufferRef response, BufferPool &pool,
+    std::vector<std::pair<std::string_view, BufferRef>> &writes) {
+  const char *header_end{strstr(response.data(), "\r\n\r\n")};
+  if (header_end == nullptr) {
+    return FAILED;
+  }
+  std::string_view header{response.data(),
+                          static_cast<size_t>(header_end + 2 -
+                                              response.data())},
+      body{response.view().substr(header.length() + 2)};
+  int status_code{parse_status_code(response.data())};
+  size_t first, last, total;
+  if (index == 0) {
+    if (status_code != 206) {
+      writes.push_back({response.view(), response});
+      return DONE;
+    } else if (!parse_content_range(response.data(), first, last, total_) ||
+               first != 0 || body.length() != last + 1) {
+      return FAILED;
+    }
+    BufferRef whole{pool.copy_of(whole_header(header, total_))};
+    if (!whole) {
+      return FAILED;
+    }
+    writes.push_back({whole.view(), whole});
+  } else if (status_code == 200) {
+    // The videoserver ignored the range and sent the whole segment; the
+    // part is cut from it once the first part says where it ends.
+  } else if (status_code == 416) {
+    body = {};
+  } else if (status_code != 206 ||
+             !parse_content_range(response.data(), first, last, total) ||
+             first != index * part_size_ ||
+             body.length() != last - first + 1) {
+    return FAILED;
+  }
+  parts_[index] = {std::move(response), body, true, status_code == 200};
+
+  if (!parts_[0].is_in) {
+    return PENDING;
+  }
+  for (; next_ < parts_.size() && parts_[next_].is_in; ++next_) {
+    if (parts_[next_].is_whole) {
+      size_t first{next_ * part_size_};
+      std::string_view &whole{parts_[next_].body};
+      whole = first >= whole.length()
+                  ? std::string_view{}
+                  : whole.substr(first, next_ + 1 < parts_.size()
+                                            ? part_size_
+                                            : std::string_view::npos);
+    }
+    if (!parts_[next_].body.empty()) {
+      writes.push_back({parts_[next_].body, parts_[next_].response});
+      no_of_bytes_sent_ += parts_[next_].body.length();
+    }
+    parts_[next_].response = {};
+  }
+  if (next_ < parts_.size()) {
+    return PENDING;
+  }
+  return no_of_bytes_sent_ == total_ ? DONE : FAILED;
+}
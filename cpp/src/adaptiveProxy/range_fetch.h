@@ -0,0 +1,62 @@
+#ifndef RANGE_FETCH_H
+#define RANGE_FETCH_H
+
+#include "buffer_pool.h"
+#include <cstddef>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+// Fetching a segment as byte ranges over several videoserver connections at
+// once, so that a single TCP connection to the videoserver does not cap how
+// fast a segment comes in.
+
+// The request of a segment is split into parts of part_size bytes, the last
+// one open-ended so that the parts cover the segment however far its size is
+// off the estimate part_size is taken from. Parts that start past the end of
+// the segment come back as 416s and are taken to be empty. The client gets
+// one 200 response: the header and body of the first part as soon as it is
+// in, then every further part as soon as it and those before it are.
+
+// Segments are not split into parts smaller than this.
+#define RANGE_MIN_PART_SIZE (64 * 1024)
+
+// The requests for no_of_parts byte ranges of part_size bytes (the last one
+// open-ended) that make up the segment GET request m4s.
+std::vector<std::string> split_into_ranges(const std::string &m4s,
+                                           size_t part_size,
+                                           size_t no_of_parts);
+
+class RangeFetch {
+public:
+  enum Status { PENDING, DONE, FAILED };
+
+  RangeFetch(size_t part_size, size_t no_of_parts);
+
+  bool has_part(size_t index) const { return parts_[index].is_in; }
+
+  // The size of the segment, once the first part is in.
+  size_t total() const { return total_; }
+
+  // The response to the request of part index (NUL-terminated, as
+  // an HttpReader leaves it) is in. Appends what can now go to the client,
+  // in order, to writes (the header from pool). If the videoserver ignored
+  // the range or answered with an error, the first part's response is all the
+  // client gets and the fetch is DONE. It has FAILED if the parts do not make
+  // up the segment, or there is no memory for the header.
+  Status on_part(size_t index, BufferRef response, BufferPool &pool,
+                 std::vector<std::pair<std::string_view, BufferRef>> &writes);
+
+private:
+  struct Part {
+    BufferRef response;
+    std::string_view body;
+    bool is_in, is_whole; // is_whole: body is the whole segment.
+  };
+
+  size_t part_size_, total_{}, next_{}, no_of_bytes_sent_{};
+  std::vector<Part> parts_;
+};
+
+#endif // !RANGE_FETCH_H
@@ -0,0 +1,232 @@
+#include "request_tracer.h"
+
+#include <unistd.h>
+
+// s as the contents of a JSON string.
+static std::string escaped(const std::string &s) {
+  std::string escaped;
+  for (unsigned char c : s) {
+    if (c == '"' || c == '\\') {
+      escaped += '\\';
+      escaped += c;
+    } else if (c < 0x20) {
+      char code[7];
+      snprintf(code, sizeof(code), "\\u%04x", c);
+      escaped += code;
+    } else {
+      escaped += c;
+    }
+  }
+  return escaped;
+}
+
+RequestTracer::~RequestTracer() {
+  if (file_ != nullptr) {
+    fclose(file_);
+  }
+}
+
+bool RequestTracer::open(const std::string &path, unsigned long slow_ms) {
+  if ((file_ = fopen(path.c_str(), "w")) == nullptr) {
+    return false;
+  }
+  // The closing ] is optional in the JSON array form, so that a trace can
+  // be read while it is being written, or after a crash.
+  fputs("[\n", file_);
+  fflush(file_);
+  slow_ = std::chrono::milliseconds{slow_ms};
+  start_ = Clock::now();
+  return true;
+}
+
+void RequestTracer::on_accept(int socket, Clock::time_point accepted_at) {
+  if (file_ == nullptr) {
+    return;
+  }
+  trace_of_slot_of_socket_[socket][SETUP].accepted = accepted_at;
+}
+
+void RequestTracer::start(int socket, uint64_t slot,
+                          Clock::time_point received_at) {
+  if (file_ == nullptr) {
+    return;
+  }
+  std::unordered_map<uint64_t, Trace> &trace_of_slot{
+      trace_of_slot_of_socket_[socket]};
+  Trace &trace{trace_of_slot[slot] = {}};
+  trace.received = received_at;
+  auto setup_it{trace_of_slot.find(SETUP)};
+  if (setup_it != trace_of_slot.end()) {
+    trace.accepted = setup_it->second.accepted;
+    trace.spans = std::move(setup_it->second.spans);
+    trace_of_slot.erase(setup_it);
+  }
+}
+
+void RequestTracer::tag(int socket, uint64_t slot, const char *name,
+                        const std::string &uuid, const std::string &video,
+                        int bitrate) {
+  if (Trace *trace{find(socket, slot)}) {
+    trace->name = name;
+    trace->uuid = uuid;
+    trace->video = video;
+    trace->bitrate = bitrate;
+  }
+}
+
+void RequestTracer::on_forwarded(int socket, uint64_t slot,
+                                 Clock::time_point at) {
+  Trace *trace{find(socket, slot)};
+  if (trace != nullptr && trace->forwarded == Clock::time_point{}) {
+    trace->forwarded = at;
+  }
+}
+
+void RequestTracer::on_first_byte(int socket, uint64_t slot,
+                                  Clock::time_point at) {
+  Trace *trace{find(socket, slot)};
+  if (trace != nullptr && trace->first_byte == Clock::time_point{}) {
+    trace->first_byte = at;
+  }
+}
+
+void RequestTracer::on_last_byte(int socket, uint64_t slot,
+                                 Clock::time_point at) {
+  Trace *trace{find(socket, slot)};
+  if (trace != nullptr && trace->last_byte == Clock::time_point{}) {
+    trace->last_byte = at;
+    undelivered_.push_back({socket, slot});
+  }
+}
+
+void RequestTracer::complete_delivered(
+    const std::function<bool(int, uint64_t)> &is_delivered) {
+  if (undelivered_.empty()) {
+    return;
+  }
+  Clock::time_point now{Clock::now()};
+  for (size_t i{0}; i < undelivered_.size();) {
+    auto [socket, slot]{undelivered_[i]};
+    if (!is_delivered(socket, slot)) {
+      ++i;
+      continue;
+    }
+    if (Trace *trace{find(socket, slot)}) {
+      write(socket, slot, *trace, now, true);
+      trace_of_slot_of_socket_[socket].erase(slot);
+    }
+    undelivered_[i] = undelivered_.back();
+    undelivered_.pop_back();
+  }
+}
+
+void RequestTracer::remove(int socket) {
+  auto it{trace_of_slot_of_socket_.find(socket)};
+  if (it == trace_of_slot_of_socket_.end()) {
+    return;
+  }
+  Clock::time_point now{Clock::now()};
+  for (const auto &[slot, trace] : it->second) {
+    if (slot != SETUP) {
+      write(socket, slot, trace, now, false);
+    }
+  }
+  trace_of_slot_of_socket_.erase(it);
+  std::erase_if(undelivered_, [socket](const std::pair<int, uint64_t> &key) {
+    return key.first == socket;
+  });
+}
+
+void RequestTracer::add_span(const char *name, Clock::time_point start,
+                             Clock::time_point end) {
+  if (Trace *trace{find(curr_.first, curr_.second)}) {
+    trace->spans.push_back({name, start, end});
+  }
+}
+
+RequestTracer::Scope::Scope(RequestTracer &tracer, int socket, uint64_t slot)
+    : tracer_{tracer}, outer_{tracer.curr_} {
+  tracer_.curr_ = {socket, slot};
+}
+
+RequestTracer::Scope::~Scope() { tracer_.curr_ = outer_; }
+
+RequestTracer::Timed::Timed(RequestTracer &tracer, const char *name)
+    : tracer_{tracer}, name_{name} {
+  if (tracer_.is_enabled()) {
+    start_ = Clock::now();
+  }
+}
+
+RequestTracer::Timed::~Timed() {
+  if (tracer_.is_enabled()) {
+    tracer_.add_span(name_, start_, Clock::now());
+  }
+}
+
+RequestTracer::Trace *RequestTracer::find(int socket, uint64_t slot) {
+  if (file_ == nullptr || socket == -1) {
+    return nullptr;
+  }
+  auto it{trace_of_slot_of_socket_.find(socket)};
+  if (it == trace_of_slot_of_socket_.end()) {
+    return nullptr;
+  }
+  auto trace_it{it->second.find(slot)};
+  return trace_it == it->second.end() ? nullptr : &trace_it->second;
+}
+
+void RequestTracer::write(int socket, uint64_t slot, const Trace &trace,
+                          Clock::time_point end, bool is_complete) {
+  if (end - trace.received < slow_) {
+    return;
+  }
+  std::string args{
+      "\"uuid\":\"" + escaped(trace.uuid) + "\",\"video\":\"" +
+      escaped(trace.video) + "\",\"bitrate\":" +
+      std::to_string(trace.bitrate) + ",\"slot\":" + std::to_string(slot) +
+      ",\"complete\":" + (is_complete ? "true" : "false")};
+  bool is_first{trace.accepted != Clock::time_point{}};
+  write_event(trace.name, socket, is_first ? trace.accepted : trace.received,
+              end, args);
+  if (is_first) {
+    write_event("accept", socket, trace.accepted, trace.received, "");
+  }
+  for (const Span &span : trace.spans) {
+    write_event(span.name, socket, span.start, span.end, "");
+  }
+  if (trace.forwarded != Clock::time_point{}) {
+    write_event("queued", socket, trace.received, trace.forwarded, "");
+    if (trace.first_byte != Clock::time_point{}) {
+      write_event("upstream first byte", socket, trace.forwarded,
+                  trace.first_byte, "");
+    }
+  }
+  if (trace.first_byte != Clock::time_point{} &&
+      trace.last_byte != Clock::time_point{}) {
+    write_event("upstream transfer", socket, trace.first_byte,
+                trace.last_byte, "");
+  }
+  if (trace.last_byte != Clock::time_point{}) {
+    write_event("delivery", socket, trace.last_byte, end, "");
+  }
+  fflush(file_);
+}
+
+void RequestTracer::write_event(const char *name, int socket,
+                                Clock::time_point start,
+                                Clock::time_point end,
+                                const std::string &args) {
+  using std::chrono::duration_cast;
+  using std::chrono::microseconds;
+  fprintf(file_,
+          "{\"name\":\"%s\",\"cat\":\"request\",\"ph\":\"X\",\"pid\":%d,"
+          "\"tid\":%d,\"ts\":%lld,\"dur\":%lld%s%s%s},\n",
+          name, getpid(), socket,
+          static_cast<long long>(
+              duration_cast<microseconds>(start - start_).count()),
+          static_cast<long long>(
+              duration_cast<microseconds>(end - start).count()),
+          args.empty() ? "" : ",\"args\":{", args.c_str(),
+          args.empty() ? "" : "}");
+}
@@ -0,0 +1,141 @@
+#ifndef REQUEST_TRACER_H
+#define REQUEST_TRACER_H
+
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <functional>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+// Where a slow request spent its time. Every request a client sends is
+// timed from when it comes in to when the last byte of its response has
+// been sent to the client: how long it was queued, how long the videoserver
+// took to start answering and to send the rest, and how long the client
+// took to take it, along with the load balancer lookups and upstream
+// connects made for it. The first request on a connection also carries the
+// accept of the connection.
+//
+// Only requests that took at least the given time are kept (tail-based
+// sampling): they are written, once complete, to a file in the JSON array
+// form of the Chrome trace event format, for chrome://tracing or Perfetto.
+// Each request is a complete ("X") event with its phases nested in it, on
+// the track of its client socket, tagged with the uuid, video and bitrate.
+// Requests still in flight when their client disconnects are written too,
+// if slow already, marked incomplete.
+
+class RequestTracer {
+public:
+  using Clock = std::chrono::steady_clock;
+
+  RequestTracer() = default;
+  RequestTracer(const RequestTracer &) = delete;
+  RequestTracer &operator=(const RequestTracer &) = delete;
+  ~RequestTracer();
+
+  // Write the requests that take at least slow_ms to the file at path.
+  // Returns false if it cannot be created. Until then every method is a
+  // no-op.
+  bool open(const std::string &path, unsigned long slow_ms);
+
+  bool is_enabled() const { return file_ != nullptr; }
+
+  // A connection was accepted on socket at accepted_at. The spans recorded
+  // for it (see Scope) go to its first request.
+  void on_accept(int socket, Clock::time_point accepted_at);
+
+  // The request of slot came in on socket at received_at.
+  void start(int socket, uint64_t slot, Clock::time_point received_at);
+
+  // What the request of slot is: name ("segment", "manifest", ...), and the
+  // uuid, video and bitrate it is for, where known.
+  void tag(int socket, uint64_t slot, const char *name,
+           const std::string &uuid, const std::string &video = "",
+           int bitrate = 0);
+
+  // The request of slot went to a videoserver, its first response byte came
+  // back, all of its response is in. A response made by the proxy itself is
+  // all in as soon as it is made.
+  void on_forwarded(int socket, uint64_t slot, Clock::time_point at);
+  void on_first_byte(int socket, uint64_t slot, Clock::time_point at);
+  void on_last_byte(int socket, uint64_t slot, Clock::time_point at);
+
+  // Complete the requests whose response is all in and is_delivered(socket,
+  // slot) says has been sent to the client since. Call once per wait().
+  void complete_delivered(
+      const std::function<bool(int, uint64_t)> &is_delivered);
+
+  // socket is closed: drop its requests, writing out those slow already.
+  void remove(int socket);
+
+  // Record that name (e.g. "upstream connect") took from start to end for
+  // the request being handled, if any.
+  void add_span(const char *name, Clock::time_point start,
+                Clock::time_point end);
+
+  // While one is in scope, the request of slot on socket is the one being
+  // handled; a slot of SETUP stands for the connection of socket before
+  // its first request.
+  class Scope {
+  public:
+    Scope(RequestTracer &tracer, int socket, uint64_t slot);
+    Scope(const Scope &) = delete;
+    Scope &operator=(const Scope &) = delete;
+    ~Scope();
+
+  private:
+    RequestTracer &tracer_;
+    std::pair<int, uint64_t> outer_;
+  };
+  static constexpr uint64_t SETUP{UINT64_MAX};
+
+  // add_span() of name, from when one is made to when it goes out of scope.
+  class Timed {
+  public:
+    Timed(RequestTracer &tracer, const char *name);
+    Timed(const Timed &) = delete;
+    Timed &operator=(const Timed &) = delete;
+    ~Timed();
+
+  private:
+    RequestTracer &tracer_;
+    const char *name_;
+    Clock::time_point start_;
+  };
+
+private:
+  struct Span {
+    const char *name;
+    Clock::time_point start, end;
+  };
+  struct Trace {
+    const char *name{"request"};
+    std::string uuid, video;
+    int bitrate{};
+    Clock::time_point accepted, received, forwarded, first_byte, last_byte;
+    std::vector<Span> spans;
+  };
+
+  // The trace of slot on socket (SETUP for the connection); nullptr if it
+  // is not traced.
+  Trace *find(int socket, uint64_t slot);
+  // Write out trace if it took at least slow_ms_ by end.
+  void write(int socket, uint64_t slot, const Trace &trace,
+             Clock::time_point end, bool is_complete);
+  void write_event(const char *name, int socket, Clock::time_point start,
+                   Clock::time_point end, const std::string &args);
+
+  FILE *file_{};
+  Clock::duration slow_{};
+  Clock::time_point start_;
+  std::unordered_map<int, std::unordered_map<uint64_t, Trace>>
+      trace_of_slot_of_socket_;
+  // The requests whose response is all in, to be sent to the client.
+  std::vector<std::pair<int, uint64_t>> undelivered_;
+  // (socket, slot) of the request being handled; socket -1 if none.
+  std::pair<int, uint64_t> curr_{-1, 0};
+};
+
+#endif // !REQUEST_TRACER_H
@@ -0,0 +1,103 @@
+#include "response_queue.h"
+
+#include "tcp_pacing.h"
+#include "spdlog/spdlog.h"
+#include <utility>
+
+ResponseQueues::ResponseQueues(WriteQueues &write_queues)
+    : write_queues_{write_queues} {}
+
+uint64_t ResponseQueues::open(int socket) {
+  Queue &queue{queue_of_socket_[socket]};
+  queue.slots.push_back({});
+  return queue.first + queue.slots.size() - 1;
+}
+
+size_t ResponseQueues::no_of_open(int socket) const {
+  auto it{queue_of_socket_.find(socket)};
+  return it == queue_of_socket_.end() ? 0 : it->second.slots.size();
+}
+
+bool ResponseQueues::write(int socket, uint64_t slot, BufferRef buffer) {
+  std::string_view data{buffer.view()};
+  return write(socket, slot, data, std::move(buffer));
+}
+
+bool ResponseQueues::write(int socket, uint64_t slot, std::string_view data,
+                           BufferRef buffer) {
+  auto it{queue_of_socket_.find(socket)};
+  if (it == queue_of_socket_.end() || slot < it->second.first ||
+      slot - it->second.first >= it->second.slots.size()) {
+    return false;
+  }
+  Queue &queue{it->second};
+  if (slot == queue.first) {
+    pace_first(socket, queue);
+    return write_queues_.write(socket, data, std::move(buffer));
+  }
+  queue.slots[slot - queue.first].writes.push_back({data, std::move(buffer)});
+  return true;
+}
+
+bool ResponseQueues::finish(int socket, uint64_t slot) {
+  auto it{queue_of_socket_.find(socket)};
+  if (it == queue_of_socket_.end() || slot < it->second.first ||
+      slot - it->second.first >= it->second.slots.size()) {
+    return false;
+  }
+  Queue &queue{it->second};
+  queue.slots[slot - queue.first].is_finished = true;
+  while (!queue.slots.empty() && queue.slots.front().is_finished) {
+    queue.slots.pop_front();
+    ++queue.first;
+    if (queue.slots.empty()) {
+      break;
+    }
+    // The next response is first now: what is held of it goes out.
+    pace_first(socket, queue);
+    for (Write &write : queue.slots.front().writes) {
+      if (!write_queues_.write(socket, write.data, std::move(write.buffer))) {
+        return false;
+      }
+    }
+    queue.slots.front().writes.clear();
+  }
+  return true;
+}
+
+void ResponseQueues::pace(int socket, uint64_t slot,
+                          unsigned long rate_kbps) {
+  auto it{queue_of_socket_.find(socket)};
+  if (it == queue_of_socket_.end() || slot < it->second.first ||
+      slot - it->second.first >= it->second.slots.size()) {
+    return;
+  }
+  Queue &queue{it->second};
+  Slot &paced{queue.slots[slot - queue.first]};
+  paced.is_paced = true;
+  paced.pacing_rate_kbps = rate_kbps;
+  if (slot == queue.first) {
+    pace_first(socket, queue);
+  }
+}
+
+// Set the rate of socket to that of the first response, lifting the one of
+// a response before it if this one is not paced.
+void ResponseQueues::pace_first(int socket, Queue &queue) {
+  const Slot &first{queue.slots.front()};
+  unsigned long rate_kbps{first.is_paced ? first.pacing_rate_kbps : 0};
+  if (rate_kbps == queue.pacing_rate_kbps) {
+    return;
+  }
+  if (!set_pacing_rate(socket, rate_kbps)) {
+    spdlog::warn("set_pacing_rate()");
+  }
+  queue.pacing_rate_kbps = rate_kbps;
+}
+
+bool ResponseQueues::is_written(int socket, uint64_t slot) const {
+  auto it{queue_of_socket_.find(socket)};
+  return it == queue_of_socket_.end() || slot < it->second.first;
+}
+
+void ResponseQueues::remove(int socket) { queue_of_socket_.erase(socket); }
@@ -0,0 +1,81 @@
+#ifndef RESPONSE_QUEUE_H
+#define RESPONSE_QUEUE_H
+
+#include "buffer_pool.h"
+#include "write_queue.h"
+#include <cstdint>
+#include <deque>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+// HTTP/1.1 pipelining: a client may send requests before the responses to
+// the earlier ones are in, and must get the responses back in the order of
+// its requests. Every request opens a slot for its response; a response is
+// written to the client as it comes in if every earlier one has been,
+// and is held in its slot until they have otherwise.
+
+// A client with more requests outstanding than this is disconnected, rather
+// than have the proxy hold an unbounded number of responses for it.
+#define MAX_PIPELINED_REQUESTS 64
+
+// How many requests of a client go to videoservers at once on connections of
+// their own besides its own connection; the rest wait for one of them.
+#define MAX_CONCURRENT_PIPELINED_REQUESTS 4
+
+class ResponseQueues {
+public:
+  explicit ResponseQueues(WriteQueues &write_queues);
+
+  // Open the slot of the response to the next request on socket.
+  uint64_t open(int socket);
+
+  // How many responses on socket are not complete yet.
+  size_t no_of_open(int socket) const;
+
+  // Send data (kept alive by buffer, if any) to socket as the next part of
+  // the response in slot. Returns false if the socket failed.
+  bool write(int socket, uint64_t slot, BufferRef buffer);
+  bool write(int socket, uint64_t slot, std::string_view data,
+             BufferRef buffer = {});
+
+  // The response in slot is complete: send what is held for the slots after
+  // it. Returns false if the socket failed.
+  bool finish(int socket, uint64_t slot);
+
+  // Pace socket at rate_kbps (see tcp_pacing.h) once the response in slot is
+  // the first one, so that the responses before it go out at their own rates.
+  // Responses that are not paced go out unpaced, whatever came before them.
+  void pace(int socket, uint64_t slot, unsigned long rate_kbps);
+
+  // Whether all of the response in slot has gone on to the write queue of
+  // socket.
+  bool is_written(int socket, uint64_t slot) const;
+
+  // Drop the slots of socket, e.g. before closing it.
+  void remove(int socket);
+
+private:
+  struct Write {
+    std::string_view data;
+    BufferRef buffer;
+  };
+  struct Slot {
+    std::vector<Write> writes; // Held until the slot is the first one.
+    bool is_finished, is_paced;
+    unsigned long pacing_rate_kbps;
+  };
+
+  struct Queue {
+    uint64_t first; // The number of slots.front().
+    std::deque<Slot> slots;
+    unsigned long pacing_rate_kbps; // That of the socket, 0 if unpaced.
+  };
+
+  void pace_first(int socket, Queue &queue);
+
+  WriteQueues &write_queues_;
+  std::unordered_map<int, Queue> queue_of_socket_;
+};
+
+#endif // !RESPONSE_QUEUE_H
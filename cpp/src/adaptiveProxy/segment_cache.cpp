@@ -0,0 +1,214 @@
+#include "segment_cache.h"
+
+#include "http.h"
+#include <algorithm>
+#include <charconv>
+#include <cstdint>
+#include <cstring>
+#include <strings.h>
+
+SegmentCache::SegmentCache(size_t capacity) : capacity_{capacity} {}
+
+BufferRef SegmentCache::find(const std::string &path) {
+  auto it{entry_of_path_.find(path)};
+  if (it == entry_of_path_.end()) {
+    return {};
+  }
+  lru_.splice(lru_.begin(), lru_, it->second.lru_it);
+  return it->second.response;
+}
+
+void SegmentCache::insert(const std::string &path, BufferRef response) {
+  // What the segment takes up is the buffer it is in.
+  if (!is_enabled() || path.empty() || response.capacity() > capacity_ ||
+      parse_status_code(response.data()) != 200) {
+    return;
+  }
+  auto it{entry_of_path_.find(path)};
+  if (it != entry_of_path_.end()) {
+    size_ -= it->second.response.capacity();
+    lru_.erase(it->second.lru_it);
+    entry_of_path_.erase(it);
+  }
+  while (size_ + response.capacity() > capacity_) {
+    auto lru_it{entry_of_path_.find(lru_.back())};
+    size_ -= lru_it->second.response.capacity();
+    entry_of_path_.erase(lru_it);
+    lru_.pop_back();
+  }
+  size_ += response.capacity();
+  lru_.push_front(path);
+  entry_of_path_[path] = {std::move(response), lru_.begin()};
+}
+
+// s as a decimal number, which must be all of it.
+static bool parse_number(std::string_view s, size_t &number) {
+  auto [end, error]{std::from_chars(s.data(), s.data() + s.length(), number)};
+  return error == std::errc{} && end == s.data() + s.length();
+}
+
+// The ranges [first, last] of a body of size bytes that the Range header
+// field value range asks for, in the order asked, but for those that start
+// past its end. Returns false if range is malformed or asks for more than
+// SEGMENT_CACHE_MAX_RANGES ranges.
+static bool parse_byte_ranges(std::string_view range, size_t size,
+                              std::vector<std::pair<size_t, size_t>> &ranges) {
+  if (range.length() < 6 || strncasecmp(range.data(), "bytes=", 6) != 0) {
+    return false;
+  }
+  range.remove_prefix(6);
+  size_t no_of_ranges{0};
+  while (!range.empty()) {
+    size_t comma{range.find(',')};
+    std::string_view spec{range.substr(0, comma)};
+    range = comma == std::string_view::npos ? std::string_view{}
+                                            : range.substr(comma + 1);
+    while (!spec.empty() && (spec.front() == ' ' || spec.front() == '\t')) {
+      spec.remove_prefix(1);
+    }
+    while (!spec.empty() && (spec.back() == ' ' || spec.back() == '\t')) {
+      spec.remove_suffix(1);
+    }
+    if (spec.empty()) {
+      continue;
+    } else if (++no_of_ranges > SEGMENT_CACHE_MAX_RANGES) {
+      return false;
+    }
+    size_t dash{spec.find('-')}, first, last;
+    if (dash == std::string_view::npos) {
+      return false;
+    } else if (dash == 0) {
+      // The last bytes of the body, as many as given.
+      size_t suffix_length;
+      if (!parse_number(spec.substr(1), suffix_length)) {
+        return false;
+      } else if (suffix_length == 0 || size == 0) {
+        continue;
+      }
+      first = suffix_length < size ? size - suffix_length : 0;
+      last = size - 1;
+    } else {
+      if (!parse_number(spec.substr(0, dash), first)) {
+        return false;
+      }
+      last = SIZE_MAX;
+      if (dash + 1 < spec.length() &&
+          (!parse_number(spec.substr(dash + 1), last) || last < first)) {
+        return false;
+      } else if (first >= size) {
+        continue;
+      }
+      last = std::min(last, size - 1);
+    }
+    ranges.push_back({first, last});
+  }
+  return no_of_ranges > 0;
+}
+
+// The fields of header (the status line and fields of a response, each
+// ending in CRLF) but for those about its body as a whole, and its
+// Content-Type too if is_multipart.
+static std::string fields_of(std::string_view header, bool is_multipart) {
+  std::string fields;
+  size_t line_start{header.find("\r\n") + 2};
+  while (line_start < header.length()) {
+    size_t line_end{header.find("\r\n", line_start)};
+    std::string_view line{header.substr(line_start, line_end - line_start)};
+    if (strncasecmp(line.data(), "content-length:", 15) != 0 &&
+        strncasecmp(line.data(), "content-range:", 14) != 0 &&
+        strncasecmp(line.data(), "transfer-encoding:", 18) != 0 &&
+        (!is_multipart || strncasecmp(line.data(), "content-type:", 13) != 0)) {
+      fields.append(line).append("\r\n");
+    }
+    line_start = line_end + 2;
+  }
+  return fields;
+}
+
+static std::string content_range(size_t first, size_t last, size_t size) {
+  return "Content-Range: bytes " + std::to_string(first) + "-" +
+         std::to_string(last) + "/" + std::to_string(size) + "\r\n";
+}
+
+void respond_to_range(
+    const std::string &range, BufferRef whole, BufferPool &pool,
+    std::vector<std::pair<std::string_view, BufferRef>> &writes) {
+  const char *header_end{strstr(whole.data(), "\r\n\r\n")};
+  std::vector<std::pair<size_t, size_t>> ranges;
+  if (header_end == nullptr || parse_status_code(whole.data()) != 200) {
+    writes.push_back({whole.view(), whole});
+    return;
+  }
+  std::string_view header{whole.data(),
+                          static_cast<size_t>(header_end + 2 - whole.data())},
+      body{whole.view().substr(header.length() + 2)};
+  if (!parse_byte_ranges(range, body.length(), ranges)) {
+    writes.push_back({whole.view(), whole});
+    return;
+  } else if (ranges.empty()) {
+    BufferRef response{pool.copy_of(
+        "HTTP/1.1 416 Range Not Satisfiable\r\nContent-Range: bytes */" +
+        std::to_string(body.length()) + "\r\ncontent-length: 0\r\n\r\n")};
+    if (!response) {
+      writes.push_back({whole.view(), whole});
+      return;
+    }
+    writes.push_back({response.view(), response});
+    return;
+  } else if (ranges.size() == 1) {
+    auto [first, last]{ranges[0]};
+    BufferRef response_header{pool.copy_of(
+        "HTTP/1.1 206 Partial Content\r\n" + fields_of(header, false) +
+        content_range(first, last, body.length()) +
+        "Content-Length: " + std::to_string(last - first + 1) + "\r\n\r\n")};
+    if (!response_header) {
+      writes.push_back({whole.view(), whole});
+      return;
+    }
+    writes.push_back({response_header.view(), response_header});
+    writes.push_back({body.substr(first, last - first + 1), std::move(whole)});
+    return;
+  }
+
+  // The header of the response and those of the parts all go in one
+  // buffer, in between which the parts are sent from whole.
+  std::string content_type{parse_header_field(whole.data(), "content-type")};
+  std::vector<std::string> part_headers;
+  std::string closing{"\r\n--" SEGMENT_CACHE_BOUNDARY "--\r\n"};
+  size_t length{closing.length()};
+  for (auto [first, last] : ranges) {
+    part_headers.push_back(
+        "\r\n--" SEGMENT_CACHE_BOUNDARY "\r\n" +
+        (content_type.empty() ? ""
+                              : "Content-Type: " + content_type + "\r\n") +
+        content_range(first, last, body.length()) + "\r\n");
+    length += part_headers.back().length() + last - first + 1;
+  }
+  std::string headers{"HTTP/1.1 206 Partial Content\r\n" +
+                      fields_of(header, true) +
+                      "Content-Type: multipart/byteranges; boundary="
+                      SEGMENT_CACHE_BOUNDARY "\r\n"
+                      "Content-Length: " +
+                      std::to_string(length) + "\r\n\r\n"};
+  size_t response_header_length{headers.length()};
+  for (const std::string &part_header : part_headers) {
+    headers += part_header;
+  }
+  headers += closing;
+
+  BufferRef buffer{pool.copy_of(headers)};
+  if (!buffer) {
+    writes.push_back({whole.view(), whole});
+    return;
+  }
+  std::string_view rest{buffer.view()};
+  writes.push_back({rest.substr(0, response_header_length), buffer});
+  rest.remove_prefix(response_header_length);
+  for (size_t i{0}; i < ranges.size(); ++i) {
+    auto [first, last]{ranges[i]};
+    writes.push_back({rest.substr(0, part_headers[i].length()), buffer});
+    rest.remove_prefix(part_headers[i].length());
+    writes.push_back({body.substr(first, last - first + 1), whole});
+  }
+  writes.push_back({rest, buffer});
+}
@@ -0,0 +1,67 @@
+#ifndef SEGMENT_CACHE_H
+#define SEGMENT_CACHE_H
+
+#include "buffer_pool.h"
+#include <cstddef>
+#include <list>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+// Whole segments, kept in memory in the buffers they arrived in, so that a
+// Range request for a segment (a seek, or a player retrying the part of a
+// segment it did not get) is answered by the proxy rather than a videoserver.
+//
+// Every segment fetched whole for a client is cached, and so is the whole
+// segment fetched in place of a Range request that missed, for the ranges
+// that follow to hit. Once the cached segments take up more than the
+// capacity of the cache, the least recently used ones are evicted.
+
+// A Range request for more ranges than this gets the whole segment: that
+// many is more likely to be abuse than a player.
+#define SEGMENT_CACHE_MAX_RANGES 16
+
+// Separates the parts of a multipart/byteranges response.
+#define SEGMENT_CACHE_BOUNDARY "adaptiveProxy-byteranges"
+
+class SegmentCache {
+public:
+  // capacity (in bytes) == 0 disables the cache.
+  explicit SegmentCache(size_t capacity);
+
+  bool is_enabled() const { return capacity_ > 0; }
+
+  // The cached response with the segment at path (the target of its GET
+  // request), or an empty BufferRef if there is none.
+  BufferRef find(const std::string &path);
+
+  // The videoserver answered the GET request of the segment at path with
+  // response (NUL-terminated, as an HttpReader leaves it): cache it if it
+  // is a 200 that fits.
+  void insert(const std::string &path, BufferRef response);
+
+private:
+  struct Entry {
+    BufferRef response;
+    std::list<std::string>::iterator lru_it;
+  };
+
+  size_t capacity_, size_{};
+  std::list<std::string> lru_; // The paths, most recently used first.
+  std::unordered_map<std::string, Entry> entry_of_path_;
+};
+
+// Append to writes the response to a GET request with the Range header field
+// range (its value) from whole, the 200 response to the request without it
+// (NUL-terminated, as an HttpReader leaves it): a 206 for one range, a
+// multipart/byteranges 206 for several, or a 416 if none can be satisfied.
+// The bodies are sent from whole and the rest from pool. If whole is not a
+// 200, range is malformed or asks for more than SEGMENT_CACHE_MAX_RANGES
+// ranges, or pool has no memory for the rest, whole itself is the response.
+void respond_to_range(
+    const std::string &range, BufferRef whole, BufferPool &pool,
+    std::vector<std::pair<std::string_view, BufferRef>> &writes);
+
+#endif // !SEGMENT_CACHE_H
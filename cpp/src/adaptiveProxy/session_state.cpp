@@ -0,0 +1,357 @@
+#include "session_state.h"
+
+#include "spdlog/spdlog.h"
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/timerfd.h>
+#include <unistd.h>
+
+// The file is a FileHeader followed by two regions of capacity bytes, each
+// after a RegionHeader. Everything is in host byte order: a file from a host
+// of the other byte order fails the magic check.
+struct FileHeader {
+  uint64_t magic;
+  uint32_t version, reserved;
+  uint64_t capacity;
+};
+
+// A region holds a snapshot if its generation is not 0 and checksum matches.
+struct RegionHeader {
+  uint64_t generation, size, checksum;
+};
+
+static size_t file_size_for(uint64_t capacity) {
+  return sizeof(FileHeader) + 2 * (sizeof(RegionHeader) + capacity);
+}
+
+// FNV-1a over the generation, size and snapshot of a region.
+static uint64_t checksum_of(uint64_t generation, uint64_t size,
+                            const unsigned char *snapshot) {
+  uint64_t hash{14695981039346656037ULL};
+  auto add = [&](const unsigned char *bytes, size_t no_of_bytes) {
+    for (size_t i{0}; i < no_of_bytes; ++i) {
+      hash = (hash ^ bytes[i]) * 1099511628211ULL;
+    }
+  };
+  add(reinterpret_cast<const unsigned char *>(&generation), sizeof(generation));
+  add(reinterpret_cast<const unsigned char *>(&size), sizeof(size));
+  add(snapshot, size);
+  return hash;
+}
+
+template <typename T> static void put(std::string &snapshot, T value) {
+  snapshot.append(reinterpret_cast<const char *>(&value), sizeof(value));
+}
+
+static void put_string(std::string &snapshot, const std::string &value) {
+  put(snapshot, static_cast<uint16_t>(value.length()));
+  snapshot.append(value);
+}
+
+// Reads a snapshot back; every get fails once the snapshot is exhausted.
+class SnapshotReader {
+public:
+  SnapshotReader(const unsigned char *snapshot, size_t size)
+      : snapshot_{snapshot}, size_{size} {}
+
+  template <typename T> bool get(T &value) {
+    if (size_ - pos_ < sizeof(value)) {
+      return false;
+    }
+    std::memcpy(&value, snapshot_ + pos_, sizeof(value));
+    pos_ += sizeof(value);
+    return true;
+  }
+
+  bool get_string(std::string &value) {
+    uint16_t length;
+    if (!get(length) || size_ - pos_ < length) {
+      return false;
+    }
+    value.assign(reinterpret_cast<const char *>(snapshot_ + pos_), length);
+    pos_ += length;
+    return true;
+  }
+
+private:
+  const unsigned char *snapshot_;
+  size_t size_, pos_{};
+};
+
+SessionStateFile::~SessionStateFile() {
+  unmap();
+  if (timer_fd_ != -1) {
+    close(timer_fd_);
+  }
+}
+
+bool SessionStateFile::open(const std::string &path) {
+  path_ = path;
+  if (!map()) {
+    spdlog::info("Creating session state file {}", path_);
+    if (!replace(SESSION_STATE_INITIAL_CAPACITY, "", 0)) {
+      return false;
+    }
+  }
+
+  if ((timer_fd_ = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC)) == -1) {
+    spdlog::warn("timerfd_create()");
+    quick_exit(EXIT_FAILURE);
+  }
+  itimerspec interval{};
+  interval.it_interval.tv_sec = SESSION_STATE_SAVE_INTERVAL_MS / 1000;
+  interval.it_interval.tv_nsec =
+      (SESSION_STATE_SAVE_INTERVAL_MS % 1000) * 1000000L;
+  interval.it_value = interval.it_interval;
+  if (timerfd_settime(timer_fd_, 0, &interval, nullptr) == -1) {
+    spdlog::warn("timerfd_settime()");
+    quick_exit(EXIT_FAILURE);
+  }
+  return true;
+}
+
+bool SessionStateFile::map() {
+  if ((fd_ = ::open(path_.c_str(), O_RDWR | O_CLOEXEC)) == -1) {
+    return false;
+  }
+  FileHeader header;
+  struct stat file_stat;
+  if (pread(fd_, &header, sizeof(header), 0) !=
+          static_cast<ssize_t>(sizeof(header)) ||
+      header.magic != SESSION_STATE_MAGIC ||
+      header.version != SESSION_STATE_VERSION || fstat(fd_, &file_stat) == -1 ||
+      static_cast<size_t>(file_stat.st_size) !=
+          file_size_for(header.capacity)) {
+    spdlog::warn("{} is not a session state file of version {}, ignoring it",
+                 path_, SESSION_STATE_VERSION);
+    close(fd_);
+    fd_ = -1;
+    return false;
+  }
+  void *data{mmap(nullptr, file_stat.st_size, PROT_READ | PROT_WRITE,
+                  MAP_SHARED, fd_, 0)};
+  if (data == MAP_FAILED) {
+    spdlog::warn("mmap() {}", path_);
+    close(fd_);
+    fd_ = -1;
+    return false;
+  }
+  data_ = static_cast<unsigned char *>(data);
+  size_ = file_stat.st_size;
+  capacity_ = header.capacity;
+  return true;
+}
+
+void SessionStateFile::unmap() {
+  if (data_ != nullptr) {
+    munmap(data_, size_);
+    data_ = nullptr;
+  }
+  if (fd_ != -1) {
+    close(fd_);
+    fd_ = -1;
+  }
+}
+
+// Write a whole new file next to the old one and rename it over it, so that
+// the path always names a complete file.
+bool SessionStateFile::replace(uint64_t capacity, const std::string &snapshot,
+                               uint64_t generation) {
+  std::string file(file_size_for(capacity), '\0');
+  FileHeader header{SESSION_STATE_MAGIC, SESSION_STATE_VERSION, 0, capacity};
+  std::memcpy(file.data(), &header, sizeof(header));
+  if (generation != 0) {
+    const unsigned char *bytes{
+        reinterpret_cast<const unsigned char *>(snapshot.data())};
+    RegionHeader region_header{generation, snapshot.size(),
+                               checksum_of(generation, snapshot.size(), bytes)};
+    std::memcpy(file.data() + sizeof(header), &region_header,
+                sizeof(region_header));
+    std::memcpy(file.data() + sizeof(header) + sizeof(region_header),
+                snapshot.data(), snapshot.size());
+  }
+
+  std::string tmp_path{path_ + ".tmp"};
+  int fd{::open(tmp_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC,
+                0644)};
+  if (fd == -1) {
+    spdlog::warn("open() {}", tmp_path);
+    return false;
+  }
+  for (size_t written{0}; written < file.size();) {
+    ssize_t n{write(fd, file.data() + written, file.size() - written)};
+    if (n == -1) {
+      spdlog::warn("write() {}", tmp_path);
+      close(fd);
+      unlink(tmp_path.c_str());
+      return false;
+    }
+    written += n;
+  }
+  if (fsync(fd) == -1 || close(fd) == -1 ||
+      rename(tmp_path.c_str(), path_.c_str()) == -1) {
+    spdlog::warn("Cannot replace {}", path_);
+    unlink(tmp_path.c_str());
+    return false;
+  }
+  unmap();
+  return map();
+}
+
+unsigned char *SessionStateFile::region(int index) const {
+  return data_ + sizeof(FileHeader) +
+         index * (sizeof(RegionHeader) + capacity_);
+}
+
+int SessionStateFile::latest_region() const {
+  int latest{-1};
+  uint64_t latest_generation{0};
+  for (int i{0}; i < 2; ++i) {
+    RegionHeader header;
+    std::memcpy(&header, region(i), sizeof(header));
+    if (header.generation > latest_generation && header.size <= capacity_ &&
+        header.checksum == checksum_of(header.generation, header.size,
+                                       region(i) + sizeof(header))) {
+      latest = i;
+      latest_generation = header.generation;
+    }
+  }
+  return latest;
+}
+
+bool SessionStateFile::load(
+    std::unordered_map<std::string, unsigned long> &throughput_of_client,
+    std::unordered_map<std::string, std::time_t> &sampled_at_of_client,
+    std::unordered_map<std::string, std::vector<int>> &bitrate_of_video,
+    std::unordered_map<std::string, double> &segment_duration_of_video) {
+  if (data_ == nullptr) {
+    return false;
+  }
+  int latest{latest_region()};
+  if (latest == -1) {
+    return false;
+  }
+  RegionHeader header;
+  std::memcpy(&header, region(latest), sizeof(header));
+  SnapshotReader reader{region(latest) + sizeof(header), header.size};
+
+  std::time_t now{std::time(nullptr)};
+  uint32_t no_of_clients;
+  if (!reader.get(no_of_clients)) {
+    return false;
+  }
+  for (uint32_t i{0}; i < no_of_clients; ++i) {
+    std::string uuid;
+    uint64_t throughput;
+    int64_t sampled_at;
+    if (!reader.get_string(uuid) || !reader.get(throughput) ||
+        !reader.get(sampled_at)) {
+      return false;
+    }
+    if (now - sampled_at <= SESSION_STATE_MAX_AGE_S) {
+      throughput_of_client[uuid] = throughput;
+      sampled_at_of_client[uuid] = sampled_at;
+    }
+  }
+  uint32_t no_of_videos;
+  if (!reader.get(no_of_videos)) {
+    return false;
+  }
+  for (uint32_t i{0}; i < no_of_videos; ++i) {
+    std::string path_to_video;
+    double segment_duration;
+    uint32_t no_of_bitrates;
+    if (!reader.get_string(path_to_video) || !reader.get(segment_duration) ||
+        !reader.get(no_of_bitrates)) {
+      return false;
+    }
+    std::vector<int> bitrates(no_of_bitrates);
+    for (int &bitrate : bitrates) {
+      int32_t value;
+      if (!reader.get(value)) {
+        return false;
+      }
+      bitrate = value;
+    }
+    bitrate_of_video[path_to_video] = std::move(bitrates);
+    segment_duration_of_video[path_to_video] = segment_duration;
+  }
+  return true;
+}
+
+void SessionStateFile::save(
+    const std::unordered_map<std::string, unsigned long>
+        &throughput_of_client,
+    const std::unordered_map<std::string, std::time_t> &sampled_at_of_client,
+    const std::unordered_map<std::string, std::vector<int>> &bitrate_of_video,
+    const std::unordered_map<std::string, double> &segment_duration_of_video) {
+  if (data_ == nullptr) {
+    return;
+  }
+  std::time_t now{std::time(nullptr)};
+  std::string snapshot{};
+  uint32_t no_of_clients{0};
+  put(snapshot, no_of_clients); // Patched below.
+  for (const auto &[uuid, throughput] : throughput_of_client) {
+    auto sampled_at_it{sampled_at_of_client.find(uuid)};
+    if (sampled_at_it == sampled_at_of_client.end() ||
+        now - sampled_at_it->second > SESSION_STATE_MAX_AGE_S) {
+      continue;
+    }
+    put_string(snapshot, uuid);
+    put(snapshot, static_cast<uint64_t>(throughput));
+    put(snapshot, static_cast<int64_t>(sampled_at_it->second));
+    ++no_of_clients;
+  }
+  std::memcpy(snapshot.data(), &no_of_clients, sizeof(no_of_clients));
+  put(snapshot, static_cast<uint32_t>(bitrate_of_video.size()));
+  for (const auto &[path_to_video, bitrates] : bitrate_of_video) {
+    auto segment_duration_it{segment_duration_of_video.find(path_to_video)};
+    put_string(snapshot, path_to_video);
+    put(snapshot, segment_duration_it == segment_duration_of_video.end()
+                      ? 0.0
+                      : segment_duration_it->second);
+    put(snapshot, static_cast<uint32_t>(bitrates.size()));
+    for (int bitrate : bitrates) {
+      put(snapshot, static_cast<int32_t>(bitrate));
+    }
+  }
+
+  int latest{latest_region()};
+  uint64_t generation{1};
+  if (latest != -1) {
+    RegionHeader latest_header;
+    std::memcpy(&latest_header, region(latest), sizeof(latest_header));
+    generation = latest_header.generation + 1;
+  }
+  if (snapshot.size() > capacity_) {
+    uint64_t capacity{capacity_};
+    while (capacity < snapshot.size()) {
+      capacity *= 2;
+    }
+    spdlog::info("Growing session state file {} to {} bytes per region",
+                 path_, capacity);
+    replace(capacity, snapshot, generation);
+    return;
+  }
+
+  // The snapshot goes in first and the header that validates it last.
+  unsigned char *target{region(latest == 0 ? 1 : 0)};
+  std::memcpy(target + sizeof(RegionHeader), snapshot.data(), snapshot.size());
+  RegionHeader header{
+      generation, snapshot.size(),
+      checksum_of(generation, snapshot.size(), target + sizeof(RegionHeader))};
+  std::memcpy(target, &header, sizeof(header));
+  if (msync(data_, size_, MS_ASYNC) == -1) {
+    spdlog::warn("msync() {}", path_);
+  }
+}
+
+void SessionStateFile::on_timer() {
+  uint64_t no_of_expirations;
+  if (read(timer_fd_, &no_of_expirations, sizeof(no_of_expirations)) == -1) {
+    spdlog::warn("SessionStateFile::on_timer(): read()");
+  }
+}
@@ -0,0 +1,88 @@
+#ifndef SESSION_STATE_H
+#define SESSION_STATE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <ctime>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// The state a session needs to pick good bitrates from its first segment on,
+// kept in a memory-mapped file so that it survives restarts and deploys: the
+// throughput estimate of every client and the bitrates and segment duration
+// of every video. A proxy started on the file of the one before it picks up
+// where it left off, instead of starting every client at the lowest bitrate
+// and fetching every manifest again.
+//
+// The file holds two regions. Every save writes a snapshot into the one that
+// does not hold the latest snapshot, with a higher generation and a checksum,
+// so a crash in the middle of a save leaves the previous snapshot intact and
+// the torn one is recognized by its checksum. A file of another version is
+// ignored and replaced.
+
+#define SESSION_STATE_MAGIC 0x5441545341525041ULL // "APRASTAT"
+#define SESSION_STATE_VERSION 1
+
+// How often the state is saved.
+#define SESSION_STATE_SAVE_INTERVAL_MS 1000
+
+// Estimates older than this are neither saved nor loaded: the network of the
+// client has likely changed since.
+#define SESSION_STATE_MAX_AGE_S 3600
+
+// The capacity of each region of a new file; a snapshot that outgrows it
+// moves the state to a new file of twice the capacity.
+#define SESSION_STATE_INITIAL_CAPACITY (1 << 20)
+
+// Until open() is called every method is a no-op.
+class SessionStateFile {
+public:
+  SessionStateFile() = default;
+  SessionStateFile(const SessionStateFile &) = delete;
+  SessionStateFile &operator=(const SessionStateFile &) = delete;
+  ~SessionStateFile();
+
+  // Map the file at path, creating it if it does not exist or is not a
+  // session state file of this version, and start the save timer. Returns
+  // false if the file cannot be created or mapped.
+  bool open(const std::string &path);
+
+  // The timerfd to watch for readability; -1 if not open.
+  int timer_fd() const { return timer_fd_; }
+
+  // Fill the maps with the latest snapshot in the file. Returns false if
+  // there is none.
+  bool load(
+      std::unordered_map<std::string, unsigned long> &throughput_of_client,
+      std::unordered_map<std::string, std::time_t> &sampled_at_of_client,
+      std::unordered_map<std::string, std::vector<int>> &bitrate_of_video,
+      std::unordered_map<std::string, double> &segment_duration_of_video);
+
+  // Write a snapshot of the maps to the file.
+  void save(
+      const std::unordered_map<std::string, unsigned long>
+          &throughput_of_client,
+      const std::unordered_map<std::string, std::time_t> &sampled_at_of_client,
+      const std::unordered_map<std::string, std::vector<int>> &bitrate_of_video,
+      const std::unordered_map<std::string, double> &segment_duration_of_video);
+
+  // Read the expirations of timer_fd(); call when it is readable.
+  void on_timer();
+
+private:
+  bool map();
+  bool replace(uint64_t capacity, const std::string &snapshot,
+               uint64_t generation);
+  void unmap();
+  // The index of the region with the latest valid snapshot, or -1.
+  int latest_region() const;
+  unsigned char *region(int index) const;
+
+  std::string path_;
+  int fd_{-1}, timer_fd_{-1};
+  unsigned char *data_{};
+  size_t size_{}, capacity_{};
+};
+
+#endif // !SESSION_STATE_H
@@ -0,0 +1,35 @@
+#include "tcp_delivery.h"
+
+#include <algorithm>
+#include <linux/tcp.h> // struct tcp_info with tcpi_delivery_rate
+#include <netinet/in.h>
+#include <sys/socket.h>
+
+bool sample_tcp_delivery(int socket, TcpDelivery &delivery) {
+  tcp_info info{};
+  socklen_t info_len{sizeof(info)};
+  if (getsockopt(socket, IPPROTO_TCP, TCP_INFO, &info, &info_len) == -1) {
+    return false;
+  }
+  delivery.at = std::chrono::steady_clock::now();
+  delivery.bytes_acked = info.tcpi_bytes_acked;
+  delivery.delivery_rate = info.tcpi_delivery_rate;
+  delivery.is_app_limited = info.tcpi_delivery_rate_app_limited;
+  delivery.rtt_us = info.tcpi_rtt;
+  delivery.snd_cwnd = info.tcpi_snd_cwnd;
+  delivery.snd_mss = info.tcpi_snd_mss;
+  return true;
+}
+
+double delivered_kbps(const TcpDelivery &before, const TcpDelivery &after) {
+  if (after.bytes_acked <= before.bytes_acked) {
+    return 0;
+  }
+  double elapsed_s{std::chrono::duration<double>(after.at - before.at).count()};
+  double acked_kbps{
+      elapsed_s > 0
+          ? (after.bytes_acked - before.bytes_acked) * 8.0 / 1000.0 / elapsed_s
+          : 0},
+      kernel_kbps{after.delivery_rate * 8.0 / 1000.0};
+  return std::max(acked_kbps, kernel_kbps);
+}
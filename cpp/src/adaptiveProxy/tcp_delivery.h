@@ -0,0 +1,30 @@
+#ifndef TCP_DELIVERY_H
+#define TCP_DELIVERY_H
+
+#include <chrono>
+#include <cstdint>
+
+// Measuring the throughput to a client from its TCP connection (TCP_INFO),
+// so that bitrate selection does not depend on the client's own beacons.
+
+struct TcpDelivery {
+  std::chrono::steady_clock::time_point at;
+  uint64_t bytes_acked;
+  // The kernel's latest delivery rate sample, in bytes per second. Samples
+  // taken while the sender ran out of data (app-limited) are lower bounds.
+  uint64_t delivery_rate;
+  bool is_app_limited;
+  uint32_t rtt_us, snd_cwnd, snd_mss;
+};
+
+// Sample TCP_INFO of socket. Returns false if it cannot be read.
+bool sample_tcp_delivery(int socket, TcpDelivery &delivery);
+
+// The throughput in Kbps at which the bytes sent on a connection between two
+// samples were delivered, or 0 if nothing was delivered. Both the kernel's
+// rate and the bytes acknowledged over the time in between are lower bounds
+// on what the path carries (the client may have sat idle), so the larger one
+// is used.
+double delivered_kbps(const TcpDelivery &before, const TcpDelivery &after);
+
+#endif // !TCP_DELIVERY_H
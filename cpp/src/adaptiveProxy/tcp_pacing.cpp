@@ -0,0 +1,29 @@
+#include "tcp_pacing.h"
+
+#include "abr.h"
+#include <algorithm>
+#include <cstdint>
+#include <sys/socket.h>
+
+unsigned long pacing_rate_kbps(const std::vector<int> &bitrates, int bitrate,
+                               double segment_duration_s, double buffer_s) {
+  if (buffer_s < PACING_MIN_BUFFER_SEGMENTS * segment_duration_s) {
+    return 0;
+  }
+  auto next_it{std::upper_bound(bitrates.begin(), bitrates.end(), bitrate)};
+  int next_bitrate{next_it == bitrates.end() ? bitrate : *next_it};
+  return static_cast<unsigned long>(
+      std::max(next_bitrate * BITRATE_SAFETY_FACTOR * PACING_HEADROOM,
+               bitrate * segment_duration_s /
+                   (buffer_s * PACING_MAX_BUFFER_SHARE)));
+}
+
+bool set_pacing_rate(int socket, unsigned long rate_kbps) {
+  // In bytes per second; all ones lifts the limit.
+  uint32_t rate{rate_kbps == 0
+                    ? UINT32_MAX
+                    : static_cast<uint32_t>(std::min<uint64_t>(
+                          rate_kbps * 125ULL, UINT32_MAX - 1))};
+  return setsockopt(socket, SOL_SOCKET, SO_MAX_PACING_RATE, &rate,
+                    sizeof(rate)) == 0;
+}
@@ -0,0 +1,35 @@
+#ifndef TCP_PACING_H
+#define TCP_PACING_H
+
+#include <vector>
+
+// Pacing the segments sent to a client (SO_MAX_PACING_RATE) at a rate
+// matched to its bitrate, rather than sending them as fast as TCP allows, in
+// bursts that fill the queue of the bottleneck link and delay or drop the
+// packets of the other flows through it.
+//
+// A paced segment arrives no faster than its pacing rate, and neither does
+// the throughput measured from it. So the rate is that the next bitrate up
+// needs (the bitrate itself at the top) by BITRATE_SAFETY_FACTOR, and
+// PACING_HEADROOM more: the estimate then stays high enough for the client to
+// keep its bitrate and to move up. The segment must also arrive within
+// PACING_MAX_BUFFER_SHARE of the video the client has buffered. A client with
+// fewer than PACING_MIN_BUFFER_SEGMENTS segments buffered, or no estimate of
+// its buffer (it sends no beacons), is not paced, so that pacing never makes
+// it stall.
+
+#define PACING_HEADROOM 1.25
+#define PACING_MAX_BUFFER_SHARE 0.5
+#define PACING_MIN_BUFFER_SEGMENTS 2
+
+// The rate in Kbps to pace a segment of segment_duration_s seconds at
+// bitrate, one of bitrates (Kbps, ascending), to a client with buffer_s
+// seconds of video buffered; 0 for no pacing.
+unsigned long pacing_rate_kbps(const std::vector<int> &bitrates, int bitrate,
+                               double segment_duration_s, double buffer_s);
+
+// Pace what is sent on socket at rate_kbps, 0 for no pacing. Returns false if
+// the rate cannot be set.
+bool set_pacing_rate(int socket, unsigned long rate_kbps);
+
+#endif // !TCP_PACING_H
@@ -0,0 +1,34 @@
+#include "throughput_priors.h"
+
+#include <arpa/inet.h>
+
+ThroughputPriors::ThroughputPriors(int prefix_length)
+    : prefix_length_{prefix_length} {}
+
+uint32_t ThroughputPriors::subnet_of(in_addr_t addr) const {
+  uint32_t mask{static_cast<uint32_t>(0xFFFFFFFFULL << (32 - prefix_length_))};
+  return ntohl(addr) & mask;
+}
+
+void ThroughputPriors::add_sample(in_addr_t addr, double kbps) {
+  if (!is_enabled()) {
+    return;
+  }
+  uint32_t subnet{subnet_of(addr)};
+  auto it{window_of_subnet_.find(subnet)};
+  if (it == window_of_subnet_.end()) {
+    if (window_of_subnet_.size() >= MAX_NO_OF_PRIOR_SUBNETS) {
+      return;
+    }
+    it = window_of_subnet_.emplace(subnet, ThroughputWindow{}).first;
+  }
+  it->second.add(kbps);
+}
+
+unsigned long ThroughputPriors::prior(in_addr_t addr) const {
+  if (!is_enabled()) {
+    return 0;
+  }
+  auto it{window_of_subnet_.find(subnet_of(addr))};
+  return it == window_of_subnet_.end() ? 0 : it->second.harmonic_mean();
+}
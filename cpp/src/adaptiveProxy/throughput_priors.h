@@ -0,0 +1,39 @@
+#ifndef THROUGHPUT_PRIORS_H
+#define THROUGHPUT_PRIORS_H
+
+#include "abr.h"
+#include <cstdint>
+#include <netinet/in.h>
+#include <unordered_map>
+
+// Throughput priors for clients the proxy has no estimate of yet: clients in
+// the same subnet (the same first prefix_length bits of their address, i.e.
+// the same /24 by default) mostly share an access network, so the throughput
+// samples of the clients before them tell what a new one is likely to get.
+// A new client starts from the harmonic mean of the latest samples of its
+// subnet instead of from 0, i.e. the lowest bitrate.
+
+// At most this many subnets are kept; samples from further ones are ignored.
+#define MAX_NO_OF_PRIOR_SUBNETS 65536
+
+class ThroughputPriors {
+public:
+  // prefix_length == 0 disables the priors.
+  explicit ThroughputPriors(int prefix_length);
+
+  bool is_enabled() const { return prefix_length_ > 0; }
+
+  // A client at addr (network byte order) got a throughput sample of kbps.
+  void add_sample(in_addr_t addr, double kbps);
+
+  // The prior (Kbps) for a new client at addr, 0 if there is none.
+  unsigned long prior(in_addr_t addr) const;
+
+private:
+  uint32_t subnet_of(in_addr_t addr) const;
+
+  int prefix_length_;
+  std::unordered_map<uint32_t, ThroughputWindow> window_of_subnet_;
+};
+
+#endif // !THROUGHPUT_PRIORS_H
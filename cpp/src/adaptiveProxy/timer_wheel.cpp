@@ -0,0 +1,149 @@
+#include "timer_wheel.h"
+
+#include <algorithm>
+#include <bit>
+
+TimerWheel::TimerWheel()
+    : start_{Clock::now()},
+      head_of_slot_(TIMER_WHEEL_LEVELS * TIMER_WHEEL_SLOTS, -1) {}
+
+void TimerWheel::arm(int fd, uint64_t timeout_ms, Clock::time_point now) {
+  cancel(fd);
+  if (node_of_fd_.size() <= static_cast<size_t>(fd)) {
+    node_of_fd_.resize(fd + 1, {0, -1, -1, -1});
+  }
+  if (no_of_armed_ == 0) {
+    // Nothing to expire on the way.
+    curr_tick_ = std::max(curr_tick_, tick_of(now));
+  }
+  uint64_t elapsed_ms{static_cast<uint64_t>(
+      std::chrono::duration_cast<std::chrono::milliseconds>(now - start_)
+          .count())};
+  uint64_t expires_at{(elapsed_ms + timeout_ms + TIMER_WHEEL_TICK_MS - 1) /
+                       TIMER_WHEEL_TICK_MS};
+  // Further than the levels reach is as far as they do.
+  expires_at = std::clamp<uint64_t>(
+      expires_at, curr_tick_ + 1,
+      curr_tick_ + (1ULL << TIMER_WHEEL_SLOT_BITS * TIMER_WHEEL_LEVELS) - 1);
+  node_of_fd_[fd].expires_at = expires_at;
+  link(fd);
+  ++no_of_armed_;
+}
+
+void TimerWheel::cancel(int fd) {
+  if (static_cast<size_t>(fd) >= node_of_fd_.size() ||
+      node_of_fd_[fd].slot == -1) {
+    return;
+  }
+  unlink(fd);
+  --no_of_armed_;
+}
+
+void TimerWheel::expire(Clock::time_point now, std::vector<int> &due) {
+  uint64_t tick{tick_of(now)};
+  while (curr_tick_ < tick) {
+    if (no_of_armed_ == 0) {
+      curr_tick_ = tick;
+      return;
+    }
+    ++curr_tick_;
+    // Level 0 came round: move the next slot of each level above down, as
+    // far as its level came round too.
+    for (int level{1}; level < TIMER_WHEEL_LEVELS; ++level) {
+      if ((curr_tick_ & ((1ULL << TIMER_WHEEL_SLOT_BITS * level) - 1)) != 0) {
+        break;
+      }
+      int slot{level * TIMER_WHEEL_SLOTS +
+               static_cast<int>((curr_tick_ >> TIMER_WHEEL_SLOT_BITS * level) &
+                                (TIMER_WHEEL_SLOTS - 1))};
+      int fd{head_of_slot_[slot]};
+      head_of_slot_[slot] = -1;
+      while (fd != -1) {
+        int next{node_of_fd_[fd].next};
+        link(fd);
+        fd = next;
+      }
+    }
+
+    int slot{static_cast<int>(curr_tick_ & (TIMER_WHEEL_SLOTS - 1))};
+    for (int fd{head_of_slot_[slot]}; fd != -1; fd = node_of_fd_[fd].next) {
+      node_of_fd_[fd].slot = -1;
+      due.push_back(fd);
+      --no_of_armed_;
+    }
+    head_of_slot_[slot] = -1;
+    level_0_occupancy_ &= ~(1ULL << slot);
+  }
+}
+
+int TimerWheel::next_timeout_ms(Clock::time_point now) const {
+  if (no_of_armed_ == 0) {
+    return -1;
+  }
+  // The next slot of level 0 that is not empty, or the next time level 0
+  // comes round and deadlines move down to it, whichever is first.
+  uint64_t no_of_ticks{TIMER_WHEEL_SLOTS -
+                       (curr_tick_ & (TIMER_WHEEL_SLOTS - 1))};
+  uint64_t ahead{std::rotr(level_0_occupancy_,
+                           static_cast<int>((curr_tick_ + 1) &
+                                            (TIMER_WHEEL_SLOTS - 1)))};
+  if (ahead != 0) {
+    no_of_ticks = std::min<uint64_t>(no_of_ticks, std::countr_zero(ahead) + 1);
+  }
+  auto timeout{start_ +
+               std::chrono::milliseconds{(curr_tick_ + no_of_ticks) *
+                                         TIMER_WHEEL_TICK_MS} -
+               now};
+  if (timeout <= Clock::duration::zero()) {
+    return 0;
+  }
+  // Rounded up, so that the wait does not end just before the tick.
+  return static_cast<int>(
+      std::chrono::ceil<std::chrono::milliseconds>(timeout).count());
+}
+
+uint64_t TimerWheel::tick_of(Clock::time_point time) const {
+  return std::chrono::duration_cast<std::chrono::milliseconds>(time - start_)
+             .count() /
+         TIMER_WHEEL_TICK_MS;
+}
+
+void TimerWheel::link(int fd) {
+  Node &node{node_of_fd_[fd]};
+  uint64_t distance{node.expires_at - curr_tick_};
+  int level{0};
+  while (level < TIMER_WHEEL_LEVELS - 1 &&
+         distance >= 1ULL << TIMER_WHEEL_SLOT_BITS * (level + 1)) {
+    ++level;
+  }
+  int slot{static_cast<int>((node.expires_at >>
+                             TIMER_WHEEL_SLOT_BITS * level) &
+                            (TIMER_WHEEL_SLOTS - 1))};
+  if (level == 0) {
+    level_0_occupancy_ |= 1ULL << slot;
+  }
+  slot += level * TIMER_WHEEL_SLOTS;
+  node.slot = slot;
+  node.prev = -1;
+  node.next = head_of_slot_[slot];
+  if (node.next != -1) {
+    node_of_fd_[node.next].prev = fd;
+  }
+  head_of_slot_[slot] = fd;
+}
+
+void TimerWheel::unlink(int fd) {
+  Node &node{node_of_fd_[fd]};
+  if (node.prev != -1) {
+    node_of_fd_[node.prev].next = node.next;
+  } else {
+    head_of_slot_[node.slot] = node.next;
+    if (node.next == -1 && node.slot < TIMER_WHEEL_SLOTS) {
+      level_0_occupancy_ &= ~(1ULL << node.slot);
+    }
+  }
+  if (node.next != -1) {
+    node_of_fd_[node.next].prev = node.prev;
+  }
+  node.slot = -1;
+}
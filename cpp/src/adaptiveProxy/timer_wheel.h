@@ -0,0 +1,65 @@
+#ifndef TIMER_WHEEL_H
+#define TIMER_WHEEL_H
+
+#include <chrono>
+#include <cstdint>
+#include <vector>
+
+// The deadlines of the sockets of the event loop, at most one per fd, in a
+// hierarchical timing wheel: arming and cancelling a deadline are O(1), and
+// so is every tick of time that passes.
+//
+// Each of the TIMER_WHEEL_LEVELS levels is a ring of TIMER_WHEEL_SLOTS slots,
+// each a list of the fds due in it. A slot of level 0 spans one tick, and one
+// of level l spans as many ticks as all of level l - 1. A deadline goes to
+// the lowest level whose ring reaches it; whenever level 0 comes round, the
+// next slot of the level above is emptied into the levels below, until the
+// deadlines in it are close enough for level 0, where they expire.
+
+#define TIMER_WHEEL_TICK_MS 10
+#define TIMER_WHEEL_LEVELS 4
+#define TIMER_WHEEL_SLOT_BITS 6
+#define TIMER_WHEEL_SLOTS (1 << TIMER_WHEEL_SLOT_BITS)
+
+class TimerWheel {
+public:
+  using Clock = std::chrono::steady_clock;
+
+  TimerWheel();
+
+  // Make fd due timeout_ms after now, replacing the deadline it had.
+  void arm(int fd, uint64_t timeout_ms, Clock::time_point now);
+
+  // fd no longer has a deadline, if it had one.
+  void cancel(int fd);
+
+  // Move the fds whose deadlines passed by now to due, in no particular order.
+  // They no longer have a deadline.
+  void expire(Clock::time_point now, std::vector<int> &due);
+
+  // How many ms after now the next deadline may pass, for the timeout of a
+  // wait; -1 if there is none. Deadlines far off can be a few ticks early,
+  // when they move down a level, which expire() then does.
+  int next_timeout_ms(Clock::time_point now) const;
+
+private:
+  struct Node {
+    uint64_t expires_at; // The tick.
+    int prev, next;      // fds in the same slot; -1 at either end.
+    int slot;            // level * TIMER_WHEEL_SLOTS + slot; -1 if not armed.
+  };
+
+  uint64_t tick_of(Clock::time_point time) const;
+  void link(int fd);
+  void unlink(int fd);
+
+  Clock::time_point start_;
+  uint64_t curr_tick_{};
+  size_t no_of_armed_{};
+  std::vector<Node> node_of_fd_;
+  std::vector<int> head_of_slot_;
+  // Bit i is set if slot i of level 0 is not empty.
+  uint64_t level_0_occupancy_{};
+};
+
+#endif // !TIMER_WHEEL_H
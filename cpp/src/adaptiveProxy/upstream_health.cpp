@@ -0,0 +1,134 @@
+#include "upstream_health.h"
+
+#include "network_utils.h"
+#include "spdlog/spdlog.h"
+#include <arpa/inet.h>
+#include <sys/socket.h>
+#include <sys/timerfd.h>
+#include <unistd.h>
+
+std::string name_of(Upstream upstream) {
+  char ip_str[INET_ADDRSTRLEN];
+  in_addr ip_addr{upstream.addr};
+  if (inet_ntop(AF_INET, &ip_addr, ip_str, sizeof(ip_str)) == NULL) {
+    return "?";
+  }
+  return std::string{ip_str} + ":" + std::to_string(ntohs(upstream.port));
+}
+
+void UpstreamHealth::start(Poller &poller) {
+  poller_ = &poller;
+  if ((timer_fd_ = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC)) == -1) {
+    spdlog::warn("timerfd_create()");
+    quick_exit(EXIT_FAILURE);
+  }
+  itimerspec interval{};
+  interval.it_interval.tv_sec = HEALTH_CHECK_INTERVAL_MS / 1000;
+  interval.it_interval.tv_nsec = (HEALTH_CHECK_INTERVAL_MS % 1000) * 1000000L;
+  interval.it_value = interval.it_interval;
+  if (timerfd_settime(timer_fd_, 0, &interval, nullptr) == -1) {
+    spdlog::warn("timerfd_settime()");
+    quick_exit(EXIT_FAILURE);
+  }
+}
+
+void UpstreamHealth::add(Upstream upstream) {
+  if (index_of_upstream_.contains(upstream.key())) {
+    return;
+  }
+  index_of_upstream_[upstream.key()] = health_.size();
+  health_.push_back({upstream, true, 0, 0, -1});
+}
+
+bool UpstreamHealth::is_healthy(Upstream upstream) const {
+  auto it{index_of_upstream_.find(upstream.key())};
+  return it == index_of_upstream_.end() || health_[it->second].is_healthy;
+}
+
+void UpstreamHealth::report_failure(Upstream upstream) {
+  add(upstream);
+  Health &health{health_[index_of_upstream_[upstream.key()]]};
+  health.successes = 0;
+  if (health.is_healthy) {
+    health.is_healthy = false;
+    spdlog::warn("Videoserver {} failed a session, marked unhealthy",
+                 name_of(upstream));
+  }
+}
+
+std::vector<Upstream> UpstreamHealth::healthy_upstreams() const {
+  std::vector<Upstream> upstreams{};
+  for (const Health &health : health_) {
+    if (health.is_healthy) {
+      upstreams.push_back(health.upstream);
+    }
+  }
+  return upstreams;
+}
+
+void UpstreamHealth::finish_check(int fd) {
+  size_t index{upstream_of_check_[fd]};
+  int error{};
+  socklen_t error_len{sizeof(error)};
+  bool is_success{getsockopt(fd, SOL_SOCKET, SO_ERROR, &error, &error_len) !=
+                      -1 &&
+                  error == 0};
+  end_check(index);
+  record(index, is_success);
+}
+
+void UpstreamHealth::send_checks() {
+  uint64_t no_of_expirations;
+  if (read(timer_fd_, &no_of_expirations, sizeof(no_of_expirations)) == -1) {
+    spdlog::warn("UpstreamHealth::send_checks(): read()");
+    return;
+  }
+
+  for (size_t i = 0; i < health_.size(); ++i) {
+    if (health_[i].check_fd != -1) {
+      // The previous check timed out.
+      end_check(i);
+      record(i, false);
+    }
+
+    int fd{start_outbound_socket(health_[i].upstream.addr,
+                                 health_[i].upstream.port)};
+    if (fd == -1) {
+      record(i, false);
+      continue;
+    }
+    poller_->add(fd, true);
+    health_[i].check_fd = fd;
+    upstream_of_check_[fd] = i;
+  }
+}
+
+void UpstreamHealth::record(size_t index, bool is_success) {
+  Health &health{health_[index]};
+  if (is_success) {
+    health.failures = 0;
+    if (++health.successes >= HEALTH_CHECK_RISE && !health.is_healthy) {
+      health.is_healthy = true;
+      spdlog::info("Videoserver {} passed {} health checks, marked healthy",
+                   name_of(health.upstream), health.successes);
+    }
+  } else {
+    health.successes = 0;
+    if (++health.failures >= HEALTH_CHECK_FALL && health.is_healthy) {
+      health.is_healthy = false;
+      spdlog::warn("Videoserver {} failed {} health checks, marked unhealthy",
+                   name_of(health.upstream), health.failures);
+    }
+  }
+}
+
+void UpstreamHealth::end_check(size_t index) {
+  int fd{health_[index].check_fd};
+  poller_->remove(fd);
+  if (close(fd) == -1) {
+    spdlog::warn("UpstreamHealth::end_check()");
+    quick_exit(EXIT_FAILURE);
+  }
+  upstream_of_check_.erase(fd);
+  health_[index].check_fd = -1;
+}
@@ -0,0 +1,94 @@
+#ifndef UPSTREAM_HEALTH_H
+#define UPSTREAM_HEALTH_H
+
+#include "poller.h"
+#include <cstdint>
+#include <netinet/in.h>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Health of the videoservers the proxy knows about, so that sessions can fail
+// over to a working one instead of taking the whole proxy down.
+
+// Every HEALTH_CHECK_INTERVAL_MS, each videoserver gets an active check: a
+// TCP connect, which fails if it has not completed by the next check.
+// HEALTH_CHECK_FALL failed checks in a row mark a videoserver unhealthy and
+// HEALTH_CHECK_RISE successful ones healthy again. Failures seen by sessions
+// (passive checks) mark it unhealthy right away.
+#define HEALTH_CHECK_INTERVAL_MS 1000
+#define HEALTH_CHECK_FALL 2
+#define HEALTH_CHECK_RISE 2
+
+// How long a session waits for a videoserver to accept its connection.
+#define UPSTREAM_CONNECT_TIMEOUT_MS 500
+
+// How long a session waits for a videoserver to start answering a request,
+// or for the next chunk of a response relayed as it comes in, before taking
+// the videoserver for failed.
+#define UPSTREAM_RESPONSE_TIMEOUT_MS 10000
+
+// How long a connection kept open for reuse is kept.
+#define UPSTREAM_IDLE_TIMEOUT_MS 30000
+
+// How many videoservers a session tries before giving up when its own fails.
+#define MAX_FAILOVER_ATTEMPTS 3
+
+// A videoserver, address and port in network byte order.
+struct Upstream {
+  in_addr_t addr;
+  uint16_t port;
+
+  uint64_t key() const { return (static_cast<uint64_t>(addr) << 16) | port; }
+};
+
+// "ip:port" of upstream, for logging.
+std::string name_of(Upstream upstream);
+
+class UpstreamHealth {
+public:
+  // Start the active checks; their sockets are added to poller.
+  void start(Poller &poller);
+
+  // The timerfd to watch for readability.
+  int timer_fd() const { return timer_fd_; }
+
+  // Start checking upstream (if not already). Upstreams start out healthy.
+  void add(Upstream upstream);
+
+  // Unknown upstreams are presumed healthy.
+  bool is_healthy(Upstream upstream) const;
+
+  // A session failed to connect to or talk to upstream.
+  void report_failure(Upstream upstream);
+
+  // The healthy upstreams, in the order they were added.
+  std::vector<Upstream> healthy_upstreams() const;
+
+  // Whether fd is the socket of an active check, and if so, record its
+  // outcome once epoll reports it.
+  bool is_check(int fd) const { return upstream_of_check_.contains(fd); }
+  void finish_check(int fd);
+
+  // Start a round of active checks; call when timer_fd() is readable.
+  void send_checks();
+
+private:
+  struct Health {
+    Upstream upstream;
+    bool is_healthy;
+    int successes, failures; // Consecutive.
+    int check_fd;            // -1 if no check is in progress.
+  };
+
+  void record(size_t index, bool is_success);
+  void end_check(size_t index);
+
+  Poller *poller_{};
+  int timer_fd_{-1};
+  std::vector<Health> health_;
+  std::unordered_map<uint64_t, size_t> index_of_upstream_;
+  std::unordered_map<int, size_t> upstream_of_check_;
+};
+
+#endif // !UPSTREAM_HEALTH_H
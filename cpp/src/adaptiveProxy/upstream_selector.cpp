@@ -0,0 +1,119 @@
+#include "upstream_selector.h"
+
+#include "spdlog/spdlog.h"
+#include <algorithm>
+#include <cmath>
+
+void UpstreamSelector::record_latency(Upstream upstream,
+                                      Clock::duration latency,
+                                      Clock::time_point now) {
+  Stats &stats{stats_of_upstream_[upstream.key()]};
+  double latency_ms{
+      std::chrono::duration<double, std::milli>{latency}.count()};
+  stats.latency_ms = stats.no_of_samples == 0
+                         ? latency_ms
+                         : UPSTREAM_LATENCY_ALPHA * latency_ms +
+                               (1.0 - UPSTREAM_LATENCY_ALPHA) *
+                                   stats.latency_ms;
+  stats.error_rate *= 1.0 - UPSTREAM_ERROR_ALPHA;
+  ++stats.no_of_samples;
+  stats.sampled_at = now;
+  eject_if_outlier(upstream, stats, now);
+}
+
+void UpstreamSelector::record_error(Upstream upstream,
+                                    Clock::time_point now) {
+  Stats &stats{stats_of_upstream_[upstream.key()]};
+  stats.error_rate =
+      UPSTREAM_ERROR_ALPHA + (1.0 - UPSTREAM_ERROR_ALPHA) * stats.error_rate;
+  ++stats.no_of_samples;
+  stats.sampled_at = now;
+  eject_if_outlier(upstream, stats, now);
+}
+
+std::vector<Upstream>
+UpstreamSelector::rank(const std::vector<Upstream> &upstreams,
+                       Clock::time_point now) {
+  std::vector<std::pair<double, Upstream>> in_rotation, ejected;
+  for (const Upstream &upstream : upstreams) {
+    auto it{stats_of_upstream_.find(upstream.key())};
+    if (it == stats_of_upstream_.end()) {
+      in_rotation.push_back({0, upstream});
+      continue;
+    }
+    Stats &stats{it->second};
+    if (stats.is_ejected && now >= stats.ejected_until) {
+      stats = {0, 0, 0, stats.no_of_ejections, false, now, {}};
+      spdlog::info("Videoserver {} back in rotation", name_of(upstream));
+    }
+    if (stats.is_ejected) {
+      ejected.push_back(
+          {static_cast<double>(stats.ejected_until.time_since_epoch().count()),
+           upstream});
+    } else {
+      in_rotation.push_back({score_of(stats, now), upstream});
+    }
+  }
+  auto by_score = [](const auto &a, const auto &b) {
+    return a.first < b.first;
+  };
+  std::stable_sort(in_rotation.begin(), in_rotation.end(), by_score);
+  std::stable_sort(ejected.begin(), ejected.end(), by_score);
+
+  std::vector<Upstream> ranked;
+  for (const auto &[score, upstream] : in_rotation) {
+    ranked.push_back(upstream);
+  }
+  for (const auto &[ejected_until, upstream] : ejected) {
+    ranked.push_back(upstream);
+  }
+  return ranked;
+}
+
+double UpstreamSelector::score_of(const Stats &stats,
+                                  Clock::time_point now) const {
+  if (stats.no_of_samples == 0) {
+    return 0;
+  }
+  double idle_ms{
+      std::chrono::duration<double, std::milli>{now - stats.sampled_at}
+          .count()};
+  return stats.latency_ms *
+         std::exp2(-idle_ms / UPSTREAM_LATENCY_HALF_LIFE_MS) /
+         std::max(0.01, 1.0 - stats.error_rate);
+}
+
+void UpstreamSelector::eject_if_outlier(Upstream upstream, Stats &stats,
+                                        Clock::time_point now) {
+  if (stats.is_ejected || stats.no_of_samples < UPSTREAM_OUTLIER_MIN_SAMPLES) {
+    return;
+  }
+  // The fastest of the others in rotation that have answered at all.
+  bool has_others{false};
+  double fastest_ms{-1};
+  for (const auto &[key, others] : stats_of_upstream_) {
+    if (key == upstream.key() || others.is_ejected) {
+      continue;
+    }
+    has_others = true;
+    if (others.latency_ms > 0 &&
+        (fastest_ms < 0 || others.latency_ms < fastest_ms)) {
+      fastest_ms = others.latency_ms;
+    }
+  }
+  if (!has_others ||
+      !(stats.error_rate > UPSTREAM_OUTLIER_ERROR_RATE ||
+        (fastest_ms > 0 &&
+         stats.latency_ms > UPSTREAM_OUTLIER_FACTOR * fastest_ms &&
+         stats.latency_ms - fastest_ms > UPSTREAM_OUTLIER_MIN_MS))) {
+    return;
+  }
+
+  int ejection_ms{std::min(UPSTREAM_EJECTION_MS * ++stats.no_of_ejections,
+                           UPSTREAM_MAX_EJECTION_MS)};
+  stats.is_ejected = true;
+  stats.ejected_until = now + std::chrono::milliseconds{ejection_ms};
+  spdlog::warn("Videoserver {} ejected for {} s (latency {} ms, error rate {})",
+               name_of(upstream), ejection_ms / 1000,
+               static_cast<long>(stats.latency_ms), stats.error_rate);
+}
@@ -0,0 +1,74 @@
+#ifndef UPSTREAM_SELECTOR_H
+#define UPSTREAM_SELECTOR_H
+
+#include "upstream_health.h"
+#include <chrono>
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+// Ranking of videoservers by how well they are serving right now, for
+// picking one per request rather than once per client.
+
+// Every response updates an EWMA of its videoserver's latency (time to the
+// first byte of the response) and every failure its error rate. A
+// videoserver is ranked by its latency inflated by its error rate. The
+// estimate of one that gets no requests halves every
+// UPSTREAM_LATENCY_HALF_LIFE_MS, so a videoserver that was slow is tried
+// again now and then rather than never again.
+#define UPSTREAM_LATENCY_ALPHA 0.3
+#define UPSTREAM_ERROR_ALPHA 0.3
+#define UPSTREAM_LATENCY_HALF_LIFE_MS 5000
+
+// Outlier ejection: after UPSTREAM_OUTLIER_MIN_SAMPLES samples, a videoserver
+// is taken out of rotation if its error rate exceeds
+// UPSTREAM_OUTLIER_ERROR_RATE, or its latency exceeds both
+// UPSTREAM_OUTLIER_FACTOR times and UPSTREAM_OUTLIER_MIN_MS more than that of
+// the fastest videoserver in rotation. It is ejected for UPSTREAM_EJECTION_MS
+// times the number of times it has been (at most UPSTREAM_MAX_EJECTION_MS),
+// then comes back with a clean slate. The last one in rotation is never
+// ejected.
+#define UPSTREAM_OUTLIER_MIN_SAMPLES 3
+#define UPSTREAM_OUTLIER_ERROR_RATE 0.5
+#define UPSTREAM_OUTLIER_FACTOR 3.0
+#define UPSTREAM_OUTLIER_MIN_MS 50
+#define UPSTREAM_EJECTION_MS 10000
+#define UPSTREAM_MAX_EJECTION_MS 60000
+
+// How many connections to a videoserver the proxy keeps open for reuse once
+// no client is using them.
+#define MAX_IDLE_CONNECTIONS_PER_UPSTREAM 32
+
+class UpstreamSelector {
+public:
+  using Clock = std::chrono::steady_clock;
+
+  // upstream answered a request latency after it was sent.
+  void record_latency(Upstream upstream, Clock::duration latency,
+                      Clock::time_point now);
+
+  // upstream failed to connect, to take a request or to answer it.
+  void record_error(Upstream upstream, Clock::time_point now);
+
+  // upstreams, best first, with the ejected ones last.
+  std::vector<Upstream> rank(const std::vector<Upstream> &upstreams,
+                             Clock::time_point now);
+
+private:
+  struct Stats {
+    double latency_ms, error_rate;
+    int no_of_samples, no_of_ejections;
+    bool is_ejected;
+    Clock::time_point sampled_at, ejected_until;
+  };
+
+  // The latency to expect from upstream, in ms. Upstreams never sampled
+  // score 0, so they are tried first.
+  double score_of(const Stats &stats, Clock::time_point now) const;
+  void eject_if_outlier(Upstream upstream, Stats &stats,
+                        Clock::time_point now);
+
+  std::unordered_map<uint64_t, Stats> stats_of_upstream_;
+};
+
+#endif // !UPSTREAM_SELECTOR_H
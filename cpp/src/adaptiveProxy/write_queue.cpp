@@ -0,0 +1,119 @@
+#include "write_queue.h"
+
+#include "spdlog/spdlog.h"
+#include <algorithm>
+#include <cerrno>
+#include <utility>
+
+WriteQueues::WriteQueues(Poller &poller) : poller_{poller} {}
+
+bool WriteQueues::write(int socket, BufferRef buffer) {
+  std::string_view data{buffer.view()};
+  return write(socket, data, std::move(buffer));
+}
+
+bool WriteQueues::write(int socket, std::string_view data, BufferRef buffer) {
+  auto it{queue_of_socket_.find(socket)};
+  if (it != queue_of_socket_.end()) {
+    it->second.writes.push_back({data, std::move(buffer)});
+    return true;
+  } else if (data.empty()) {
+    return true;
+  }
+
+  iovec iov{const_cast<char *>(data.data()), data.length()};
+  long curr{poller_.send(socket, &iov, &buffer, 1)};
+  if (curr < 0 && errno == EINPROGRESS) {
+    queue_of_socket_[socket] = {{{data, std::move(buffer)}}, false};
+    return true;
+  } else if (curr < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+    curr = 0;
+  } else if (curr <= 0) {
+    spdlog::warn("WriteQueues::write(): socket {} failed", socket);
+    return false;
+  }
+  data.remove_prefix(curr);
+  no_of_bytes_sent_ += curr;
+  if (!data.empty()) {
+    queue_of_socket_[socket] = {{{data, std::move(buffer)}}, true};
+    poller_.watch_writable(socket, true);
+  }
+  return true;
+}
+
+bool WriteQueues::flush(int socket) {
+  auto it{queue_of_socket_.find(socket)};
+  if (it == queue_of_socket_.end()) {
+    return true;
+  }
+  Queue &queue{it->second};
+  long sent{poller_.take_sent(socket)};
+  if (sent < 0) {
+    spdlog::warn("WriteQueues::flush(): socket {} failed", socket);
+    return false;
+  }
+  consume(queue, sent);
+  while (!queue.writes.empty()) {
+    for (const Write &write : queue.writes) {
+      if (iovs_.size() == WRITE_QUEUE_MAX_IOVS) {
+        break;
+      }
+      iovs_.push_back({const_cast<char *>(write.data.data()),
+                       write.data.length()});
+      buffers_.push_back(write.buffer);
+    }
+    long curr{poller_.send(socket, iovs_.data(), buffers_.data(),
+                           static_cast<int>(iovs_.size()))};
+    int send_errno{errno};
+    iovs_.clear();
+    buffers_.clear();
+    if (curr < 0 && send_errno == EINPROGRESS) {
+      return true;
+    } else if (curr < 0 &&
+               (send_errno == EAGAIN || send_errno == EWOULDBLOCK)) {
+      if (!queue.is_watched) {
+        queue.is_watched = true;
+        poller_.watch_writable(socket, true);
+      }
+      return true;
+    } else if (curr <= 0) {
+      spdlog::warn("WriteQueues::flush(): socket {} failed", socket);
+      return false;
+    }
+    consume(queue, curr);
+  }
+  if (queue.is_watched) {
+    poller_.watch_writable(socket, false);
+  }
+  queue_of_socket_.erase(it);
+  return true;
+}
+
+void WriteQueues::remove(int socket) { queue_of_socket_.erase(socket); }
+
+size_t WriteQueues::no_of_queued_bytes(int socket) const {
+  auto it{queue_of_socket_.find(socket)};
+  if (it == queue_of_socket_.end()) {
+    return 0;
+  }
+  size_t no_of_bytes{};
+  for (const Write &write : it->second.writes) {
+    no_of_bytes += write.data.length();
+  }
+  return no_of_bytes;
+}
+
+void WriteQueues::consume(Queue &queue, size_t no_of_bytes) {
+  no_of_bytes_sent_ += no_of_bytes;
+  // Empty writes go too, so that a send is never left with nothing.
+  while (!queue.writes.empty() &&
+         (no_of_bytes > 0 || queue.writes.front().data.empty())) {
+    std::string_view &data{queue.writes.front().data};
+    size_t no_of_bytes_of_write{std::min(no_of_bytes, data.length())};
+    data.remove_prefix(no_of_bytes_of_write);
+    no_of_bytes -= no_of_bytes_of_write;
+    if (data.empty()) {
+      queue.writes.pop_front();
+    }
+  }
+}
@@ -0,0 +1,66 @@
+#ifndef WRITE_QUEUE_H
+#define WRITE_QUEUE_H
+
+#include "buffer_pool.h"
+#include "poller.h"
+#include <cstdint>
+#include <deque>
+#include <string_view>
+#include <sys/uio.h>
+#include <unordered_map>
+#include <vector>
+
+// Non-blocking writes to clients, through the poller (see Poller::send()).
+// Whatever a socket does not take right away is queued, with a reference to
+// the buffer holding it, and sent once the poller reports the socket
+// writable, so that one slow client does not hold up the others. What is
+// queued goes in one send of up to WRITE_QUEUE_MAX_IOVS buffers, and while a
+// send is in flight through the poller's ring, what it holds stays queued
+// until it completes.
+
+#define WRITE_QUEUE_MAX_IOVS 64
+
+class WriteQueues {
+public:
+  explicit WriteQueues(Poller &poller);
+
+  // Send data (kept alive by buffer, if any) to socket after whatever is
+  // already queued for it. Returns false if the socket failed.
+  bool write(int socket, BufferRef buffer);
+  bool write(int socket, std::string_view data, BufferRef buffer = {});
+
+  // socket is writable: send what is queued for it, once what was in flight
+  // is taken off. Returns false if the socket failed.
+  bool flush(int socket);
+
+  // Drop whatever is queued for socket, e.g. before closing it.
+  void remove(int socket);
+
+  size_t no_of_queued_bytes(int socket) const;
+
+  // How many bytes were sent to all sockets since the start.
+  uint64_t no_of_bytes_sent() const { return no_of_bytes_sent_; }
+
+private:
+  struct Write {
+    std::string_view data;
+    BufferRef buffer;
+  };
+  struct Queue {
+    std::deque<Write> writes;
+    // Whether the poller reports the socket writable.
+    bool is_watched;
+  };
+
+  // Take no_of_bytes sent off the front of queue, and count them.
+  void consume(Queue &queue, size_t no_of_bytes);
+
+  Poller &poller_;
+  std::unordered_map<int, Queue> queue_of_socket_;
+  // What the next send gathers, kept to reuse their storage.
+  std::vector<iovec> iovs_;
+  std::vector<BufferRef> buffers_;
+  uint64_t no_of_bytes_sent_{};
+};
+
+#endif // !WRITE_QUEUE_H
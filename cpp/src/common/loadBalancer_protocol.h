@@ -6,14 +6,19 @@
 // Define the protocol between the load balancer and the adaptive proxy.
 
 // The adaptive proxy sends a request to the load balancer containing the IP
-// address of the client it wishes to serve.
+// address of the client it wishes to serve, optionally followed by
+// content_key_len bytes of content key (e.g. the path of the video the client
+// is watching, without a terminating '\0').
 
 // The load balancer replies with the (address, port) of the videoserver that
 // the adaptive proxy should use for that particular client.
 
+#define MAX_CONTENT_KEY_LEN 1024
+
 struct LoadBalancerRequest {
-  in_addr_t client_addr; // The IP address of the client.
-  uint16_t request_id;   // A randomly-chosen identifier for this request.
+  in_addr_t client_addr;    // The IP address of the client.
+  uint16_t request_id;      // A randomly-chosen identifier for this request.
+  uint16_t content_key_len; // Length of the content key that follows, or 0.
 };
 
 struct LoadBalancerResponse {
@@ -21,3 +26,16 @@ struct LoadBalancerResponse {
   uint16_t videoserver_port;  // The port of the videoserver.
   uint16_t request_id;        // The request_id from the LoadBalancerRequest.
 };
+
+// In load and chash mode, videoservers (or an agent acting on their behalf, such as an
+// adaptiveProxy run with --report-load) periodically send a LoadReport as a
+// UDP datagram to the load balancer's port. Reports for the same videoserver
+// from different reporters are summed.
+
+struct LoadReport {
+  in_addr_t videoserver_addr;  // The IP address of the videoserver.
+  uint16_t videoserver_port;   // The port of the videoserver.
+  uint16_t report_interval_ms; // How often the reporter sends reports.
+  uint32_t active_sessions;    // Sessions currently served by the videoserver.
+  uint32_t egress_kbps;        // Egress rate over the last report interval.
+};
@@ -1,6 +1,10 @@
 #include "network_utils.h"
 
+#include <cerrno>
+#include <fcntl.h>
+#include <poll.h>
 #include <string.h> // memcpy()
+#include <unistd.h>
 
 void increase_fd_limit() {
   struct rlimit curr;
@@ -50,6 +54,59 @@ int get_outbound_socket(const char *const hostname, int port) {
   return sockfd;
 }
 
+bool resolve_hostname(const char *const hostname, in_addr_t &addr) {
+  struct hostent *host{};
+  if ((host = gethostbyname(hostname)) == nullptr ||
+      host->h_length != sizeof(addr)) {
+    return false;
+  }
+  memcpy(&addr, host->h_addr, host->h_length);
+  return true;
+}
+
+int start_outbound_socket(in_addr_t addr, uint16_t port) {
+  int sockfd;
+  if ((sockfd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC,
+                       IPPROTO_TCP)) == -1) {
+    return -1;
+  }
+
+  struct sockaddr_in remote_addr;
+  memset(&remote_addr, 0, sizeof(remote_addr));
+  remote_addr.sin_family = AF_INET;
+  remote_addr.sin_addr.s_addr = addr;
+  remote_addr.sin_port = port;
+  if (connect(sockfd, (sockaddr *)&remote_addr, sizeof(remote_addr)) == -1 &&
+      errno != EINPROGRESS) {
+    close(sockfd);
+    return -1;
+  }
+
+  return sockfd;
+}
+
+int try_get_outbound_socket(in_addr_t addr, uint16_t port, int timeout_ms) {
+  int sockfd{start_outbound_socket(addr, port)};
+  if (sockfd == -1) {
+    return -1;
+  }
+
+  // Wait for the connection to complete, then make the socket blocking again
+  // like the ones get_outbound_socket() returns.
+  pollfd connecting{sockfd, POLLOUT, 0};
+  int error{};
+  socklen_t error_len{sizeof(error)};
+  if (poll(&connecting, 1, timeout_ms) != 1 ||
+      getsockopt(sockfd, SOL_SOCKET, SO_ERROR, &error, &error_len) == -1 ||
+      error != 0 ||
+      fcntl(sockfd, F_SETFL, fcntl(sockfd, F_GETFL) & ~O_NONBLOCK) == -1) {
+    close(sockfd);
+    return -1;
+  }
+
+  return sockfd;
+}
+
 int get_inbound_socket(int port) {
   // (1) Create socket
   int sockfd;
@@ -93,3 +150,56 @@ int get_inbound_socket(int port) {
 
   return sockfd;
 }
+
+int get_outbound_udp_socket(const char *const hostname, int port) {
+  // (1) Create socket.
+  int sockfd;
+  if ((sockfd = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP)) == -1) {
+    quick_exit(EXIT_FAILURE);
+  }
+
+  // (2) Create a sockaddr_in to specify remote host and port.
+  struct sockaddr_in addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.sin_family = AF_INET;
+  struct hostent *host{};
+  if ((host = gethostbyname(hostname)) == nullptr) {
+    quick_exit(EXIT_FAILURE);
+  }
+  memcpy(&(addr.sin_addr), host->h_addr, host->h_length);
+  addr.sin_port = htons(static_cast<uint16_t>(port));
+
+  // (3) "Connect" so that send() knows where datagrams go.
+  if (connect(sockfd, (sockaddr *)&addr, sizeof(addr)) == -1) {
+    quick_exit(EXIT_FAILURE);
+  }
+
+  return sockfd;
+}
+
+int get_inbound_udp_socket(int port) {
+  // (1) Create socket
+  int sockfd;
+  if ((sockfd = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP)) == -1) {
+    quick_exit(EXIT_FAILURE);
+  }
+
+  // (2) Set the "reuse port" socket option
+  const int enable{1};
+  if (setsockopt(sockfd, SOL_SOCKET, SO_REUSEADDR, &enable, sizeof(enable)) ==
+      -1) {
+    quick_exit(EXIT_FAILURE);
+  }
+
+  // (3) Bind to the port on every interface.
+  struct sockaddr_in addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = INADDR_ANY;
+  addr.sin_port = htons(static_cast<uint16_t>(port));
+  if (bind(sockfd, (sockaddr *)&addr, sizeof(addr)) == -1) {
+    quick_exit(EXIT_FAILURE);
+  }
+
+  return sockfd;
+}
@@ -13,6 +13,24 @@ void increase_fd_limit();
 
 int get_outbound_socket(const char *const hostname, int port);
 
+// Resolve hostname to an IPv4 address (network byte order). Returns false if
+// it cannot be resolved.
+bool resolve_hostname(const char *const hostname, in_addr_t &addr);
+
+// Start connecting a non-blocking socket to addr:port (both in network byte
+// order); the connection is complete once the socket is writable and
+// SO_ERROR is 0. Returns -1 if the connection fails right away.
+int start_outbound_socket(in_addr_t addr, uint16_t port);
+
+// Connect a blocking socket to addr:port (both in network byte order),
+// waiting at most timeout_ms. Unlike get_outbound_socket(), returns -1
+// instead of exiting if the remote host is down or unreachable.
+int try_get_outbound_socket(in_addr_t addr, uint16_t port, int timeout_ms);
+
 int get_inbound_socket(int port);
 
+int get_outbound_udp_socket(const char *const hostname, int port);
+
+int get_inbound_udp_socket(int port);
+
 #endif // NETWORK_UTILS_H
@@ -0,0 +1,59 @@
+#include "consistent_hash.h"
+
+#include <algorithm>
+#include <cmath>
+
+uint64_t hash_content_key(const char *key, size_t key_len) {
+  uint64_t hash{14695981039346656037ull};
+  for (size_t i = 0; i < key_len; ++i) {
+    hash ^= static_cast<unsigned char>(key[i]);
+    hash *= 1099511628211ull;
+  }
+  // FNV-1a mixes the last bytes poorly; finish with the splitmix64 finalizer.
+  hash ^= hash >> 30;
+  hash *= 0xbf58476d1ce4e5b9ull;
+  hash ^= hash >> 27;
+  hash *= 0x94d049bb133111ebull;
+  hash ^= hash >> 31;
+  return hash;
+}
+
+ConsistentHashRing::ConsistentHashRing(const std::vector<Videoserver> &servers)
+    : num_servers_(servers.size()) {
+  for (size_t i = 0; i < servers.size(); ++i) {
+    for (int j = 0; j < CHASH_VIRTUAL_NODES; ++j) {
+      std::string virtual_node{servers[i].name + "#" + std::to_string(j)};
+      ring_.push_back(
+          {hash_content_key(virtual_node.c_str(), virtual_node.length()),
+           static_cast<int>(i)});
+    }
+  }
+  std::sort(ring_.begin(), ring_.end());
+}
+
+int ConsistentHashRing::choose(
+    uint64_t key_hash, const std::vector<uint64_t> &load_of_server) const {
+  if (ring_.empty()) {
+    return -1;
+  }
+
+  // Count the new session too, so an idle cluster still admits one per server.
+  uint64_t total_load{1};
+  for (uint64_t load : load_of_server) {
+    total_load += load;
+  }
+  double capacity{std::ceil(CHASH_LOAD_FACTOR * total_load / num_servers_)};
+
+  size_t start{static_cast<size_t>(
+      std::lower_bound(ring_.begin(), ring_.end(),
+                       std::pair<uint64_t, int>{key_hash, 0}) -
+      ring_.begin())};
+  for (size_t i = 0; i < ring_.size(); ++i) {
+    int server{ring_[(start + i) % ring_.size()].second};
+    if (load_of_server[server] + 1 <= capacity) {
+      return server;
+    }
+  }
+  // Unreachable as the average load is always under capacity, but be safe.
+  return ring_[start % ring_.size()].second;
+}
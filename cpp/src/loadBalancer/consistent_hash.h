@@ -0,0 +1,38 @@
+#ifndef CONSISTENT_HASH_H
+#define CONSISTENT_HASH_H
+
+#include "server_info.h"
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Consistent hashing with bounded loads (Mirrokni, Thorup & Zadimoghaddam):
+// a content key goes to the first videoserver clockwise of its hash on a ring
+// of virtual nodes, unless that videoserver already carries more than
+// CHASH_LOAD_FACTOR times the average load, in which case it keeps walking
+// clockwise. Each title therefore concentrates on one videoserver (and spills
+// to the next ones only when it is hot), which keeps origin page caches warm.
+
+#define CHASH_VIRTUAL_NODES 128
+#define CHASH_LOAD_FACTOR 1.25
+
+// A 64-bit FNV-1a hash with a final avalanche, stable across runs.
+uint64_t hash_content_key(const char *key, size_t key_len);
+
+class ConsistentHashRing {
+public:
+  explicit ConsistentHashRing(const std::vector<Videoserver> &servers);
+
+  // Choose the videoserver for key_hash given the current load of every
+  // videoserver. Returns -1 if there are no videoservers.
+  int choose(uint64_t key_hash,
+             const std::vector<uint64_t> &load_of_server) const;
+
+private:
+  // (point on the ring, videoserver), sorted by point.
+  std::vector<std::pair<uint64_t, int>> ring_;
+  size_t num_servers_;
+};
+
+#endif // !CONSISTENT_HASH_H
@@ -1,8 +1,6 @@
 #include "djikstra.h"
 
-std::vector<int>
-dijkstra(const std::vector<std::vector<std::pair<int, int>>> &adj, int start,
-         int n) {
+std::vector<int> dijkstra(const LinkGraph &adj, int start, int n) {
   std::vector<int> dist(n, INT_MAX);
   dist[start] = 0;
   std::priority_queue<std::pair<int, int>, std::vector<std::pair<int, int>>,
@@ -20,9 +18,9 @@ dijkstra(const std::vector<std::vector<std::pair<int, int>>> &adj, int start,
       continue;
 
     // Explore each neighbor of u
-    for (const auto &edge : adj[u]) {
-      int v = edge.first;
-      int weight = edge.second;
+    for (const auto &edge : adj.links_of(u)) {
+      int v = edge.to;
+      int weight = edge.cost;
 
       // Relax the edge if a shorter path is found
       if (dist[v] > dist[u] + weight) {
@@ -1,12 +1,11 @@
 #ifndef DIJKSTRA_H
 #define DIJKSTRA_H
 
+#include "link_graph.h"
 #include <climits>
 #include <queue>
 #include <vector>
 
-std::vector<int>
-dijkstra(const std::vector<std::vector<std::pair<int, int>>> &adj, int start,
-         int n);
+std::vector<int> dijkstra(const LinkGraph &adj, int start, int n);
 
 #endif // !DIJKSTRA_H
@@ -0,0 +1,277 @@
+#include "geography_snapshot.h"
+
+#include "mapped_file.h"
+#include <arpa/inet.h>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <span>
+#include <unistd.h>
+
+// The file is a SnapshotHeader followed by these arrays, in order, which
+// leaves each of them aligned for its records:
+//   uint64_t link_offsets[num_nodes + 1]     (into links, per from node)
+//   Link links[num_links]
+//   uint64_t in_link_offsets[num_nodes + 1]  (into in_links, per to node)
+//   Link in_links[num_links]                 (to the from node)
+//   SnapshotClient clients[num_clients]      (in the order of client_nodes)
+//   SnapshotServer servers[num_servers]      (in the order of server_nodes)
+//   int64_t dist[num_nodes]
+//   int32_t server[num_nodes]
+//   int32_t next_hop[num_nodes]
+//   uint32_t table_entries[num_table_entries[level]], for levels 0 to 2
+//   uint8_t table_prefix_lens[num_table_entries[level]], for levels 0 to 2
+struct SnapshotHeader {
+  uint64_t magic;
+  uint32_t version, num_nodes;
+  uint64_t num_links;
+  uint32_t num_clients, num_servers;
+  uint64_t num_table_entries[3];
+};
+
+struct SnapshotClient {
+  int32_t node;
+  uint32_t prefix; // Network byte order.
+  int32_t prefix_len, reserved;
+  int64_t demand;
+};
+
+struct SnapshotServer {
+  int32_t node;
+  uint32_t addr; // Network byte order.
+  int64_t capacity;
+};
+
+bool is_geography_snapshot(const std::string &path) {
+  FILE *file{fopen(path.c_str(), "rb")};
+  if (file == NULL) {
+    return false;
+  }
+  uint64_t magic;
+  bool is_snapshot{fread(&magic, sizeof(magic), 1, file) == 1 &&
+                   magic == GEOGRAPHY_SNAPSHOT_MAGIC};
+  fclose(file);
+  return is_snapshot;
+}
+
+template <typename Array>
+static bool write_array(FILE *file, const Array &array) {
+  return fwrite(array.data(), sizeof(array[0]), array.size(), file) ==
+         array.size();
+}
+
+// The links of every node of graph in CSR form.
+static void flatten(const LinkGraph &graph, std::vector<uint64_t> &link_offsets,
+                    std::vector<Link> &links) {
+  link_offsets.assign(1, 0);
+  for (int node = 0; node < graph.num_nodes(); ++node) {
+    std::span<const Link> node_links{graph.links_of(node)};
+    links.insert(links.end(), node_links.begin(), node_links.end());
+    link_offsets.push_back(links.size());
+  }
+}
+
+bool write_geography_snapshot(const std::string &path,
+                              const Geography &geography,
+                              const std::vector<Videoserver> &servers,
+                              const NearestServerLabels &labels,
+                              const PrefixTable &closest_server_table) {
+  std::vector<uint64_t> link_offsets{}, in_link_offsets{};
+  std::vector<Link> links{}, in_links{};
+  flatten(geography.links, link_offsets, links);
+  flatten(labels.in_links(), in_link_offsets, in_links);
+  std::vector<SnapshotClient> clients{};
+  for (size_t i = 0; i < geography.client_nodes.size(); ++i) {
+    clients.push_back({geography.client_nodes[i],
+                       geography.client_prefixes[i].first,
+                       geography.client_prefixes[i].second, 0,
+                       geography.client_demands[i]});
+  }
+  std::vector<SnapshotServer> snapshot_servers{};
+  for (size_t i = 0; i < geography.server_nodes.size(); ++i) {
+    snapshot_servers.push_back({geography.server_nodes[i],
+                                servers[i].response.videoserver_addr,
+                                geography.server_capacities[i]});
+  }
+  std::vector<int64_t> dist(geography.num_nodes);
+  std::vector<int32_t> server(geography.num_nodes),
+      next_hop(geography.num_nodes);
+  for (int node = 0; node < geography.num_nodes; ++node) {
+    dist[node] = labels.dist_of(node);
+    server[node] = labels.server_of(node);
+    next_hop[node] = labels.next_hop_of(node);
+  }
+  const PrefixTable::Arrays &table{closest_server_table.arrays()};
+  SnapshotHeader header{GEOGRAPHY_SNAPSHOT_MAGIC,
+                        GEOGRAPHY_SNAPSHOT_VERSION,
+                        static_cast<uint32_t>(geography.num_nodes),
+                        links.size(),
+                        static_cast<uint32_t>(clients.size()),
+                        static_cast<uint32_t>(snapshot_servers.size()),
+                        {table.entries[0].size(), table.entries[1].size(),
+                         table.entries[2].size()}};
+
+  std::string tmp_path{path + ".tmp"};
+  FILE *file{fopen(tmp_path.c_str(), "wb")};
+  if (file == NULL) {
+    return false;
+  }
+  bool is_written{fwrite(&header, sizeof(header), 1, file) == 1 &&
+                  write_array(file, link_offsets) &&
+                  write_array(file, links) &&
+                  write_array(file, in_link_offsets) &&
+                  write_array(file, in_links) && write_array(file, clients) &&
+                  write_array(file, snapshot_servers) &&
+                  write_array(file, dist) && write_array(file, server) &&
+                  write_array(file, next_hop)};
+  for (int level = 0; level < 3; ++level) {
+    is_written = is_written && write_array(file, table.entries[level]);
+  }
+  for (int level = 0; level < 3; ++level) {
+    is_written = is_written && write_array(file, table.prefix_lens[level]);
+  }
+  is_written = is_written && fflush(file) == 0 && fsync(fileno(file)) == 0;
+  if (fclose(file) == EOF || !is_written ||
+      rename(tmp_path.c_str(), path.c_str()) == -1) {
+    unlink(tmp_path.c_str());
+    return false;
+  }
+  return true;
+}
+
+// Copy count records of type T from the snapshot at pos, advancing pos.
+// Returns false if the snapshot ends before them.
+template <typename T>
+static bool read_array(const MappedFile &file, size_t &pos, uint64_t count,
+                       std::vector<T> &array) {
+  if (count > (file.size() - pos) / sizeof(T)) {
+    return false;
+  }
+  array.resize(count);
+  memcpy(array.data(), file.data() + pos, count * sizeof(T));
+  pos += count * sizeof(T);
+  return true;
+}
+
+// View count records of type T in the snapshot at pos, advancing pos.
+// Returns false if the snapshot ends before them or they are misaligned.
+template <typename T>
+static bool view_array(const MappedFile &file, size_t &pos, uint64_t count,
+                       std::span<const T> &array) {
+  if (count > (file.size() - pos) / sizeof(T) ||
+      reinterpret_cast<uintptr_t>(file.data() + pos) % alignof(T) != 0) {
+    return false;
+  }
+  array = {reinterpret_cast<const T *>(file.data() + pos), count};
+  pos += count * sizeof(T);
+  return true;
+}
+
+// Whether link_offsets and links are the links of num_nodes nodes in CSR
+// form, none of negative cost.
+static bool is_valid_csr(std::span<const uint64_t> link_offsets,
+                         std::span<const Link> links, int num_nodes) {
+  if (link_offsets[0] != 0 || link_offsets[num_nodes] != links.size()) {
+    return false;
+  }
+  for (int node = 0; node < num_nodes; ++node) {
+    if (link_offsets[node] > link_offsets[node + 1]) {
+      return false;
+    }
+  }
+  for (const auto &[to, cost] : links) {
+    if (to < 0 || to >= num_nodes || cost < 0) {
+      return false;
+    }
+  }
+  return true;
+}
+
+bool read_geography_snapshot(const std::string &path, Geography &geography,
+                             std::vector<Videoserver> &servers,
+                             std::optional<NearestServerLabels> &labels,
+                             std::optional<PrefixTable> &closest_server_table) {
+  auto file{std::make_shared<MappedFile>()};
+  SnapshotHeader header;
+  if (!file->open(path, false) || file->size() < sizeof(header)) {
+    return false;
+  }
+  memcpy(&header, file->data(), sizeof(header));
+  if (header.magic != GEOGRAPHY_SNAPSHOT_MAGIC ||
+      header.version != GEOGRAPHY_SNAPSHOT_VERSION ||
+      header.num_nodes > INT32_MAX) {
+    return false;
+  }
+
+  int num_nodes{static_cast<int>(header.num_nodes)};
+  size_t pos{sizeof(header)};
+  std::span<const uint64_t> link_offsets, in_link_offsets;
+  std::span<const Link> links, in_links;
+  std::vector<SnapshotClient> clients;
+  std::vector<SnapshotServer> snapshot_servers;
+  std::vector<int64_t> dist;
+  std::vector<int32_t> server, next_hop;
+  PrefixTable::Arrays table;
+  bool is_read{view_array(*file, pos, header.num_nodes + 1ULL, link_offsets) &&
+               view_array(*file, pos, header.num_links, links) &&
+               view_array(*file, pos, header.num_nodes + 1ULL,
+                          in_link_offsets) &&
+               view_array(*file, pos, header.num_links, in_links) &&
+               read_array(*file, pos, header.num_clients, clients) &&
+               read_array(*file, pos, header.num_servers, snapshot_servers) &&
+               read_array(*file, pos, header.num_nodes, dist) &&
+               read_array(*file, pos, header.num_nodes, server) &&
+               read_array(*file, pos, header.num_nodes, next_hop)};
+  for (int level = 0; level < 3; ++level) {
+    is_read = is_read && view_array(*file, pos, header.num_table_entries[level],
+                                    table.entries[level]);
+  }
+  for (int level = 0; level < 3; ++level) {
+    is_read = is_read && view_array(*file, pos, header.num_table_entries[level],
+                                    table.prefix_lens[level]);
+  }
+  if (!is_read || pos != file->size() ||
+      !is_valid_csr(link_offsets, links, num_nodes) ||
+      !is_valid_csr(in_link_offsets, in_links, num_nodes) ||
+      !PrefixTable::is_valid(table, static_cast<int>(header.num_servers))) {
+    return false;
+  }
+
+  geography = Geography{};
+  geography.num_nodes = num_nodes;
+  geography.links = LinkGraph{link_offsets, links, file};
+  for (const SnapshotClient &client : clients) {
+    if (client.node < 0 || client.node >= num_nodes ||
+        client.prefix_len < 0 || client.prefix_len > 32) {
+      return false;
+    }
+    geography.client_nodes.push_back(client.node);
+    geography.client_prefixes.push_back({client.prefix, client.prefix_len});
+    geography.client_demands.push_back(client.demand);
+  }
+  servers.clear();
+  char ip_str[INET_ADDRSTRLEN];
+  for (const SnapshotServer &snapshot_server : snapshot_servers) {
+    in_addr ip_addr{snapshot_server.addr};
+    if (snapshot_server.node < 0 || snapshot_server.node >= num_nodes ||
+        inet_ntop(AF_INET, &ip_addr, ip_str, sizeof(ip_str)) == NULL) {
+      return false;
+    }
+    geography.server_nodes.push_back(snapshot_server.node);
+    geography.server_capacities.push_back(snapshot_server.capacity);
+    servers.push_back(make_videoserver(snapshot_server.addr, 8000, ip_str));
+  }
+  for (int node = 0; node < num_nodes; ++node) {
+    if (server[node] < -1 ||
+        server[node] >= static_cast<int>(header.num_servers) ||
+        next_hop[node] < -1 || next_hop[node] >= num_nodes) {
+      return false;
+    }
+  }
+  labels.emplace(geography, LinkGraph{in_link_offsets, in_links, file},
+                 std::vector<long long>(dist.begin(), dist.end()),
+                 std::move(server), std::move(next_hop));
+  closest_server_table.emplace(table, std::move(file));
+  return true;
+}
@@ -0,0 +1,50 @@
+#ifndef GEOGRAPHY_SNAPSHOT_H
+#define GEOGRAPHY_SNAPSHOT_H
+
+#include "nearest_server.h"
+#include "server_info.h"
+#include <optional>
+#include <string>
+#include <vector>
+
+// A geography compiled into a binary snapshot, so that a load balancer
+// restarting after a failure is serving again in the time it takes to map the
+// file rather than to parse millions of links and run Dijkstra over them.
+//
+// The snapshot holds the links in CSR form (the links of every node stored
+// back to back, with the offset of each node's first link) and the same
+// links reversed, the clients and servers, the nearest-server label of every
+// node, and the arrays of the table of the closest server of every client
+// prefix. All sections are arrays of fixed-size records in host byte order,
+// each aligned for its records. The links and the table are used where they
+// are mapped, so reading them is a bounds check; they are only copied as
+// link changes need it. The rest is bounds-checked and copied. A snapshot
+// from a host of the other byte order or another version fails the magic
+// check.
+
+#define GEOGRAPHY_SNAPSHOT_MAGIC 0x50414e5347424c41ULL // "ALBGSNAP"
+#define GEOGRAPHY_SNAPSHOT_VERSION 2
+
+// Whether the file at path starts like a geography snapshot.
+bool is_geography_snapshot(const std::string &path);
+
+// Write geography, its servers, labels and closest_server_table (as built by
+// build_closest_server_table()) to path, through a temporary file renamed
+// over it: a load balancer watching path never reads half a snapshot, and
+// one still using the snapshot it replaces keeps the file it mapped. Returns
+// false if the file cannot be written.
+bool write_geography_snapshot(const std::string &path,
+                              const Geography &geography,
+                              const std::vector<Videoserver> &servers,
+                              const NearestServerLabels &labels,
+                              const PrefixTable &closest_server_table);
+
+// Read the snapshot at path, which stays mapped for as long as geography,
+// labels or closest_server_table use it. Returns false if it is missing,
+// truncated or inconsistent, or has a link of negative cost.
+bool read_geography_snapshot(const std::string &path, Geography &geography,
+                             std::vector<Videoserver> &servers,
+                             std::optional<NearestServerLabels> &labels,
+                             std::optional<PrefixTable> &closest_server_table);
+
+#endif // !GEOGRAPHY_SNAPSHOT_H
@@ -0,0 +1,59 @@
+#include "link_graph.h"
+
+#include <algorithm>
+#include <utility>
+
+// The arrays of a LinkGraph that owns them.
+struct OwnedLinks {
+  std::vector<uint64_t> link_offsets;
+  std::vector<Link> links;
+};
+
+LinkGraph::LinkGraph(std::vector<uint64_t> link_offsets,
+                     std::vector<Link> links) {
+  auto owned{std::make_shared<OwnedLinks>(
+      OwnedLinks{std::move(link_offsets), std::move(links)})};
+  link_offsets_ = owned->link_offsets;
+  links_ = owned->links;
+  storage_ = std::move(owned);
+}
+
+LinkGraph::LinkGraph(std::span<const uint64_t> link_offsets,
+                     std::span<const Link> links,
+                     std::shared_ptr<const void> storage)
+    : storage_{std::move(storage)}, link_offsets_{link_offsets},
+      links_{links} {}
+
+void LinkGraph::set_link(int from, int to, int cost) {
+  auto [it, is_new]{changed_links_.try_emplace(from)};
+  std::vector<Link> &links{it->second};
+  if (is_new) {
+    links.assign(links_.begin() + link_offsets_[from],
+                 links_.begin() + link_offsets_[from + 1]);
+  }
+  std::erase_if(links, [to](const Link &link) { return link.to == to; });
+  if (cost >= 0) {
+    links.push_back({to, cost});
+  }
+}
+
+LinkGraph LinkGraph::reversed() const {
+  // Counted before they are stored, so that they go in CSR form in one pass.
+  std::vector<uint64_t> link_offsets(num_nodes() + 1, 0);
+  for (int from = 0; from < num_nodes(); ++from) {
+    for (const auto &[to, cost] : links_of(from)) {
+      ++link_offsets[to + 1];
+    }
+  }
+  for (int node = 0; node < num_nodes(); ++node) {
+    link_offsets[node + 1] += link_offsets[node];
+  }
+  std::vector<Link> links(link_offsets.back());
+  std::vector<uint64_t> next(link_offsets.begin(), link_offsets.end() - 1);
+  for (int from = 0; from < num_nodes(); ++from) {
+    for (const auto &[to, cost] : links_of(from)) {
+      links[next[to]++] = {from, cost};
+    }
+  }
+  return LinkGraph{std::move(link_offsets), std::move(links)};
+}
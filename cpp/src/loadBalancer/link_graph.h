@@ -0,0 +1,62 @@
+#ifndef LINK_GRAPH_H
+#define LINK_GRAPH_H
+
+#include <cstdint>
+#include <memory>
+#include <span>
+#include <unordered_map>
+#include <vector>
+
+// A link to node to, of the given cost. Laid out as in geography snapshots,
+// so that the links of a snapshot are used where they are mapped.
+struct Link {
+  int32_t to, cost;
+};
+
+// The links of every node of a geography in CSR form: the links of all nodes
+// back to back, with the offset of each node's first link. The arrays are
+// either owned or a view of memory that storage keeps alive (the snapshot
+// they are mapped from), and are never written to: a node whose links change
+// gets a copy of its links of its own. Copies share the arrays.
+class LinkGraph {
+public:
+  LinkGraph() = default;
+
+  // Own link_offsets (one per node and one past the last) and links.
+  LinkGraph(std::vector<uint64_t> link_offsets, std::vector<Link> links);
+
+  // View link_offsets and links, which storage keeps alive.
+  LinkGraph(std::span<const uint64_t> link_offsets,
+            std::span<const Link> links, std::shared_ptr<const void> storage);
+
+  int num_nodes() const {
+    return link_offsets_.empty() ? 0
+                                 : static_cast<int>(link_offsets_.size() - 1);
+  }
+
+  std::span<const Link> links_of(int node) const {
+    if (!changed_links_.empty()) {
+      auto it{changed_links_.find(node)};
+      if (it != changed_links_.end()) {
+        return it->second;
+      }
+    }
+    return links_.subspan(link_offsets_[node],
+                          link_offsets_[node + 1] - link_offsets_[node]);
+  }
+
+  // Replace every link from -> to by one of the given cost, or remove them if
+  // cost is negative.
+  void set_link(int from, int to, int cost);
+
+  // The same links, from their destinations to their origins.
+  LinkGraph reversed() const;
+
+private:
+  std::shared_ptr<const void> storage_;
+  std::span<const uint64_t> link_offsets_;
+  std::span<const Link> links_;
+  std::unordered_map<int, std::vector<Link>> changed_links_;
+};
+
+#endif // !LINK_GRAPH_H
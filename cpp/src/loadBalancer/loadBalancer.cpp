@@ -1,15 +1,18 @@
-#include "djikstra.h"
+#include "consistent_hash.h"
 #include "loadBalancer_protocol.h"
+#include "load_table.h"
 #include "network_utils.h"
+#include "routing_state.h"
 #include "spdlog/spdlog.h"
 #include <arpa/inet.h>
-#include <climits>
+#include <chrono>
 #include <cstddef>
 #include <cstdio>
 #include <cstdlib>
 #include <cstring>
 #include <cxxopts.hpp>
 #include <netinet/in.h>
+#include <sys/epoll.h>
 #include <sys/socket.h>
 #include <unistd.h>
 
@@ -17,8 +20,9 @@ int main(int argc, char *argv[]) {
   increase_fd_limit();
 
   cxxopts::Options cxxopts{"loadBalancer",
-                           "A simple load balancer that implements round-robin "
-                           "& geographic load balancing."};
+                           "A simple load balancer that implements round-robin, "
+                           "geographic, load-aware & content-affinity load "
+                           "balancing."};
   cxxopts.add_options()("p,port", "Port of the load balancer",
                         cxxopts::value<int>())(
 
@@ -28,98 +32,156 @@ int main(int argc, char *argv[]) {
       "r,rr", "Run in round-robin mode",
       cxxopts::value<bool>()->default_value("false"))(
 
+      "l,load", "Run in load mode",
+      cxxopts::value<bool>()->default_value("false"))(
+
+      "c,chash", "Run in consistent hashing (content-affinity) mode",
+      cxxopts::value<bool>()->default_value("false"))(
+
+      "capacity",
+      "In geo mode, honour the capacities of SERVERs, assigning clients by "
+      "min-cost flow rather than to their closest server",
+      cxxopts::value<bool>()->default_value("false"))(
+
+      "a,admin-port",
+      "In geo mode, port to accept link changes on (disabled by default)",
+      cxxopts::value<int>()->default_value("0"))(
+
+      "write-snapshot",
+      "In geo mode, compile the --servers file into a binary snapshot at "
+      "this path, which loads in a fraction of the time, and exit",
+      cxxopts::value<std::string>()->default_value(""))(
+
       "s,servers", "Path to file containing server info",
       cxxopts::value<std::string>());
 
-  int loadBalancer_port;
-  bool is_geo, is_rr;
-  std::string server_info_path;
+  int loadBalancer_port, admin_port;
+  bool is_geo, is_rr, is_load, is_chash, is_capacity;
+  std::string server_info_path, snapshot_path;
   try {
     const auto cxxopts_argv{cxxopts.parse(argc, argv)};
     loadBalancer_port = cxxopts_argv["port"].as<int>();
     is_geo = cxxopts_argv["geo"].as<bool>();
     is_rr = cxxopts_argv["rr"].as<bool>();
+    is_load = cxxopts_argv["load"].as<bool>();
+    is_chash = cxxopts_argv["chash"].as<bool>();
+    is_capacity = cxxopts_argv["capacity"].as<bool>();
+    admin_port = cxxopts_argv["admin-port"].as<int>();
     server_info_path = cxxopts_argv["servers"].as<std::string>();
+    snapshot_path = cxxopts_argv["write-snapshot"].as<std::string>();
   } catch (const cxxopts::exceptions::parsing &e) {
     return EXIT_FAILURE;
   }
   if (1024 > loadBalancer_port || loadBalancer_port > 65535) {
     return EXIT_FAILURE;
-  } else if ((is_geo && is_rr) || (!is_geo && !is_rr)) {
+  } else if (is_geo + is_rr + is_load + is_chash != 1) {
+    return EXIT_FAILURE;
+  } else if (is_capacity && !is_geo) {
+    return EXIT_FAILURE;
+  } else if (admin_port != 0 &&
+             (!is_geo || 1024 > admin_port || admin_port > 65535 ||
+              admin_port == loadBalancer_port)) {
+    return EXIT_FAILURE;
+  } else if (!snapshot_path.empty() && !is_geo) {
     return EXIT_FAILURE;
   }
 
-  if (is_rr) {
-    FILE *server_info_file;
-    if ((server_info_file = fopen(server_info_path.c_str(), "r")) == NULL) {
-      return EXIT_FAILURE;
-    }
-
-    int num_servers;
-    if (fscanf(server_info_file, "%*s%d", &num_servers) != 1) {
-      return EXIT_FAILURE;
-    }
-    char ip_str[16];
-    in_addr ip_addr;
-    in_addr_t server_ips[num_servers];
-    unsigned short server_ports[num_servers];
-    for (int i = 0; i < num_servers; ++i) {
-      if (fscanf(server_info_file, "%s%hu", ip_str, &server_ports[i]) != 2) {
-        return EXIT_FAILURE;
-      }
-      if (inet_pton(AF_INET, ip_str, &ip_addr) != 1) {
-        return EXIT_FAILURE;
-      }
-      server_ips[i] = ip_addr.s_addr;
-    }
-
-    if (fclose(server_info_file) == EOF) {
-      return EXIT_FAILURE;
-    }
-
-    // (1) Create socket
-    int loadBalancer_fd;
-    if ((loadBalancer_fd = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP)) == -1) {
+  RoutingSource routing_source{server_info_path, {is_geo, is_capacity}};
+  std::shared_ptr<const RoutingState> state{routing_source.reload()};
+  if (state == nullptr) {
+    return EXIT_FAILURE;
+  }
+  if (!snapshot_path.empty()) {
+    if (!routing_source.write_snapshot(snapshot_path)) {
       return EXIT_FAILURE;
     }
-
-    // (2) Set the "reuse port" socket option
-    const int enable{1};
-    if (setsockopt(loadBalancer_fd, SOL_SOCKET, SO_REUSEADDR, &enable,
-                   sizeof(enable)) == -1) {
+    spdlog::info("Snapshot of {} written to {}", server_info_path,
+                 snapshot_path);
+    return EXIT_SUCCESS;
+  }
+  RoutingTable routing_table{state};
+  LoadTable load_table{state->servers};
+
+  int loadBalancer_fd{get_inbound_socket(loadBalancer_port)};
+  int admin_fd{admin_port != 0 ? get_inbound_socket(admin_port) : -1};
+  // Rewriting the --servers file, sending SIGHUP or changing links through the
+  // admin port rebuilds the routing state.
+  std::thread routing_state_watcher{start_routing_state_watcher(
+      std::move(routing_source), admin_fd, routing_table)};
+  routing_state_watcher.detach();
+  // In load and chash mode, LoadReports arrive as UDP datagrams on the same
+  // port.
+  bool is_load_reported{is_load || is_chash};
+  int load_report_fd{
+      is_load_reported ? get_inbound_udp_socket(loadBalancer_port) : -1};
+
+  int epoll_fd{epoll_create1(EPOLL_CLOEXEC)};
+  if (epoll_fd == -1) {
+    return EXIT_FAILURE;
+  }
+  epoll_event event, events[2];
+  event.events = EPOLLIN;
+  event.data.fd = loadBalancer_fd;
+  if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, loadBalancer_fd, &event) == -1) {
+    return EXIT_FAILURE;
+  }
+  if (is_load_reported) {
+    event.data.fd = load_report_fd;
+    if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, load_report_fd, &event) == -1) {
       return EXIT_FAILURE;
     }
-
-    // (3) Create a sockaddr_in struct for the proper port and bind() to it.
-    struct sockaddr_in addr;
-    std::memset(&addr, 0, sizeof(addr));
-
-    // (3.1): specify socket family.
-    // This is an IPv4 socket.
-    addr.sin_family = AF_INET;
-
-    // (3.2): specify client address whitelist (hostname).
-    // The socket will be a server listening to everybody.
-    addr.sin_addr.s_addr = INADDR_ANY;
-
-    // (3.3): Set the port value.
-    // If port is 0, the OS will choose the port for us.
-    // Use htons to convert from local byte order to network byte order.
-    addr.sin_port = htons(static_cast<uint16_t>(loadBalancer_port));
-
-    // (3.4) Bind to the port.
-    if (bind(loadBalancer_fd, (sockaddr *)&addr, sizeof(addr)) == -1) {
+  }
+  spdlog::info("Load balancer started on port {}", loadBalancer_port);
+
+  int curr_server{0};
+  char ip_str[16], content_key[MAX_CONTENT_KEY_LEN];
+  std::vector<uint64_t> load_of_server(state->servers.size());
+  in_addr ip_addr;
+  while (true) {
+    int no_of_events{epoll_wait(epoll_fd, events, 2, -1)};
+    if (no_of_events == -1) {
       return EXIT_FAILURE;
     }
-
-    // (4) Begin listening for clients.
-    if (listen(loadBalancer_fd, MAX_NO_OF_PORTS) == -1) {
-      return EXIT_FAILURE;
+    if (std::shared_ptr<const RoutingState> curr_state{
+            routing_table.current()};
+        curr_state != state) {
+      // The server list changed: start over with an empty load table, which
+      // refills with the next round of LoadReports.
+      state = std::move(curr_state);
+      load_table = LoadTable{state->servers};
+      load_of_server.assign(state->servers.size(), 0);
+      curr_server = 0;
     }
-    spdlog::info("Load balancer started on port {}", loadBalancer_port);
+    const std::vector<Videoserver> &servers{state->servers};
+    for (int i{0}; i < no_of_events; ++i) {
+      if (events[i].data.fd == load_report_fd) {
+        // Drain every pending report.
+        LoadReport report;
+        sockaddr_in reporter_addr;
+        socklen_t reporter_addr_len{sizeof(reporter_addr)};
+        long curr;
+        while ((curr = recvfrom(load_report_fd, &report, sizeof(report),
+                                MSG_DONTWAIT, (sockaddr *)&reporter_addr,
+                                &reporter_addr_len)) != -1) {
+          if (curr != sizeof(report)) {
+            continue;
+          }
+          uint64_t reporter{
+              (static_cast<uint64_t>(reporter_addr.sin_addr.s_addr) << 16) |
+              reporter_addr.sin_port};
+          int server{load_table.report(reporter, report,
+                                       std::chrono::steady_clock::now())};
+          if (server == -1) {
+            spdlog::warn("Load report for unknown videoserver");
+            continue;
+          }
+          spdlog::debug("Load report for {}: {} sessions, {} Kbps",
+                        servers[server].name, ntohl(report.active_sessions),
+                        ntohl(report.egress_kbps));
+        }
+        continue;
+      }
 
-    int curr_server{0};
-    while (true) {
       // (5) Accept clients.
       struct sockaddr_in client_addr;
       socklen_t client_addr_len{sizeof(client_addr)};
@@ -132,172 +194,32 @@ int main(int argc, char *argv[]) {
       LoadBalancerRequest client_request;
       size_t no_of_bytes_read{};
       while (no_of_bytes_read < sizeof(client_request)) {
-        long curr{recv(client_sockfd, &client_request + no_of_bytes_read,
+        long curr{recv(client_sockfd,
+                       (char *)&client_request + no_of_bytes_read,
                        sizeof(client_request) - no_of_bytes_read, 0)};
         if (curr <= 0) {
           return EXIT_FAILURE;
         }
         no_of_bytes_read += curr;
       }
-      ip_addr.s_addr = client_request.client_addr;
-      if (inet_ntop(AF_INET, &ip_addr, ip_str, sizeof(ip_str)) == NULL) {
-        return EXIT_FAILURE;
-      }
-      spdlog::info("Received request for client {} with request ID {}", ip_str,
-                   ntohs(client_request.request_id));
-
-      LoadBalancerResponse loadBalancer_response;
-      loadBalancer_response.videoserver_addr = server_ips[curr_server];
-      loadBalancer_response.videoserver_port = htons(server_ports[curr_server]);
-      loadBalancer_response.request_id = client_request.request_id;
-      size_t no_of_bytes_sent{};
-      while (no_of_bytes_sent < sizeof(loadBalancer_response)) {
-        long curr{send(client_sockfd, &loadBalancer_response + no_of_bytes_sent,
-                       sizeof(loadBalancer_response) - no_of_bytes_sent, 0)};
-        if (curr <= 0) {
+      size_t content_key_len{ntohs(client_request.content_key_len)};
+      if (content_key_len > MAX_CONTENT_KEY_LEN) {
+        spdlog::warn("Content key of request ID {} too long",
+                     ntohs(client_request.request_id));
+        if (close(client_sockfd) == -1) {
           return EXIT_FAILURE;
         }
-        no_of_bytes_sent += curr;
-      }
-      ip_addr.s_addr = loadBalancer_response.videoserver_addr;
-      if (inet_ntop(AF_INET, &ip_addr, ip_str, sizeof(ip_str)) == NULL) {
-        return EXIT_FAILURE;
-      }
-      spdlog::info("Responded to request ID {} with server {}:{}",
-                   ntohs(loadBalancer_response.request_id), ip_str,
-                   server_ports[curr_server]);
-
-      if (close(client_sockfd) == -1) {
-        return EXIT_FAILURE;
-      }
-      curr_server = (curr_server + 1) % num_servers;
-    }
-  } else {
-    FILE *server_info_file;
-    if ((server_info_file = fopen(server_info_path.c_str(), "r")) == NULL) {
-      return EXIT_FAILURE;
-    }
-
-    int num_nodes, num_clients{}, id_of_first_server;
-    std::vector<std::string> client_ips{}, server_ips{};
-    char identity_str[7], ip_str[16];
-    bool is_first_server{true};
-    if (fscanf(server_info_file, "%*s%d", &num_nodes) != 1) {
-      return EXIT_FAILURE;
-    }
-    for (int i = 0; i < num_nodes; ++i) {
-      if (fscanf(server_info_file, "%s%s", identity_str, ip_str) != 2) {
-        return EXIT_FAILURE;
-      }
-      if (strcmp(identity_str, "CLIENT") == 0) {
-        ++num_clients;
-        client_ips.push_back(ip_str);
-      } else if (strcmp(identity_str, "SERVER") == 0) {
-        if (is_first_server) {
-          id_of_first_server = i;
-          is_first_server = false;
-        }
-        server_ips.push_back(ip_str);
-      }
-    }
-
-    std::vector<std::vector<std::pair<int, int>>> adj_list{};
-    int num_links, from, to, cost;
-    for (int i = 0; i < num_nodes; i++) {
-      adj_list.push_back({});
-    }
-    if (fscanf(server_info_file, "%*s%d", &num_links) != 1) {
-      return EXIT_FAILURE;
-    }
-    for (int i = 0; i < num_links; ++i) {
-      if (fscanf(server_info_file, "%d%d%d", &from, &to, &cost) != 3) {
-        return EXIT_FAILURE;
-      }
-      adj_list[from].push_back({to, cost});
-    }
-
-    if (fclose(server_info_file) == EOF) {
-      return EXIT_FAILURE;
-    }
-
-    std::unordered_map<std::string, std::string> closest_server_of{};
-    for (int i = 0; i < num_clients; ++i) {
-      std::vector<int> curr{dijkstra(adj_list, i, num_nodes)};
-      int min{id_of_first_server};
-      for (int j = id_of_first_server; j < num_nodes; j++) {
-        if (curr[j] < curr[min]) {
-          min = j;
-        }
-      }
-      if (curr[min] == INT_MAX) {
         continue;
       }
-      closest_server_of[client_ips[i]] = server_ips[min - id_of_first_server];
-    }
-
-    // (1) Create socket
-    int loadBalancer_fd;
-    if ((loadBalancer_fd = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP)) == -1) {
-      return EXIT_FAILURE;
-    }
-
-    // (2) Set the "reuse port" socket option
-    const int enable{1};
-    if (setsockopt(loadBalancer_fd, SOL_SOCKET, SO_REUSEADDR, &enable,
-                   sizeof(enable)) == -1) {
-      return EXIT_FAILURE;
-    }
-
-    // (3) Create a sockaddr_in struct for the proper port and bind() to it.
-    struct sockaddr_in addr;
-    std::memset(&addr, 0, sizeof(addr));
-
-    // (3.1): specify socket family.
-    // This is an IPv4 socket.
-    addr.sin_family = AF_INET;
-
-    // (3.2): specify client address whitelist (hostname).
-    // The socket will be a server listening to everybody.
-    addr.sin_addr.s_addr = INADDR_ANY;
-
-    // (3.3): Set the port value.
-    // If port is 0, the OS will choose the port for us.
-    // Use htons to convert from local byte order to network byte order.
-    addr.sin_port = htons(static_cast<uint16_t>(loadBalancer_port));
-
-    // (3.4) Bind to the port.
-    if (bind(loadBalancer_fd, (sockaddr *)&addr, sizeof(addr)) == -1) {
-      return EXIT_FAILURE;
-    }
-
-    // (4) Begin listening for clients.
-    if (listen(loadBalancer_fd, MAX_NO_OF_PORTS) == -1) {
-      return EXIT_FAILURE;
-    }
-    spdlog::info("Load balancer started on port {}", loadBalancer_port);
-
-    while (true) {
-      // (5) Accept clients.
-      struct sockaddr_in client_addr;
-      socklen_t client_addr_len{sizeof(client_addr)};
-      int client_sockfd =
-          accept(loadBalancer_fd, (sockaddr *)&client_addr, &client_addr_len);
-      if (client_sockfd == -1) {
-        return EXIT_FAILURE;
-      }
-
-      LoadBalancerRequest client_request;
-      size_t no_of_bytes_read{};
-      while (no_of_bytes_read < sizeof(client_request)) {
-        long curr{recv(client_sockfd, &client_request + no_of_bytes_read,
-                       sizeof(client_request) - no_of_bytes_read, 0)};
+      no_of_bytes_read = 0;
+      while (no_of_bytes_read < content_key_len) {
+        long curr{recv(client_sockfd, content_key + no_of_bytes_read,
+                       content_key_len - no_of_bytes_read, 0)};
         if (curr <= 0) {
           return EXIT_FAILURE;
         }
         no_of_bytes_read += curr;
       }
-      char ip_str[16];
-      in_addr ip_addr;
       ip_addr.s_addr = client_request.client_addr;
       if (inet_ntop(AF_INET, &ip_addr, ip_str, sizeof(ip_str)) == NULL) {
         return EXIT_FAILURE;
@@ -305,38 +227,56 @@ int main(int argc, char *argv[]) {
       spdlog::info("Received request for client {} with request ID {}", ip_str,
                    ntohs(client_request.request_id));
 
-      LoadBalancerResponse loadBalancer_response;
-      if (!closest_server_of.contains(ip_str)) {
+      int server;
+      if (is_rr) {
+        server = curr_server;
+        curr_server = (curr_server + 1) % static_cast<int>(servers.size());
+      } else if (is_geo) {
+        server = state->closest_server(client_request.client_addr);
+      } else if (is_load) {
+        server = load_table.choose(std::chrono::steady_clock::now());
+      } else {
+        // Requests without a content key are pinned by client address.
+        uint64_t key_hash{
+            content_key_len > 0
+                ? hash_content_key(content_key, content_key_len)
+                : hash_content_key((const char *)&client_request.client_addr,
+                                   sizeof(client_request.client_addr))};
+        auto now{std::chrono::steady_clock::now()};
+        for (size_t j = 0; j < servers.size(); ++j) {
+          load_of_server[j] = load_table.sessions_of(static_cast<int>(j), now);
+        }
+        server = state->consistent_hash_ring.choose(key_hash, load_of_server);
+        if (server != -1) {
+          load_table.assign(server, now);
+        }
+        spdlog::debug("Content key {} hashed to server {}",
+                      std::string_view{content_key, content_key_len}, server);
+      }
+      if (server == -1) {
         spdlog::info("Failed to fulfill request ID {}",
                      ntohs(client_request.request_id));
         if (close(client_sockfd) == -1) {
           return EXIT_FAILURE;
         }
         continue;
-      } else {
-        std::string closest_server{closest_server_of[ip_str]};
-        if (inet_pton(AF_INET, closest_server.c_str(), &ip_addr) != 1) {
-          return EXIT_FAILURE;
-        }
-        loadBalancer_response.videoserver_addr = ip_addr.s_addr;
       }
-      loadBalancer_response.videoserver_port = htons(8000);
+
+      LoadBalancerResponse loadBalancer_response{servers[server].response};
       loadBalancer_response.request_id = client_request.request_id;
       size_t no_of_bytes_sent{};
       while (no_of_bytes_sent < sizeof(loadBalancer_response)) {
-        long curr{send(client_sockfd, &loadBalancer_response + no_of_bytes_sent,
+        long curr{send(client_sockfd,
+                       (char *)&loadBalancer_response + no_of_bytes_sent,
                        sizeof(loadBalancer_response) - no_of_bytes_sent, 0)};
         if (curr <= 0) {
           return EXIT_FAILURE;
         }
         no_of_bytes_sent += curr;
       }
-      ip_addr.s_addr = loadBalancer_response.videoserver_addr;
-      if (inet_ntop(AF_INET, &ip_addr, ip_str, sizeof(ip_str)) == NULL) {
-        return EXIT_FAILURE;
-      }
-      spdlog::info("Responded to request ID {} with server {}:{}",
-                   ntohs(loadBalancer_response.request_id), ip_str, 8000);
+      spdlog::info("Responded to request ID {} with server {}",
+                   ntohs(loadBalancer_response.request_id),
+                   servers[server].name);
 
       if (close(client_sockfd) == -1) {
         return EXIT_FAILURE;
@@ -0,0 +1,112 @@
+#include "load_table.h"
+
+#include "Random.h"
+#include <algorithm>
+#include <arpa/inet.h>
+
+static uint64_t endpoint_key(in_addr_t addr, uint16_t port) {
+  return (static_cast<uint64_t>(addr) << 16) | port;
+}
+
+LoadTable::LoadTable(const std::vector<Videoserver> &servers)
+    : load_of_server_(servers.size()) {
+  for (size_t i = 0; i < servers.size(); ++i) {
+    server_of_endpoint_[endpoint_key(servers[i].response.videoserver_addr,
+                                     servers[i].response.videoserver_port)] =
+        static_cast<int>(i);
+  }
+}
+
+int LoadTable::report(uint64_t reporter, const LoadReport &report,
+                      std::chrono::steady_clock::time_point now) {
+  auto it{server_of_endpoint_.find(
+      endpoint_key(report.videoserver_addr, report.videoserver_port))};
+  if (it == server_of_endpoint_.end()) {
+    return -1;
+  }
+
+  Load &load{load_of_server_[it->second]};
+  std::chrono::milliseconds report_interval{ntohs(report.report_interval_ms)};
+  if (report_interval.count() == 0) {
+    report_interval = std::chrono::milliseconds{DEFAULT_REPORT_INTERVAL_MS};
+  }
+  load.report_of_reporter[reporter] = {
+      ntohl(report.active_sessions), ntohl(report.egress_kbps), now,
+      now + STALE_AFTER_INTERVALS * report_interval};
+  // The reports now include whatever we handed out before the oldest of
+  // the latest reports of the server's reporters.
+  expire(it->second, now);
+  auto included_until{now};
+  for (const auto &[other_reporter, other_report] : load.report_of_reporter) {
+    included_until = std::min(included_until, other_report.reported_at);
+  }
+  while (!load.assigned_at.empty() &&
+         load.assigned_at.front() < included_until) {
+    load.assigned_at.pop_front();
+  }
+  return it->second;
+}
+
+int LoadTable::choose(std::chrono::steady_clock::time_point now) {
+  if (load_of_server_.empty()) {
+    return -1;
+  }
+
+  int chosen{0};
+  if (load_of_server_.size() > 1) {
+    // Power of two choices: sample two distinct servers, keep the lighter one.
+    size_t a{Random::get<size_t>(0, load_of_server_.size() - 1)};
+    size_t b{Random::get<size_t>(0, load_of_server_.size() - 2)};
+    if (b >= a) {
+      ++b;
+    }
+    int first{static_cast<int>(a)}, second{static_cast<int>(b)};
+    uint64_t sessions_first{sessions_of(first, now)},
+        sessions_second{sessions_of(second, now)};
+    if (sessions_first != sessions_second) {
+      chosen = sessions_first < sessions_second ? first : second;
+    } else {
+      chosen = egress_kbps_of(first) <= egress_kbps_of(second) ? first : second;
+    }
+  }
+
+  assign(chosen, now);
+  return chosen;
+}
+
+void LoadTable::assign(int server, std::chrono::steady_clock::time_point now) {
+  load_of_server_[server].assigned_at.push_back(now);
+}
+
+uint64_t LoadTable::sessions_of(int server,
+                                std::chrono::steady_clock::time_point now) {
+  expire(server, now);
+  const Load &load{load_of_server_[server]};
+  uint64_t sessions{load.assigned_at.size()};
+  for (const auto &[reporter, report] : load.report_of_reporter) {
+    sessions += report.active_sessions;
+  }
+  return sessions;
+}
+
+void LoadTable::expire(int server, std::chrono::steady_clock::time_point now) {
+  Load &load{load_of_server_[server]};
+  std::erase_if(load.report_of_reporter, [now](const auto &entry) {
+    return entry.second.stale_at < now;
+  });
+  while (!load.assigned_at.empty() &&
+         load.assigned_at.front() +
+                 std::chrono::milliseconds{ASSIGNMENT_TTL_MS} <
+             now) {
+    load.assigned_at.pop_front();
+  }
+}
+
+uint64_t LoadTable::egress_kbps_of(int server) const {
+  uint64_t egress_kbps{};
+  for (const auto &[reporter, report] : load_of_server_[server]
+                                            .report_of_reporter) {
+    egress_kbps += report.egress_kbps;
+  }
+  return egress_kbps;
+}
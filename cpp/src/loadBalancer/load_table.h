@@ -0,0 +1,69 @@
+#ifndef LOAD_TABLE_H
+#define LOAD_TABLE_H
+
+#include "loadBalancer_protocol.h"
+#include "server_info.h"
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <unordered_map>
+#include <vector>
+
+// The load of every videoserver as last reported through LoadReports, used by
+// load and chash mode to pick videoservers.
+
+// A report is considered fresh for STALE_AFTER_INTERVALS of its reporter's
+// report interval; after that the reporter is presumed gone and its report no
+// longer counts.
+#define STALE_AFTER_INTERVALS 3
+
+// Assumed report interval for reporters that do not state one.
+#define DEFAULT_REPORT_INTERVAL_MS 1000
+
+// Sessions handed out by the load balancer are counted against a videoserver
+// until every reporter on it has reported since (as any one of them may be
+// the one to see the session, only then do the reports include it), or for
+// this long if no report arrives, e.g. because nobody reports on that
+// videoserver.
+#define ASSIGNMENT_TTL_MS (STALE_AFTER_INTERVALS * DEFAULT_REPORT_INTERVAL_MS)
+
+class LoadTable {
+public:
+  explicit LoadTable(const std::vector<Videoserver> &servers);
+
+  // Record a report received from reporter (e.g. its packed UDP address).
+  // Returns the index of the videoserver it is about, or -1 if the videoserver
+  // is unknown.
+  int report(uint64_t reporter, const LoadReport &report,
+             std::chrono::steady_clock::time_point now);
+
+  // Pick a videoserver by power-of-two-choices on the number of sessions
+  // (egress breaks ties) and count the new session against it.
+  int choose(std::chrono::steady_clock::time_point now);
+
+  // Count a new session against server until its next report.
+  void assign(int server, std::chrono::steady_clock::time_point now);
+
+  // Sessions of server according to its fresh reports, plus the sessions the
+  // load balancer assigned to it that those reports do not include yet.
+  uint64_t sessions_of(int server, std::chrono::steady_clock::time_point now);
+
+private:
+  struct Report {
+    uint32_t active_sessions;
+    uint32_t egress_kbps;
+    std::chrono::steady_clock::time_point reported_at, stale_at;
+  };
+  struct Load {
+    std::unordered_map<uint64_t, Report> report_of_reporter;
+    std::deque<std::chrono::steady_clock::time_point> assigned_at;
+  };
+
+  void expire(int server, std::chrono::steady_clock::time_point now);
+  uint64_t egress_kbps_of(int server) const;
+
+  std::unordered_map<uint64_t, int> server_of_endpoint_;
+  std::vector<Load> load_of_server_;
+};
+
+#endif // !LOAD_TABLE_H
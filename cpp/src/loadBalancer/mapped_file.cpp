@@ -0,0 +1,40 @@
+#include "mapped_file.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+MappedFile::~MappedFile() {
+  if (size_ != 0) {
+    munmap(const_cast<char *>(data_), size_);
+  }
+}
+
+bool MappedFile::open(const std::string &path, bool is_sequential) {
+  int fd{::open(path.c_str(), O_RDONLY | O_CLOEXEC)};
+  if (fd == -1) {
+    return false;
+  }
+  struct stat file_stat;
+  if (fstat(fd, &file_stat) == -1) {
+    close(fd);
+    return false;
+  }
+  if (file_stat.st_size == 0) {
+    // mmap() refuses empty mappings; an empty file is simply empty.
+    close(fd);
+    return true;
+  }
+  void *data{mmap(nullptr, file_stat.st_size, PROT_READ, MAP_PRIVATE, fd, 0)};
+  close(fd);
+  if (data == MAP_FAILED) {
+    return false;
+  }
+  if (is_sequential) {
+    madvise(data, file_stat.st_size, MADV_SEQUENTIAL);
+  }
+  data_ = static_cast<const char *>(data);
+  size_ = file_stat.st_size;
+  return true;
+}
@@ -0,0 +1,29 @@
+#ifndef MAPPED_FILE_H
+#define MAPPED_FILE_H
+
+#include <cstddef>
+#include <string>
+
+// A file mapped read-only into memory, so that it is parsed where the page
+// cache holds it instead of being copied through stdio first.
+class MappedFile {
+public:
+  MappedFile() = default;
+  MappedFile(const MappedFile &) = delete;
+  MappedFile &operator=(const MappedFile &) = delete;
+  ~MappedFile();
+
+  // Map the file at path for a single sequential pass, or if !is_sequential
+  // for lookups for as long as it stays mapped. Returns false if it cannot be
+  // opened or mapped.
+  bool open(const std::string &path, bool is_sequential = true);
+
+  const char *data() const { return data_; }
+  size_t size() const { return size_; }
+
+private:
+  const char *data_{};
+  size_t size_{};
+};
+
+#endif // !MAPPED_FILE_H
@@ -0,0 +1,79 @@
+#include "min_cost_flow.h"
+
+#include <algorithm>
+#include <climits>
+#include <functional>
+#include <queue>
+
+MinCostFlow::MinCostFlow(int num_nodes) : edges_of_node_(num_nodes) {}
+
+size_t MinCostFlow::add_edge(int from, int to, long long capacity,
+                             long long cost) {
+  size_t id{edges_.size()};
+  edges_.push_back({to, capacity, cost});
+  edges_of_node_[from].push_back(id);
+  edges_.push_back({from, 0, -cost});
+  edges_of_node_[to].push_back(id + 1);
+  initial_capacity_.push_back(capacity);
+  initial_capacity_.push_back(0);
+  return id;
+}
+
+long long MinCostFlow::solve(int source, int sink) {
+  size_t num_nodes{edges_of_node_.size()};
+  std::vector<long long> potential(num_nodes, 0), dist(num_nodes);
+  std::vector<size_t> parent_edge(num_nodes);
+  long long total_flow{};
+
+  while (true) {
+    // Dijkstra on reduced costs, which are non-negative thanks to potentials.
+    std::fill(dist.begin(), dist.end(), LLONG_MAX);
+    dist[source] = 0;
+    std::priority_queue<std::pair<long long, int>,
+                        std::vector<std::pair<long long, int>>,
+                        std::greater<std::pair<long long, int>>>
+        pq;
+    pq.push({0, source});
+    while (!pq.empty()) {
+      auto [d, u] = pq.top();
+      pq.pop();
+      if (d > dist[u]) {
+        continue;
+      }
+      for (size_t id : edges_of_node_[u]) {
+        const Edge &edge{edges_[id]};
+        if (edge.capacity <= 0) {
+          continue;
+        }
+        long long reduced{edge.cost + potential[u] - potential[edge.to]};
+        if (dist[edge.to] > d + reduced) {
+          dist[edge.to] = d + reduced;
+          parent_edge[edge.to] = id;
+          pq.push({dist[edge.to], edge.to});
+        }
+      }
+    }
+    if (dist[sink] == LLONG_MAX) {
+      return total_flow;
+    }
+    for (size_t v = 0; v < num_nodes; ++v) {
+      if (dist[v] != LLONG_MAX) {
+        potential[v] += dist[v];
+      }
+    }
+
+    long long bottleneck{LLONG_MAX};
+    for (int v = sink; v != source; v = edges_[parent_edge[v] ^ 1].to) {
+      bottleneck = std::min(bottleneck, edges_[parent_edge[v]].capacity);
+    }
+    for (int v = sink; v != source; v = edges_[parent_edge[v] ^ 1].to) {
+      edges_[parent_edge[v]].capacity -= bottleneck;
+      edges_[parent_edge[v] ^ 1].capacity += bottleneck;
+    }
+    total_flow += bottleneck;
+  }
+}
+
+long long MinCostFlow::flow(size_t edge) const {
+  return initial_capacity_[edge] - edges_[edge].capacity;
+}
@@ -0,0 +1,36 @@
+#ifndef MIN_COST_FLOW_H
+#define MIN_COST_FLOW_H
+
+#include <cstddef>
+#include <vector>
+
+// Min-cost max-flow by successive shortest paths, with Johnson potentials so
+// that every augmenting path is found by Dijkstra. Each augmentation pushes the
+// path's full bottleneck capacity. Costs must be non-negative.
+class MinCostFlow {
+public:
+  explicit MinCostFlow(int num_nodes);
+
+  // Add a directed edge and return its id.
+  size_t add_edge(int from, int to, long long capacity, long long cost);
+
+  // Push as much flow as possible from source to sink at minimum cost.
+  // Returns the total flow.
+  long long solve(int source, int sink);
+
+  // The flow on the edge with the given id after solve().
+  long long flow(size_t edge) const;
+
+private:
+  struct Edge {
+    int to;
+    long long capacity, cost;
+  };
+
+  // Edges are stored in pairs: edge i ^ 1 is the residual of edge i.
+  std::vector<Edge> edges_;
+  std::vector<std::vector<size_t>> edges_of_node_;
+  std::vector<long long> initial_capacity_;
+};
+
+#endif // !MIN_COST_FLOW_H
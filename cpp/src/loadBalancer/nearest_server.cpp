@@ -0,0 +1,153 @@
+#include "nearest_server.h"
+
+#include <algorithm>
+#include <climits>
+#include <functional>
+
+#define UNREACHABLE LLONG_MAX
+
+NearestServerLabels::NearestServerLabels(const Geography &geography)
+    : out_links_(geography.links), in_links_(geography.links.reversed()),
+      server_index_of_node_(geography.num_nodes, -1),
+      dist_(geography.num_nodes, UNREACHABLE),
+      server_(geography.num_nodes, -1), next_hop_(geography.num_nodes, -1),
+      is_touched_(geography.num_nodes, false) {
+  index_servers(geography);
+  Heap heap{};
+  for (size_t i = 0; i < geography.server_nodes.size(); ++i) {
+    push(heap, geography.server_nodes[i], {0, static_cast<int>(i)}, -1);
+  }
+  propagate(heap);
+  for (const auto &[node, server] : touched_) {
+    is_touched_[node] = false;
+  }
+  touched_.clear();
+}
+
+NearestServerLabels::NearestServerLabels(const Geography &geography,
+                                         LinkGraph in_links,
+                                         std::vector<long long> dist,
+                                         std::vector<int> server,
+                                         std::vector<int> next_hop)
+    : out_links_(geography.links), in_links_(std::move(in_links)),
+      server_index_of_node_(geography.num_nodes, -1), dist_(std::move(dist)),
+      server_(std::move(server)), next_hop_(std::move(next_hop)),
+      is_touched_(geography.num_nodes, false) {
+  index_servers(geography);
+}
+
+void NearestServerLabels::index_servers(const Geography &geography) {
+  for (size_t i = 0; i < geography.server_nodes.size(); ++i) {
+    server_index_of_node_[geography.server_nodes[i]] = static_cast<int>(i);
+  }
+}
+
+std::vector<int> NearestServerLabels::set_link(int from, int to, int cost) {
+  out_links_.set_link(from, to, cost);
+  in_links_.set_link(to, from, cost);
+
+  Heap heap{};
+  if (next_hop_[from] == to) {
+    // The labels routed through the link may get worse: collect the subtree
+    // of nodes whose next hops lead through it...
+    std::vector<int> subtree{from};
+    std::vector<bool> is_in_subtree(dist_.size(), false);
+    is_in_subtree[from] = true;
+    for (size_t i = 0; i < subtree.size(); ++i) {
+      for (const auto &[prev, prev_cost] : in_links_.links_of(subtree[i])) {
+        if (!is_in_subtree[prev] && next_hop_[prev] == subtree[i]) {
+          is_in_subtree[prev] = true;
+          subtree.push_back(prev);
+        }
+      }
+    }
+    // ...forget their labels...
+    for (int node : subtree) {
+      if (!is_touched_[node]) {
+        is_touched_[node] = true;
+        touched_.push_back({node, server_[node]});
+      }
+      int server_index{server_index_of_node_[node]};
+      dist_[node] = server_index == -1 ? UNREACHABLE : 0;
+      server_[node] = server_index;
+      next_hop_[node] = -1;
+    }
+    // ...and relabel them from the nodes around them, which are unaffected.
+    for (int node : subtree) {
+      Label best{label_of(node)};
+      int best_next_hop{-1};
+      for (const auto &[next, next_cost] : out_links_.links_of(node)) {
+        if (!is_in_subtree[next] && dist_[next] != UNREACHABLE) {
+          Label label{dist_[next] + next_cost, server_[next]};
+          if (label < best) {
+            best = label;
+            best_next_hop = next;
+          }
+        }
+      }
+      if (best.first != UNREACHABLE) {
+        heap.push_back({best, node});
+        dist_[node] = best.first;
+        server_[node] = best.second;
+        next_hop_[node] = best_next_hop;
+      }
+    }
+    std::make_heap(heap.begin(), heap.end(), std::greater<>{});
+  } else if (cost >= 0 && dist_[to] != UNREACHABLE) {
+    // The link can only improve from and whatever is routed through it.
+    push(heap, from, {dist_[to] + cost, server_[to]}, to);
+  }
+  propagate(heap);
+
+  std::vector<int> changed{};
+  for (const auto &[node, server] : touched_) {
+    is_touched_[node] = false;
+    if (server_[node] != server) {
+      changed.push_back(node);
+    }
+  }
+  touched_.clear();
+  return changed;
+}
+
+void NearestServerLabels::push(Heap &heap, int node, Label label,
+                               int next_hop) {
+  if (!(label < label_of(node))) {
+    return;
+  }
+  if (!is_touched_[node]) {
+    is_touched_[node] = true;
+    touched_.push_back({node, server_[node]});
+  }
+  dist_[node] = label.first;
+  server_[node] = label.second;
+  next_hop_[node] = next_hop;
+  heap.push_back({label, node});
+  std::push_heap(heap.begin(), heap.end(), std::greater<>{});
+}
+
+void NearestServerLabels::propagate(Heap &heap) {
+  while (!heap.empty()) {
+    std::pop_heap(heap.begin(), heap.end(), std::greater<>{});
+    auto [label, node]{heap.back()};
+    heap.pop_back();
+    // Skip if a better label for node has already been found.
+    if (label != label_of(node)) {
+      continue;
+    }
+    for (const auto &[prev, cost] : in_links_.links_of(node)) {
+      push(heap, prev, {label.first + cost, label.second}, node);
+    }
+  }
+}
+
+PrefixTable build_closest_server_table(const Geography &geography,
+                                       const NearestServerLabels &labels) {
+  PrefixTable closest_server_table{};
+  for (size_t i = 0; i < geography.client_nodes.size(); ++i) {
+    closest_server_table.insert(geography.client_prefixes[i].first,
+                                geography.client_prefixes[i].second,
+                                labels.server_of(geography.client_nodes[i]));
+  }
+  return closest_server_table;
+}
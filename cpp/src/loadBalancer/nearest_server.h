@@ -0,0 +1,72 @@
+#ifndef NEAREST_SERVER_H
+#define NEAREST_SERVER_H
+
+#include "prefix_table.h"
+#include "server_info.h"
+#include <utility>
+#include <vector>
+
+// The closest server of every node of a geography, kept up to date as links
+// change.
+
+// Every node is labelled (distance to its closest server, index of that
+// server), compared lexicographically so that ties go to the earliest server
+// in the file. The labels are computed by a single Dijkstra from all servers
+// at once over the reversed links, and each node remembers the next hop its
+// label came through. A link that gets cheaper can only improve the labels
+// upstream of it, so those are relaxed from its origin; a link that gets
+// dearer or disappears can only worsen the nodes routed through it, so only
+// that subtree of next hops is reset and relabelled from its surroundings
+// (in the spirit of Ramalingam & Reps). Either way the rest of the network is
+// never visited.
+
+class NearestServerLabels {
+public:
+  explicit NearestServerLabels(const Geography &geography);
+
+  // Take the reversed links and the labels (distance, server and next hop of
+  // every node) from a snapshot of geography instead of computing them.
+  NearestServerLabels(const Geography &geography, LinkGraph in_links,
+                      std::vector<long long> dist, std::vector<int> server,
+                      std::vector<int> next_hop);
+
+  // Index of the closest server of node, or -1 if it cannot reach any.
+  int server_of(int node) const { return server_[node]; }
+
+  // The rest of the label of node, for snapshots: the distance to its closest
+  // server and the node its label came through (-1 for none).
+  long long dist_of(int node) const { return dist_[node]; }
+  int next_hop_of(int node) const { return next_hop_[node]; }
+  const LinkGraph &in_links() const { return in_links_; }
+
+  // Replace every link from -> to by one of the given cost, or remove them if
+  // cost is negative, and repair the labels. Returns the nodes whose closest
+  // server changed.
+  std::vector<int> set_link(int from, int to, int cost);
+
+private:
+  using Label = std::pair<long long, int>; // (distance, server)
+  using Heap = std::vector<std::pair<Label, int>>;
+
+  Label label_of(int node) const { return {dist_[node], server_[node]}; }
+  void index_servers(const Geography &geography);
+  void push(Heap &heap, int node, Label label, int next_hop);
+  // Dijkstra over the reversed links from the nodes in heap.
+  void propagate(Heap &heap);
+
+  LinkGraph out_links_, in_links_;
+  std::vector<int> server_index_of_node_; // -1 for non-servers.
+  std::vector<long long> dist_;
+  std::vector<int> server_, next_hop_;
+  // Nodes whose label changed during the current update, with their server
+  // from before it.
+  std::vector<std::pair<int, int>> touched_;
+  std::vector<bool> is_touched_;
+};
+
+// Map every client prefix to the index of its closest server (the earliest one
+// in the file on ties). Clients that cannot reach any server map to -1.
+PrefixTable build_closest_server_table(const Geography &geography,
+                                       const NearestServerLabels &labels);
+
+#endif // !NEAREST_SERVER_H
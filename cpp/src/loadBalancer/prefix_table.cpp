@@ -0,0 +1,169 @@
+#include "prefix_table.h"
+
+#include <arpa/inet.h>
+#include <cstdlib>
+#include <cstring>
+#include <utility>
+
+#define CHUNK_BIT (1u << 31)
+#define CHUNK_SIZE 256
+
+PrefixTable::PrefixTable() : levels_{std::make_shared<Levels>()} {
+  levels_->entries[0].assign(1 << 16, 0);
+  levels_->prefix_lens[0].assign(1 << 16, 0);
+  point_at_levels();
+}
+
+PrefixTable::PrefixTable(const Arrays &arrays,
+                         std::shared_ptr<const void> storage)
+    : arrays_{arrays}, storage_{std::move(storage)} {}
+
+bool PrefixTable::is_valid(const Arrays &arrays, int num_values) {
+  if (arrays.entries[0].size() != 1 << 16) {
+    return false;
+  }
+  for (int level = 0; level < 3; ++level) {
+    std::span<const uint32_t> entries{arrays.entries[level]};
+    if (entries.size() != arrays.prefix_lens[level].size() ||
+        entries.size() % CHUNK_SIZE != 0) {
+      return false;
+    }
+    for (size_t i = 0; i < entries.size(); ++i) {
+      if (arrays.prefix_lens[level][i] > 32) {
+        return false;
+      } else if (entries[i] & CHUNK_BIT) {
+        // Chunks only lead to the next level, so every lookup ends.
+        size_t chunk{entries[i] & ~CHUNK_BIT};
+        if (level == 2 ||
+            (chunk + 1) * CHUNK_SIZE > arrays.entries[level + 1].size()) {
+          return false;
+        }
+      } else if (entries[i] > static_cast<uint32_t>(num_values)) {
+        return false;
+      }
+    }
+  }
+  return true;
+}
+
+void PrefixTable::insert(in_addr_t prefix, int prefix_len, int value) {
+  uint32_t addr{ntohl(prefix)};
+  uint32_t entry{static_cast<uint32_t>(value) + 1};
+
+  own();
+  if (prefix_len <= 16) {
+    insert_range(0, addr >> 16, 1u << (16 - prefix_len), prefix_len, entry);
+  } else {
+    uint32_t chunk1{get_or_create_chunk(0, addr >> 16)};
+    size_t index1{(chunk1 << 8) | ((addr >> 8) & 0xff)};
+    if (prefix_len <= 24) {
+      insert_range(1, index1, 1u << (24 - prefix_len), prefix_len, entry);
+    } else {
+      uint32_t chunk2{get_or_create_chunk(1, index1)};
+      insert_range(2, (chunk2 << 8) | (addr & 0xff), 1u << (32 - prefix_len),
+                   prefix_len, entry);
+    }
+  }
+  point_at_levels();
+}
+
+int PrefixTable::lookup(in_addr_t addr) const {
+  uint32_t host{ntohl(addr)};
+  uint32_t entry{arrays_.entries[0][host >> 16]};
+  if (entry & CHUNK_BIT) {
+    entry = arrays_.entries[1][((entry & ~CHUNK_BIT) << 8) |
+                               ((host >> 8) & 0xff)];
+    if (entry & CHUNK_BIT) {
+      entry = arrays_.entries[2][((entry & ~CHUNK_BIT) << 8) | (host & 0xff)];
+    }
+  }
+  return static_cast<int>(entry) - 1;
+}
+
+void PrefixTable::own() {
+  if (levels_ != nullptr && levels_.use_count() == 1) {
+    return;
+  }
+  auto levels{std::make_shared<Levels>()};
+  for (int level = 0; level < 3; ++level) {
+    levels->entries[level].assign(arrays_.entries[level].begin(),
+                                  arrays_.entries[level].end());
+    levels->prefix_lens[level].assign(arrays_.prefix_lens[level].begin(),
+                                      arrays_.prefix_lens[level].end());
+  }
+  levels_ = std::move(levels);
+  storage_.reset();
+}
+
+void PrefixTable::point_at_levels() {
+  for (int level = 0; level < 3; ++level) {
+    arrays_.entries[level] = levels_->entries[level];
+    arrays_.prefix_lens[level] = levels_->prefix_lens[level];
+  }
+}
+
+void PrefixTable::insert_range(int level, size_t first, size_t count,
+                               int prefix_len, uint32_t entry) {
+  std::vector<uint32_t> &entries{levels_->entries[level]};
+  std::vector<uint8_t> &prefix_lens{levels_->prefix_lens[level]};
+  for (size_t i{first}; i < first + count; ++i) {
+    if (level < 2 && entries[i] & CHUNK_BIT) {
+      // A longer prefix already split this slot: push the new prefix down
+      // into every slot of the chunk it has not been overridden in.
+      insert_range(level + 1,
+                   static_cast<size_t>(entries[i] & ~CHUNK_BIT) << 8,
+                   CHUNK_SIZE, prefix_len, entry);
+    } else if (prefix_lens[i] <= prefix_len) {
+      entries[i] = entry;
+      prefix_lens[i] = static_cast<uint8_t>(prefix_len);
+    }
+  }
+}
+
+uint32_t PrefixTable::get_or_create_chunk(int level, size_t index) {
+  std::vector<uint32_t> &entries{levels_->entries[level]};
+  std::vector<uint8_t> &prefix_lens{levels_->prefix_lens[level]};
+  if (entries[index] & CHUNK_BIT) {
+    return entries[index] & ~CHUNK_BIT;
+  }
+
+  // The new chunk inherits the route (and its length) that covered the slot.
+  std::vector<uint32_t> &next{levels_->entries[level + 1]};
+  std::vector<uint8_t> &next_lens{levels_->prefix_lens[level + 1]};
+  uint32_t chunk{static_cast<uint32_t>(next.size() / CHUNK_SIZE)};
+  next.insert(next.end(), CHUNK_SIZE, entries[index]);
+  next_lens.insert(next_lens.end(), CHUNK_SIZE, prefix_lens[index]);
+  entries[index] = CHUNK_BIT | chunk;
+  return chunk;
+}
+
+bool parse_prefix(const char *str, in_addr_t &prefix, int &prefix_len) {
+  char addr_str[INET_ADDRSTRLEN];
+  const char *slash{strchr(str, '/')};
+  size_t addr_len{slash == nullptr ? strlen(str)
+                                   : static_cast<size_t>(slash - str)};
+  if (addr_len >= sizeof(addr_str)) {
+    return false;
+  }
+  memcpy(addr_str, str, addr_len);
+  addr_str[addr_len] = '\0';
+
+  in_addr addr;
+  if (inet_pton(AF_INET, addr_str, &addr) != 1) {
+    return false;
+  }
+
+  prefix_len = 32;
+  if (slash != nullptr) {
+    char *end;
+    long len{strtol(slash + 1, &end, 10)};
+    if (end == slash + 1 || *end != '\0' || len < 0 || len > 32) {
+      return false;
+    }
+    prefix_len = static_cast<int>(len);
+  }
+
+  uint32_t mask{prefix_len == 0 ? 0 : ~0u << (32 - prefix_len)};
+  prefix = htonl(ntohl(addr.s_addr) & mask);
+  return true;
+}
@@ -0,0 +1,76 @@
+#ifndef PREFIX_TABLE_H
+#define PREFIX_TABLE_H
+
+#include <cstdint>
+#include <memory>
+#include <netinet/in.h>
+#include <span>
+#include <vector>
+
+// A longest-prefix-match table from IPv4 prefixes to small integer values
+// (e.g. the index of the videoserver a client prefix is assigned to).
+
+// The table is a fixed-stride 16-8-8 multibit trie in the spirit of DIR-24-8:
+// the top 16 bits of an address index a flat array, and only the /17-/32
+// prefixes that need it spill into 256-entry chunks for the next 8 bits. A
+// lookup is therefore at most three dependent array reads and never touches
+// the build-time bookkeeping (prefix lengths), which lives in separate arrays.
+//
+// The arrays are copied on write: copies of a table share them, as does a
+// table viewing those of a snapshot, until the first insert into it.
+
+class PrefixTable {
+public:
+  PrefixTable();
+
+  // The arrays of a table, for snapshots: the entries of each level and the
+  // length of the prefix each entry comes from.
+  struct Arrays {
+    std::span<const uint32_t> entries[3];
+    std::span<const uint8_t> prefix_lens[3];
+  };
+
+  // View arrays (those of another table), which storage keeps alive, e.g.
+  // the snapshot they are mapped from.
+  PrefixTable(const Arrays &arrays, std::shared_ptr<const void> storage);
+
+  // Whether arrays make up a table whose values are all below num_values.
+  static bool is_valid(const Arrays &arrays, int num_values);
+
+  const Arrays &arrays() const { return arrays_; }
+
+  // Insert prefix/prefix_len (prefix in network byte order) mapping to value.
+  // Longer prefixes win regardless of insertion order; for equal prefixes the
+  // last insertion wins.
+  void insert(in_addr_t prefix, int prefix_len, int value);
+
+  // Return the value of the longest prefix matching addr (network byte order),
+  // or -1 if no prefix matches.
+  int lookup(in_addr_t addr) const;
+
+private:
+  struct Levels {
+    std::vector<uint32_t> entries[3];
+    std::vector<uint8_t> prefix_lens[3];
+  };
+
+  // Make levels_ a copy of the arrays of this table alone.
+  void own();
+  void point_at_levels();
+  void insert_range(int level, size_t first, size_t count, int prefix_len,
+                    uint32_t entry);
+  uint32_t get_or_create_chunk(int level, size_t index);
+
+  // Entries hold (value + 1), 0 for "no route", or a chunk index of the next
+  // level tagged with CHUNK_BIT. They are read from arrays_, which points
+  // into levels_ or, for a table viewing a snapshot, into storage_.
+  Arrays arrays_;
+  std::shared_ptr<Levels> levels_;
+  std::shared_ptr<const void> storage_;
+};
+
+// Parse "a.b.c.d" or "a.b.c.d/len" into a network-order prefix with its host
+// bits cleared. Returns false on malformed input.
+bool parse_prefix(const char *str, in_addr_t &prefix, int &prefix_len);
+
+#endif // !PREFIX_TABLE_H
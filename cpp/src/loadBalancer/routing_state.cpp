@@ -0,0 +1,306 @@
+#include "routing_state.h"
+
+#include "geography_snapshot.h"
+#include "spdlog/spdlog.h"
+#include <cerrno>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <poll.h>
+#include <sys/inotify.h>
+#include <sys/signalfd.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+// Admin connections sending longer lines than this are dropped.
+#define MAX_ADMIN_LINE_LEN 256
+
+int RoutingState::closest_server(in_addr_t addr) const {
+  int value{closest_server_table.lookup(addr)};
+  return value == -1 || server_splits.empty()
+             ? value
+             : choose_server(server_splits[value]);
+}
+
+RoutingSource::RoutingSource(std::string path, RoutingOptions options)
+    : path_{std::move(path)}, options_{options} {}
+
+std::shared_ptr<const RoutingState> RoutingSource::reload() {
+  std::vector<Videoserver> servers{};
+  Geography geography{};
+  PrefixTable closest_server_table{};
+  std::vector<ServerSplit> server_splits{};
+  std::optional<NearestServerLabels> labels{};
+  std::optional<PrefixTable> snapshot_table{};
+  if (options_.is_geo) {
+    // A snapshot comes with its labels and table, so nothing is left to build.
+    if (is_geography_snapshot(path_)
+            ? !read_geography_snapshot(path_, geography, servers, labels,
+                                       snapshot_table)
+            : !read_geography(path_, geography, servers)) {
+      return nullptr;
+    }
+    if (options_.is_capacity) {
+      labels.reset();
+      closest_server_table =
+          build_capacitated_server_table(geography, server_splits);
+    } else if (snapshot_table) {
+      closest_server_table = std::move(*snapshot_table);
+    } else {
+      labels.emplace(geography);
+      closest_server_table = build_closest_server_table(geography, *labels);
+    }
+  } else if (!read_server_list(path_, servers)) {
+    return nullptr;
+  }
+
+  servers_ = std::move(servers);
+  geography_ = std::move(geography);
+  labels_ = std::move(labels);
+  client_index_of_node_.assign(geography_.num_nodes, -1);
+  for (size_t i = 0; i < geography_.client_nodes.size(); ++i) {
+    client_index_of_node_[geography_.client_nodes[i]] = static_cast<int>(i);
+  }
+  changed_nodes_.clear();
+  state_ = std::make_shared<const RoutingState>(
+      RoutingState{servers_, std::move(closest_server_table),
+                   std::move(server_splits), ConsistentHashRing{servers_}});
+  return state_;
+}
+
+bool RoutingSource::set_link(int from, int to, int cost) {
+  if (!options_.is_geo || from < 0 || from >= geography_.num_nodes || to < 0 ||
+      to >= geography_.num_nodes) {
+    return false;
+  }
+
+  geography_.links.set_link(from, to, cost);
+  if (labels_) {
+    std::vector<int> changed_nodes{labels_->set_link(from, to, cost)};
+    changed_nodes_.insert(changed_nodes_.end(), changed_nodes.begin(),
+                          changed_nodes.end());
+  }
+  return true;
+}
+
+std::shared_ptr<const RoutingState> RoutingSource::commit() {
+  PrefixTable closest_server_table{};
+  std::vector<ServerSplit> server_splits{};
+  if (options_.is_capacity) {
+    closest_server_table =
+        build_capacitated_server_table(geography_, server_splits);
+  } else {
+    closest_server_table = state_->closest_server_table;
+    for (int node : changed_nodes_) {
+      int client{client_index_of_node_[node]};
+      if (client != -1) {
+        closest_server_table.insert(geography_.client_prefixes[client].first,
+                                    geography_.client_prefixes[client].second,
+                                    labels_->server_of(node));
+      }
+    }
+  }
+  changed_nodes_.clear();
+  state_ = std::make_shared<const RoutingState>(
+      RoutingState{servers_, std::move(closest_server_table),
+                   std::move(server_splits), state_->consistent_hash_ring});
+  return state_;
+}
+
+bool RoutingSource::write_snapshot(const std::string &path) const {
+  if (!options_.is_geo) {
+    return false;
+  }
+  if (labels_) {
+    return write_geography_snapshot(path, geography_, servers_, *labels_,
+                                    state_->closest_server_table);
+  }
+  // With --capacity, the closest servers are not kept up to date.
+  NearestServerLabels labels{geography_};
+  return write_geography_snapshot(path, geography_, servers_, labels,
+                                  build_closest_server_table(geography_,
+                                                             labels));
+}
+
+RoutingTable::RoutingTable(std::shared_ptr<const RoutingState> state)
+    : state_{std::move(state)} {}
+
+std::shared_ptr<const RoutingState> RoutingTable::current() const {
+  return state_.load(std::memory_order_acquire);
+}
+
+void RoutingTable::publish(std::shared_ptr<const RoutingState> state) {
+  state_.store(std::move(state), std::memory_order_release);
+}
+
+// Apply one admin command. Returns false if it is malformed or refers to
+// nodes that do not exist.
+static bool apply_admin_command(RoutingSource &routing_source,
+                                const std::string &line) {
+  char command[8];
+  int from, to, cost, len{-1};
+  if (sscanf(line.c_str(), "%7s%d%d%d %n", command, &from, &to, &cost, &len) ==
+          4 &&
+      strcmp(command, "LINK") == 0 && len == static_cast<int>(line.size()) &&
+      cost >= 0) {
+    return routing_source.set_link(from, to, cost);
+  }
+  len = -1;
+  if (sscanf(line.c_str(), "%7s%d%d %n", command, &from, &to, &len) == 3 &&
+      strcmp(command, "UNLINK") == 0 && len == static_cast<int>(line.size())) {
+    return routing_source.set_link(from, to, -1);
+  }
+  return false;
+}
+
+struct AdminConnection {
+  int fd;
+  std::string pending; // Received bytes not yet ending in a newline.
+};
+
+// Handle whatever arrived on connection. Returns whether any link changed, and
+// sets is_closed if the connection should be dropped.
+static bool handle_admin_connection(RoutingSource &routing_source,
+                                    AdminConnection &connection,
+                                    bool &is_closed) {
+  char buffer[4096];
+  long len{recv(connection.fd, buffer, sizeof(buffer), MSG_DONTWAIT)};
+  if (len <= 0) {
+    is_closed = len == 0 || (errno != EAGAIN && errno != EWOULDBLOCK);
+    return false;
+  }
+  connection.pending.append(buffer, len);
+
+  bool is_changed{false};
+  std::string replies{};
+  size_t line_end;
+  while ((line_end = connection.pending.find('\n')) != std::string::npos) {
+    std::string line{connection.pending.substr(0, line_end)};
+    connection.pending.erase(0, line_end + 1);
+    if (!line.empty() && line.back() == '\r') {
+      line.pop_back();
+    }
+    if (apply_admin_command(routing_source, line)) {
+      is_changed = true;
+      replies += "OK\n";
+    } else {
+      spdlog::warn("Rejected admin command \"{}\"", line);
+      replies += "ERROR\n";
+    }
+  }
+  is_closed = connection.pending.size() > MAX_ADMIN_LINE_LEN ||
+              send(connection.fd, replies.data(), replies.size(),
+                   MSG_DONTWAIT | MSG_NOSIGNAL) !=
+                  static_cast<long>(replies.size());
+  return is_changed;
+}
+
+static void watch_routing_state(RoutingSource routing_source, int admin_fd,
+                                RoutingTable &routing_table, int inotify_fd,
+                                int signal_fd) {
+  // Editors and deployment tools usually replace the file by a rename, which
+  // a watch on the file itself would not survive, so watch its directory.
+  std::filesystem::path file_path{routing_source.path()};
+  std::string file_name{file_path.filename()};
+  std::filesystem::path dir_path{file_path.parent_path()};
+  if (inotify_add_watch(inotify_fd,
+                        dir_path.empty() ? "." : dir_path.c_str(),
+                        IN_CLOSE_WRITE | IN_MOVED_TO) == -1) {
+    quick_exit(EXIT_FAILURE);
+  }
+
+  // inotify, signalfd, the admin port and then one per admin connection.
+  std::vector<pollfd> fds{{inotify_fd, POLLIN, 0},
+                          {signal_fd, POLLIN, 0},
+                          {admin_fd, POLLIN, 0}};
+  std::vector<AdminConnection> connections{};
+  alignas(inotify_event) char events[4096];
+  while (true) {
+    if (poll(fds.data(), fds.size(), -1) == -1) {
+      if (errno == EINTR) {
+        continue;
+      }
+      quick_exit(EXIT_FAILURE);
+    }
+
+    bool is_changed{false};
+    if (fds[0].revents & POLLIN) {
+      long len{read(inotify_fd, events, sizeof(events))};
+      if (len == -1) {
+        quick_exit(EXIT_FAILURE);
+      }
+      for (long i{0}; i < len;) {
+        const inotify_event *event{(const inotify_event *)(events + i)};
+        if (event->len > 0 && file_name == event->name) {
+          is_changed = true;
+        }
+        i += sizeof(inotify_event) + event->len;
+      }
+    }
+    if (fds[1].revents & POLLIN) {
+      signalfd_siginfo siginfo;
+      if (read(signal_fd, &siginfo, sizeof(siginfo)) != sizeof(siginfo)) {
+        quick_exit(EXIT_FAILURE);
+      }
+      spdlog::info("Received SIGHUP");
+      is_changed = true;
+    }
+    if (is_changed) {
+      std::shared_ptr<const RoutingState> state{routing_source.reload()};
+      if (state == nullptr) {
+        spdlog::warn("Failed to reload {}, keeping the previous servers",
+                     routing_source.path());
+      } else {
+        routing_table.publish(state);
+        spdlog::info("Reloaded {} servers from {}", state->servers.size(),
+                     routing_source.path());
+      }
+    }
+
+    bool is_link_changed{false};
+    for (size_t i = connections.size(); i-- > 0;) {
+      if (fds[3 + i].revents == 0) {
+        continue;
+      }
+      bool is_closed{false};
+      is_link_changed |=
+          handle_admin_connection(routing_source, connections[i], is_closed);
+      if (is_closed) {
+        close(connections[i].fd);
+        connections.erase(connections.begin() + i);
+        fds.erase(fds.begin() + 3 + i);
+      }
+    }
+    if (is_link_changed) {
+      routing_table.publish(routing_source.commit());
+      spdlog::info("Applied link changes");
+    }
+    if (fds[2].revents & POLLIN) {
+      int connection_fd{accept4(admin_fd, NULL, NULL, SOCK_CLOEXEC)};
+      if (connection_fd != -1) {
+        connections.push_back({connection_fd, {}});
+        fds.push_back({connection_fd, POLLIN, 0});
+      }
+    }
+  }
+}
+
+std::thread start_routing_state_watcher(RoutingSource routing_source,
+                                        int admin_fd,
+                                        RoutingTable &routing_table) {
+  sigset_t mask;
+  sigemptyset(&mask);
+  sigaddset(&mask, SIGHUP);
+  if (pthread_sigmask(SIG_BLOCK, &mask, NULL) != 0) {
+    quick_exit(EXIT_FAILURE);
+  }
+  int signal_fd{signalfd(-1, &mask, SFD_CLOEXEC)};
+  int inotify_fd{inotify_init1(IN_CLOEXEC)};
+  if (signal_fd == -1 || inotify_fd == -1) {
+    quick_exit(EXIT_FAILURE);
+  }
+  return std::thread{watch_routing_state, std::move(routing_source), admin_fd,
+                     std::ref(routing_table), inotify_fd, signal_fd};
+}
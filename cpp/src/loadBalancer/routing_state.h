@@ -0,0 +1,100 @@
+#ifndef ROUTING_STATE_H
+#define ROUTING_STATE_H
+
+#include "consistent_hash.h"
+#include "nearest_server.h"
+#include "prefix_table.h"
+#include "server_info.h"
+#include <atomic>
+#include <memory>
+#include <optional>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Everything the load balancer derives from its --servers file. A
+// RoutingState is immutable once built: reloads build a new one on the
+// watcher thread and publish it through a RoutingTable, so the request path
+// never waits for a rebuild and never sees a half-updated state. A request
+// keeps the state it started with alive until it is answered.
+
+struct RoutingOptions {
+  bool is_geo;
+  bool is_capacity;
+};
+
+struct RoutingState {
+  std::vector<Videoserver> servers;
+  PrefixTable closest_server_table; // Only filled in geo mode.
+  // With --capacity, what closest_server_table maps client prefixes to.
+  std::vector<ServerSplit> server_splits;
+  ConsistentHashRing consistent_hash_ring;
+
+  // In geo mode, the server for a client at addr (network byte order), or
+  // -1 if there is none.
+  int closest_server(in_addr_t addr) const;
+};
+
+// The inputs routing states are built from: the --servers file and, in geo
+// mode, the link changes made through the admin port since it was last read.
+class RoutingSource {
+public:
+  RoutingSource(std::string path, RoutingOptions options);
+
+  const std::string &path() const { return path_; }
+
+  // Read the file and build its routing state, dropping any link changes.
+  // Returns nullptr if the file is missing or malformed, in which case the
+  // previous inputs stay in place.
+  std::shared_ptr<const RoutingState> reload();
+
+  // In geo mode, replace every link from -> to by one of the given cost, or
+  // remove them if cost is negative. Returns false if not in geo mode or if
+  // either node does not exist. Takes effect at the next commit().
+  bool set_link(int from, int to, int cost);
+
+  // Build the routing state with the link changes made since the last reload
+  // or commit. Without --capacity only the clients whose closest server
+  // changed are updated; with it, the min-cost flow is solved again.
+  std::shared_ptr<const RoutingState> commit();
+
+  // In geo mode, write the geography as last reloaded or committed to path
+  // as a snapshot (see geography_snapshot.h), which --servers can name in
+  // place of the text file. Returns false if not in geo mode or if the file
+  // cannot be written.
+  bool write_snapshot(const std::string &path) const;
+
+private:
+  std::string path_;
+  RoutingOptions options_;
+  std::vector<Videoserver> servers_;
+  Geography geography_;
+  std::optional<NearestServerLabels> labels_; // Geo mode without --capacity.
+  std::vector<int> client_index_of_node_;     // -1 for non-clients.
+  std::vector<int> changed_nodes_;
+  std::shared_ptr<const RoutingState> state_;
+};
+
+class RoutingTable {
+public:
+  explicit RoutingTable(std::shared_ptr<const RoutingState> state);
+
+  std::shared_ptr<const RoutingState> current() const;
+  void publish(std::shared_ptr<const RoutingState> state);
+
+private:
+  std::atomic<std::shared_ptr<const RoutingState>> state_;
+};
+
+// Start a thread that rebuilds the routing state and publishes it to
+// routing_table whenever the file of routing_source is rewritten (or replaced
+// by a rename) or the process receives SIGHUP. A file that fails to parse is
+// logged and the previous state stays in place. If admin_fd is a listening
+// socket, link changes (see README.md) are accepted on it as well. Must be
+// called before any other thread is started, since SIGHUP is blocked in the
+// calling thread and every thread it starts afterwards.
+std::thread start_routing_state_watcher(RoutingSource routing_source,
+                                        int admin_fd,
+                                        RoutingTable &routing_table);
+
+#endif // !ROUTING_STATE_H
@@ -0,0 +1,279 @@
+#include "server_info.h"
+
+#include "Random.h"
+#include "djikstra.h"
+#include "mapped_file.h"
+#include "min_cost_flow.h"
+#include <algorithm>
+#include <arpa/inet.h>
+#include <array>
+#include <cctype>
+#include <climits>
+#include <cstdio>
+#include <string_view>
+
+Videoserver make_videoserver(in_addr_t addr, uint16_t port,
+                             const char *ip_str) {
+  Videoserver server;
+  server.response.videoserver_addr = addr;
+  server.response.videoserver_port = htons(port);
+  server.response.request_id = 0;
+  server.name = std::string{ip_str} + ":" + std::to_string(port);
+  return server;
+}
+
+bool read_server_list(const std::string &path,
+                      std::vector<Videoserver> &servers) {
+  FILE *server_info_file;
+  if ((server_info_file = fopen(path.c_str(), "r")) == NULL) {
+    return false;
+  }
+
+  int num_servers;
+  if (fscanf(server_info_file, "%*s%d", &num_servers) != 1) {
+    fclose(server_info_file);
+    return false;
+  }
+  char ip_str[16];
+  unsigned short port;
+  in_addr ip_addr;
+  servers.clear();
+  for (int i = 0; i < num_servers; ++i) {
+    if (fscanf(server_info_file, "%15s%hu", ip_str, &port) != 2 ||
+        inet_pton(AF_INET, ip_str, &ip_addr) != 1) {
+      fclose(server_info_file);
+      return false;
+    }
+    servers.push_back(make_videoserver(ip_addr.s_addr, port, ip_str));
+  }
+
+  return fclose(server_info_file) != EOF && !servers.empty();
+}
+
+// Scans a mapped geography file by hand: for a large topology the file is
+// almost all links, and fscanf() would parse its format string again for
+// every one of them.
+class GeographyScanner {
+public:
+  GeographyScanner(const char *data, size_t size)
+      : pos_{data}, end_{data + size} {}
+
+  // The next whitespace-separated token, empty at the end of the file.
+  std::string_view token() {
+    while (pos_ < end_ && isspace(static_cast<unsigned char>(*pos_))) {
+      ++pos_;
+    }
+    const char *start{pos_};
+    while (pos_ < end_ && !isspace(static_cast<unsigned char>(*pos_))) {
+      ++pos_;
+    }
+    return {start, static_cast<size_t>(pos_ - start)};
+  }
+
+  // The next token as a decimal number in the range [min, max].
+  bool number(long long &value, long long min, long long max) {
+    std::string_view digits{token()};
+    bool is_negative{false};
+    if (!digits.empty() && (digits[0] == '-' || digits[0] == '+')) {
+      is_negative = digits[0] == '-';
+      digits.remove_prefix(1);
+    }
+    if (!parse_digits(digits, value)) {
+      return false;
+    }
+    value = is_negative ? -value : value;
+    return min <= value && value <= max;
+  }
+
+  // A non-negative number if one follows on the current line.
+  bool optional_number(long long &value) {
+    while (pos_ < end_ && (*pos_ == ' ' || *pos_ == '\t')) {
+      ++pos_;
+    }
+    if (pos_ == end_ || !isdigit(static_cast<unsigned char>(*pos_))) {
+      return false;
+    }
+    return parse_digits(token(), value);
+  }
+
+private:
+  // At most 18 digits, so that the value cannot overflow.
+  static bool parse_digits(std::string_view digits, long long &value) {
+    if (digits.empty() || digits.size() > 18) {
+      return false;
+    }
+    long long parsed{0};
+    for (char digit : digits) {
+      if (!isdigit(static_cast<unsigned char>(digit))) {
+        return false;
+      }
+      parsed = parsed * 10 + (digit - '0');
+    }
+    value = parsed;
+    return true;
+  }
+
+  const char *pos_, *end_;
+};
+
+bool read_geography(const std::string &path, Geography &geography,
+                    std::vector<Videoserver> &servers) {
+  MappedFile file;
+  if (!file.open(path)) {
+    return false;
+  }
+  GeographyScanner scanner{file.data(), file.size()};
+
+  geography = Geography{};
+  servers.clear();
+  long long num_nodes, num_links;
+  scanner.token();
+  if (!scanner.number(num_nodes, 0, INT_MAX)) {
+    return false;
+  }
+  geography.num_nodes = static_cast<int>(num_nodes);
+  char ip_str[19];
+  for (int i = 0; i < geography.num_nodes; ++i) {
+    std::string_view identity{scanner.token()}, ip{scanner.token()};
+    if (ip.empty() || ip.size() >= sizeof(ip_str)) {
+      return false;
+    }
+    ip.copy(ip_str, ip.size());
+    ip_str[ip.size()] = '\0';
+    if (identity == "CLIENT") {
+      // Clients are either single IPs or CIDR prefixes (e.g. 10.0.0.0/24).
+      in_addr_t prefix;
+      int prefix_len;
+      if (!parse_prefix(ip_str, prefix, prefix_len)) {
+        return false;
+      }
+      long long demand{1};
+      scanner.optional_number(demand);
+      geography.client_nodes.push_back(i);
+      geography.client_prefixes.push_back({prefix, prefix_len});
+      geography.client_demands.push_back(demand);
+    } else if (identity == "SERVER") {
+      in_addr ip_addr;
+      if (inet_pton(AF_INET, ip_str, &ip_addr) != 1) {
+        return false;
+      }
+      long long capacity{-1};
+      scanner.optional_number(capacity);
+      geography.server_nodes.push_back(i);
+      geography.server_capacities.push_back(capacity);
+      servers.push_back(make_videoserver(ip_addr.s_addr, 8000, ip_str));
+    }
+  }
+
+  scanner.token();
+  if (!scanner.number(num_links, 0, INT_MAX)) {
+    return false;
+  }
+  // Every node's links are counted before they are stored, so that they go
+  // in CSR form in one pass.
+  std::vector<std::array<int, 3>> links(num_links);
+  std::vector<uint64_t> link_offsets(geography.num_nodes + 1, 0);
+  for (auto &[from, to, cost] : links) {
+    long long value[3];
+    if (!scanner.number(value[0], 0, geography.num_nodes - 1) ||
+        !scanner.number(value[1], 0, geography.num_nodes - 1) ||
+        !scanner.number(value[2], 0, INT_MAX)) {
+      return false;
+    }
+    from = static_cast<int>(value[0]);
+    to = static_cast<int>(value[1]);
+    cost = static_cast<int>(value[2]);
+    ++link_offsets[from + 1];
+  }
+  for (int node = 0; node < geography.num_nodes; ++node) {
+    link_offsets[node + 1] += link_offsets[node];
+  }
+  std::vector<Link> csr_links(num_links);
+  std::vector<uint64_t> next(link_offsets.begin(), link_offsets.end() - 1);
+  for (const auto &[from, to, cost] : links) {
+    csr_links[next[from]++] = {to, cost};
+  }
+  geography.links = LinkGraph{std::move(link_offsets), std::move(csr_links)};
+  return true;
+}
+
+PrefixTable build_capacitated_server_table(const Geography &geography,
+                                           std::vector<ServerSplit> &splits) {
+  size_t num_clients{geography.client_nodes.size()},
+      num_servers{geography.server_nodes.size()};
+
+  // One Dijkstra per server on the reversed graph gives the distance from
+  // every client to that server; there are far fewer servers than clients.
+  LinkGraph reversed_links{geography.links.reversed()};
+  std::vector<std::vector<int>> dist_to_server{};
+  for (int server_node : geography.server_nodes) {
+    dist_to_server.push_back(
+        dijkstra(reversed_links, server_node, geography.num_nodes));
+  }
+
+  // source -> client (demand) -> server (distance) -> sink (capacity).
+  int source{static_cast<int>(num_clients + num_servers)}, sink{source + 1};
+  MinCostFlow min_cost_flow{sink + 1};
+  long long unlimited{LLONG_MAX / 4};
+  std::vector<std::vector<std::pair<size_t, int>>> edges_of_client(
+      num_clients);
+  for (size_t i = 0; i < num_clients; ++i) {
+    min_cost_flow.add_edge(source, static_cast<int>(i),
+                           geography.client_demands[i], 0);
+    for (size_t j = 0; j < num_servers; ++j) {
+      int dist{dist_to_server[j][geography.client_nodes[i]]};
+      if (dist != INT_MAX) {
+        edges_of_client[i].push_back(
+            {min_cost_flow.add_edge(static_cast<int>(i),
+                                    static_cast<int>(num_clients + j),
+                                    unlimited, dist),
+             static_cast<int>(j)});
+      }
+    }
+  }
+  for (size_t j = 0; j < num_servers; ++j) {
+    long long capacity{geography.server_capacities[j]};
+    min_cost_flow.add_edge(static_cast<int>(num_clients + j), sink,
+                           capacity < 0 ? unlimited : capacity, 0);
+  }
+  min_cost_flow.solve(source, sink);
+
+  PrefixTable server_table{};
+  splits.clear();
+  for (size_t i = 0; i < num_clients; ++i) {
+    ServerSplit split{};
+    long long total_flow{0};
+    int closest{-1};
+    for (const auto &[edge, server] : edges_of_client[i]) {
+      int dist{dist_to_server[server][geography.client_nodes[i]]};
+      if (closest == -1 ||
+          dist < dist_to_server[closest][geography.client_nodes[i]]) {
+        closest = server;
+      }
+      if (min_cost_flow.flow(edge) > 0) {
+        total_flow += min_cost_flow.flow(edge);
+        split.push_back({server, total_flow});
+      }
+    }
+    if (split.empty() && closest != -1) {
+      split.push_back({closest, 1});
+    }
+    int value{-1};
+    if (!split.empty()) {
+      value = static_cast<int>(splits.size());
+      splits.push_back(std::move(split));
+    }
+    server_table.insert(geography.client_prefixes[i].first,
+                        geography.client_prefixes[i].second, value);
+  }
+  return server_table;
+}
+
+int choose_server(const ServerSplit &split) {
+  long long flow{Random::get<long long>(0, split.back().second - 1)};
+  return std::upper_bound(split.begin(), split.end(), flow,
+                          [](long long flow, const auto &server_flow) {
+                            return flow < server_flow.second;
+                          })
+      ->first;
+}
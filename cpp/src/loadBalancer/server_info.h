@@ -0,0 +1,64 @@
+#ifndef SERVER_INFO_H
+#define SERVER_INFO_H
+
+#include "link_graph.h"
+#include "loadBalancer_protocol.h"
+#include "prefix_table.h"
+#include <string>
+#include <vector>
+
+// A videoserver the load balancer can hand out. The response is precomputed
+// (address and port in network byte order) so that answering a request only
+// fills in the request_id.
+struct Videoserver {
+  LoadBalancerResponse response;
+  std::string name; // "ip:port", for logging.
+};
+
+// The network described by a geography file (see README.md).
+struct Geography {
+  int num_nodes;
+  std::vector<int> client_nodes, server_nodes;
+  // (prefix, prefix_len) of each client node, in the order of client_nodes.
+  std::vector<std::pair<in_addr_t, int>> client_prefixes;
+  // Expected sessions from each client node (1 unless given in the file).
+  std::vector<long long> client_demands;
+  // Sessions each server can take, in the order of server_nodes; -1 means
+  // unlimited (the default).
+  std::vector<long long> server_capacities;
+  LinkGraph links;
+};
+
+// A videoserver at addr:port (addr in network byte order) named ip_str.
+Videoserver make_videoserver(in_addr_t addr, uint16_t port,
+                             const char *ip_str);
+
+// Parse a NUM_SERVERS file. Returns false if it is missing or malformed.
+bool read_server_list(const std::string &path,
+                      std::vector<Videoserver> &servers);
+
+// Parse a NUM_NODES/NUM_LINKS file. Every SERVER is assumed to listen on port
+// 8000, in the order the servers appear in the file. Returns false if the file
+// is missing or malformed, or has a link of negative cost (which Dijkstra
+// cannot route over).
+bool read_geography(const std::string &path, Geography &geography,
+                    std::vector<Videoserver> &servers);
+
+// The servers the demand of a client is split across, each with the flow it
+// carries plus that of the servers before it.
+using ServerSplit = std::vector<std::pair<int, long long>>;
+
+// Split the demand of every client across servers such that the total
+// distance travelled by client demand is minimal without exceeding any
+// server's capacity, by a min-cost flow over the shortest-path distances, and
+// map every client prefix to the index of its split in splits. A client that
+// fits nowhere (total demand exceeds total capacity) falls back to its closest
+// server, and one that cannot reach any server maps to -1.
+PrefixTable build_capacitated_server_table(const Geography &geography,
+                                           std::vector<ServerSplit> &splits);
+
+// A server of split, picked at random in proportion to the flow it carries,
+// so that every server gets its share of the client's sessions.
+int choose_server(const ServerSplit &split);
+
+#endif // !SERVER_INFO_H
@@ -0,0 +1,101 @@
+#include "load.h"
+
+#include "network_utils.h"
+#include <cstdlib>
+#include <string_view>
+#include <strings.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#define CONNECT_TIMEOUT_MS 1000
+#define RECV_SIZE (256 * 1024)
+
+Load::Load(int port, int no_of_players) : port_{port} {
+  for (int i{0}; i < no_of_players; ++i) {
+    threads_.emplace_back([this, i]() { play(i); });
+  }
+}
+
+void Load::stop() {
+  is_stopped_ = true;
+  for (std::thread &thread : threads_) {
+    if (thread.joinable()) {
+      thread.join();
+    }
+  }
+}
+
+void Load::play(int player) {
+  int socket{try_get_outbound_socket(inet_addr("127.0.0.1"), htons(port_),
+                                     CONNECT_TIMEOUT_MS)};
+  if (socket == -1) {
+    ++no_of_failed_;
+    return;
+  }
+  timeval timeout{LOAD_RECV_TIMEOUT_S, 0};
+  setsockopt(socket, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+
+  // A few videos, so that the proxy keeps the bitrates of more than one.
+  std::string uuid{"bench-" + std::to_string(player)},
+      path_to_video{"/videos/bench-" + std::to_string(player % 8)},
+      headers{" HTTP/1.1\r\nHost: bench\r\nx-489-uuid: " + uuid +
+              "\r\ncontent-length: 0\r\n\r\n"};
+  std::vector<char> buffer;
+  uint64_t no_of_bytes;
+  bool is_ok{fetch(socket, "GET " + path_to_video + "/vid.mpd" + headers,
+                   buffer, no_of_bytes)};
+  for (int segment_no{1}; is_ok && !is_stopped_; ++segment_no) {
+    is_ok = fetch(socket,
+                  "GET " + path_to_video + "/video/vid-500-seg-" +
+                      std::to_string(segment_no) + ".m4s" + headers,
+                  buffer, no_of_bytes);
+    if (is_ok) {
+      ++no_of_segments_;
+      no_of_bytes_ += no_of_bytes;
+    }
+  }
+  if (!is_ok && !is_stopped_) {
+    ++no_of_failed_;
+  }
+  close(socket);
+}
+
+bool Load::fetch(int socket, const std::string &request,
+                 std::vector<char> &buffer, uint64_t &no_of_bytes) {
+  if (send(socket, request.data(), request.length(), MSG_NOSIGNAL) !=
+      static_cast<long>(request.length())) {
+    return false;
+  }
+  buffer.resize(RECV_SIZE);
+  size_t no_of_bytes_received{0}, header_end;
+  while ((header_end = std::string_view{buffer.data(), no_of_bytes_received}
+                           .find("\r\n\r\n")) == std::string_view::npos) {
+    long curr{recv(socket, buffer.data() + no_of_bytes_received,
+                   RECV_SIZE - no_of_bytes_received, 0)};
+    if (curr <= 0) {
+      return false;
+    }
+    no_of_bytes_received += curr;
+  }
+  std::string_view header{buffer.data(), header_end};
+  if (!header.starts_with("HTTP/1.1 200")) {
+    return false;
+  }
+  size_t content_length{0};
+  for (size_t line{header.find("\r\n")}; line != std::string_view::npos;
+       line = header.find("\r\n", line + 2)) {
+    if (strncasecmp(header.data() + line + 2, "content-length:", 15) == 0) {
+      content_length = strtoull(header.data() + line + 17, nullptr, 10);
+    }
+  }
+  // Only the body is left; it is counted as it comes in.
+  no_of_bytes = no_of_bytes_received - header_end - 4;
+  while (no_of_bytes < content_length) {
+    long curr{recv(socket, buffer.data(), RECV_SIZE, 0)};
+    if (curr <= 0) {
+      return false;
+    }
+    no_of_bytes += curr;
+  }
+  return no_of_bytes == content_length;
+}
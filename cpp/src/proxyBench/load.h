@@ -0,0 +1,50 @@
+#ifndef LOAD_H
+#define LOAD_H
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Players streaming through the proxy at 127.0.0.1:port, as fast as it
+// relays: each fetches the manifest of a video, then its segments back to
+// back, on a keep-alive connection and in a thread of its own.
+
+// A player is given up on if a response stalls this long.
+#define LOAD_RECV_TIMEOUT_S 10
+
+class Load {
+public:
+  Load(int port, int no_of_players);
+  Load(const Load &) = delete;
+  Load &operator=(const Load &) = delete;
+  ~Load() { stop(); }
+
+  // Let the players finish the segments they are fetching, and end.
+  void stop();
+
+  // Of the segments received in full since the start.
+  uint64_t no_of_segments() const { return no_of_segments_; }
+  uint64_t no_of_bytes() const { return no_of_bytes_; }
+
+  // How many players failed before stop(): could not connect, lost their
+  // connection or got something other than 200 OK.
+  int no_of_failed() const { return no_of_failed_; }
+
+private:
+  void play(int player);
+  // Send request on socket and receive its response into buffer, setting
+  // no_of_bytes to the length of its body. Returns false if that fails or
+  // the response is not 200 OK.
+  bool fetch(int socket, const std::string &request, std::vector<char> &buffer,
+             uint64_t &no_of_bytes);
+
+  int port_;
+  std::atomic<bool> is_stopped_{};
+  std::atomic<uint64_t> no_of_segments_{}, no_of_bytes_{};
+  std::atomic<int> no_of_failed_{};
+  std::vector<std::thread> threads_;
+};
+
+#endif // !LOAD_H
@@ -0,0 +1,102 @@
+#include "origin.h"
+
+#include "network_utils.h"
+#include "spdlog/spdlog.h"
+#include <cstring>
+#include <string_view>
+#include <sys/socket.h>
+#include <thread>
+#include <unistd.h>
+
+#define MPD_HEAD                                                               \
+  "<?xml version='1.0' encoding='utf-8'?>\n"                                   \
+  "<MPD profiles=\"urn:mpeg:dash:profile:isoff-live:2011\" "                   \
+  "mediaPresentationDuration=\"PT3M13.167S\" type=\"static\">\n"               \
+  "<Period>\n"                                                                 \
+  "<AdaptationSet mimeType=\"video/mp4\">\n"                                   \
+  "<SegmentTemplate timescale=\"1000\" duration=\"2000\" "                     \
+  "media=\"$RepresentationID$-seg-$Number$.m4s\" startNumber=\"1\" />\n"
+
+#define MPD_TAIL "</AdaptationSet>\n</Period>\n</MPD>\n"
+
+// The manifest with its representations, and the one the proxy hands the
+// player instead, without them.
+static const std::string vid_mpd{
+    MPD_HEAD
+    "<Representation id=\"video/vid-500\" bandwidth=\"500\" />\n"
+    "<Representation id=\"video/vid-800\" bandwidth=\"800\" />\n"
+    "<Representation id=\"video/vid-1100\" bandwidth=\"1100\" />\n"
+    "<Representation id=\"video/vid-1400\" bandwidth=\"1400\" />\n" MPD_TAIL};
+static const std::string vid_no_list_mpd{MPD_HEAD MPD_TAIL};
+
+static std::string header_of(size_t content_length) {
+  return "HTTP/1.1 200 OK\r\nContent-Length: " +
+         std::to_string(content_length) + "\r\n\r\n";
+}
+
+// With is_more, more of the response follows right away: not sent on its own
+// for the delayed ACK of its peer to hold up the rest.
+static bool send_all(int socket, std::string_view data, bool is_more = false) {
+  while (!data.empty()) {
+    long curr{send(socket, data.data(), data.length(),
+                   MSG_NOSIGNAL | (is_more ? MSG_MORE : 0))};
+    if (curr <= 0) {
+      return false;
+    }
+    data.remove_prefix(curr);
+  }
+  return true;
+}
+
+Origin::Origin(size_t segment_size) : segment_(segment_size, 'x') {}
+
+void Origin::start(int port) {
+  int listen_socket{get_inbound_socket(port)};
+  std::thread{[this, listen_socket]() {
+    while (true) {
+      int socket{accept(listen_socket, nullptr, nullptr)};
+      if (socket == -1) {
+        spdlog::warn("Origin::start(): accept()");
+        quick_exit(EXIT_FAILURE);
+      }
+      std::thread{[this, socket]() { serve(socket); }}.detach();
+    }
+  }}.detach();
+}
+
+// The proxy sends one request at a time on a connection, with no body.
+void Origin::serve(int socket) const {
+  std::string received;
+  char buffer[4096];
+  while (true) {
+    size_t header_end;
+    while ((header_end = received.find("\r\n\r\n")) == std::string::npos) {
+      long curr{recv(socket, buffer, sizeof(buffer), 0)};
+      if (curr <= 0) {
+        close(socket);
+        return;
+      }
+      received.append(buffer, curr);
+    }
+    std::string_view request_line{received.data(), received.find("\r\n")};
+    bool is_sent;
+    if (request_line.find(".m4s ") != std::string_view::npos) {
+      is_sent = send_all(socket, header_of(segment_.length()), true) &&
+                send_all(socket, segment_);
+    } else if (request_line.find("/vid.mpd ") != std::string_view::npos) {
+      is_sent = send_all(socket, header_of(vid_mpd.length()) + vid_mpd);
+    } else if (request_line.find("/vid-no-list.mpd ") !=
+               std::string_view::npos) {
+      is_sent = send_all(socket, header_of(vid_no_list_mpd.length()) +
+                                     vid_no_list_mpd);
+    } else {
+      is_sent = send_all(socket, "HTTP/1.1 404 Not Found\r\n"
+                                 "Content-Length: 0\r\n\r\n");
+    }
+    if (!is_sent) {
+      close(socket);
+      return;
+    }
+    received.erase(0, header_end + 4);
+  }
+}
@@ -0,0 +1,25 @@
+#ifndef ORIGIN_H
+#define ORIGIN_H
+
+#include <cstddef>
+#include <string>
+
+// A videoserver for the proxy to relay from, in the benchmark's own process
+// so that it costs the proxy nothing to measure. It serves the manifests of
+// a video at any path, with the bitrates of the videos in
+// videoserver/static, and every segment at any bitrate as segment_size
+// bytes, over keep-alive connections, one thread per connection.
+class Origin {
+public:
+  explicit Origin(size_t segment_size);
+
+  // Listen on port and serve in the background until the process exits.
+  void start(int port);
+
+private:
+  void serve(int socket) const;
+
+  std::string segment_;
+};
+
+#endif // !ORIGIN_H
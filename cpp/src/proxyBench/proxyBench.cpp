@@ -0,0 +1,209 @@
+#include "load.h"
+#include "network_utils.h"
+#include "origin.h"
+#include <chrono>
+#include <csignal>
+#include <cstdlib>
+#include <cxxopts.hpp>
+#include <fcntl.h>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <sys/wait.h>
+#include <thread>
+#include <unistd.h>
+
+// Compares the I/O backends of the proxy: runs adaptiveProxy with each in
+// turn, relaying segments from an origin in this process to players in this
+// process as fast as it can, and reports how much it relays and how much CPU
+// it takes to. The players and the origin run on the same machine and take
+// CPU of their own, so the CPU the proxy takes per gigabyte relayed says more
+// than the throughput does.
+
+// How long the proxy is given to start listening, and how long the players
+// stream before the measurement starts.
+#define PROXY_START_TIMEOUT_MS 5000
+#define WARM_UP_MS 1000
+
+// The CPU time the process pid has taken, user and system, in seconds.
+// Returns a negative time if it cannot be read.
+static double cpu_seconds_of(pid_t pid) {
+  std::ifstream file{"/proc/" + std::to_string(pid) + "/stat"};
+  std::string stat{std::istreambuf_iterator<char>{file}, {}};
+  size_t comm_end{stat.rfind(')')};
+  if (comm_end == std::string::npos) {
+    return -1;
+  }
+  // utime and stime are the 14th and 15th fields, the 12th and 13th after
+  // the command name.
+  std::istringstream fields{stat.substr(comm_end + 2)};
+  std::string field;
+  for (int i{0}; i < 11; ++i) {
+    fields >> field;
+  }
+  unsigned long utime, stime;
+  if (!(fields >> utime >> stime)) {
+    return -1;
+  }
+  return static_cast<double>(utime + stime) / sysconf(_SC_CLK_TCK);
+}
+
+// Whether something listens on port.
+static bool is_listening(int port) {
+  int socket{try_get_outbound_socket(inet_addr("127.0.0.1"), htons(port), 50)};
+  if (socket == -1) {
+    return false;
+  }
+  close(socket);
+  return true;
+}
+
+// Start the proxy at path with io_backend, listening on port and relaying
+// from the origin on origin_port, and wait for it to listen. Returns its
+// pid, or -1 if it exited.
+static pid_t start_proxy(const std::string &path, const std::string &io_backend,
+                         int port, int origin_port) {
+  // The listen socket of a proxy on io_uring outlives it until the kernel
+  // has torn down its ring, with the accepts in flight on it.
+  for (int waited_ms{0};
+       waited_ms < PROXY_START_TIMEOUT_MS && is_listening(port);
+       waited_ms += 50) {
+    std::this_thread::sleep_for(std::chrono::milliseconds{50});
+  }
+
+  pid_t pid{fork()};
+  if (pid == -1) {
+    std::cout << "Error: fork()\n";
+    quick_exit(EXIT_FAILURE);
+  } else if (pid == 0) {
+    // Its log would cost this process more to read than it costs the proxy
+    // to write.
+    int dev_null{open("/dev/null", O_WRONLY)};
+    dup2(dev_null, STDOUT_FILENO);
+    dup2(dev_null, STDERR_FILENO);
+    std::string listen_port{std::to_string(port)},
+        videoserver_port{std::to_string(origin_port)};
+    execl(path.c_str(), "adaptiveProxy", "-l", listen_port.c_str(), "-h",
+          "127.0.0.1", "-p", videoserver_port.c_str(), "-a", "0.5", "-i",
+          io_backend.c_str(), nullptr);
+    _exit(127);
+  }
+
+  for (int waited_ms{0}; waited_ms < PROXY_START_TIMEOUT_MS; waited_ms += 50) {
+    if (waitpid(pid, nullptr, WNOHANG) == pid) {
+      return -1;
+    } else if (is_listening(port)) {
+      return pid;
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds{50});
+  }
+  kill(pid, SIGKILL);
+  waitpid(pid, nullptr, 0);
+  return -1;
+}
+
+int main(int argc, char *argv[]) {
+  cxxopts::Options cxxopts_options{
+      "proxyBench",
+      "Runs adaptiveProxy with each I/O backend under the same load and "
+      "reports the throughput and CPU cost of each"};
+  cxxopts_options.add_options()(
+      "x,proxy", "The adaptiveProxy executable (by default, the one next to "
+                 "proxyBench).",
+      cxxopts::value<std::string>()->default_value(""))(
+      "i,io-backends", "Comma-separated list of I/O backends to compare.",
+      cxxopts::value<std::vector<std::string>>()->default_value(
+          "epoll,io_uring"))(
+      "c,players", "How many players stream through the proxy at once.",
+      cxxopts::value<int>()->default_value("32"))(
+      "s,segment-size", "The size of every segment in KiB.",
+      cxxopts::value<int>()->default_value("1024"))(
+      "d,duration", "How many seconds to measure each backend for.",
+      cxxopts::value<int>()->default_value("10"))(
+      "p,port",
+      "The port of the origin; the proxy listens on the one after it.",
+      cxxopts::value<int>()->default_value("9700"));
+
+  std::string proxy_path;
+  std::vector<std::string> io_backends;
+  int no_of_players, segment_size_kib, duration_s, origin_port;
+  try {
+    const auto cxxopts_argv{cxxopts_options.parse(argc, argv)};
+    proxy_path = cxxopts_argv["proxy"].as<std::string>();
+    io_backends = cxxopts_argv["io-backends"].as<std::vector<std::string>>();
+    no_of_players = cxxopts_argv["players"].as<int>();
+    segment_size_kib = cxxopts_argv["segment-size"].as<int>();
+    duration_s = cxxopts_argv["duration"].as<int>();
+    origin_port = cxxopts_argv["port"].as<int>();
+  } catch (const cxxopts::exceptions::exception &e) {
+    std::cout << e.what() << '\n';
+    return EXIT_FAILURE;
+  }
+  if (no_of_players <= 0) {
+    std::cout << "Error: players must be positive\n";
+    return EXIT_FAILURE;
+  } else if (segment_size_kib <= 0) {
+    std::cout << "Error: segment-size must be positive\n";
+    return EXIT_FAILURE;
+  } else if (duration_s <= 0) {
+    std::cout << "Error: duration must be positive\n";
+    return EXIT_FAILURE;
+  } else if (origin_port <= 0 || origin_port + 1 >= MAX_NO_OF_PORTS) {
+    std::cout << "Error: port must be in the range of [1, "
+              << MAX_NO_OF_PORTS - 2 << "]\n";
+    return EXIT_FAILURE;
+  }
+  if (proxy_path.empty()) {
+    proxy_path = (std::filesystem::read_symlink("/proc/self/exe")
+                      .parent_path() /
+                  "adaptiveProxy")
+                     .string();
+  }
+
+  Origin origin{static_cast<size_t>(segment_size_kib) * 1024};
+  origin.start(origin_port);
+
+  std::cout << std::setw(10) << "backend" << std::setw(12) << "segments/s"
+            << std::setw(8) << "Gbps" << std::setw(12) << "proxy_cpu_%"
+            << std::setw(16) << "cpu_ms_per_GB" << std::setw(8) << "failed"
+            << '\n'
+            << std::fixed;
+  for (const std::string &io_backend : io_backends) {
+    pid_t pid{start_proxy(proxy_path, io_backend, origin_port + 1,
+                          origin_port)};
+    if (pid == -1) {
+      std::cout << "Error: " << proxy_path << " did not start with "
+                << io_backend << '\n';
+      return EXIT_FAILURE;
+    }
+
+    Load load{origin_port + 1, no_of_players};
+    std::this_thread::sleep_for(std::chrono::milliseconds{WARM_UP_MS});
+    auto started_at{std::chrono::steady_clock::now()};
+    uint64_t no_of_segments{load.no_of_segments()},
+        no_of_bytes{load.no_of_bytes()};
+    double cpu_s{cpu_seconds_of(pid)};
+    std::this_thread::sleep_for(std::chrono::seconds{duration_s});
+    double elapsed_s{std::chrono::duration<double>(
+                         std::chrono::steady_clock::now() - started_at)
+                         .count()};
+    no_of_segments = load.no_of_segments() - no_of_segments;
+    no_of_bytes = load.no_of_bytes() - no_of_bytes;
+    cpu_s = cpu_seconds_of(pid) - cpu_s;
+    load.stop();
+    kill(pid, SIGTERM);
+    waitpid(pid, nullptr, 0);
+
+    double gb{static_cast<double>(no_of_bytes) / 1e9};
+    std::cout << std::setw(10) << io_backend << std::setprecision(1)
+              << std::setw(12) << no_of_segments / elapsed_s
+              << std::setprecision(2) << std::setw(8) << gb * 8 / elapsed_s
+              << std::setprecision(1) << std::setw(12)
+              << cpu_s / elapsed_s * 100 << std::setw(16)
+              << (gb > 0 ? cpu_s * 1000 / gb : 0) << std::setw(8)
+              << load.no_of_failed() << '\n';
+  }
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,85 @@
+#include "check.h"
+#include "session.h"
+#include "trace.h"
+
+#include <cmath>
+#include <cstdlib>
+#include <fstream>
+#include <string>
+#include <unistd.h>
+
+// The abrSimulator on traces small enough to work out by hand: parsing trace
+// files, transfers across intervals of no bandwidth and around the end of a
+// trace, and the QoE of sessions on a fast and a slow link.
+
+static bool is_near(double a, double b) { return std::abs(a - b) < 1e-9; }
+
+static SessionSettings settings(double alpha, double max_buffer_s) {
+  return {ThroughputFilter::EWMA, alpha, BITRATE_SAFETY_FACTOR, 0.0,
+          max_buffer_s};
+}
+
+int main() {
+  char path_template[]{"/tmp/abr_simulator_test.XXXXXX"};
+  int fd{mkstemp(path_template)};
+  if (fd == -1) {
+    std::cout << "mkstemp() failed\n";
+    return EXIT_FAILURE;
+  }
+  close(fd);
+  std::string path{path_template};
+
+  Trace trace{};
+  std::ofstream{path} << "time,mbps\n0,1.5\n# comment\n1 \t 0\n2,2\n";
+  CHECK(load_trace(path, 1000, trace));
+  CHECK((trace.times == std::vector<double>{0, 1, 2}));
+  CHECK((trace.kbps == std::vector<double>{1500, 0, 2000}));
+  for (const char *unusable :
+       {"0 1\n0 1\n", "0 1\n2 -1\n3 1\n", "0 0\n1 0\n2 5\n", "0 1\n", ""}) {
+    Trace rejected{};
+    std::ofstream{path} << unusable;
+    CHECK(!load_trace(path, 1, rejected));
+  }
+  unlink(path.c_str());
+  Trace missing{};
+  CHECK(!load_trace(path, 1, missing));
+
+  // 1000 Kbps for a second, then none for a second, then around again.
+  Trace on_off{"on_off", {0, 1, 2}, {1000, 0, 0}};
+  TraceCursor cursor{on_off};
+  CHECK(is_near(cursor.transfer(500), 0.5));
+  CHECK(is_near(cursor.transfer(1000), 2.0));
+  cursor.wait(0.25);
+  CHECK(is_near(cursor.transfer(250), 0.25));
+  CHECK(is_near(cursor.transfer(0), 0));
+  cursor.wait(0.5);
+  CHECK(is_near(cursor.transfer(100), 0.6));
+
+  // On a fast link the first segment is at the lowest bitrate and every
+  // later one at the highest, with no stalls.
+  Video video{"video", {500, 1000, 2000}, 2.0, 20.0};
+  Trace fast{"fast", {0, 1000}, {10000, 10000}};
+  Qoe qoe{play(video, fast, settings(1.0, 30.0))};
+  CHECK(is_near(qoe.startup_s, 0.1));
+  CHECK(qoe.no_of_switches == 1);
+  CHECK(is_near(qoe.rebuffer_s, 0));
+  CHECK(is_near(qoe.average_bitrate, (500 + 9 * 2000) / 10.0));
+
+  // At 200 Kbps even the lowest bitrate takes 5 s a segment, so the player
+  // stalls for 3 s before every segment after the first.
+  Trace slow{"slow", {0, 1000}, {200, 200}};
+  qoe = play(video, slow, settings(0.5, 30.0));
+  CHECK(is_near(qoe.startup_s, 5.0));
+  CHECK(qoe.no_of_switches == 0);
+  CHECK(is_near(qoe.rebuffer_s, 9 * 3.0));
+  CHECK(is_near(qoe.average_bitrate, 500));
+
+  // A full buffer holds off the next fetch: on the on-off trace the fourth
+  // segment is fetched only once the link is down, and comes in after the
+  // half second of video buffered has played out.
+  Video short_video{"short", {100}, 0.5, 2.0};
+  qoe = play(short_video, on_off, settings(1.0, 0.5));
+  CHECK(is_near(qoe.startup_s, 0.05));
+  CHECK(is_near(qoe.rebuffer_s, 0.5));
+  return check_status();
+}
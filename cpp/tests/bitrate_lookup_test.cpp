@@ -0,0 +1,80 @@
+#include "buffer_pool.h"
+#include "check.h"
+#include "http.h"
+
+#include <cstring>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+// parse_bitrate_of_video() on the answers a videoserver may give a bitrate
+// lookup: only a 200 whose manifest lists video bitrates is recorded. An
+// error status (whatever its body), an HTML page, a manifest without video,
+// a body that is not XML and a message without the end of its header are
+// all refused, leaving what was recorded before as it was.
+
+// A NUL-terminated copy of text, as an HttpReader leaves a message.
+static BufferRef message(BufferPool &pool, std::string_view text) {
+  BufferRef buffer{pool.acquire(text.size() + 1)};
+  std::memcpy(buffer.data(), text.data(), text.size());
+  buffer.data()[text.size()] = '\0';
+  buffer.set_size(text.size());
+  return buffer;
+}
+
+static std::string response(const std::string &status,
+                            const std::string &body) {
+  return "HTTP/1.1 " + status + "\r\nContent-Length: " +
+         std::to_string(body.length()) + "\r\n\r\n" + body;
+}
+
+static const std::string MANIFEST{
+    "<?xml version=\"1.0\"?>\n"
+    "<MPD mediaPresentationDuration=\"PT1M0S\"><Period>"
+    "<AdaptationSet mimeType=\"audio/mp4\">"
+    "<Representation bandwidth=\"128000\"/></AdaptationSet>"
+    "<AdaptationSet mimeType=\"video/mp4\">"
+    "<SegmentTemplate duration=\"8000\" timescale=\"2000\"/>"
+    "<Representation bandwidth=\"500\"/>"
+    "<Representation bandwidth=\"1500\"/></AdaptationSet>"
+    "</Period></MPD>"};
+
+int main() {
+  BufferPool pool{};
+  std::unordered_map<std::string, std::vector<int>> bitrate_of_video{
+      {"/videos/old", {100, 200}}};
+  std::unordered_map<std::string, double> segment_duration_of_video{};
+
+  auto parse = [&](const std::string &text, const std::string &path) {
+    return parse_bitrate_of_video(message(pool, text), bitrate_of_video,
+                                  segment_duration_of_video, path);
+  };
+
+  CHECK(!parse(response("404 Not Found", MANIFEST), "/videos/a"));
+  CHECK(!parse(response("503 Service Unavailable", ""), "/videos/a"));
+  CHECK(!parse(response("200 OK", "<html><body>Sign in</body></html>"),
+               "/videos/a"));
+  CHECK(!parse(response("200 OK",
+                        "<MPD><Period><AdaptationSet mimeType=\"audio/mp4\">"
+                        "<Representation bandwidth=\"128000\"/>"
+                        "</AdaptationSet></Period></MPD>"),
+               "/videos/a"));
+  CHECK(!parse(response("200 OK", "<MPD><Period>"), "/videos/a"));
+  CHECK(!parse(response("200 OK", ""), "/videos/a"));
+  CHECK(!parse("HTTP/1.1 200 OK\r\nContent-Length: 5\r\n", "/videos/a"));
+  CHECK(!parse("not HTTP\r\n\r\n" + MANIFEST, "/videos/a"));
+  CHECK(!bitrate_of_video.contains("/videos/a"));
+  CHECK(segment_duration_of_video.empty());
+
+  // A failed lookup of a video known already leaves what it had.
+  CHECK(!parse(response("500 Internal Server Error", ""), "/videos/old"));
+  CHECK((bitrate_of_video.at("/videos/old") == std::vector<int>{100, 200}));
+
+  CHECK(parse(response("200 OK", MANIFEST), "/videos/a"));
+  CHECK((bitrate_of_video.at("/videos/a") == std::vector<int>{500, 1500}));
+  CHECK(segment_duration_of_video.at("/videos/a") == 4.0);
+  CHECK(bitrate_of_video.size() == 2);
+
+  return check_status();
+}
@@ -0,0 +1,105 @@
+#include "buffer_pool.h"
+#include "check.h"
+#include "poller.h"
+#include "write_queue.h"
+
+#include <cstring>
+#include <string>
+#include <sys/socket.h>
+#include <unistd.h>
+
+// BufferPool size classes, reference counting and reuse, then WriteQueues
+// relaying pooled buffers to a client that takes them slowly: what the
+// socket does not take stays queued, kept alive by its buffer after every
+// other reference is gone, and goes out in order as the client drains it.
+
+// Whether capacity is the size class for a request of size bytes: a power
+// of two from BUFFER_POOL_MIN_SIZE up, less than twice the size.
+static bool is_class_for(size_t capacity, size_t size) {
+  return capacity >= BUFFER_POOL_MIN_SIZE && (capacity & (capacity - 1)) == 0 &&
+         capacity >= size && (capacity == BUFFER_POOL_MIN_SIZE ||
+                              capacity < 2 * size);
+}
+
+int main() {
+  BufferPool pool{};
+  for (size_t size : {size_t{0}, size_t{1}, size_t{4096}, size_t{4097},
+                      size_t{100000}, size_t{BUFFER_POOL_CHUNK_SIZE}}) {
+    BufferRef buffer{pool.acquire(size)};
+    CHECK(buffer && buffer.size() == 0);
+    CHECK(is_class_for(buffer.capacity(), size));
+  }
+  BufferRef own{pool.acquire(BUFFER_POOL_CHUNK_SIZE + 1)};
+  CHECK(own.capacity() >= BUFFER_POOL_CHUNK_SIZE + 1);
+  own.data()[BUFFER_POOL_CHUNK_SIZE] = 'x';
+  own = {};
+  CHECK(!own);
+
+  // A buffer goes back to the pool with its last reference, and is lent
+  // out again from there.
+  BufferRef first{pool.copy_of("manifest")};
+  CHECK(first.view() == "manifest");
+  char *data{first.data()};
+  BufferRef copy{first}, moved{std::move(first)};
+  CHECK(!first && copy.data() == data && moved.data() == data);
+  copy = {};
+  CHECK(pool.acquire(10).data() != data);
+  moved = {};
+  BufferRef again{pool.acquire(10)};
+  CHECK(again.data() == data && again.size() == 0);
+
+  int fds[2];
+  if (socketpair(AF_UNIX, SOCK_STREAM, 0, fds) == -1) {
+    std::cout << "socketpair() failed\n";
+    return EXIT_FAILURE;
+  }
+  EpollPoller poller{};
+  if (!poller.start()) {
+    std::cout << "epoll unavailable\n";
+    return EXIT_FAILURE;
+  }
+  poller.add_socket(fds[0]);
+  WriteQueues write_queues{poller};
+
+  // More than the socket takes at once, from a buffer nobody else holds by
+  // the time it is sent.
+  std::string expected(3 * 1024 * 1024, '\0');
+  for (size_t i = 0; i < expected.size(); ++i) {
+    expected[i] = static_cast<char>('a' + i % 26);
+  }
+  CHECK(write_queues.write(fds[0], pool.copy_of(expected)));
+  CHECK(write_queues.no_of_queued_bytes(fds[0]) > 0);
+  CHECK(write_queues.write(fds[0], "HTTP/1.1 200 OK\r\n"));
+  CHECK(write_queues.write(fds[0], ""));
+  BufferRef last{pool.copy_of("last")};
+  CHECK(write_queues.write(fds[0], last.view().substr(1), last));
+  last = {};
+  expected += "HTTP/1.1 200 OK\r\nast";
+
+  std::string received{};
+  char chunk[64 * 1024];
+  while (received.size() < expected.size()) {
+    long curr{recv(fds[1], chunk, sizeof(chunk), MSG_DONTWAIT)};
+    if (curr > 0) {
+      received.append(chunk, curr);
+    } else if (write_queues.no_of_queued_bytes(fds[0]) == 0) {
+      break; // Nothing more is coming.
+    }
+    CHECK(write_queues.flush(fds[0]));
+  }
+  CHECK(received == expected);
+  CHECK(write_queues.no_of_queued_bytes(fds[0]) == 0);
+  CHECK(write_queues.no_of_bytes_sent() == expected.size());
+
+  // Nothing is queued once a socket is removed; writes to a socket whose
+  // peer is gone fail.
+  CHECK(write_queues.write(fds[0], pool.copy_of(expected)));
+  write_queues.remove(fds[0]);
+  CHECK(write_queues.no_of_queued_bytes(fds[0]) == 0);
+  close(fds[1]);
+  CHECK(!write_queues.write(fds[0], "gone"));
+
+  poller.remove(fds[0]);
+  close(fds[0]);
+  return check_status();
+}
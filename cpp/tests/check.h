@@ -0,0 +1,31 @@
+#ifndef CHECK_H
+#define CHECK_H
+
+#include <cstdlib>
+#include <iostream>
+
+// The checks of the tests, each of which is a program of its own: a failed
+// CHECK() is reported with where it is and what it tried, and the program
+// goes on, so that it reports every check that fails. main() returns
+// check_status().
+
+inline int no_of_failed_checks{0};
+
+#define CHECK(condition)                                                       \
+  do {                                                                         \
+    if (!(condition)) {                                                        \
+      ++no_of_failed_checks;                                                   \
+      std::cout << __FILE__ << ':' << __LINE__ << ": CHECK(" #condition       \
+                << ") failed\n";                                               \
+    }                                                                          \
+  } while (false)
+
+inline int check_status() {
+  if (no_of_failed_checks > 0) {
+    std::cout << no_of_failed_checks << " checks failed\n";
+    return EXIT_FAILURE;
+  }
+  return EXIT_SUCCESS;
+}
+
+#endif // !CHECK_H
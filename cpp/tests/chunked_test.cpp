@@ -0,0 +1,203 @@
+#include "check.h"
+#include "chunked.h"
+
+#include <cstdint>
+#include <cstdio>
+#include <random>
+#include <string>
+#include <string_view>
+
+// ChunkedDecoder, fed a body in random pieces, against a parser of the whole
+// body at once, on chunked bodies that are well-formed, cut short or
+// corrupted.
+
+enum class Verdict { DONE, MALFORMED, INCOMPLETE };
+
+struct Parse {
+  Verdict verdict;
+  // Past the body if it is done, at the byte that makes it malformed, or
+  // the end of the input.
+  size_t end;
+  std::string decoded;
+};
+
+static int hex_value(char c) {
+  const std::string_view digits{"0123456789abcdef"}, upper{"ABCDEF"};
+  if (size_t i{digits.find(c)}; i != std::string_view::npos) {
+    return static_cast<int>(i);
+  }
+  if (size_t i{upper.find(c)}; i != std::string_view::npos) {
+    return static_cast<int>(i) + 10;
+  }
+  return -1;
+}
+
+static Parse brute_force_parse(std::string_view body) {
+  Parse parse{Verdict::INCOMPLETE, body.length(), {}};
+  auto malformed{[&](size_t at) {
+    parse.verdict = Verdict::MALFORMED;
+    parse.end = at;
+    return parse;
+  }};
+  // Whether the line whose CR is the first at or after from is all in, and
+  // if so, end at the byte after its CR, which has to be an LF.
+  auto line_end{[&](size_t from, size_t &end) {
+    size_t cr{body.find('\r', from)};
+    if (cr == std::string_view::npos || cr + 1 >= body.length()) {
+      return false;
+    }
+    end = cr + 1;
+    return true;
+  }};
+
+  size_t i{0};
+  while (true) {
+    uint64_t size{0};
+    size_t digits_start{i};
+    for (; i < body.length() && hex_value(body[i]) >= 0; ++i) {
+      size = size * 16 + hex_value(body[i]);
+      if (size > MAX_CHUNK_SIZE) {
+        return malformed(i);
+      }
+    }
+    if (i == body.length()) {
+      return parse;
+    }
+    if (i == digits_start) {
+      return malformed(i);
+    }
+    size_t lf;
+    if (body[i] == ';' || body[i] == ' ' || body[i] == '\t' ||
+        body[i] == '\r') {
+      if (!line_end(i, lf)) {
+        return parse;
+      }
+    } else {
+      return malformed(i);
+    }
+    if (body[lf] != '\n') {
+      return malformed(lf);
+    }
+    i = lf + 1;
+
+    if (size == 0) {
+      // Trailer fields, up to an empty line.
+      while (true) {
+        if (i == body.length()) {
+          return parse;
+        }
+        if (!line_end(body[i] == '\r' ? i : i + 1, lf)) {
+          return parse;
+        }
+        if (body[lf] != '\n') {
+          return malformed(lf);
+        }
+        bool is_last{body[i] == '\r'};
+        i = lf + 1;
+        if (is_last) {
+          parse.verdict = Verdict::DONE;
+          parse.end = i;
+          return parse;
+        }
+      }
+    }
+
+    if (body.length() - i < size) {
+      parse.decoded.append(body.substr(i));
+      return parse;
+    }
+    parse.decoded.append(body.substr(i, size));
+    i += size;
+    for (char c : {'\r', '\n'}) {
+      if (i == body.length()) {
+        return parse;
+      }
+      if (body[i] != c) {
+        return malformed(i);
+      }
+      ++i;
+    }
+  }
+}
+
+static std::string random_body(std::mt19937 &rng) {
+  std::string body;
+  int num_chunks{static_cast<int>(rng() % 5)};
+  for (int i = 0; i < num_chunks; ++i) {
+    size_t size{1 + rng() % 300};
+    char size_str[32];
+    snprintf(size_str, sizeof(size_str), rng() % 2 == 0 ? "%zx" : "%zX",
+             size);
+    body += std::string(rng() % 3, '0') + size_str;
+    if (rng() % 4 == 0) {
+      body += rng() % 2 == 0 ? ";name=value" : " ;ext";
+    }
+    body += "\r\n";
+    for (size_t j = 0; j < size; ++j) {
+      body += static_cast<char>(rng());
+    }
+    body += "\r\n";
+  }
+  body += rng() % 4 == 0 ? "0;last\r\n" : "0\r\n";
+  for (int i = static_cast<int>(rng() % 3); i > 0; --i) {
+    body += "Trailer-" + std::to_string(i) + ": x\r\n";
+  }
+  return body + "\r\n";
+}
+
+// Break body in some way: cut it short, or change, add or drop a byte.
+static std::string corrupt(std::string body, std::mt19937 &rng) {
+  size_t at{rng() % body.length()};
+  const std::string_view likely{"\r\n0123456789abcdefxyz; \t"};
+  char c{rng() % 2 == 0 ? likely[rng() % likely.length()]
+                        : static_cast<char>(rng())};
+  switch (rng() % 4) {
+  case 0:
+    return body.substr(0, at);
+  case 1:
+    body[at] = c;
+    return body;
+  case 2:
+    return body.insert(at, 1, c);
+  default:
+    return body.erase(at, 1);
+  }
+}
+
+int main() {
+  std::mt19937 rng{41};
+  for (int round = 0; round < 20000; ++round) {
+    std::string body{random_body(rng)};
+    if (round % 2 == 1) {
+      body = corrupt(std::move(body), rng);
+    }
+    // The next message on the connection, which is none of the body's.
+    std::string input{body + "HTTP/1.1 200 OK\r\n"};
+    Parse expected{brute_force_parse(input)};
+
+    ChunkedDecoder decoder;
+    std::string decoded;
+    size_t consumed{0};
+    while (consumed < input.length()) {
+      size_t length{1 + rng() % (rng() % 2 == 0 ? 4 : 400)};
+      std::string_view piece{std::string_view{input}.substr(consumed, length)};
+      size_t used{decoder.feed(piece, &decoded)};
+      consumed += used;
+      if (used < piece.length()) {
+        break;
+      }
+    }
+    CHECK(decoder.is_done() == (expected.verdict == Verdict::DONE));
+    CHECK(decoder.is_malformed() == (expected.verdict == Verdict::MALFORMED));
+    CHECK(consumed == expected.end);
+    CHECK(decoded == expected.decoded);
+    if (round % 2 == 0) {
+      CHECK(decoder.is_done() && consumed == body.length());
+    }
+  }
+
+  // A chunk size past MAX_CHUNK_SIZE is malformed at its last digit.
+  ChunkedDecoder decoder;
+  CHECK(decoder.feed("10000000001\r\n") == 10 && decoder.is_malformed());
+  return check_status();
+}
@@ -0,0 +1,123 @@
+#include "check.h"
+#include "consistent_hash.h"
+
+#include <cmath>
+#include <cstdint>
+#include <random>
+#include <string>
+#include <vector>
+
+// ConsistentHashRing against a scan of every virtual node for the nearest
+// one clockwise whose videoserver has room.
+
+struct VirtualNode {
+  uint64_t point;
+  int server;
+};
+
+static std::vector<VirtualNode>
+virtual_nodes_of(const std::vector<Videoserver> &servers) {
+  std::vector<VirtualNode> nodes;
+  for (size_t i = 0; i < servers.size(); ++i) {
+    for (int j = 0; j < CHASH_VIRTUAL_NODES; ++j) {
+      std::string name{servers[i].name + "#" + std::to_string(j)};
+      nodes.push_back({hash_content_key(name.c_str(), name.length()),
+                       static_cast<int>(i)});
+    }
+  }
+  return nodes;
+}
+
+static int brute_force_choose(const std::vector<VirtualNode> &nodes,
+                              size_t num_servers, uint64_t key_hash,
+                              const std::vector<uint64_t> &load_of_server) {
+  uint64_t total_load{1};
+  for (uint64_t load : load_of_server) {
+    total_load += load;
+  }
+  double capacity{std::ceil(CHASH_LOAD_FACTOR * total_load / num_servers)};
+  // Clockwise of key_hash: the least distance, wrapping around, and of
+  // virtual nodes at the same point, that of the first videoserver.
+  const VirtualNode *nearest{nullptr};
+  for (const auto &node : nodes) {
+    if (load_of_server[node.server] + 1 > capacity) {
+      continue;
+    }
+    if (nearest == nullptr ||
+        node.point - key_hash < nearest->point - key_hash ||
+        (node.point == nearest->point && node.server < nearest->server)) {
+      nearest = &node;
+    }
+  }
+  return nearest == nullptr ? -1 : nearest->server;
+}
+
+static std::vector<Videoserver> make_servers(size_t num_servers) {
+  std::vector<Videoserver> servers(num_servers);
+  for (size_t i = 0; i < num_servers; ++i) {
+    servers[i].name = "10.0.0." + std::to_string(i + 1) + ":8000";
+  }
+  return servers;
+}
+
+int main() {
+  std::mt19937_64 rng{28};
+
+  std::vector<uint64_t> no_load;
+  CHECK(ConsistentHashRing{{}}.choose(rng(), no_load) == -1);
+
+  for (size_t num_servers : {1, 2, 3, 7, 16}) {
+    auto servers{make_servers(num_servers)};
+    auto nodes{virtual_nodes_of(servers)};
+    ConsistentHashRing ring{servers};
+
+    // Sessions come and go at random; every one goes where the scan puts
+    // it, and no videoserver ever carries more than its bound.
+    std::vector<uint64_t> load_of_server(num_servers, 0);
+    for (int i = 0; i < 5000; ++i) {
+      if (rng() % 3 == 0) {
+        size_t server{rng() % num_servers};
+        if (load_of_server[server] > 0) {
+          --load_of_server[server];
+        }
+        continue;
+      }
+      uint64_t key_hash{rng()};
+      int server{ring.choose(key_hash, load_of_server)};
+      CHECK(server ==
+            brute_force_choose(nodes, num_servers, key_hash, load_of_server));
+      if (server < 0) {
+        continue;
+      }
+      uint64_t total_load{1};
+      for (uint64_t load : load_of_server) {
+        total_load += load;
+      }
+      CHECK(load_of_server[server] + 1 <=
+            std::ceil(CHASH_LOAD_FACTOR * total_load / num_servers));
+      ++load_of_server[server];
+    }
+
+    // Keys hash onto virtual nodes exactly too.
+    std::vector<uint64_t> idle(num_servers, 0);
+    for (const auto &node : nodes) {
+      CHECK(ring.choose(node.point, idle) ==
+            brute_force_choose(nodes, num_servers, node.point, idle));
+    }
+
+    // Removing a videoserver moves only the keys that were on it.
+    if (num_servers > 1) {
+      std::vector<Videoserver> fewer{servers.begin(), servers.end() - 1};
+      ConsistentHashRing smaller{fewer};
+      std::vector<uint64_t> idle_fewer(num_servers - 1, 0);
+      for (int i = 0; i < 1000; ++i) {
+        std::string key{"/videos/" + std::to_string(rng()) + "/"};
+        uint64_t key_hash{hash_content_key(key.c_str(), key.length())};
+        int before{ring.choose(key_hash, idle)};
+        int after{smaller.choose(key_hash, idle_fewer)};
+        CHECK(before == static_cast<int>(num_servers - 1) || before == after);
+      }
+    }
+  }
+  return check_status();
+}
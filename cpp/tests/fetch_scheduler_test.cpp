@@ -0,0 +1,112 @@
+#include "check.h"
+#include "fetch_scheduler.h"
+
+#include <chrono>
+#include <optional>
+#include <string>
+
+// FetchScheduler on hand-built beacons and fetches: the playback buffer each
+// deadline comes from, fetches going out earliest deadline first once
+// max_inflight are out, ties in arrival order, and clients at their fair
+// share waiting while others are queued.
+
+using namespace std::chrono_literals;
+using Clock = FetchScheduler::Clock;
+
+static bool submit(FetchScheduler &scheduler, int socket,
+                   const std::string &uuid, double segment_duration_s,
+                   const std::string &request) {
+  return scheduler.submit(socket, uuid, segment_duration_s, 0, request);
+}
+
+// The request of the next fetch to go out, or "" if none may.
+static std::string next_request(FetchScheduler &scheduler) {
+  std::optional<FetchScheduler::Fetch> fetch{scheduler.next()};
+  return fetch ? fetch->request : "";
+}
+
+int main() {
+  Clock::time_point now{Clock::now()};
+
+  // Without a limit nothing is held back.
+  FetchScheduler unlimited{0};
+  for (int i = 0; i < 10; ++i) {
+    CHECK(submit(unlimited, 1, "a", 2.0, "GET a"));
+  }
+  CHECK(unlimited.no_of_queued() == 0 && next_request(unlimited).empty());
+
+  // A beacon adds a segment of the duration last submitted (the default
+  // before any), and the buffer drains by the time between the ends of two
+  // downloads, never below empty.
+  FetchScheduler scheduler{1};
+  scheduler.on_fragment_received("a", 1000, now);
+  CHECK(scheduler.deadline_of("a") ==
+        now + std::chrono::duration_cast<Clock::duration>(
+                  std::chrono::duration<double>{DEFAULT_SEGMENT_DURATION_S}));
+  CHECK(submit(scheduler, 1, "a", 4.0, "GET a1"));
+  scheduler.on_fragment_received("a", 2500, now + 1s);
+  CHECK(scheduler.deadline_of("a") == now + 1s + 4500ms);
+  scheduler.on_fragment_received("a", 2000, now + 2s);
+  CHECK(scheduler.deadline_of("a") == now + 2s + 8500ms);
+  scheduler.on_fragment_received("a", 60000, now + 3s);
+  CHECK(scheduler.deadline_of("a") == now + 3s + 4s);
+
+  // Queued fetches go out earliest deadline first, one per completion: b's
+  // buffer holds one segment of the default duration, d's two and c's three.
+  for (int i = 0; i < 3; ++i) {
+    scheduler.on_fragment_received("c", 0, now);
+  }
+  scheduler.on_fragment_received("d", 0, now);
+  scheduler.on_fragment_received("d", 0, now);
+  scheduler.on_fragment_received("b", 0, now);
+  CHECK(!submit(scheduler, 3, "c", 2.0, "GET c"));
+  CHECK(!submit(scheduler, 4, "d", 2.0, "GET d"));
+  CHECK(!submit(scheduler, 2, "b", 2.0, "GET b"));
+  CHECK(scheduler.no_of_queued() == 3);
+  CHECK(next_request(scheduler).empty());
+  scheduler.complete(1);
+  CHECK(next_request(scheduler) == "GET b");
+  CHECK(next_request(scheduler).empty());
+  scheduler.complete(2);
+  CHECK(next_request(scheduler) == "GET d");
+  scheduler.complete(4);
+  CHECK(next_request(scheduler) == "GET c");
+  scheduler.complete(3);
+  CHECK(scheduler.no_of_queued() == 0);
+
+  // Equal deadlines go in arrival order. A removed client's fetches are
+  // dropped, in flight or queued.
+  scheduler.on_fragment_received("g", 0, now);
+  scheduler.on_fragment_received("h", 0, now);
+  CHECK(submit(scheduler, 1, "a", 4.0, "GET a2"));
+  CHECK(!submit(scheduler, 5, "e", 2.0, "GET e"));
+  CHECK(!submit(scheduler, 8, "h", 2.0, "GET h"));
+  CHECK(!submit(scheduler, 7, "g", 2.0, "GET g"));
+  scheduler.remove(5);
+  CHECK(scheduler.no_of_queued() == 2);
+  scheduler.remove(1);
+  CHECK(next_request(scheduler) == "GET h");
+  scheduler.complete(8);
+  CHECK(next_request(scheduler) == "GET g");
+  scheduler.complete(7);
+  CHECK(scheduler.no_of_queued() == 0);
+
+  // With two fetches in flight and two clients, the fair share is one each:
+  // a client already at it waits for another whose deadline is later, but
+  // takes an idle slot if nobody else is waiting.
+  FetchScheduler shared{2};
+  shared.on_fragment_received("x", 0, now);
+  shared.on_fragment_received("y", 0, now);
+  shared.on_fragment_received("y", 0, now);
+  CHECK(submit(shared, 1, "x", 2.0, "GET x1"));
+  CHECK(submit(shared, 1, "x", 2.0, "GET x2"));
+  CHECK(!submit(shared, 1, "x", 2.0, "GET x3"));
+  CHECK(!submit(shared, 2, "y", 2.0, "GET y1"));
+  shared.complete(1);
+  CHECK(next_request(shared) == "GET y1");
+  CHECK(next_request(shared).empty());
+  shared.complete(2);
+  CHECK(next_request(shared) == "GET x3");
+
+  return check_status();
+}
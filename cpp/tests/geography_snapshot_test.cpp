@@ -0,0 +1,202 @@
+#include "check.h"
+#include "geography_snapshot.h"
+#include "nearest_server.h"
+#include "server_info.h"
+
+#include <arpa/inet.h>
+#include <cstdlib>
+#include <fstream>
+#include <iterator>
+#include <optional>
+#include <string>
+#include <unistd.h>
+#include <vector>
+
+// Geography snapshots written from a geography file and read back: the
+// links, clients, servers, labels and closest-server table all as built from
+// the file, labels repaired alike after link changes, a snapshot still in
+// use surviving its replacement, and truncated or foreign files rejected.
+
+#define GRID_SIDE 8
+#define NO_OF_CLIENTS 8
+#define NO_OF_SERVERS 4
+
+// A grid of switches linked both ways, with clients linked into it and
+// servers out of it, the clients at nested prefixes.
+static std::string geography_file() {
+  int no_of_switches{GRID_SIDE * GRID_SIDE};
+  std::string nodes{}, links{};
+  int no_of_links{0};
+  auto link{[&](int from, int to, int cost) {
+    links += std::to_string(from) + " " + std::to_string(to) + " " +
+             std::to_string(cost) + "\n";
+    ++no_of_links;
+  }};
+  for (int i = 0; i < GRID_SIDE; ++i) {
+    for (int j = 0; j < GRID_SIDE; ++j) {
+      nodes += "SWITCH NO_IP\n";
+      int node{i * GRID_SIDE + j};
+      if (j + 1 < GRID_SIDE) {
+        link(node, node + 1, (i * 7 + j * 3) % 10 + 1);
+        link(node + 1, node, (i * 3 + j * 7) % 10 + 1);
+      }
+      if (i + 1 < GRID_SIDE) {
+        link(node, node + GRID_SIDE, (i * 5 + j * 11) % 10 + 1);
+        link(node + GRID_SIDE, node, (i * 11 + j * 5) % 10 + 1);
+      }
+    }
+  }
+  for (int k = 0; k < NO_OF_CLIENTS; ++k) {
+    nodes += k % 2 == 0 ? "CLIENT 10." + std::to_string(k) + ".0.0/16\n"
+                        : "CLIENT 10." + std::to_string(k - 1) + "." +
+                              std::to_string(k) + ".0/24\n";
+    link(no_of_switches + k, (k * 13) % no_of_switches, 1);
+  }
+  for (int k = 0; k < NO_OF_SERVERS; ++k) {
+    nodes += "SERVER 10.100.0." + std::to_string(k + 1) + "\n";
+    link((k * 29 + 5) % no_of_switches, no_of_switches + NO_OF_CLIENTS + k,
+         2);
+  }
+  return "NUM_NODES: " +
+         std::to_string(no_of_switches + NO_OF_CLIENTS + NO_OF_SERVERS) +
+         "\n" + nodes + "NUM_LINKS: " + std::to_string(no_of_links) + "\n" +
+         links;
+}
+
+static bool is_same_links(const LinkGraph &a, const LinkGraph &b) {
+  if (a.num_nodes() != b.num_nodes()) {
+    return false;
+  }
+  for (int node = 0; node < a.num_nodes(); ++node) {
+    auto a_links{a.links_of(node)}, b_links{b.links_of(node)};
+    if (a_links.size() != b_links.size()) {
+      return false;
+    }
+    for (size_t i = 0; i < a_links.size(); ++i) {
+      if (a_links[i].to != b_links[i].to ||
+          a_links[i].cost != b_links[i].cost) {
+        return false;
+      }
+    }
+  }
+  return true;
+}
+
+static bool is_same_labels(const NearestServerLabels &a,
+                           const NearestServerLabels &b, int num_nodes) {
+  for (int node = 0; node < num_nodes; ++node) {
+    if (a.server_of(node) != b.server_of(node) ||
+        a.dist_of(node) != b.dist_of(node) ||
+        a.next_hop_of(node) != b.next_hop_of(node)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+// Whether the tables map every address in 10.0.0.0/12 alike.
+static bool is_same_table(const PrefixTable &a, const PrefixTable &b) {
+  for (uint32_t addr = 0x0a000000; addr < 0x0a100000; addr += 0x37) {
+    if (a.lookup(htonl(addr)) != b.lookup(htonl(addr))) {
+      return false;
+    }
+  }
+  return true;
+}
+
+int main() {
+  char dir_template[]{"/tmp/geography_snapshot_test.XXXXXX"};
+  if (mkdtemp(dir_template) == nullptr) {
+    std::cout << "mkdtemp() failed\n";
+    return EXIT_FAILURE;
+  }
+  std::string dir{dir_template}, text_path{dir + "/geography.txt"},
+      path{dir + "/geography.snap"}, bad_path{dir + "/bad.snap"};
+  std::ofstream{text_path} << geography_file();
+
+  Geography geography{};
+  std::vector<Videoserver> servers{};
+  CHECK(read_geography(text_path, geography, servers));
+  CHECK(servers.size() == NO_OF_SERVERS);
+  NearestServerLabels labels{geography};
+  PrefixTable table{build_closest_server_table(geography, labels)};
+  CHECK(table.lookup(inet_addr("10.2.9.9")) != -1);
+  CHECK(!is_geography_snapshot(text_path));
+  CHECK(write_geography_snapshot(path, geography, servers, labels, table));
+  CHECK(is_geography_snapshot(path));
+
+  Geography read{};
+  std::vector<Videoserver> read_servers{};
+  std::optional<NearestServerLabels> read_labels{};
+  std::optional<PrefixTable> read_table{};
+  CHECK(read_geography_snapshot(path, read, read_servers, read_labels,
+                                read_table));
+  if (!read_labels || !read_table) {
+    return check_status();
+  }
+  CHECK(read.num_nodes == geography.num_nodes);
+  CHECK(read.client_nodes == geography.client_nodes);
+  CHECK(read.server_nodes == geography.server_nodes);
+  CHECK(read.client_prefixes == geography.client_prefixes);
+  CHECK(read.client_demands == geography.client_demands);
+  CHECK(read.server_capacities == geography.server_capacities);
+  CHECK(is_same_links(read.links, geography.links));
+  CHECK(read_servers.size() == servers.size());
+  for (size_t i = 0; i < servers.size() && i < read_servers.size(); ++i) {
+    CHECK(read_servers[i].response.videoserver_addr ==
+          servers[i].response.videoserver_addr);
+    CHECK(read_servers[i].response.videoserver_port ==
+          servers[i].response.videoserver_port);
+    CHECK(read_servers[i].name == servers[i].name);
+  }
+  CHECK(is_same_labels(*read_labels, labels, geography.num_nodes));
+  CHECK(is_same_links(read_labels->in_links(), labels.in_links()));
+  CHECK(is_same_table(*read_table, table));
+
+  // Replacing the snapshot leaves the one in use intact; link changes
+  // repair the labels read from it as they do those built from the file.
+  NearestServerLabels fresh{geography};
+  Geography empty{};
+  CHECK(write_geography_snapshot(path, empty, {}, NearestServerLabels{empty},
+                                 PrefixTable{}));
+  for (int node = 0; node < GRID_SIDE * GRID_SIDE; node += 9) {
+    int to{node + 1 < GRID_SIDE * GRID_SIDE ? node + 1 : 0};
+    CHECK(fresh.set_link(node, to, 100) ==
+          read_labels->set_link(node, to, 100));
+    CHECK(fresh.set_link(to, node, -1) == read_labels->set_link(to, node, -1));
+  }
+  CHECK(is_same_labels(*read_labels, fresh, geography.num_nodes));
+  // The table read is copied on its first insert, not written through.
+  int closest{table.lookup(inet_addr("10.2.9.9"))};
+  read_table->insert(inet_addr("10.2.9.0"), 24, closest + 1);
+  CHECK(read_table->lookup(inet_addr("10.2.9.9")) == closest + 1);
+  CHECK(read_table->lookup(inet_addr("10.2.8.9")) == closest);
+
+  // A truncated snapshot, or anything but a snapshot of this version, is
+  // rejected.
+  CHECK(write_geography_snapshot(path, geography, servers, labels, table));
+  std::ifstream file{path, std::ios::binary};
+  std::string bytes{std::istreambuf_iterator<char>{file}, {}};
+  for (size_t size : {size_t{0}, size_t{7}, size_t{64}, bytes.size() / 2,
+                      bytes.size() - 1}) {
+    std::ofstream{bad_path, std::ios::binary} << bytes.substr(0, size);
+    Geography bad{};
+    CHECK(!read_geography_snapshot(bad_path, bad, read_servers, read_labels,
+                                   read_table));
+  }
+  std::string foreign{bytes};
+  foreign[0] ^= 1;
+  std::ofstream{bad_path, std::ios::binary} << foreign;
+  CHECK(!is_geography_snapshot(bad_path));
+  Geography bad{};
+  CHECK(!read_geography_snapshot(bad_path, bad, read_servers, read_labels,
+                                 read_table));
+  CHECK(!read_geography_snapshot(dir + "/missing.snap", bad, read_servers,
+                                 read_labels, read_table));
+
+  unlink(text_path.c_str());
+  unlink(path.c_str());
+  unlink(bad_path.c_str());
+  rmdir(dir.c_str());
+  return check_status();
+}
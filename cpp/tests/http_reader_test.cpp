@@ -0,0 +1,116 @@
+#include "buffer_pool.h"
+#include "check.h"
+#include "http.h"
+#include "poller.h"
+
+#include <stdexcept>
+#include <string>
+#include <sys/socket.h>
+#include <thread>
+#include <unistd.h>
+
+// HttpReader on messages too large to read whole: a Content-Length over
+// MAX_HTTP_BODY_SIZE, one that does not fit in 64 bits and one that would
+// wrap the size of the message all fail the connection before any buffer is
+// sized by them, as does a chunked body that grows past the cap. A message
+// under the cap is still read, and a pool that cannot map a buffer hands out
+// an empty one rather than exiting.
+
+// A connected pair of sockets, the first added to poller.
+static bool connect_pair(EpollPoller &poller, int fds[2]) {
+  if (socketpair(AF_UNIX, SOCK_STREAM, 0, fds) == -1) {
+    return false;
+  }
+  poller.add_socket(fds[0]);
+  return true;
+}
+
+static void close_pair(EpollPoller &poller, int fds[2]) {
+  poller.remove(fds[0]);
+  close(fds[0]);
+  close(fds[1]);
+}
+
+// Read the message with header on a fresh connection: whether the read
+// failed the connection.
+static bool fails(EpollPoller &poller, BufferPool &pool,
+                  const std::string &header) {
+  int fds[2];
+  if (!connect_pair(poller, fds)) {
+    return false;
+  }
+  send(fds[1], header.data(), header.length(), 0);
+  HttpReader reader{};
+  bool is_failed{false};
+  try {
+    reader.read(poller, fds[0], pool);
+  } catch (const std::runtime_error &e) {
+    is_failed = true;
+  }
+  close_pair(poller, fds);
+  return is_failed;
+}
+
+int main() {
+  BufferPool pool{};
+  CHECK(!pool.acquire(SIZE_MAX));
+  CHECK(!pool.acquire(SIZE_MAX - BUFFER_POOL_CHUNK_SIZE));
+  CHECK(!pool.acquire(size_t{1} << 60));
+  CHECK(pool.acquire(BUFFER_POOL_CHUNK_SIZE + 1));
+
+  EpollPoller poller{};
+  if (!poller.start()) {
+    std::cout << "epoll unavailable\n";
+    return EXIT_FAILURE;
+  }
+  std::string request{"POST /beacon HTTP/1.1\r\nContent-Length: "};
+  CHECK(fails(poller, pool, request + "10000000000000\r\n\r\n"));
+  CHECK(fails(poller, pool,
+              request + std::to_string(MAX_HTTP_BODY_SIZE + 1) + "\r\n\r\n"));
+  CHECK(fails(poller, pool, request + "18446744073709551615\r\n\r\n"));
+  CHECK(fails(poller, pool, request + "18446744073709551616\r\n\r\n"));
+  CHECK(fails(poller, pool, request + "99999999999999999999999\r\n\r\n"));
+
+  // Under the cap, the message is read and what follows it left queued.
+  int fds[2];
+  CHECK(connect_pair(poller, fds));
+  std::string message{request + "5\r\n\r\nhello"}, next{"GET / HTTP/1.1\r\n"};
+  send(fds[1], (message + next).data(), message.length() + next.length(), 0);
+  HttpReader reader{};
+  BufferRef read{reader.read(poller, fds[0], pool)};
+  CHECK(read && read.view() == message);
+  char rest[64];
+  CHECK(recv(fds[0], rest, sizeof(rest), MSG_DONTWAIT) ==
+        static_cast<long>(next.length()));
+  close_pair(poller, fds);
+
+  // A chunked body is cut off once it is over the cap, however it is
+  // chunked.
+  CHECK(connect_pair(poller, fds));
+  std::thread sender{[fd = fds[1]]() {
+    std::string header{"HTTP/1.1 200 OK\r\nTransfer-Encoding: chunked\r\n\r\n"},
+        chunk{"10000\r\n" + std::string(0x10000, 'x') + "\r\n"};
+    if (send(fd, header.data(), header.length(), MSG_NOSIGNAL) == -1) {
+      return;
+    }
+    while (send(fd, chunk.data(), chunk.length(), MSG_NOSIGNAL) != -1) {
+    }
+  }};
+  bool is_failed{false};
+  PollEvent events[4];
+  while (!is_failed && poller.wait(events, 4) != -1) {
+    try {
+      reader.read(poller, fds[0], pool);
+    } catch (const std::runtime_error &e) {
+      is_failed = true;
+    }
+  }
+  CHECK(is_failed);
+  poller.remove(fds[0]);
+  shutdown(fds[0], SHUT_RDWR);
+  sender.join();
+  close(fds[0]);
+  close(fds[1]);
+
+  return check_status();
+}
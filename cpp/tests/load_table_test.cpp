@@ -0,0 +1,88 @@
+#include "check.h"
+#include "load_table.h"
+
+#include <arpa/inet.h>
+#include <chrono>
+#include <cstdint>
+#include <vector>
+
+// LoadTable on hand-made reports: sessions counted from fresh reports plus
+// the assignments they do not include yet, reports going stale, and
+// power-of-two choices between two videoservers, which always sees both.
+
+using namespace std::chrono_literals;
+
+static const std::chrono::steady_clock::time_point START{};
+
+static Videoserver videoserver(uint16_t port) {
+  Videoserver server{};
+  server.response.videoserver_addr = htonl(INADDR_LOOPBACK);
+  server.response.videoserver_port = htons(port);
+  return server;
+}
+
+static LoadReport load_report(uint16_t port, uint16_t interval_ms,
+                              uint32_t sessions, uint32_t egress_kbps) {
+  return {htonl(INADDR_LOOPBACK), htons(port), htons(interval_ms),
+          htonl(sessions), htonl(egress_kbps)};
+}
+
+int main() {
+  LoadTable empty{{}};
+  CHECK(empty.choose(START) == -1);
+
+  LoadTable table{{videoserver(8000), videoserver(8001)}};
+  CHECK(table.report(1, load_report(9000, 0, 5, 0), START) == -1);
+
+  // A report counts for STALE_AFTER_INTERVALS of its interval, and the
+  // default interval if it states none.
+  CHECK(table.report(1, load_report(8000, 100, 5, 0), START) == 0);
+  CHECK(table.sessions_of(0, START + 300ms) == 5);
+  CHECK(table.sessions_of(0, START + 301ms) == 0);
+  CHECK(table.report(1, load_report(8001, 0, 7, 0), START) == 1);
+  CHECK(table.sessions_of(1, START + 3000ms) == 7);
+  CHECK(table.sessions_of(1, START + 3001ms) == 0);
+
+  // An assignment counts until a later report includes it, or for
+  // ASSIGNMENT_TTL_MS.
+  auto now{START + 10s};
+  table.assign(0, now);
+  table.assign(0, now);
+  CHECK(table.sessions_of(0, now) == 2);
+  CHECK(table.sessions_of(0, now + std::chrono::milliseconds{
+                                       ASSIGNMENT_TTL_MS}) == 2);
+  CHECK(table.sessions_of(0, now + std::chrono::milliseconds{
+                                       ASSIGNMENT_TTL_MS + 1}) == 0);
+  now += 20s;
+  table.assign(0, now);
+  table.report(1, load_report(8000, 1000, 4, 0), now + 1ms);
+  CHECK(table.sessions_of(0, now + 1ms) == 4);
+
+  // With two videoservers, the one with fewer sessions is chosen and then
+  // counts the new session; on a tie, the one with less egress.
+  now += 1s;
+  table.report(1, load_report(8000, 1000, 3, 500), now);
+  table.report(1, load_report(8001, 1000, 1, 100), now);
+  CHECK(table.choose(now) == 1);
+  CHECK(table.choose(now) == 1);
+  CHECK(table.sessions_of(1, now) == 3);
+  CHECK(table.choose(now) == 1);
+  CHECK(table.choose(now) == 0);
+  table.report(1, load_report(8000, 1000, 2, 500), now + 1ms);
+  table.report(1, load_report(8001, 1000, 2, 100), now + 1ms);
+  CHECK(table.choose(now + 1ms) == 1);
+
+  // Reports of the same videoserver from different reporters add up, and an
+  // assignment counts until every one of them has reported since.
+  LoadTable shared{{videoserver(8000)}};
+  shared.report(1, load_report(8000, 1000, 2, 0), START);
+  shared.report(2, load_report(8000, 1000, 3, 0), START);
+  CHECK(shared.sessions_of(0, START) == 5);
+  CHECK(shared.choose(START + 10ms) == 0);
+  shared.report(1, load_report(8000, 1000, 2, 0), START + 20ms);
+  CHECK(shared.sessions_of(0, START + 20ms) == 6);
+  shared.report(2, load_report(8000, 1000, 4, 0), START + 30ms);
+  CHECK(shared.sessions_of(0, START + 30ms) == 6);
+
+  return check_status();
+}
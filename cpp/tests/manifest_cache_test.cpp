@@ -0,0 +1,87 @@
+#include "buffer_pool.h"
+#include "check.h"
+#include "manifest_cache.h"
+
+#include <chrono>
+#include <cstring>
+#include <string>
+#include <string_view>
+
+// ManifestCache through a revalidation cycle: a 200 cached and served until
+// its ttl passes, the conditional request from its validators, a 304
+// extending it, errors passed through without touching it, and a 304 for a
+// manifest that is not cached (e.g. evicted by a restart) passed through
+// rather than answered from nothing.
+
+using namespace std::chrono_literals;
+using Clock = ManifestCache::Clock;
+
+// A NUL-terminated copy of text, as an HttpReader leaves a message.
+static BufferRef message(BufferPool &pool, std::string_view text) {
+  BufferRef buffer{pool.acquire(text.size() + 1)};
+  std::memcpy(buffer.data(), text.data(), text.size());
+  buffer.data()[text.size()] = '\0';
+  buffer.set_size(text.size());
+  return buffer;
+}
+
+static bool contains(const std::string &text, std::string_view part) {
+  return text.find(part) != std::string::npos;
+}
+
+int main() {
+  BufferPool pool{};
+  Clock::time_point now{Clock::now()};
+
+  CHECK(!ManifestCache{0s}.is_enabled());
+  ManifestCache cache{10s};
+  CHECK(cache.is_enabled());
+  CHECK(cache.request_for("/videos/a") ==
+        "GET /videos/a/vid-no-list.mpd HTTP/1.1\r\ncontent-length: 0\r\n\r\n");
+
+  // Nothing cached: a 304 or an error is passed on as it is and not kept.
+  BufferRef not_modified{message(pool, "HTTP/1.1 304 Not Modified\r\n\r\n")};
+  BufferRef sent{cache.on_response("/videos/a", not_modified, now)};
+  CHECK(sent.data() == not_modified.data());
+  BufferRef error{message(pool, "HTTP/1.1 500 Internal Server Error\r\n"
+                                "Content-Length: 0\r\n\r\n")};
+  CHECK(cache.on_response("/videos/a", error, now).data() == error.data());
+  CHECK(!cache.find_fresh("/videos/a", now));
+  CHECK(!contains(cache.request_for("/videos/a"), "If-"));
+
+  // A 200 is kept and served until its ttl passes.
+  BufferRef manifest{message(pool, "HTTP/1.1 200 OK\r\n"
+                                   "ETag: \"v1\"\r\n"
+                                   "Last-Modified: Mon, 19 Oct 2026\r\n"
+                                   "Content-Length: 3\r\n\r\nmpd")};
+  CHECK(cache.on_response("/videos/a", manifest, now).data() ==
+        manifest.data());
+  CHECK(cache.find_fresh("/videos/a", now + 9s).data() == manifest.data());
+  CHECK(!cache.find_fresh("/videos/a", now + 10s));
+  CHECK(!cache.find_fresh("/videos/b", now));
+
+  // Once stale, it is revalidated, and a 304 keeps it for another ttl.
+  std::string request{cache.request_for("/videos/a")};
+  CHECK(contains(request, "If-None-Match: \"v1\"\r\n"));
+  CHECK(contains(request, "If-Modified-Since: Mon, 19 Oct 2026\r\n"));
+  CHECK(request.ends_with("content-length: 0\r\n\r\n"));
+  now += 11s;
+  CHECK(cache.on_response("/videos/a", not_modified, now).data() ==
+        manifest.data());
+  CHECK(cache.find_fresh("/videos/a", now + 9s).data() == manifest.data());
+
+  // An error leaves the cached response alone; a new 200 replaces it.
+  CHECK(cache.on_response("/videos/a", error, now).data() == error.data());
+  CHECK(cache.find_fresh("/videos/a", now).data() == manifest.data());
+  BufferRef changed{message(pool, "HTTP/1.1 200 OK\r\n"
+                                  "Last-Modified: Tue, 20 Oct 2026\r\n"
+                                  "Content-Length: 4\r\n\r\nmpd2")};
+  CHECK(cache.on_response("/videos/a", changed, now).data() ==
+        changed.data());
+  CHECK(cache.find_fresh("/videos/a", now).data() == changed.data());
+  request = cache.request_for("/videos/a");
+  CHECK(!contains(request, "If-None-Match"));
+  CHECK(contains(request, "If-Modified-Since: Tue, 20 Oct 2026\r\n"));
+
+  return check_status();
+}
@@ -0,0 +1,133 @@
+#include "check.h"
+#include "min_cost_flow.h"
+
+#include <climits>
+#include <cstdint>
+#include <random>
+#include <utility>
+#include <vector>
+
+// MinCostFlow against successive shortest paths by Bellman-Ford, one unit
+// of flow at a time, on small random graphs; and its flows checked to be
+// feasible and of least cost (no negative cycle left in the residual graph).
+
+struct Edge {
+  int from, to;
+  long long capacity, cost;
+};
+
+// The maximum flow from source to sink and its least cost.
+static std::pair<long long, long long>
+brute_force_min_cost_flow(int num_nodes, const std::vector<Edge> &edges,
+                          int source, int sink) {
+  // Residual edges in pairs, as MinCostFlow has them, but walked by
+  // Bellman-Ford, which needs no potentials.
+  std::vector<Edge> residual;
+  for (const auto &edge : edges) {
+    residual.push_back(edge);
+    residual.push_back({edge.to, edge.from, 0, -edge.cost});
+  }
+  long long total_flow{0}, total_cost{0};
+  while (true) {
+    std::vector<long long> distance(num_nodes, LLONG_MAX);
+    std::vector<size_t> via(num_nodes, SIZE_MAX);
+    distance[source] = 0;
+    for (int round = 0; round < num_nodes; ++round) {
+      for (size_t i = 0; i < residual.size(); ++i) {
+        const auto &[from, to, capacity, cost] = residual[i];
+        if (capacity > 0 && distance[from] != LLONG_MAX &&
+            distance[from] + cost < distance[to]) {
+          distance[to] = distance[from] + cost;
+          via[to] = i;
+        }
+      }
+    }
+    if (distance[sink] == LLONG_MAX) {
+      return {total_flow, total_cost};
+    }
+    for (int node = sink; node != source; node = residual[via[node]].from) {
+      --residual[via[node]].capacity;
+      ++residual[via[node] ^ 1].capacity;
+    }
+    ++total_flow;
+    total_cost += distance[sink];
+  }
+}
+
+// Whether the residual graph of flows has a cycle of negative cost, i.e.
+// whether the flows could be made cheaper.
+static bool has_negative_cycle(int num_nodes, const std::vector<Edge> &edges,
+                               const std::vector<long long> &flows) {
+  std::vector<Edge> residual;
+  for (size_t i = 0; i < edges.size(); ++i) {
+    const auto &[from, to, capacity, cost] = edges[i];
+    if (flows[i] < capacity) {
+      residual.push_back({from, to, capacity - flows[i], cost});
+    }
+    if (flows[i] > 0) {
+      residual.push_back({to, from, flows[i], -cost});
+    }
+  }
+  // From every node at once, as if from a node linked to all of them.
+  std::vector<long long> distance(num_nodes, 0);
+  for (int round = 0; round <= num_nodes; ++round) {
+    bool is_relaxed{false};
+    for (const auto &[from, to, capacity, cost] : residual) {
+      if (distance[from] + cost < distance[to]) {
+        distance[to] = distance[from] + cost;
+        is_relaxed = true;
+      }
+    }
+    if (!is_relaxed) {
+      return false;
+    }
+  }
+  return true;
+}
+
+int main() {
+  std::mt19937 rng{29};
+  for (int round = 0; round < 500; ++round) {
+    int num_nodes{2 + static_cast<int>(rng() % 8)};
+    int num_edges{static_cast<int>(rng() % 25)};
+    std::vector<Edge> edges;
+    for (int i = 0; i < num_edges; ++i) {
+      int from{static_cast<int>(rng() % num_nodes)};
+      int to{static_cast<int>(rng() % num_nodes)};
+      if (from != to) {
+        edges.push_back({from, to, static_cast<long long>(rng() % 6),
+                         static_cast<long long>(rng() % 10)});
+      }
+    }
+    int source{0}, sink{num_nodes - 1};
+
+    MinCostFlow flow{num_nodes};
+    std::vector<size_t> ids;
+    for (const auto &[from, to, capacity, cost] : edges) {
+      ids.push_back(flow.add_edge(from, to, capacity, cost));
+    }
+    long long total_flow{flow.solve(source, sink)};
+
+    std::vector<long long> flows, net_out(num_nodes, 0);
+    long long total_cost{0};
+    for (size_t i = 0; i < edges.size(); ++i) {
+      flows.push_back(flow.flow(ids[i]));
+      CHECK(flows[i] >= 0 && flows[i] <= edges[i].capacity);
+      net_out[edges[i].from] += flows[i];
+      net_out[edges[i].to] -= flows[i];
+      total_cost += flows[i] * edges[i].cost;
+    }
+    for (int node = 0; node < num_nodes; ++node) {
+      CHECK(net_out[node] == (node == source ? total_flow
+                              : node == sink ? -total_flow
+                                             : 0));
+    }
+    CHECK(!has_negative_cycle(num_nodes, edges, flows));
+
+    auto [expected_flow, expected_cost]{
+        brute_force_min_cost_flow(num_nodes, edges, source, sink)};
+    CHECK(total_flow == expected_flow);
+    CHECK(total_cost == expected_cost);
+  }
+  return check_status();
+}
@@ -0,0 +1,169 @@
+#include "check.h"
+#include "nearest_server.h"
+
+#include <algorithm>
+#include <arpa/inet.h>
+#include <climits>
+#include <random>
+#include <utility>
+#include <vector>
+
+// NearestServerLabels, as links are added, made cheaper or dearer and
+// removed, against Floyd-Warshall over the links as they stand.
+
+#define UNREACHABLE LLONG_MAX
+
+// The links of the test, from -> to with the least cost of those between
+// them, or none.
+using Costs = std::vector<std::vector<long long>>;
+
+// The label of every node: the distance to its closest server, and the index
+// of that server (the earliest on ties), or (UNREACHABLE, -1).
+static std::vector<std::pair<long long, int>>
+brute_force_labels(const Costs &costs, const std::vector<int> &server_nodes) {
+  size_t num_nodes{costs.size()};
+  Costs dist{costs};
+  for (size_t node = 0; node < num_nodes; ++node) {
+    dist[node][node] = 0;
+  }
+  for (size_t via = 0; via < num_nodes; ++via) {
+    for (size_t from = 0; from < num_nodes; ++from) {
+      for (size_t to = 0; to < num_nodes; ++to) {
+        if (dist[from][via] != UNREACHABLE && dist[via][to] != UNREACHABLE) {
+          dist[from][to] =
+              std::min(dist[from][to], dist[from][via] + dist[via][to]);
+        }
+      }
+    }
+  }
+  std::vector<std::pair<long long, int>> labels(num_nodes, {UNREACHABLE, -1});
+  for (size_t node = 0; node < num_nodes; ++node) {
+    for (size_t i = 0; i < server_nodes.size(); ++i) {
+      std::pair<long long, int> label{dist[node][server_nodes[i]],
+                                      static_cast<int>(i)};
+      if (label.first != UNREACHABLE && label < labels[node]) {
+        labels[node] = label;
+      }
+    }
+  }
+  return labels;
+}
+
+// The labels match those of Floyd-Warshall, and every next hop is a link
+// that the label comes through.
+static void check_labels(const NearestServerLabels &labels,
+                         const Costs &costs,
+                         const std::vector<int> &server_nodes) {
+  auto expected{brute_force_labels(costs, server_nodes)};
+  for (size_t node = 0; node < costs.size(); ++node) {
+    int n{static_cast<int>(node)};
+    CHECK(labels.dist_of(n) == expected[node].first);
+    CHECK(labels.server_of(n) == expected[node].second);
+    int next_hop{labels.next_hop_of(n)};
+    if (next_hop != -1) {
+      CHECK(costs[node][next_hop] != UNREACHABLE &&
+            labels.dist_of(next_hop) + costs[node][next_hop] ==
+                labels.dist_of(n) &&
+            labels.server_of(next_hop) == labels.server_of(n));
+    } else {
+      CHECK(labels.dist_of(n) == 0 || labels.dist_of(n) == UNREACHABLE);
+    }
+  }
+}
+
+static LinkGraph make_links(const Costs &costs) {
+  std::vector<uint64_t> link_offsets{0};
+  std::vector<Link> links;
+  for (size_t from = 0; from < costs.size(); ++from) {
+    for (size_t to = 0; to < costs.size(); ++to) {
+      if (costs[from][to] != UNREACHABLE) {
+        links.push_back({static_cast<int32_t>(to),
+                         static_cast<int32_t>(costs[from][to])});
+      }
+    }
+    link_offsets.push_back(links.size());
+  }
+  return LinkGraph{std::move(link_offsets), std::move(links)};
+}
+
+int main() {
+  std::mt19937 rng{31};
+  for (int round = 0; round < 200; ++round) {
+    int num_nodes{2 + static_cast<int>(rng() % 14)};
+    Costs costs(num_nodes, std::vector<long long>(num_nodes, UNREACHABLE));
+    for (int i = 0; i < num_nodes * 2; ++i) {
+      int from{static_cast<int>(rng() % num_nodes)};
+      int to{static_cast<int>(rng() % num_nodes)};
+      if (from != to) {
+        costs[from][to] = rng() % 10;
+      }
+    }
+
+    Geography geography{};
+    geography.num_nodes = num_nodes;
+    for (int node = 0; node < num_nodes; ++node) {
+      if (rng() % 4 == 0) {
+        geography.server_nodes.push_back(node);
+      } else {
+        geography.client_nodes.push_back(node);
+        geography.client_prefixes.push_back({htonl(0x0a000000 | node << 8),
+                                             24});
+      }
+    }
+    geography.links = make_links(costs);
+
+    NearestServerLabels labels{geography};
+    check_labels(labels, costs, geography.server_nodes);
+
+    // Labels taken from a snapshot of these are repaired the same way.
+    std::vector<long long> dist;
+    std::vector<int> server, next_hop;
+    for (int node = 0; node < num_nodes; ++node) {
+      dist.push_back(labels.dist_of(node));
+      server.push_back(labels.server_of(node));
+      next_hop.push_back(labels.next_hop_of(node));
+    }
+    NearestServerLabels restored{geography, labels.in_links(), dist, server,
+                                 next_hop};
+
+    for (int change = 0; change < 30; ++change) {
+      int from{static_cast<int>(rng() % num_nodes)};
+      int to{static_cast<int>(rng() % num_nodes)};
+      if (from == to) {
+        continue;
+      }
+      // Most often a link on the paths of the labels, removed or changed,
+      // as those are what the repair has to undo.
+      if (rng() % 2 == 0 && labels.next_hop_of(from) != -1) {
+        to = labels.next_hop_of(from);
+      }
+      int cost{rng() % 3 == 0 ? -1 : static_cast<int>(rng() % 10)};
+      costs[from][to] = cost < 0 ? UNREACHABLE : cost;
+
+      std::vector<int> servers_before;
+      for (int node = 0; node < num_nodes; ++node) {
+        servers_before.push_back(labels.server_of(node));
+      }
+      std::vector<int> changed{labels.set_link(from, to, cost)};
+      check_labels(labels, costs, geography.server_nodes);
+      CHECK(restored.set_link(from, to, cost) == changed);
+      check_labels(restored, costs, geography.server_nodes);
+
+      std::vector<int> expected_changed;
+      for (int node = 0; node < num_nodes; ++node) {
+        if (labels.server_of(node) != servers_before[node]) {
+          expected_changed.push_back(node);
+        }
+      }
+      std::sort(changed.begin(), changed.end());
+      CHECK(changed == expected_changed);
+    }
+
+    PrefixTable table{build_closest_server_table(geography, labels)};
+    for (int node : geography.client_nodes) {
+      CHECK(table.lookup(htonl(0x0a000001 | node << 8)) ==
+            labels.server_of(node));
+    }
+  }
+  return check_status();
+}
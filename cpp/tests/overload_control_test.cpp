@@ -0,0 +1,96 @@
+#include "check.h"
+#include "overload_control.h"
+
+#include "abr.h"
+#include <cstdint>
+#include <vector>
+
+// OverloadControl admission, and the bitrate cap under an egress limit of
+// 1000 Kbps: set from the highest bitrate picked once egress passes the high
+// watermark, held for BITRATE_CAP_HOLD_MS before it is lowered again, raised
+// below the low watermark until lifted, and left alone while no segments are
+// picked. Two controllers run side by side, so that their updates share the
+// wait for OVERLOAD_CONTROL_INTERVAL_MS. Also the bitrates picked under a
+// cap, for a ladder that is empty (a video whose bitrates are not known) or
+// that the cap covers none of.
+
+// Bytes sent in an interval at kbps.
+static uint64_t bytes_at(unsigned long kbps) {
+  return kbps * OVERLOAD_CONTROL_INTERVAL_MS / 8;
+}
+
+int main() {
+  OverloadControl unlimited{0, 0};
+  unlimited.start();
+  CHECK(unlimited.timer_fd() == -1);
+  CHECK(unlimited.is_admitting(1000000));
+  CHECK(unlimited.capped(123456) == 123456);
+  OverloadControl admission{2, 0};
+  CHECK(admission.is_admitting(0) && admission.is_admitting(1));
+  CHECK(!admission.is_admitting(2) && !admission.is_admitting(3));
+  std::vector<int> bitrates{300, 800, 1500};
+  CHECK(select_bitrate({}, unlimited.capped(10000), BITRATE_SAFETY_FACTOR) ==
+        0);
+  CHECK(select_bitrate({}, 0, BITRATE_SAFETY_FACTOR) == 0);
+  CHECK(select_bitrate(bitrates, 0, BITRATE_SAFETY_FACTOR) == 300);
+  CHECK(select_bitrate(bitrates, unlimited.capped(1000000),
+                       BITRATE_SAFETY_FACTOR) == 1500);
+
+  // lowered is overloaded throughout; recovered only at first.
+  OverloadControl lowered{0, 1000}, recovered{0, 1000};
+  lowered.start();
+  recovered.start();
+  CHECK(lowered.timer_fd() != -1);
+  uint64_t lowered_sent{0}, recovered_sent{0};
+  lowered.record_segment(800, 800);
+  recovered.record_segment(800, 800);
+
+  // Egress averages 1000 Kbps over the first interval, 900 / 1000 of which
+  // is the cap: 720 Kbps.
+  lowered.update(lowered_sent += bytes_at(2000));
+  recovered.update(recovered_sent += bytes_at(2000));
+  CHECK(lowered.capped(10000) ==
+        static_cast<unsigned long>(720 * BITRATE_SAFETY_FACTOR));
+  CHECK(lowered.capped(500) == 500);
+  CHECK(recovered.capped(10000) == lowered.capped(10000));
+  CHECK(select_bitrate(bitrates, lowered.capped(10000),
+                       BITRATE_SAFETY_FACTOR) == 300);
+  CHECK(select_bitrate({}, lowered.capped(10000), BITRATE_SAFETY_FACTOR) ==
+        0);
+
+  // Egress falls to 500 and 250 Kbps: the cap goes up by
+  // BITRATE_CAP_INCREASE to 792 Kbps, and is then lifted as 871 Kbps caps no
+  // bitrate of the video.
+  for (int interval = 2; interval <= 5; ++interval) {
+    lowered.record_segment(720, 800);
+    lowered.update(lowered_sent += bytes_at(2000));
+    if (interval < 5) {
+      // Within BITRATE_CAP_HOLD_MS of the first cap, it holds.
+      CHECK(lowered.capped(10000) ==
+            static_cast<unsigned long>(720 * BITRATE_SAFETY_FACTOR));
+    }
+    if (interval == 2) {
+      recovered.update(recovered_sent);
+      CHECK(recovered.capped(10000) ==
+            static_cast<unsigned long>(792 * BITRATE_SAFETY_FACTOR));
+    } else if (interval == 3) {
+      recovered.update(recovered_sent);
+      CHECK(recovered.capped(10000) == 10000);
+    } else if (interval == 4) {
+      // Overloaded with no segments picked: nothing to cap.
+      recovered.update(recovered_sent += bytes_at(8000));
+      CHECK(recovered.capped(10000) == 10000);
+    } else {
+      recovered.record_segment(400, 800);
+      recovered.update(recovered_sent += bytes_at(8000));
+      CHECK(recovered.capped(10000) ==
+            static_cast<unsigned long>(200 * BITRATE_SAFETY_FACTOR));
+    }
+  }
+  // At 1937.5 Kbps, 900 / 1937.5 of the cap is less than
+  // MAX_BITRATE_CAP_DECREASE of it, which it is lowered to instead.
+  CHECK(lowered.capped(10000) ==
+        static_cast<unsigned long>(360 * BITRATE_SAFETY_FACTOR));
+
+  return check_status();
+}
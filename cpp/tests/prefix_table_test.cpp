@@ -0,0 +1,125 @@
+#include "check.h"
+#include "prefix_table.h"
+
+#include <arpa/inet.h>
+#include <cstdint>
+#include <memory>
+#include <random>
+#include <vector>
+
+// PrefixTable against a linear scan of the prefixes inserted.
+
+struct Route {
+  uint32_t prefix; // Host byte order.
+  int prefix_len, value;
+};
+
+static uint32_t mask_of(int prefix_len) {
+  return prefix_len == 0 ? 0 : ~0u << (32 - prefix_len);
+}
+
+// The value of the longest route matching addr (host byte order), the last
+// inserted of equal ones, or -1.
+static int brute_force_lookup(const std::vector<Route> &routes,
+                              uint32_t addr) {
+  int value{-1}, longest{-1};
+  for (const auto &[prefix, prefix_len, route_value] : routes) {
+    if ((addr & mask_of(prefix_len)) == prefix && prefix_len >= longest) {
+      value = route_value;
+      longest = prefix_len;
+    }
+  }
+  return value;
+}
+
+// addr with some of its low bits flipped at random.
+static uint32_t near(uint32_t addr, std::mt19937 &rng) {
+  return addr ^ (static_cast<uint32_t>(rng()) &
+                 ~mask_of(static_cast<int>(rng() % 33)));
+}
+
+// Addresses near those of the routes, so that most of them match some, and
+// some anywhere.
+static uint32_t random_addr(const std::vector<Route> &routes,
+                            std::mt19937 &rng) {
+  if (routes.empty() || rng() % 4 == 0) {
+    return static_cast<uint32_t>(rng());
+  }
+  return near(routes[rng() % routes.size()].prefix, rng);
+}
+
+static void check_lookups(const PrefixTable &table,
+                          const std::vector<Route> &routes,
+                          std::mt19937 &rng) {
+  for (int i = 0; i < 2000; ++i) {
+    uint32_t addr{random_addr(routes, rng)};
+    CHECK(table.lookup(htonl(addr)) == brute_force_lookup(routes, addr));
+  }
+}
+
+int main() {
+  std::mt19937 rng{26};
+  // A few networks, so that prefixes of every length nest in each other
+  // and fall in all three levels.
+  std::vector<uint32_t> networks(8);
+  for (auto &network : networks) {
+    network = static_cast<uint32_t>(rng());
+  }
+
+  for (int round = 0; round < 20; ++round) {
+    PrefixTable table;
+    std::vector<Route> routes;
+    check_lookups(table, routes, rng);
+    for (int i = 0; i < 200; ++i) {
+      int prefix_len{static_cast<int>(rng() % 33)};
+      uint32_t addr{near(networks[rng() % networks.size()], rng)};
+      Route route{addr & mask_of(prefix_len), prefix_len,
+                  static_cast<int>(rng() % 16)};
+      table.insert(htonl(route.prefix), route.prefix_len, route.value);
+      routes.push_back(route);
+      if (i % 50 == 49) {
+        check_lookups(table, routes, rng);
+      }
+    }
+
+    // A copy is written to apart from the table it is copied from.
+    PrefixTable copy{table};
+    std::vector<Route> copy_routes{routes};
+    for (int i = 0; i < 20; ++i) {
+      int prefix_len{16 + static_cast<int>(rng() % 17)};
+      Route route{networks[rng() % networks.size()] & mask_of(prefix_len),
+                  prefix_len, 16 + static_cast<int>(rng() % 16)};
+      copy.insert(htonl(route.prefix), route.prefix_len, route.value);
+      copy_routes.push_back(route);
+    }
+    check_lookups(table, routes, rng);
+    check_lookups(copy, copy_routes, rng);
+
+    // As is a table viewing the arrays of another, as one viewing a
+    // snapshot does.
+    auto owner{std::make_shared<PrefixTable>(table)};
+    CHECK(PrefixTable::is_valid(owner->arrays(), 16));
+    CHECK(!PrefixTable::is_valid(owner->arrays(), 1));
+    PrefixTable view{owner->arrays(), owner};
+    check_lookups(view, routes, rng);
+    view.insert(htonl(networks[0]), 32, 99);
+    CHECK(view.lookup(htonl(networks[0])) == 99);
+    CHECK(owner->lookup(htonl(networks[0])) ==
+          brute_force_lookup(routes, networks[0]));
+  }
+
+  in_addr_t prefix;
+  int prefix_len;
+  CHECK(parse_prefix("10.1.2.3/12", prefix, prefix_len));
+  CHECK(ntohl(prefix) == 0x0a000000 && prefix_len == 12);
+  CHECK(parse_prefix("10.1.2.3", prefix, prefix_len));
+  CHECK(ntohl(prefix) == 0x0a010203 && prefix_len == 32);
+  CHECK(parse_prefix("10.1.2.3/0", prefix, prefix_len));
+  CHECK(prefix == 0 && prefix_len == 0);
+  CHECK(!parse_prefix("10.1.2.3/33", prefix, prefix_len));
+  CHECK(!parse_prefix("10.1.2.3/", prefix, prefix_len));
+  CHECK(!parse_prefix("10.1.2.3/8x", prefix, prefix_len));
+  CHECK(!parse_prefix("10.1.2/8", prefix, prefix_len));
+  CHECK(!parse_prefix("", prefix, prefix_len));
+  return check_status();
+}
@@ -0,0 +1,175 @@
+#include "buffer_pool.h"
+#include "check.h"
+#include "range_fetch.h"
+
+#include <algorithm>
+#include <cstring>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+// RangeFetch reassembling segments from byte-range responses arriving in
+// every order: what goes to the client is always the 200 response of the
+// whole segment, in order, and parts are held back only until those before
+// them are in. Also a segment shorter than estimated (416s for parts past
+// its end), videoservers ignoring Range or failing, and parts that do not
+// match their range.
+
+using Writes = std::vector<std::pair<std::string_view, BufferRef>>;
+
+// A NUL-terminated copy of text, as an HttpReader leaves a message.
+static BufferRef message(BufferPool &pool, std::string_view text) {
+  BufferRef buffer{pool.acquire(text.size() + 1)};
+  std::memcpy(buffer.data(), text.data(), text.size());
+  buffer.data()[text.size()] = '\0';
+  buffer.set_size(text.size());
+  return buffer;
+}
+
+// The response to the range of segment from first on, of at most size bytes.
+static std::string part_response(const std::string &segment, size_t first,
+                                 size_t size) {
+  if (first >= segment.size()) {
+    return "HTTP/1.1 416 Range Not Satisfiable\r\n"
+           "Content-Range: bytes */" +
+           std::to_string(segment.size()) + "\r\nContent-Length: 0\r\n\r\n";
+  }
+  std::string body{segment.substr(first, size)};
+  return "HTTP/1.1 206 Partial Content\r\nContent-Type: video/mp4\r\n"
+         "Content-Range: bytes " +
+         std::to_string(first) + "-" +
+         std::to_string(first + body.size() - 1) + "/" +
+         std::to_string(segment.size()) +
+         "\r\nContent-Length: " + std::to_string(body.size()) + "\r\n\r\n" +
+         body;
+}
+
+static std::string whole_response(const std::string &segment) {
+  return "HTTP/1.1 200 OK\r\nContent-Type: video/mp4\r\n"
+         "Content-Length: " +
+         std::to_string(segment.size()) + "\r\n\r\n" + segment;
+}
+
+static std::string concat(const Writes &writes) {
+  std::string all{};
+  for (const auto &[data, buffer] : writes) {
+    all += data;
+  }
+  return all;
+}
+
+// Fetch segment in no_of_parts of part_size, the parts arriving in order.
+// Returns what went to the client if the fetch is done, "" otherwise.
+static std::string fetch(BufferPool &pool, const std::string &segment,
+                         size_t part_size, std::vector<size_t> order) {
+  RangeFetch fetch{part_size, order.size()};
+  Writes writes{};
+  RangeFetch::Status status{RangeFetch::PENDING};
+  size_t no_of_in_order{0}; // Parts in with all before them.
+  for (size_t i = 0; i < order.size(); ++i) {
+    size_t index{order[i]};
+    size_t size{index + 1 < order.size() ? part_size : segment.size()};
+    status = fetch.on_part(
+        index, message(pool, part_response(segment, index * part_size, size)),
+        pool, writes);
+    CHECK(fetch.has_part(index));
+    while (no_of_in_order < order.size() && fetch.has_part(no_of_in_order)) {
+      ++no_of_in_order;
+    }
+    size_t no_of_body_bytes{
+        std::min(no_of_in_order * part_size, segment.size())};
+    if (no_of_in_order == 0) {
+      CHECK(writes.empty());
+    } else {
+      CHECK(concat(writes).ends_with(segment.substr(0, no_of_body_bytes)));
+    }
+    CHECK(status == (i + 1 < order.size() ? RangeFetch::PENDING
+                                           : RangeFetch::DONE));
+  }
+  CHECK(fetch.total() == segment.size());
+  return status == RangeFetch::DONE ? concat(writes) : "";
+}
+
+int main() {
+  BufferPool pool{};
+  std::string request{"GET /videos/a/video/avc1/1/seg-1.m4s HTTP/1.1\r\n"
+                      "Host: localhost\r\n\r\n"};
+  std::vector<std::string> ranges{split_into_ranges(request, 100, 3)};
+  CHECK(ranges.size() == 3);
+  CHECK(ranges[0] == "GET /videos/a/video/avc1/1/seg-1.m4s HTTP/1.1\r\n"
+                     "Range: bytes=0-99\r\nHost: localhost\r\n\r\n");
+  CHECK(ranges[1].find("\r\nRange: bytes=100-199\r\n") != std::string::npos);
+  CHECK(ranges[2].find("\r\nRange: bytes=200-\r\n") != std::string::npos);
+
+  std::string segment(320, '\0');
+  for (size_t i = 0; i < segment.size(); ++i) {
+    segment[i] = static_cast<char>('a' + i % 26);
+  }
+  std::string expected{whole_response(segment)};
+  std::vector<size_t> order{0, 1, 2, 3};
+  do {
+    CHECK(fetch(pool, segment, 100, order) == expected);
+  } while (std::next_permutation(order.begin(), order.end()));
+
+  // Estimated at four parts, the segment ends in the second: the other two
+  // come back as 416s.
+  std::string short_segment{segment.substr(0, 150)};
+  order = {0, 1, 2, 3};
+  do {
+    CHECK(fetch(pool, short_segment, 100, order) ==
+          whole_response(short_segment));
+  } while (std::next_permutation(order.begin(), order.end()));
+
+  // A videoserver that ignores Range: if the first part is whole, that is
+  // the response; a later part that is whole is cut down to the part.
+  Writes writes{};
+  RangeFetch ignored{100, 3};
+  CHECK(ignored.on_part(0, message(pool, whole_response(segment)), pool,
+                        writes) == RangeFetch::DONE);
+  CHECK(concat(writes) == expected);
+  writes.clear();
+  RangeFetch partly_ignored{100, 4};
+  CHECK(partly_ignored.on_part(2, message(pool, whole_response(segment)), pool,
+                               writes) == RangeFetch::PENDING);
+  CHECK(partly_ignored.on_part(0, message(pool, part_response(segment, 0, 100)),
+                               pool, writes) == RangeFetch::PENDING);
+  CHECK(partly_ignored.on_part(3, message(pool, whole_response(segment)), pool,
+                               writes) == RangeFetch::PENDING);
+  CHECK(partly_ignored.on_part(1,
+                               message(pool, part_response(segment, 100, 100)),
+                               pool, writes) == RangeFetch::DONE);
+  CHECK(concat(writes) == expected);
+
+  // An error for the first part goes to the client as it is.
+  writes.clear();
+  std::string not_found{"HTTP/1.1 404 Not Found\r\nContent-Length: 0\r\n\r\n"};
+  RangeFetch missing{100, 3};
+  CHECK(missing.on_part(0, message(pool, not_found), pool, writes) ==
+        RangeFetch::DONE);
+  CHECK(concat(writes) == not_found);
+
+  // Parts that are not what was asked for fail the fetch.
+  for (const std::string &bad :
+       {not_found, part_response(segment, 101, 100),
+        part_response(segment, 100, 100).substr(0, 150),
+        std::string{"HTTP/1.1 206 Partial Content\r\n"}}) {
+    RangeFetch fetch{100, 4};
+    CHECK(fetch.on_part(1, message(pool, bad), pool, writes) ==
+          RangeFetch::FAILED);
+  }
+  RangeFetch bad_first{100, 4};
+  CHECK(bad_first.on_part(0, message(pool, part_response(segment, 1, 100)),
+                          pool, writes) == RangeFetch::FAILED);
+  // A 416 for a part the segment covers leaves bytes out.
+  RangeFetch gap{100, 3};
+  writes.clear();
+  gap.on_part(1, message(pool, part_response(segment, 1000, 100)), pool,
+              writes);
+  gap.on_part(2, message(pool, part_response(segment, 200, 1000)), pool,
+              writes);
+  CHECK(gap.on_part(0, message(pool, part_response(segment, 0, 100)), pool,
+                    writes) == RangeFetch::FAILED);
+
+  return check_status();
+}
@@ -0,0 +1,136 @@
+#include "check.h"
+#include "request_tracer.h"
+
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <string>
+#include <unistd.h>
+#include <vector>
+
+// RequestTracer writing the trace file of a few requests: only those that
+// took at least the threshold are written, once delivered or once their
+// client is gone; the first request on a connection carries its accept and
+// setup spans; spans go to the request in scope; and the events are one per
+// line with the tags escaped and the phases timed as recorded.
+
+using namespace std::chrono_literals;
+using Clock = RequestTracer::Clock;
+
+// The lines of the file at path.
+static std::vector<std::string> lines_of(const std::string &path) {
+  std::ifstream file{path};
+  std::vector<std::string> lines{};
+  for (std::string line; std::getline(file, line);) {
+    lines.push_back(line);
+  }
+  return lines;
+}
+
+// The event line named name on the track of socket, or "" if none.
+static std::string event(const std::vector<std::string> &lines,
+                         const std::string &name, int socket) {
+  std::string name_field{"{\"name\":\"" + name + "\","},
+      tid_field{"\"tid\":" + std::to_string(socket) + ","};
+  for (const std::string &line : lines) {
+    if (line.starts_with(name_field) &&
+        line.find(tid_field) != std::string::npos) {
+      return line;
+    }
+  }
+  return "";
+}
+
+static bool has(const std::string &line, const std::string &part) {
+  return line.find(part) != std::string::npos;
+}
+
+int main() {
+  char path_template[]{"/tmp/request_tracer_test.XXXXXX"};
+  int fd{mkstemp(path_template)};
+  if (fd == -1) {
+    std::cout << "mkstemp() failed\n";
+    return EXIT_FAILURE;
+  }
+  close(fd);
+  std::string path{path_template};
+
+  // Until opened, nothing is traced.
+  RequestTracer tracer{};
+  CHECK(!tracer.is_enabled());
+  tracer.start(4, 0, Clock::now() - 1s);
+  tracer.on_last_byte(4, 0, Clock::now());
+  { RequestTracer::Timed timed{tracer, "lookup"}; }
+  tracer.complete_delivered([](int, uint64_t) { return true; });
+  tracer.remove(4);
+  CHECK(!tracer.open("/nonexistent/trace.json", 100));
+  CHECK(tracer.open(path, 100));
+  CHECK(tracer.is_enabled());
+
+  // A slow first request on socket 5, with an upstream connect made for the
+  // connection before it came in, and a fast second one.
+  Clock::time_point now{Clock::now()};
+  tracer.on_accept(5, now - 300ms);
+  {
+    RequestTracer::Scope scope{tracer, 5, RequestTracer::SETUP};
+    tracer.add_span("upstream connect", now - 290ms, now - 280ms);
+  }
+  tracer.start(5, 0, now - 250ms);
+  tracer.tag(5, 0, "segment", "uuid\"\n", "videos/a", 1500);
+  tracer.on_forwarded(5, 0, now - 240ms);
+  tracer.on_forwarded(5, 0, now - 10ms);
+  tracer.on_first_byte(5, 0, now - 200ms);
+  tracer.on_last_byte(5, 0, now - 100ms);
+  tracer.start(5, 1, now);
+  tracer.tag(5, 1, "manifest", "uuid");
+  {
+    RequestTracer::Scope outer{tracer, 5, 1};
+    {
+      RequestTracer::Scope inner{tracer, 5, 0};
+      RequestTracer::Timed timed{tracer, "load balancer lookup"};
+    }
+    tracer.add_span("upstream connect", now, now);
+  }
+  tracer.on_last_byte(5, 1, now);
+  tracer.complete_delivered([](int, uint64_t) { return false; });
+  CHECK(lines_of(path) == std::vector<std::string>{"["});
+  tracer.complete_delivered(
+      [](int socket, uint64_t slot) { return socket == 5; });
+
+  // A slow request whose client disconnects before it is answered.
+  tracer.start(6, 0, now - 500ms);
+  tracer.tag(6, 0, "segment", "other");
+  tracer.on_forwarded(6, 0, now - 400ms);
+  tracer.remove(6);
+  tracer.remove(5);
+
+  std::vector<std::string> lines{lines_of(path)};
+  CHECK(!lines.empty() && lines[0] == "[");
+  for (size_t i = 1; i < lines.size(); ++i) {
+    CHECK(lines[i].starts_with("{\"name\":\"") && lines[i].ends_with("},"));
+    CHECK(has(lines[i], "\"ph\":\"X\""));
+  }
+  // 5's first request: the event from the accept, then its phases.
+  std::string request{event(lines, "segment", 5)};
+  CHECK(has(request, "\"uuid\":\"uuid\\\"\\u000a\""));
+  CHECK(has(request, "\"video\":\"videos/a\",\"bitrate\":1500,\"slot\":0,"
+                     "\"complete\":true"));
+  CHECK(has(event(lines, "accept", 5), "\"dur\":50000}"));
+  CHECK(has(event(lines, "upstream connect", 5), "\"dur\":10000}"));
+  CHECK(has(event(lines, "load balancer lookup", 5), "\"dur\":"));
+  CHECK(has(event(lines, "queued", 5), "\"dur\":10000}"));
+  CHECK(has(event(lines, "upstream first byte", 5), "\"dur\":40000}"));
+  CHECK(has(event(lines, "upstream transfer", 5), "\"dur\":100000}"));
+  CHECK(has(event(lines, "delivery", 5), "\"dur\":"));
+  CHECK(event(lines, "manifest", 5).empty());
+  // 6's request, written when it went, without the phases it never got to.
+  request = event(lines, "segment", 6);
+  CHECK(has(request, "\"uuid\":\"other\",\"video\":\"\",\"bitrate\":0,"
+                     "\"slot\":0,\"complete\":false"));
+  CHECK(!event(lines, "queued", 6).empty());
+  CHECK(event(lines, "delivery", 6).empty());
+  CHECK(lines.size() == 1 + 8 + 2);
+
+  unlink(path.c_str());
+  return check_status();
+}
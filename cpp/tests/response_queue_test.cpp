@@ -0,0 +1,212 @@
+#include "buffer_pool.h"
+#include "check.h"
+#include "poller.h"
+#include "response_queue.h"
+#include "write_queue.h"
+
+#include <algorithm>
+#include <arpa/inet.h>
+#include <cstdint>
+#include <netinet/in.h>
+#include <string>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <vector>
+
+// ResponseQueues with three pipelined responses of two parts each, written
+// and finished in every interleaving that keeps the parts of each response
+// in order: the client always reads the responses in the order of its
+// requests, and a response counts as written once it and all before it are
+// finished. Then the pacing of a TCP connection as its responses take turns:
+// each goes out at its own rate, and one that is not paced unpaced, whatever
+// the rate of the one before it.
+
+#define NO_OF_SLOTS 3
+#define NO_OF_PARTS 2
+
+static std::string part(int slot, int index) {
+  return "response " + std::to_string(slot) + " part " +
+         std::to_string(index) + "\r\n";
+}
+
+static uint32_t pacing_rate_of(int socket) {
+  uint32_t rate{0};
+  socklen_t length{sizeof(rate)};
+  if (getsockopt(socket, SOL_SOCKET, SO_MAX_PACING_RATE, &rate, &length) ==
+      -1) {
+    return 0;
+  }
+  return rate;
+}
+
+// A connected pair of TCP sockets on the loopback interface.
+static bool connect_tcp_pair(int fds[2]) {
+  sockaddr_in addr{};
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  socklen_t length{sizeof(addr)};
+  int listener{socket(AF_INET, SOCK_STREAM, 0)};
+  bool is_connected{
+      listener != -1 &&
+      bind(listener, reinterpret_cast<sockaddr *>(&addr), length) == 0 &&
+      listen(listener, 1) == 0 &&
+      getsockname(listener, reinterpret_cast<sockaddr *>(&addr), &length) ==
+          0 &&
+      (fds[1] = socket(AF_INET, SOCK_STREAM, 0)) != -1 &&
+      connect(fds[1], reinterpret_cast<sockaddr *>(&addr), length) == 0 &&
+      (fds[0] = accept(listener, nullptr, nullptr)) != -1};
+  if (listener != -1) {
+    close(listener);
+  }
+  return is_connected;
+}
+
+// Everything there is to read on fd.
+static std::string read_all(int fd) {
+  std::string all{};
+  char buffer[4096];
+  long curr;
+  while ((curr = recv(fd, buffer, sizeof(buffer), MSG_DONTWAIT)) > 0) {
+    all.append(buffer, curr);
+  }
+  return all;
+}
+
+int main() {
+  BufferPool pool{};
+  EpollPoller poller{};
+  if (!poller.start()) {
+    std::cout << "epoll unavailable\n";
+    return EXIT_FAILURE;
+  }
+  std::string expected{};
+  for (int slot = 0; slot < NO_OF_SLOTS; ++slot) {
+    for (int index = 0; index < NO_OF_PARTS; ++index) {
+      expected += part(slot, index);
+    }
+  }
+
+  // Each slot once per part, then once more for finishing it.
+  std::vector<int> order{};
+  for (int slot = 0; slot < NO_OF_SLOTS; ++slot) {
+    order.insert(order.end(), NO_OF_PARTS + 1, slot);
+  }
+  int no_of_orders{0};
+  do {
+    int fds[2];
+    if (socketpair(AF_UNIX, SOCK_STREAM, 0, fds) == -1) {
+      std::cout << "socketpair() failed\n";
+      return EXIT_FAILURE;
+    }
+    poller.add_socket(fds[0]);
+    WriteQueues write_queues{poller};
+    ResponseQueues response_queues{write_queues};
+    uint64_t slots[NO_OF_SLOTS];
+    for (int slot = 0; slot < NO_OF_SLOTS; ++slot) {
+      slots[slot] = response_queues.open(fds[0]);
+    }
+    CHECK(response_queues.no_of_open(fds[0]) == NO_OF_SLOTS);
+
+    int no_of_events[NO_OF_SLOTS]{};
+    std::string received{};
+    for (int slot : order) {
+      if (no_of_events[slot] < NO_OF_PARTS) {
+        CHECK(response_queues.write(
+            fds[0], slots[slot],
+            pool.copy_of(part(slot, no_of_events[slot]))));
+      } else {
+        CHECK(response_queues.finish(fds[0], slots[slot]));
+      }
+      ++no_of_events[slot];
+
+      // What the client has is every part of the finished responses before
+      // the first unfinished one, then the parts of that one written so far.
+      std::string sent{};
+      int first_open{0};
+      for (; first_open < NO_OF_SLOTS; ++first_open) {
+        for (int index = 0;
+             index < std::min(no_of_events[first_open], NO_OF_PARTS);
+             ++index) {
+          sent += part(first_open, index);
+        }
+        if (no_of_events[first_open] <= NO_OF_PARTS) {
+          break;
+        }
+      }
+      received += read_all(fds[1]);
+      CHECK(received == sent);
+      for (int other = 0; other < NO_OF_SLOTS; ++other) {
+        CHECK(response_queues.is_written(fds[0], slots[other]) ==
+              (other < first_open));
+      }
+      CHECK(response_queues.no_of_open(fds[0]) ==
+            static_cast<size_t>(NO_OF_SLOTS - first_open));
+    }
+    CHECK(received == expected);
+
+    // Slots that were never opened or are done take nothing.
+    CHECK(!response_queues.write(fds[0], slots[0], "late"));
+    CHECK(!response_queues.write(fds[0], slots[NO_OF_SLOTS - 1] + 1, "x"));
+    CHECK(!response_queues.finish(fds[0], slots[NO_OF_SLOTS - 1] + 1));
+    uint64_t next{response_queues.open(fds[0])};
+    CHECK(next == slots[NO_OF_SLOTS - 1] + 1);
+    response_queues.remove(fds[0]);
+    CHECK(response_queues.no_of_open(fds[0]) == 0);
+    CHECK(!response_queues.write(fds[0], next, "x"));
+
+    poller.remove(fds[0]);
+    close(fds[0]);
+    close(fds[1]);
+    ++no_of_orders;
+  } while (std::next_permutation(order.begin(), order.end()));
+  CHECK(no_of_orders == 1680);
+
+  int fds[2]{-1, -1};
+  CHECK(connect_tcp_pair(fds));
+  poller.add_socket(fds[0]);
+  WriteQueues write_queues{poller};
+  ResponseQueues response_queues{write_queues};
+  uint32_t unpaced{pacing_rate_of(fds[0])};
+  uint64_t segment{response_queues.open(fds[0])},
+      manifest{response_queues.open(fds[0])},
+      next_segment{response_queues.open(fds[0])};
+  // The first response is paced at once, the ones after it when they start.
+  response_queues.pace(fds[0], segment, 1000);
+  response_queues.pace(fds[0], next_segment, 2000);
+  CHECK(pacing_rate_of(fds[0]) == 125000);
+  CHECK(response_queues.write(fds[0], manifest, pool.copy_of("manifest")));
+  CHECK(response_queues.write(fds[0], segment, pool.copy_of("segment")));
+  CHECK(pacing_rate_of(fds[0]) == 125000);
+  CHECK(response_queues.finish(fds[0], segment));
+  CHECK(pacing_rate_of(fds[0]) == UINT32_MAX);
+  CHECK(response_queues.finish(fds[0], manifest));
+  CHECK(pacing_rate_of(fds[0]) == 250000);
+  CHECK(response_queues.finish(fds[0], next_segment));
+  // Finished, the segment keeps its rate until the next response starts,
+  // which is not paced.
+  CHECK(pacing_rate_of(fds[0]) == 250000);
+  uint64_t other{response_queues.open(fds[0])};
+  CHECK(response_queues.write(fds[0], other, pool.copy_of("other")));
+  CHECK(pacing_rate_of(fds[0]) == UINT32_MAX);
+  CHECK(response_queues.finish(fds[0], other));
+  uint64_t urgent{response_queues.open(fds[0])};
+  response_queues.pace(fds[0], urgent, 3000);
+  CHECK(pacing_rate_of(fds[0]) == 375000);
+  CHECK(response_queues.finish(fds[0], urgent));
+  // A segment of a client with too little buffered for a rate: unpaced.
+  uint64_t unbuffered{response_queues.open(fds[0])};
+  response_queues.pace(fds[0], unbuffered, 0);
+  CHECK(pacing_rate_of(fds[0]) == UINT32_MAX);
+  CHECK(unpaced == UINT32_MAX);
+  std::string in_order{"segmentmanifestother"};
+  char received[32]{};
+  CHECK(recv(fds[1], received, in_order.length(), MSG_WAITALL) ==
+        static_cast<long>(in_order.length()));
+  CHECK(received == in_order);
+  response_queues.remove(fds[0]);
+  poller.remove(fds[0]);
+  close(fds[0]);
+  close(fds[1]);
+
+  return check_status();
+}
@@ -0,0 +1,120 @@
+#include "check.h"
+#include "routing_state.h"
+
+#include <arpa/inet.h>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <string>
+#include <thread>
+#include <unistd.h>
+
+// RoutingSource reloads of round-robin and geography files, good and
+// malformed, and the watcher publishing a file rewritten in place or
+// replaced by a rename, but never one that fails to parse.
+
+static void write_file(const std::string &path, const std::string &contents) {
+  std::ofstream{path} << contents;
+}
+
+static in_addr_t addr_of(const char *ip) { return inet_addr(ip); }
+
+// Wait up to a few seconds for the state routing_table holds to be other
+// than state.
+static std::shared_ptr<const RoutingState>
+next_state(const RoutingTable &routing_table,
+           const std::shared_ptr<const RoutingState> &state) {
+  for (int i = 0; i < 500 && routing_table.current() == state; ++i) {
+    std::this_thread::sleep_for(std::chrono::milliseconds{10});
+  }
+  return routing_table.current();
+}
+
+int main() {
+  char dir_template[]{"/tmp/routing_state_test.XXXXXX"};
+  if (mkdtemp(dir_template) == nullptr) {
+    std::cout << "mkdtemp() failed\n";
+    return EXIT_FAILURE;
+  }
+  std::string dir{dir_template}, servers_path{dir + "/servers.txt"},
+      geography_path{dir + "/geography.txt"}, temp_path{dir + "/new.txt"};
+
+  // A round-robin file that stops parsing keeps the servers read before.
+  write_file(servers_path, "NUM_SERVERS: 2\n127.0.0.1 8000\n127.0.0.1 8001\n");
+  RoutingSource source{servers_path, {false, false}};
+  std::shared_ptr<const RoutingState> state{source.reload()};
+  CHECK(state != nullptr && state->servers.size() == 2);
+  for (const char *malformed :
+       {"", "NUM_SERVERS: 0\n", "NUM_SERVERS: 2\n127.0.0.1 8000\n",
+        "NUM_SERVERS: 1\nlocalhost 8000\n"}) {
+    write_file(servers_path, malformed);
+    CHECK(source.reload() == nullptr);
+  }
+  unlink(servers_path.c_str());
+  CHECK(source.reload() == nullptr);
+  CHECK(state->servers.size() == 2 &&
+        state->servers[1].response.videoserver_port == htons(8001));
+
+  // Geography: each client is served by the server nearest to it, a /16
+  // client by its prefix.
+  write_file(geography_path, "NUM_NODES: 4\n"
+                             "CLIENT 10.0.0.1\n"
+                             "CLIENT 10.1.0.0/16\n"
+                             "SERVER 10.0.0.3\n"
+                             "SERVER 10.0.0.4\n"
+                             "NUM_LINKS: 4\n"
+                             "0 2 1\n"
+                             "0 3 5\n"
+                             "1 2 5\n"
+                             "1 3 1\n");
+  RoutingSource geo_source{geography_path, {true, false}};
+  std::shared_ptr<const RoutingState> geo_state{geo_source.reload()};
+  CHECK(geo_state != nullptr && geo_state->servers.size() == 2);
+  if (geo_state != nullptr) {
+    auto closest_addr{[&](const char *ip) {
+      int server{geo_state->closest_server(addr_of(ip))};
+      return server == -1
+                 ? INADDR_NONE
+                 : geo_state->servers[server].response.videoserver_addr;
+    }};
+    CHECK(closest_addr("10.0.0.1") == addr_of("10.0.0.3"));
+    CHECK(closest_addr("10.1.200.7") == addr_of("10.0.0.4"));
+    CHECK(closest_addr("10.2.0.1") == INADDR_NONE);
+  }
+  write_file(geography_path, "NUM_NODES: 2\nCLIENT 10.0.0.1\n");
+  CHECK(geo_source.reload() == nullptr);
+
+  // The watcher publishes the file once it is rewritten or renamed over,
+  // skipping the versions that fail to parse.
+  write_file(servers_path, "NUM_SERVERS: 1\n127.0.0.1 8000\n");
+  state = source.reload();
+  CHECK(state != nullptr);
+  RoutingTable routing_table{state};
+  std::thread watcher{
+      start_routing_state_watcher(std::move(source), -1, routing_table)};
+  watcher.detach();
+
+  // The watch may not be in place yet when the thread has just started, so
+  // the first rewrite is repeated until it is seen.
+  for (int i = 0; i < 500 && routing_table.current() == state; ++i) {
+    write_file(servers_path,
+               "NUM_SERVERS: 2\n127.0.0.1 8000\n127.0.0.1 8001\n");
+    std::this_thread::sleep_for(std::chrono::milliseconds{10});
+  }
+  state = routing_table.current();
+  CHECK(state->servers.size() == 2);
+
+  write_file(temp_path, "NUM_SERVERS: 3\n127.0.0.1 8000\n");
+  CHECK(rename(temp_path.c_str(), servers_path.c_str()) == 0);
+  write_file(temp_path, "NUM_SERVERS: 3\n127.0.0.1 8000\n127.0.0.1 8001\n"
+                        "127.0.0.1 8002\n");
+  CHECK(rename(temp_path.c_str(), servers_path.c_str()) == 0);
+  state = next_state(routing_table, state);
+  CHECK(state->servers.size() == 3);
+
+  unlink(servers_path.c_str());
+  unlink(geography_path.c_str());
+  rmdir(dir.c_str());
+  return check_status();
+}
@@ -0,0 +1,246 @@
+#include "buffer_pool.h"
+#include "check.h"
+#include "segment_cache.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <iterator>
+#include <random>
+#include <regex>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+// respond_to_range against a reading of the Range header field by the RFC
+// 9110 grammar, on random byte-range sets (single, multipart, suffix and
+// open-ended ranges, unsatisfiable and malformed ones), with the responses
+// taken apart part by part; and the eviction of SegmentCache against a list
+// of the paths it holds.
+
+#define CONTENT_TYPE "video/iso.segment"
+
+enum class Outcome { WHOLE, UNSATISFIABLE, PARTIAL };
+
+// The ranges [first, last] of a body of size bytes that range asks for.
+static Outcome
+brute_force_ranges(const std::string &range, size_t size,
+                   std::vector<std::pair<size_t, size_t>> &ranges) {
+  static const std::regex prefix{"bytes=", std::regex::icase},
+      spec{"[ \t]*(?:([0-9]+)-([0-9]*)|-([0-9]+))?[ \t]*"};
+  if (range.size() < 6 || !std::regex_match(range.substr(0, 6), prefix)) {
+    return Outcome::WHOLE;
+  }
+  size_t no_of_specs{0};
+  size_t start{6};
+  while (start <= range.size()) {
+    size_t end{std::min(range.find(',', start), range.size())};
+    std::smatch match;
+    std::string element{range.substr(start, end - start)};
+    start = end + 1;
+    if (!std::regex_match(element, match, spec)) {
+      return Outcome::WHOLE;
+    }
+    if (!match[1].matched && !match[3].matched) {
+      continue; // Empty, which the list syntax allows.
+    }
+    ++no_of_specs;
+    if (match[3].matched) {
+      size_t suffix_length{std::stoul(match[3])};
+      if (suffix_length > 0 && size > 0) {
+        ranges.push_back({size - std::min(suffix_length, size), size - 1});
+      }
+      continue;
+    }
+    size_t first{std::stoul(match[1])};
+    size_t last{match[2].length() == 0 ? SIZE_MAX : std::stoul(match[2])};
+    if (last < first) {
+      return Outcome::WHOLE;
+    }
+    if (first < size) {
+      ranges.push_back({first, std::min(last, size - 1)});
+    }
+  }
+  if (no_of_specs == 0 || no_of_specs > SEGMENT_CACHE_MAX_RANGES) {
+    ranges.clear();
+    return Outcome::WHOLE;
+  }
+  return ranges.empty() ? Outcome::UNSATISFIABLE : Outcome::PARTIAL;
+}
+
+// The value of field in header, or "" if it is not in it.
+static std::string field_of(std::string_view header, const std::string &field) {
+  std::string name{"\r\n" + field + ": "};
+  size_t at{header.find(name)};
+  if (at == std::string_view::npos) {
+    return "";
+  }
+  at += name.length();
+  return std::string{header.substr(at, header.find("\r\n", at) - at)};
+}
+
+static std::string content_range(size_t first, size_t last, size_t size) {
+  return "bytes " + std::to_string(first) + "-" + std::to_string(last) + "/" +
+         std::to_string(size);
+}
+
+// A range spec of a body of size bytes: mostly one that can be satisfied,
+// but also suffix and open-ended ones, ones past the end, empty ones and
+// malformed ones.
+static std::string random_spec(size_t size, std::mt19937 &rng) {
+  size_t first{rng() % (size + 3)}, last{first + rng() % (size + 3)};
+  std::string spaces(rng() % 4 == 0 ? 1 : 0, rng() % 2 == 0 ? ' ' : '\t');
+  switch (rng() % 16) {
+  case 0:
+    return spaces;
+  case 1:
+    return "-" + std::to_string(rng() % (size + 3));
+  case 2:
+    return std::to_string(first) + "-";
+  case 3:
+    return std::to_string(size + rng() % 3) + "-" + std::to_string(last + 5);
+  case 4: {
+    const char *malformed[]{"5",   "-",      "a-3",  "3-1",  "--3",
+                            "3-a", " 1 - 2", "+1-2", "1-2-3"};
+    return malformed[rng() % std::size(malformed)];
+  }
+  default:
+    return spaces + std::to_string(first) + "-" + std::to_string(last) +
+           spaces;
+  }
+}
+
+static void check_range(const std::string &range, const std::string &body,
+                        BufferPool &pool) {
+  std::string header{"HTTP/1.1 200 OK\r\nContent-Type: " CONTENT_TYPE
+                     "\r\nX-Cache: miss\r\nContent-Length: " +
+                     std::to_string(body.size()) + "\r\n\r\n"};
+  // NUL-terminated, as an HttpReader leaves it.
+  BufferRef whole{pool.copy_of(header + body + '\0')};
+  whole.set_size(header.size() + body.size());
+
+  std::vector<std::pair<std::string_view, BufferRef>> writes;
+  respond_to_range(range, whole, pool, writes);
+  std::string response;
+  for (const auto &[data, buffer] : writes) {
+    // Every write is of the buffer it holds on to.
+    CHECK(data.data() >= buffer.data() &&
+          data.data() + data.size() <= buffer.data() + buffer.size());
+    response.append(data);
+  }
+
+  std::vector<std::pair<size_t, size_t>> ranges;
+  Outcome outcome{brute_force_ranges(range, body.size(), ranges)};
+  if (outcome == Outcome::WHOLE) {
+    CHECK(response == whole.view());
+    return;
+  }
+  size_t header_end{response.find("\r\n\r\n")};
+  CHECK(header_end != std::string::npos);
+  std::string_view response_header{response.data(), header_end + 2};
+  std::string_view response_body{std::string_view{response}.substr(
+      header_end + 4)};
+  CHECK(field_of(response_header, "Content-Length") ==
+            std::to_string(response_body.size()) ||
+        field_of(response_header, "content-length") ==
+            std::to_string(response_body.size()));
+  if (outcome == Outcome::UNSATISFIABLE) {
+    CHECK(response.starts_with("HTTP/1.1 416 "));
+    CHECK(field_of(response_header, "Content-Range") ==
+          "bytes */" + std::to_string(body.size()));
+    return;
+  }
+
+  CHECK(response.starts_with("HTTP/1.1 206 "));
+  // The fields of the 200 but for those about its body come along.
+  CHECK(field_of(response_header, "X-Cache") == "miss");
+  if (ranges.size() == 1) {
+    auto [first, last]{ranges[0]};
+    CHECK(field_of(response_header, "Content-Type") == CONTENT_TYPE);
+    CHECK(field_of(response_header, "Content-Range") ==
+          content_range(first, last, body.size()));
+    CHECK(response_body == body.substr(first, last - first + 1));
+    return;
+  }
+
+  // A part for every range, in the order asked, between boundaries.
+  CHECK(field_of(response_header, "Content-Type") ==
+        "multipart/byteranges; boundary=" SEGMENT_CACHE_BOUNDARY);
+  std::string_view rest{response_body};
+  for (auto [first, last] : ranges) {
+    std::string part{"\r\n--" SEGMENT_CACHE_BOUNDARY "\r\n"};
+    CHECK(rest.starts_with(part));
+    size_t part_header_end{rest.find("\r\n\r\n", part.length() - 2)};
+    CHECK(part_header_end != std::string_view::npos);
+    std::string_view part_header{rest.substr(part.length() - 2,
+                                             part_header_end -
+                                                 (part.length() - 2) + 2)};
+    CHECK(field_of(part_header, "Content-Type") == CONTENT_TYPE);
+    CHECK(field_of(part_header, "Content-Range") ==
+          content_range(first, last, body.size()));
+    rest.remove_prefix(part_header_end + 4);
+    CHECK(rest.substr(0, last - first + 1) ==
+          body.substr(first, last - first + 1));
+    rest.remove_prefix(std::min(rest.size(), last - first + 1));
+  }
+  CHECK(rest == "\r\n--" SEGMENT_CACHE_BOUNDARY "--\r\n");
+}
+
+int main() {
+  std::mt19937 rng{49};
+  BufferPool pool;
+  for (int round = 0; round < 20000; ++round) {
+    size_t size{rng() % 4 == 0 ? rng() % 4 : rng() % 300};
+    std::string body;
+    for (size_t i = 0; i < size; ++i) {
+      body += static_cast<char>(rng());
+    }
+    const char *prefixes[]{"bytes=", "BYTES=", "Bytes=", "bits=", "bytes"};
+    std::string range{prefixes[rng() % 16 == 0 ? 1 + rng() % 4 : 0]};
+    // Mostly a few ranges, now and then more than may be asked for.
+    size_t no_of_specs{rng() % 8 == 0 ? rng() % 24 : 1 + rng() % 4};
+    for (size_t i = 0; i < no_of_specs; ++i) {
+      range += (i == 0 ? "" : rng() % 2 ? ", " : ",") + random_spec(size, rng);
+    }
+    check_range(range, body, pool);
+  }
+
+  // A response other than a 200 is sent as it is.
+  BufferRef not_found{pool.copy_of(
+      std::string_view{"HTTP/1.1 404 Not Found\r\nContent-Length: 0\r\n\r\n"})};
+  std::vector<std::pair<std::string_view, BufferRef>> writes;
+  respond_to_range("bytes=0-1", not_found, pool, writes);
+  CHECK(writes.size() == 1 && writes[0].first == not_found.view());
+
+  // The least recently used segments are evicted once they take up more
+  // than the capacity.
+  std::vector<std::string> paths;
+  std::vector<BufferRef> responses;
+  for (int i = 0; i < 8; ++i) {
+    paths.push_back("/videos/a/seg-" + std::to_string(i) + ".m4s");
+    std::string response{"HTTP/1.1 200 OK\r\nContent-Length: 1\r\n\r\nx"};
+    responses.push_back(pool.copy_of(response + '\0'));
+    responses.back().set_size(response.size());
+  }
+  SegmentCache cache{3 * responses[0].capacity()};
+  std::vector<std::string> lru; // Most recently used first.
+  for (int step = 0; step < 2000; ++step) {
+    size_t i{rng() % paths.size()};
+    auto it{std::find(lru.begin(), lru.end(), paths[i])};
+    if (rng() % 2 == 0) {
+      CHECK(static_cast<bool>(cache.find(paths[i])) == (it != lru.end()));
+      if (it != lru.end()) {
+        lru.erase(it);
+        lru.insert(lru.begin(), paths[i]);
+      }
+    } else {
+      cache.insert(paths[i], responses[i]);
+      if (it != lru.end()) {
+        lru.erase(it);
+      }
+      lru.insert(lru.begin(), paths[i]);
+      lru.resize(std::min<size_t>(lru.size(), 3));
+    }
+  }
+  return check_status();
+}
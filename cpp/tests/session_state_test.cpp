@@ -0,0 +1,221 @@
+#include "check.h"
+#include "session_state.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <fstream>
+#include <iterator>
+#include <random>
+#include <string>
+#include <unistd.h>
+#include <unordered_map>
+#include <vector>
+
+// SessionStateFile saves, read back and checked byte by byte against the
+// file layout, and files torn in the middle of a save (any mix of the bytes
+// before and after it) against the snapshot a reader of that layout would
+// take as the latest.
+
+struct State {
+  std::unordered_map<std::string, unsigned long> throughput_of_client;
+  std::unordered_map<std::string, std::time_t> sampled_at_of_client;
+  std::unordered_map<std::string, std::vector<int>> bitrate_of_video;
+  std::unordered_map<std::string, double> segment_duration_of_video;
+
+  bool operator==(const State &) const = default;
+};
+
+// The layout of session_state.cpp: a header of magic, version, reserved and
+// capacity, then two regions of capacity bytes, each after a header of
+// generation, size and checksum.
+#define FILE_HEADER_SIZE 24
+#define REGION_HEADER_SIZE 24
+
+static uint64_t get_u64(const std::string &file, size_t offset) {
+  uint64_t value;
+  std::memcpy(&value, file.data() + offset, sizeof(value));
+  return value;
+}
+
+static uint64_t fnv1a(const std::string &bytes) {
+  uint64_t hash{14695981039346656037ULL};
+  for (unsigned char c : bytes) {
+    hash = (hash ^ c) * 1099511628211ULL;
+  }
+  return hash;
+}
+
+// The generation of the latest region of file whose checksum holds, or 0.
+static uint64_t brute_force_latest_generation(const std::string &file) {
+  uint64_t capacity{get_u64(file, 16)}, latest{0};
+  for (int i = 0; i < 2; ++i) {
+    size_t offset{FILE_HEADER_SIZE + i * (REGION_HEADER_SIZE + capacity)};
+    uint64_t generation{get_u64(file, offset)}, size{get_u64(file, offset + 8)};
+    if (generation == 0 || size > capacity) {
+      continue;
+    }
+    // The checksum covers the generation and size, then the snapshot.
+    std::string covered{file.substr(offset, 16) +
+                        file.substr(offset + REGION_HEADER_SIZE, size)};
+    if (fnv1a(covered) == get_u64(file, offset + 16) && generation > latest) {
+      latest = generation;
+    }
+  }
+  return latest;
+}
+
+static std::string read_file(const std::string &path) {
+  std::ifstream in{path, std::ios::binary};
+  return {std::istreambuf_iterator<char>{in}, {}};
+}
+
+static void write_file(const std::string &path, const std::string &file) {
+  std::ofstream{path, std::ios::binary | std::ios::trunc} << file;
+}
+
+static State random_state(std::mt19937 &rng, size_t no_of_clients) {
+  State state;
+  std::time_t now{std::time(nullptr)};
+  for (size_t i = 0; i < no_of_clients; ++i) {
+    std::string uuid{"client-" + std::to_string(rng())};
+    state.throughput_of_client[uuid] = rng() % 100000;
+    state.sampled_at_of_client[uuid] = now - rng() % 600;
+  }
+  for (int i = static_cast<int>(rng() % 4); i > 0; --i) {
+    std::string video{"/videos/" + std::to_string(rng()) + "/"};
+    state.bitrate_of_video[video] = {static_cast<int>(rng() % 500),
+                                     static_cast<int>(rng() % 5000)};
+    state.segment_duration_of_video[video] = 1 + rng() % 8;
+  }
+  return state;
+}
+
+static void save(SessionStateFile &file, const State &state) {
+  file.save(state.throughput_of_client, state.sampled_at_of_client,
+            state.bitrate_of_video, state.segment_duration_of_video);
+}
+
+// The state in the file at path, if it has one.
+static bool load(const std::string &path, State &state) {
+  SessionStateFile file;
+  state = {};
+  return file.open(path) &&
+         file.load(state.throughput_of_client, state.sampled_at_of_client,
+                   state.bitrate_of_video, state.segment_duration_of_video);
+}
+
+int main() {
+  std::mt19937 rng{43};
+  char dir_template[]{"/tmp/session_state_test.XXXXXX"};
+  if (mkdtemp(dir_template) == nullptr) {
+    std::cout << "mkdtemp() failed\n";
+    return EXIT_FAILURE;
+  }
+  std::string dir{dir_template}, path{dir + "/state"}, torn_path{dir + "/torn"};
+
+  State loaded;
+  CHECK(!load(path, loaded));
+  CHECK(brute_force_latest_generation(read_file(path)) == 0);
+
+  // Every save is read back, and is the latest snapshot of the file.
+  SessionStateFile file;
+  CHECK(file.open(path));
+  std::unordered_map<uint64_t, State> state_of_generation;
+  for (uint64_t generation = 1; generation <= 200; ++generation) {
+    std::string before{read_file(path)};
+    State state{random_state(rng, rng() % 50)};
+    save(file, state);
+    state_of_generation[generation] = state;
+    std::string after{read_file(path)};
+    CHECK(brute_force_latest_generation(after) == generation);
+    CHECK(load(path, loaded) && loaded == state);
+
+    // A crash in the middle of the save leaves some of its bytes written
+    // and the rest as they were, in whatever order the pages went out.
+    std::string torn{before};
+    size_t first{after.size()}, last{0};
+    for (size_t i = 0; i < after.size(); ++i) {
+      if (after[i] != before[i]) {
+        first = std::min(first, i);
+        last = i + 1;
+      }
+    }
+    switch (rng() % 3) {
+    case 0: // A prefix of the changes.
+      for (size_t i = first, end = first + rng() % (last - first + 1); i < end;
+           ++i) {
+        torn[i] = after[i];
+      }
+      break;
+    case 1: // Any of them.
+      for (size_t i = first; i < last; ++i) {
+        torn[i] = rng() % 2 == 0 ? after[i] : before[i];
+      }
+      break;
+    default: // All but the last.
+      torn = after;
+      torn[last - 1] = before[last - 1];
+      break;
+    }
+    write_file(torn_path, torn);
+    uint64_t latest{brute_force_latest_generation(torn)};
+    CHECK(latest == generation || latest == generation - 1);
+    bool is_loaded{load(torn_path, loaded)};
+    CHECK(is_loaded == (latest != 0));
+    if (latest != 0) {
+      CHECK(loaded == state_of_generation[latest]);
+    }
+  }
+
+  // Corrupting a byte of either region, header or snapshot, leaves the
+  // other one to load.
+  std::string whole{read_file(path)};
+  uint64_t capacity{get_u64(whole, 16)};
+  for (int i = 0; i < 200; ++i) {
+    std::string corrupted{whole};
+    int region{static_cast<int>(rng() % 2)};
+    size_t offset{FILE_HEADER_SIZE + region * (REGION_HEADER_SIZE + capacity)};
+    size_t size{get_u64(whole, offset + 8)};
+    corrupted[offset + rng() % (REGION_HEADER_SIZE + size)] ^=
+        static_cast<char>(1 + rng() % 255);
+    write_file(torn_path, corrupted);
+    uint64_t latest{brute_force_latest_generation(corrupted)};
+    CHECK(latest == 199 || latest == 200);
+    CHECK(load(torn_path, loaded) && loaded == state_of_generation[latest]);
+  }
+
+  // A snapshot past the capacity grows the file, and is read back.
+  State big{random_state(rng, SESSION_STATE_INITIAL_CAPACITY / 32)};
+  save(file, big);
+  std::string grown{read_file(path)};
+  CHECK(get_u64(grown, 16) > capacity);
+  CHECK(brute_force_latest_generation(grown) == 201);
+  CHECK(load(path, loaded) && loaded == big);
+
+  // Estimates past their age are neither saved nor loaded.
+  State stale{random_state(rng, 10)};
+  State fresh{stale};
+  for (auto &[uuid, sampled_at] : stale.sampled_at_of_client) {
+    if (rng() % 2 == 0) {
+      sampled_at -= SESSION_STATE_MAX_AGE_S + 60;
+      fresh.throughput_of_client.erase(uuid);
+      fresh.sampled_at_of_client.erase(uuid);
+    }
+  }
+  save(file, stale);
+  CHECK(load(path, loaded) && loaded == fresh);
+
+  // Neither is a file of another version.
+  std::string other{read_file(path)};
+  other[8] ^= 1;
+  write_file(torn_path, other);
+  CHECK(!load(torn_path, loaded));
+
+  unlink(path.c_str());
+  unlink(torn_path.c_str());
+  rmdir(dir.c_str());
+  return check_status();
+}
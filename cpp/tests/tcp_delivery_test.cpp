@@ -0,0 +1,103 @@
+#include "check.h"
+#include "tcp_delivery.h"
+
+#include <arpa/inet.h>
+#include <chrono>
+#include <sys/socket.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+// delivered_kbps() on hand-made samples: the larger of the kernel's rate and
+// the bytes acknowledged over the time in between, and 0 when nothing was
+// delivered or no time passed. Then TCP_INFO of a connection on the loopback
+// as it carries a segment's worth of bytes.
+
+using namespace std::chrono_literals;
+
+static TcpDelivery sample(std::chrono::steady_clock::time_point at,
+                          uint64_t bytes_acked, uint64_t delivery_rate) {
+  return {at, bytes_acked, delivery_rate, false, 0, 0, 0};
+}
+
+// A connected pair of TCP sockets on the loopback; -1s if it fails.
+static void connect_loopback(int &client_fd, int &server_fd) {
+  client_fd = server_fd = -1;
+  int listen_fd{socket(AF_INET, SOCK_STREAM, 0)};
+  sockaddr_in addr{};
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  socklen_t addr_len{sizeof(addr)};
+  if (listen_fd == -1 ||
+      bind(listen_fd, (sockaddr *)&addr, sizeof(addr)) == -1 ||
+      getsockname(listen_fd, (sockaddr *)&addr, &addr_len) == -1 ||
+      listen(listen_fd, 1) == -1) {
+    return;
+  }
+  client_fd = socket(AF_INET, SOCK_STREAM, 0);
+  if (connect(client_fd, (sockaddr *)&addr, sizeof(addr)) == 0) {
+    server_fd = accept(listen_fd, nullptr, nullptr);
+  }
+  close(listen_fd);
+}
+
+int main() {
+  auto t0{std::chrono::steady_clock::now()};
+
+  // 1 MB acked over a second is 8000 Kbps, which beats a kernel rate of
+  // 500 KB/s (4000 Kbps) but not one of 2 MB/s (16000 Kbps).
+  CHECK(delivered_kbps(sample(t0, 1000, 500000),
+                       sample(t0 + 1s, 1001000, 500000)) == 8000);
+  CHECK(delivered_kbps(sample(t0, 1000, 0),
+                       sample(t0 + 1s, 1001000, 2000000)) == 16000);
+  CHECK(delivered_kbps(sample(t0, 0, 0), sample(t0, 1000, 125000)) == 1000);
+  CHECK(delivered_kbps(sample(t0, 0, 0), sample(t0, 1000, 0)) == 0);
+  CHECK(delivered_kbps(sample(t0, 5000, 0), sample(t0 + 1s, 5000, 125000)) ==
+        0);
+  CHECK(delivered_kbps(sample(t0, 5000, 0), sample(t0 + 1s, 4000, 125000)) ==
+        0);
+
+  int unix_fds[2];
+  TcpDelivery delivery{};
+  CHECK(socketpair(AF_UNIX, SOCK_STREAM, 0, unix_fds) == 0);
+  CHECK(!sample_tcp_delivery(unix_fds[0], delivery));
+  close(unix_fds[0]);
+  close(unix_fds[1]);
+
+  int client_fd, server_fd;
+  connect_loopback(client_fd, server_fd);
+  if (server_fd == -1) {
+    std::cout << "loopback connection failed\n";
+    return EXIT_FAILURE;
+  }
+  TcpDelivery before{}, after{};
+  CHECK(sample_tcp_delivery(server_fd, before));
+  std::vector<char> segment(256 * 1024, 'x');
+  size_t no_of_sent{0}, no_of_received{0};
+  while (no_of_received < segment.size()) {
+    if (no_of_sent < segment.size()) {
+      long sent{send(server_fd, segment.data() + no_of_sent,
+                     segment.size() - no_of_sent, MSG_DONTWAIT)};
+      no_of_sent += sent > 0 ? sent : 0;
+    }
+    long received{recv(client_fd, segment.data(), segment.size(),
+                       MSG_DONTWAIT)};
+    no_of_received += received > 0 ? received : 0;
+  }
+  // The last ACK may trail the last byte read.
+  for (int i = 0; i < 100; ++i) {
+    CHECK(sample_tcp_delivery(server_fd, after));
+    if (after.bytes_acked - before.bytes_acked >= segment.size()) {
+      break;
+    }
+    std::this_thread::sleep_for(1ms);
+  }
+  CHECK(after.bytes_acked - before.bytes_acked >= segment.size());
+  CHECK(after.at > before.at && after.snd_mss > 0 && after.snd_cwnd > 0);
+  CHECK(delivered_kbps(before, after) > 0);
+  CHECK(delivered_kbps(after, after) == 0);
+
+  close(client_fd);
+  close(server_fd);
+  return check_status();
+}
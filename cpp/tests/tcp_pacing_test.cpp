@@ -0,0 +1,51 @@
+#include "check.h"
+#include "tcp_pacing.h"
+
+#include <cstdint>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <vector>
+
+// The pacing rates worked by hand: none for a client with too little
+// buffered, the next bitrate up with the safety factor and headroom (the
+// bitrate itself at the top), and the rate set on a socket read back from
+// it, with 0 lifting the limit and rates too high for the option clamped.
+
+static uint32_t pacing_rate_of(int socket) {
+  uint32_t rate{0};
+  socklen_t length{sizeof(rate)};
+  if (getsockopt(socket, SOL_SOCKET, SO_MAX_PACING_RATE, &rate, &length) ==
+      -1) {
+    return 0;
+  }
+  return rate;
+}
+
+int main() {
+  std::vector<int> bitrates{500, 1000, 2000};
+
+  // Fewer than 2 segments of 4 s buffered: not paced.
+  CHECK(pacing_rate_kbps(bitrates, 1000, 4, 0) == 0);
+  CHECK(pacing_rate_kbps(bitrates, 1000, 4, 7.9) == 0);
+  // 2000 * 1.5 * 1.25 for 1000, and for 2000 at the top.
+  CHECK(pacing_rate_kbps(bitrates, 1000, 4, 8) == 3750);
+  CHECK(pacing_rate_kbps(bitrates, 2000, 4, 8) == 3750);
+  CHECK(pacing_rate_kbps(bitrates, 500, 4, 60) == 1875);
+  // A bitrate not on the ladder goes by the next one up.
+  CHECK(pacing_rate_kbps(bitrates, 700, 2, 4) == 1875);
+  CHECK(pacing_rate_kbps({}, 800, 2, 4) == 1500);
+
+  int socket_fd{socket(AF_INET, SOCK_STREAM, 0)};
+  CHECK(socket_fd != -1);
+  CHECK(set_pacing_rate(socket_fd, 1000));
+  CHECK(pacing_rate_of(socket_fd) == 125000);
+  CHECK(set_pacing_rate(socket_fd, 0));
+  CHECK(pacing_rate_of(socket_fd) == UINT32_MAX);
+  CHECK(set_pacing_rate(socket_fd, 1UL << 40));
+  CHECK(pacing_rate_of(socket_fd) == UINT32_MAX - 1);
+  close(socket_fd);
+  CHECK(!set_pacing_rate(socket_fd, 1000));
+
+  return check_status();
+}
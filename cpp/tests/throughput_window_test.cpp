@@ -0,0 +1,107 @@
+#include "abr.h"
+#include "check.h"
+
+#include <algorithm>
+#include <cmath>
+#include <deque>
+#include <random>
+#include <vector>
+
+// ThroughputWindow and the estimates made of it against the same statistics
+// of a plain list of the latest samples.
+
+static bool is_close(double a, double b) {
+  return std::abs(a - b) <= 1e-9 * std::max(std::abs(a), std::abs(b));
+}
+
+static double brute_force_harmonic_mean(const std::deque<double> &samples) {
+  if (samples.empty() ||
+      std::any_of(samples.begin(), samples.end(),
+                  [](double kbps) { return kbps <= 0; })) {
+    return 0;
+  }
+  double sum_of_inverses{0};
+  for (double kbps : samples) {
+    sum_of_inverses += 1 / kbps;
+  }
+  return samples.size() / sum_of_inverses;
+}
+
+// The sample at rank p * (n - 1), rounded to the nearest.
+static double brute_force_percentile(std::deque<double> samples, double p) {
+  if (samples.empty()) {
+    return 0;
+  }
+  std::sort(samples.begin(), samples.end());
+  return samples[std::lround(p * (samples.size() - 1))];
+}
+
+int main() {
+  std::mt19937 rng{44};
+  std::uniform_real_distribution<double> kbps_of{100, 20000};
+  for (int round = 0; round < 200; ++round) {
+    ThroughputWindow window, estimated;
+    std::deque<double> samples;
+    unsigned long ewma{0}, throughput{0};
+    auto filter{static_cast<ThroughputFilter>(rng() % 3)};
+    CHECK(window.empty());
+    CHECK(window.harmonic_mean() == 0 && window.percentile(0.5) == 0);
+
+    // Enough samples to wrap around the ring several times.
+    for (int i = 0; i < 5 * THROUGHPUT_WINDOW; ++i) {
+      // Now and then a sample of 0, which the harmonic mean cannot take,
+      // or an outlier.
+      double kbps{rng() % 20 == 0   ? 0
+                  : rng() % 10 == 0 ? 50 * kbps_of(rng)
+                                    : kbps_of(rng)};
+      window.add(kbps);
+      samples.push_back(kbps);
+      if (samples.size() > THROUGHPUT_WINDOW) {
+        samples.pop_front();
+      }
+      CHECK(!window.empty());
+      CHECK(is_close(window.harmonic_mean(),
+                     brute_force_harmonic_mean(samples)));
+      for (double p : {0.0, 0.2, 0.5, 0.8, 1.0, THROUGHPUT_PERCENTILE}) {
+        CHECK(window.percentile(p) == brute_force_percentile(samples, p));
+      }
+
+      double alpha{0.1 * (1 + round % 9)};
+      unsigned long expected{static_cast<unsigned long>(
+          alpha * kbps + (1 - alpha) * static_cast<double>(ewma))};
+      ewma = update_throughput(ewma, kbps, alpha);
+      CHECK(ewma == expected);
+      throughput = update_throughput(filter, throughput, estimated, kbps,
+                                     alpha);
+      switch (filter) {
+      case ThroughputFilter::HARMONIC_MEAN:
+        // Summed in another order, so it may round the other way.
+        CHECK(std::abs(static_cast<double>(throughput) -
+                       brute_force_harmonic_mean(samples)) < 1);
+        break;
+      case ThroughputFilter::PERCENTILE:
+        CHECK(throughput ==
+              static_cast<unsigned long>(brute_force_percentile(
+                  samples, THROUGHPUT_PERCENTILE)));
+        break;
+      default:
+        CHECK(throughput == ewma);
+        break;
+      }
+    }
+  }
+
+  // The highest bitrate covered by the safety factor, else the lowest.
+  std::vector<int> bitrates{45, 176, 506, 1006, 2006, 4006};
+  for (unsigned long throughput = 0; throughput < 10000; throughput += 7) {
+    int expected{bitrates.front()};
+    for (int bitrate : bitrates) {
+      if (throughput >= bitrate * BITRATE_SAFETY_FACTOR) {
+        expected = bitrate;
+      }
+    }
+    CHECK(select_bitrate(bitrates, throughput, BITRATE_SAFETY_FACTOR) ==
+          expected);
+  }
+  return check_status();
+}
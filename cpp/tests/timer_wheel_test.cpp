@@ -0,0 +1,187 @@
+#include "check.h"
+#include "timer_wheel.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <map>
+#include <random>
+#include <vector>
+
+// TimerWheel against a map of the deadline of every fd, as deadlines are
+// armed and cancelled and time moves on by a tick or jumps across the
+// rollovers of every level; and the timeouts it asks for, waited for one
+// after another, against the deadlines they are to wake up for.
+
+#define HORIZON_TICKS (1ULL << TIMER_WHEEL_SLOT_BITS * TIMER_WHEEL_LEVELS)
+
+// The deadlines of the fds armed, by tick, as TimerWheel is to keep them.
+class BruteForceTimers {
+public:
+  void arm(int fd, uint64_t timeout_ms, uint64_t now_ms) {
+    if (expires_at_of_fd_.erase(fd), expires_at_of_fd_.empty()) {
+      curr_tick_ = std::max(curr_tick_, now_ms / TIMER_WHEEL_TICK_MS);
+    }
+    uint64_t expires_at{(now_ms + timeout_ms + TIMER_WHEEL_TICK_MS - 1) /
+                        TIMER_WHEEL_TICK_MS};
+    expires_at_of_fd_[fd] = std::clamp<uint64_t>(
+        expires_at, curr_tick_ + 1, curr_tick_ + HORIZON_TICKS - 1);
+  }
+
+  void cancel(int fd) { expires_at_of_fd_.erase(fd); }
+
+  std::vector<int> expire(uint64_t now_ms) {
+    curr_tick_ = std::max(curr_tick_, now_ms / TIMER_WHEEL_TICK_MS);
+    std::vector<int> due;
+    std::erase_if(expires_at_of_fd_, [&](const auto &fd_and_expires_at) {
+      if (fd_and_expires_at.second > curr_tick_) {
+        return false;
+      }
+      due.push_back(fd_and_expires_at.first);
+      return true;
+    });
+    return due;
+  }
+
+  bool empty() const { return expires_at_of_fd_.empty(); }
+
+  uint64_t expires_at(int fd) const { return expires_at_of_fd_.at(fd); }
+
+  uint64_t first_expires_at() const {
+    uint64_t first{UINT64_MAX};
+    for (const auto &[fd, expires_at] : expires_at_of_fd_) {
+      first = std::min(first, expires_at);
+    }
+    return first;
+  }
+
+private:
+  uint64_t curr_tick_{};
+  std::map<int, uint64_t> expires_at_of_fd_;
+};
+
+// A wheel, and the time it started at give or take less than a ms, so that
+// times a whole number of ms after it fall in the ticks they are meant to.
+static TimerWheel::Clock::time_point start_wheel(TimerWheel &wheel) {
+  while (true) {
+    auto before{TimerWheel::Clock::now()};
+    wheel = TimerWheel{};
+    auto after{TimerWheel::Clock::now()};
+    if (after - before < std::chrono::microseconds{500}) {
+      return after;
+    }
+  }
+}
+
+// A timeout of a few ticks, or of up to past the horizon of the wheel.
+static uint64_t random_timeout_ms(std::mt19937_64 &rng) {
+  int bits{static_cast<int>(rng() % 26)};
+  return rng() % (uint64_t{TIMER_WHEEL_TICK_MS} << bits);
+}
+
+int main() {
+  std::mt19937_64 rng{47};
+  const int no_of_fds{64};
+
+  // Time moves on by itself, in steps of anything from a ms to jumps across
+  // the rollover of level 3.
+  for (int round = 0; round < 10; ++round) {
+    TimerWheel wheel;
+    auto start{start_wheel(wheel)};
+    BruteForceTimers timers;
+    uint64_t now_ms{0};
+    for (int step = 0; step < 5000; ++step) {
+      auto now{start + std::chrono::milliseconds{now_ms}};
+      int fd{static_cast<int>(rng() % no_of_fds)};
+      switch (rng() % 4) {
+      case 0:
+        timers.cancel(fd);
+        wheel.cancel(fd);
+        break;
+      case 1: {
+        std::vector<int> due;
+        wheel.expire(now, due);
+        std::vector<int> expected{timers.expire(now_ms)};
+        std::sort(due.begin(), due.end());
+        CHECK(due == expected);
+        break;
+      }
+      default: {
+        uint64_t timeout_ms{random_timeout_ms(rng)};
+        timers.arm(fd, timeout_ms, now_ms);
+        wheel.arm(fd, timeout_ms, now);
+        break;
+      }
+      }
+
+      // The wait never ends after the next deadline.
+      int timeout_ms{wheel.next_timeout_ms(now)};
+      CHECK((timeout_ms == -1) == timers.empty());
+      if (timeout_ms != -1) {
+        uint64_t first_ms{timers.first_expires_at() * TIMER_WHEEL_TICK_MS};
+        CHECK(static_cast<uint64_t>(timeout_ms) <=
+              (first_ms > now_ms ? first_ms - now_ms : 0));
+      }
+
+      // Mostly by less than level 0 spans; now and then by up to a few
+      // slots of level 3. expire() goes through every tick on the way.
+      int bits{rng() % 16 == 0 ? static_cast<int>(rng() % 21)
+                               : TIMER_WHEEL_SLOT_BITS};
+      now_ms += rng() % (uint64_t{TIMER_WHEEL_TICK_MS} << bits);
+    }
+  }
+
+  // Time moves on as an event loop waits: by the timeout the wheel asks
+  // for, every fd expires at the tick of its deadline, never late, through
+  // every cascade of the levels above. The wheel wakes the loop at least
+  // every time level 0 comes round, so a deadline at the horizon is a few
+  // hundred thousand waits away.
+  for (int round = 0; round < 5; ++round) {
+    TimerWheel wheel;
+    auto start{start_wheel(wheel)};
+    BruteForceTimers timers;
+    uint64_t now_ms{0};
+    for (int fd = 0; fd < no_of_fds; ++fd) {
+      uint64_t timeout_ms{random_timeout_ms(rng)};
+      timers.arm(fd, timeout_ms, now_ms);
+      wheel.arm(fd, timeout_ms, start);
+    }
+    uint64_t no_of_waits{0};
+    while (!timers.empty() && no_of_waits < 2 * HORIZON_TICKS) {
+      ++no_of_waits;
+      auto now{start + std::chrono::milliseconds{now_ms}};
+      int timeout_ms{wheel.next_timeout_ms(now)};
+      CHECK(timeout_ms >= 0);
+      now_ms += std::max(timeout_ms, 0);
+      now = start + std::chrono::milliseconds{now_ms};
+
+      std::vector<int> due;
+      wheel.expire(now, due);
+      for (int fd : due) {
+        CHECK(timers.expires_at(fd) == now_ms / TIMER_WHEEL_TICK_MS);
+      }
+      std::vector<int> expected{timers.expire(now_ms)};
+      std::sort(due.begin(), due.end());
+      CHECK(due == expected);
+
+      // Early on, now and then one is armed again, or cancelled.
+      if (no_of_waits > 10000) {
+        continue;
+      }
+      if (rng() % 8 == 0) {
+        int fd{static_cast<int>(rng() % no_of_fds)};
+        uint64_t rearm_ms{random_timeout_ms(rng)};
+        timers.arm(fd, rearm_ms, now_ms);
+        wheel.arm(fd, rearm_ms, now);
+      } else if (rng() % 8 == 0) {
+        int fd{static_cast<int>(rng() % no_of_fds)};
+        timers.cancel(fd);
+        wheel.cancel(fd);
+      }
+    }
+    CHECK(timers.empty());
+    CHECK(wheel.next_timeout_ms(start + std::chrono::milliseconds{now_ms}) ==
+          -1);
+  }
+  return check_status();
+}
@@ -0,0 +1,113 @@
+#include "check.h"
+#include "poller.h"
+#include "upstream_health.h"
+
+#include <arpa/inet.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <vector>
+
+// UpstreamHealth on two videoservers on the loopback, one listening and one
+// refusing connections: active checks taking a videoserver out after
+// HEALTH_CHECK_FALL failures and back after HEALTH_CHECK_RISE successes,
+// and failures reported by sessions taking it out at once. Each round of
+// checks waits for the timerfd, so this takes a few seconds.
+
+// A socket on the loopback bound to a port of its own, and the port.
+static int bound_socket(uint16_t &port) {
+  int fd{socket(AF_INET, SOCK_STREAM, 0)};
+  sockaddr_in addr{};
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  socklen_t addr_len{sizeof(addr)};
+  if (fd == -1 || bind(fd, (sockaddr *)&addr, sizeof(addr)) == -1 ||
+      getsockname(fd, (sockaddr *)&addr, &addr_len) == -1) {
+    return -1;
+  }
+  port = addr.sin_port;
+  return fd;
+}
+
+// Run a round of active checks to its end.
+static void check_round(UpstreamHealth &health, Poller &poller,
+                        int no_of_upstreams) {
+  health.send_checks();
+  PollEvent events[8];
+  for (int no_of_finished = 0; no_of_finished < no_of_upstreams;) {
+    int no_of_events{poller.wait(events, 8)};
+    if (no_of_events == -1) {
+      return;
+    }
+    for (int i = 0; i < no_of_events; ++i) {
+      if (health.is_check(events[i].fd)) {
+        health.finish_check(events[i].fd);
+        ++no_of_finished;
+      }
+    }
+  }
+}
+
+static bool is_listed(const std::vector<Upstream> &upstreams,
+                      Upstream upstream) {
+  for (Upstream listed : upstreams) {
+    if (listed.key() == upstream.key()) {
+      return true;
+    }
+  }
+  return false;
+}
+
+int main() {
+  uint16_t up_port, down_port;
+  int listen_fd{bound_socket(up_port)}, closed_fd{bound_socket(down_port)};
+  if (listen_fd == -1 || closed_fd == -1 || listen(listen_fd, 16) == -1) {
+    std::cout << "socket setup failed\n";
+    return EXIT_FAILURE;
+  }
+  close(closed_fd);
+  Upstream up{htonl(INADDR_LOOPBACK), up_port},
+      down{htonl(INADDR_LOOPBACK), down_port},
+      unknown{htonl(INADDR_LOOPBACK), htons(1)};
+  CHECK(name_of(up) == "127.0.0.1:" + std::to_string(ntohs(up_port)));
+
+  EpollPoller poller{};
+  if (!poller.start()) {
+    std::cout << "epoll unavailable\n";
+    return EXIT_FAILURE;
+  }
+  UpstreamHealth health{};
+  health.start(poller);
+  health.add(up);
+  health.add(down);
+  health.add(up);
+  CHECK(health.is_healthy(up) && health.is_healthy(down));
+  CHECK(health.is_healthy(unknown));
+  CHECK(health.healthy_upstreams().size() == 2);
+
+  for (int round = 1; round <= HEALTH_CHECK_FALL; ++round) {
+    CHECK(health.is_healthy(down));
+    check_round(health, poller, 2);
+  }
+  CHECK(!health.is_healthy(down) && health.is_healthy(up));
+  std::vector<Upstream> healthy{health.healthy_upstreams()};
+  CHECK(healthy.size() == 1 && is_listed(healthy, up));
+
+  // A failure seen by a session counts at once, and the videoserver is back
+  // only after HEALTH_CHECK_RISE checks in a row.
+  health.report_failure(up);
+  CHECK(!health.is_healthy(up));
+  CHECK(health.healthy_upstreams().empty());
+  for (int round = 1; round <= HEALTH_CHECK_RISE; ++round) {
+    CHECK(!health.is_healthy(up));
+    check_round(health, poller, 2);
+  }
+  CHECK(health.is_healthy(up) && !health.is_healthy(down));
+
+  // An unknown videoserver that fails is checked from then on.
+  health.report_failure(unknown);
+  CHECK(!health.is_healthy(unknown));
+  CHECK(health.healthy_upstreams().size() == 1);
+
+  close(listen_fd);
+  return check_status();
+}
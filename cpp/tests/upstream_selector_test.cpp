@@ -0,0 +1,121 @@
+#include "check.h"
+#include "upstream_selector.h"
+
+#include <arpa/inet.h>
+#include <chrono>
+#include <vector>
+
+// UpstreamSelector rankings worked out by hand: by latency, inflated by the
+// error rate and decaying while idle; outliers by error rate or latency
+// ejected to the back for a growing time and back with a clean slate; and
+// the last videoserver in rotation never ejected.
+
+using namespace std::chrono_literals;
+using Clock = UpstreamSelector::Clock;
+
+static Upstream upstream(uint16_t port) {
+  return {htonl(INADDR_LOOPBACK), htons(port)};
+}
+
+// The ports of upstreams ranked by selector.
+static std::vector<int> ranked_ports(UpstreamSelector &selector,
+                                     const std::vector<Upstream> &upstreams,
+                                     Clock::time_point now) {
+  std::vector<int> ports{};
+  for (Upstream ranked : selector.rank(upstreams, now)) {
+    ports.push_back(ntohs(ranked.port));
+  }
+  return ports;
+}
+
+int main() {
+  Clock::time_point now{Clock::now()};
+  Upstream a{upstream(1)}, b{upstream(2)}, c{upstream(3)}, d{upstream(4)};
+  std::vector<Upstream> abc{a, b, c}, abcd{a, b, c, d};
+
+  // Videoservers never sampled go first, in the order given.
+  UpstreamSelector selector{};
+  CHECK((ranked_ports(selector, abc, now) == std::vector<int>{1, 2, 3}));
+  selector.record_latency(a, 10ms, now);
+  selector.record_latency(b, 30ms, now);
+  selector.record_latency(c, 20ms, now);
+  CHECK((ranked_ports(selector, abcd, now) == std::vector<int>{4, 1, 3, 2}));
+
+  // Latency is an EWMA: a's is 0.3 * 100 + 0.7 * 10 = 37 ms now.
+  selector.record_latency(a, 100ms, now);
+  CHECK((ranked_ports(selector, abc, now) == std::vector<int>{3, 2, 1}));
+  // An error takes c to 20 / 0.7 = 28.6 ms, just behind b once b is down to
+  // 0.3 * 25 + 0.7 * 30 = 28.5 ms.
+  selector.record_error(c, now);
+  CHECK((ranked_ports(selector, abc, now) == std::vector<int>{3, 2, 1}));
+  selector.record_latency(b, 25ms, now);
+  CHECK((ranked_ports(selector, abc, now) == std::vector<int>{2, 3, 1}));
+  // The estimate of a videoserver left idle halves every half-life: a's 37
+  // ms count as 18.5 ms next to the 29 ms of b and 20 / 0.79 = 25.3 ms of c
+  // just sampled.
+  selector.record_latency(b, 30ms, now + 5s);
+  selector.record_latency(c, 20ms, now + 5s);
+  CHECK((ranked_ports(selector, abc, now + 5s) ==
+         std::vector<int>{1, 3, 2}));
+
+  // Three errors in a row put the error rate at 0.66: ejected for
+  // UPSTREAM_EJECTION_MS, then back with a clean slate, and ejected for
+  // twice as long the next time.
+  UpstreamSelector errors{};
+  errors.record_latency(b, 10ms, now);
+  errors.record_latency(c, 10ms, now);
+  errors.record_error(a, now);
+  errors.record_error(a, now);
+  CHECK((ranked_ports(errors, abc, now) == std::vector<int>{1, 2, 3}));
+  errors.record_error(a, now);
+  CHECK((ranked_ports(errors, abc, now) == std::vector<int>{2, 3, 1}));
+  auto ejection{std::chrono::milliseconds{UPSTREAM_EJECTION_MS}};
+  CHECK((ranked_ports(errors, abc, now + ejection - 1ms) ==
+         std::vector<int>{2, 3, 1}));
+  now += ejection;
+  CHECK((ranked_ports(errors, abc, now) == std::vector<int>{1, 2, 3}));
+  for (int i = 0; i < UPSTREAM_OUTLIER_MIN_SAMPLES; ++i) {
+    errors.record_error(a, now);
+  }
+  CHECK((ranked_ports(errors, abc, now + 2 * ejection - 1ms) ==
+         std::vector<int>{2, 3, 1}));
+  now += 2 * ejection;
+  CHECK((ranked_ports(errors, abc, now) == std::vector<int>{1, 2, 3}));
+  // Ejected videoservers go last, the one back soonest first: b, ejected for
+  // the first time, before a, ejected for the third.
+  errors.record_latency(c, 10ms, now);
+  for (int i = 0; i < UPSTREAM_OUTLIER_MIN_SAMPLES; ++i) {
+    errors.record_error(a, now);
+    errors.record_error(b, now + 1ms);
+  }
+  CHECK((ranked_ports(errors, abc, now + 1ms) == std::vector<int>{3, 2, 1}));
+
+  // A latency outlier is UPSTREAM_OUTLIER_FACTOR times and
+  // UPSTREAM_OUTLIER_MIN_MS slower than the fastest: 100 ms is next to 10 ms,
+  // 40 ms is not.
+  UpstreamSelector latencies{};
+  latencies.record_latency(a, 10ms, now);
+  for (int i = 0; i < UPSTREAM_OUTLIER_MIN_SAMPLES; ++i) {
+    latencies.record_latency(b, 40ms, now);
+    latencies.record_latency(c, 100ms, now);
+  }
+  CHECK((ranked_ports(latencies, abc, now) == std::vector<int>{1, 2, 3}));
+  CHECK((ranked_ports(latencies, {c, b, a}, now) ==
+         std::vector<int>{1, 2, 3}));
+  latencies.record_latency(a, 10ms, now);
+  latencies.record_latency(c, 10ms, now + ejection);
+  CHECK((ranked_ports(latencies, {c, b, a}, now + ejection) ==
+         std::vector<int>{3, 1, 2}));
+
+  // However bad the only videoserver in rotation gets, it stays: after ten
+  // errors, a's 5 ms count as 5 / 0.7^10 = 177 ms, ahead of 200 ms.
+  UpstreamSelector alone{};
+  alone.record_latency(a, 5ms, now);
+  for (int i = 0; i < 10; ++i) {
+    alone.record_error(a, now);
+  }
+  alone.record_latency(b, 200ms, now);
+  CHECK((ranked_ports(alone, {b, a}, now) == std::vector<int>{1, 2}));
+
+  return check_status();
+}
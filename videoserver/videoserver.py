@@ -14,6 +14,8 @@ from sanic.response import html, text, redirect
 
 from sanic import HTTPResponse, Sanic
 from sanic.response import file
+from sanic.compat import stat_async
+from sanic.handlers import ContentRangeHandler
 from sanic.worker.loader import AppLoader
 
 VIDEO_NAMES = ["tears-of-steel", "cuhk"]
@@ -56,12 +58,16 @@ class VideoServer:
         
 
         @self.app.route('videos/<video_name:slug>/<video_file:path>')
-        async def get_video_file(_, video_name, video_file):
+        async def get_video_file(request, video_name, video_file):
             file_path = f"{WEBSERVER_DIR}/static/videos/{video_name}/{video_file}"
             if (not os.path.exists(file_path)) :
                 return text(f"File {video_file} for video {video_name} not found (full path: {file_path})",  status=404)
 
-            return await file(file_path)
+            # Byte ranges, for a proxy fetching a segment in parts (a 416 if out of range)
+            _range = None
+            if "range" in request.headers:
+                _range = ContentRangeHandler(request, await stat_async(file_path))
+            return await file(file_path, _range=_range)
         
         @self.app.post('/on-fragment-received')
         async def send_teapot(_):